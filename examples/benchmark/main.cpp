@@ -0,0 +1,264 @@
+// Runs the library's hot paths N times each and prints a table of their cost, measured
+// with the CPU cycle counter. The same file builds for Linux against the host simulation
+// (host/CMakeLists.txt), both print the same table, so the numbers can be compared.
+//
+// The table is comma-separated, lines starting with # are comments:
+//   name,iterations,cycles_per_op,ns_per_op
+// The emergency_stop_* rows are worst cases over their iterations, not averages.
+//
+// The encoder benchmarks drive the pins of motor M1's encoder as outputs, disconnect the
+// encoder first. The encoder_load_* rows generate 1k, 10k and 50k edges/s, their cycles
+// are the ones the manager spent estimating the speed, see ManagerStats::encoderCycles.
+// Set BENCHMARK_SAMPLED_SPEED to 1 (or pass "sampled" after the iterations on Linux) to
+// compare the edge interrupts with MAN_ENCODER_SAMPLED_SPEED. The servo round trip needs an LX-16A servo with id 0 on the bus.
+
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xtensa/hal.h>
+
+#include "RBControl.hpp"
+#include "RBControl_arm.hpp"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include "rbsim.hpp"
+#endif
+
+#ifndef CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ
+#define CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ 240
+#endif
+
+#ifndef BENCHMARK_SAMPLED_SPEED
+#define BENCHMARK_SAMPLED_SPEED 0
+#endif
+
+using namespace rb;
+
+static const uint32_t DEFAULT_ITERATIONS = 1000;
+static const uint32_t WARMUP_ITERATIONS = 10;
+
+static void printHeader(uint32_t iterations) {
+    printf("# RBControl %d.%d.%d benchmark, %d MHz, %u iterations\n",
+        RB3201_MAJOR, RB3201_MINOR, RB3201_PATCH, CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ, iterations);
+    printf("name,iterations,cycles_per_op,ns_per_op\n");
+}
+
+/**
+ * \brief Run op(i) for i in 0..iterations and print its average cost.
+ *
+ * finish() runs inside the measured time after the last op, to wait for work the ops
+ * have queued to other tasks. The cycle counter is 32-bit, a run must take less than
+ * 2^32 cycles (17 s at 240 MHz). The counter is per-core, the calling task must be pinned.
+ */
+template <typename Op, typename Finish>
+static void run(const char* name, uint32_t iterations, Op op, Finish finish) {
+    for (uint32_t i = 0; i != WARMUP_ITERATIONS; ++i)
+        op(i);
+    finish();
+
+    const uint32_t start = xthal_get_ccount();
+    for (uint32_t i = 0; i != iterations; ++i)
+        op(i);
+    finish();
+    const uint32_t cycles = xthal_get_ccount() - start;
+
+    const double per_op = double(cycles) / iterations;
+    printf("%s,%u,%u,%.1f\n", name, iterations, unsigned(per_op + 0.5),
+        per_op * 1000.0 / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+}
+
+template <typename Op>
+static void run(const char* name, uint32_t iterations, Op op) {
+    run(name, iterations, op, []() {});
+}
+
+static void waitForManager() {
+    while (Manager::get().stats().eventQueueWaiting != 0)
+        vTaskDelay(1);
+}
+
+static std::atomic<bool> queueLoadRunning;
+static std::atomic<bool> queueLoadDone;
+
+// A control loop that sends motor changes as fast as the manager's queue takes them
+static void queueLoadRoutine(void*) {
+    auto& man = Manager::get();
+    for (uint32_t i = 0; queueLoadRunning.load(); ++i)
+        man.setMotors().power(MotorId::M1, i % 100).set();
+    queueLoadDone.store(true);
+    vTaskDelete(nullptr);
+}
+
+static void printWorstCase(const char* name, uint32_t iterations, uint32_t us) {
+    printf("%s,%u,%u,%u.0\n", name, iterations, us * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ, us * 1000);
+}
+
+static void quadratureStep(gpio_num_t a, gpio_num_t b, uint32_t step) {
+    // Gray code, A leads B
+    static const uint8_t seq[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+    const auto& s = seq[step & 3];
+    gpio_set_level(a, s[0]);
+    gpio_set_level(b, s[1]);
+}
+
+/**
+ * \brief Generate edgesPerSecond quadrature edges on M1's encoder for duration_ms and print
+ *        the CPU cycles the manager spent on them, per edge and as a load of one core.
+ */
+static void encoderLoad(const char* mode, uint32_t edgesPerSecond, uint32_t duration_ms) {
+    auto& man = Manager::get();
+    const uint32_t edges = edgesPerSecond * duration_ms / 1000;
+    const auto before = man.stats();
+    const int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i != edges; ++i) {
+        const int64_t due = start + int64_t(i) * 1000000 / edgesPerSecond;
+        while (esp_timer_get_time() < due) {
+        }
+        quadratureStep(ENC1A, ENC1B, i);
+    }
+    waitForManager();
+    const int64_t elapsed_us = esp_timer_get_time() - start;
+    const auto after = man.stats();
+    const uint32_t cycles = after.encoderCycles - before.encoderCycles;
+
+    char name[32];
+    snprintf(name, sizeof(name), "encoder_load_%uk_%s", edgesPerSecond / 1000, mode);
+    const double per_edge = double(cycles) / edges;
+    printf("%s,%u,%u,%.1f\n", name, edges, unsigned(per_edge + 0.5),
+        per_edge * 1000.0 / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+    printf("# %s: %.0f cycles/s, %.2f %% of one core, %u edge events dropped\n", name,
+        double(cycles) * 1000000.0 / elapsed_us,
+        double(cycles) * 100.0 / (double(elapsed_us) * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ),
+        after.droppedIsrEvents - before.droppedIsrEvents);
+}
+
+static void runBenchmarks(uint32_t iterations, bool sampledSpeed) {
+    auto& man = Manager::get();
+    man.install(MAN_DISABLE_MOTOR_FAILSAFE | (sampledSpeed ? MAN_ENCODER_SAMPLED_SPEED : MAN_NONE));
+
+    printHeader(iterations);
+
+    {
+        // Same layout as the motors' PWM, on the other I2S peripheral and without any pins
+        SerialPWM pwm(16, { -1 }, -1, -1, -1, 20000, 0);
+        run("pwm_update", iterations, [&](uint32_t i) {
+            pwm[i & 15] = i % SerialPWM::resolution();
+            pwm.update();
+        });
+    }
+
+    // The manager applies pwmMaxPercent, once it is visible the whole change was handled
+    run("motor_roundtrip", iterations, [&](uint32_t i) {
+        const int8_t pct = (i & 1) ? 99 : 100;
+        man.setMotors().pwmMaxPercent(MotorId::M1, pct).power(MotorId::M1, 0).set();
+        while (man.motor(MotorId::M1).pwmMaxPercent() != pct)
+            taskYIELD();
+    });
+
+    {
+        // Emergency stops while the manager's queue is full, from the stats the manager keeps
+        const uint32_t stops = iterations / 10 ? iterations / 10 : 1;
+        esp_log_level_set("RBControlManager", ESP_LOG_ERROR);
+        queueLoadRunning.store(true);
+        queueLoadDone.store(false);
+        xTaskCreate(&queueLoadRoutine, "bench_load", 3072, nullptr, 1, nullptr);
+        for (uint32_t i = 0; i != stops; ++i) {
+            vTaskDelay(pdMS_TO_TICKS(5));
+            man.emergencyStop();
+            vTaskDelay(pdMS_TO_TICKS(5));
+            man.clearEmergencyStop();
+        }
+        queueLoadRunning.store(false);
+        while (!queueLoadDone.load())
+            vTaskDelay(1);
+        man.setMotors().power(MotorId::M1, 0).set();
+        waitForManager();
+        esp_log_level_set("RBControlManager", ESP_LOG_INFO);
+
+        const auto stats = man.stats();
+        printWorstCase("emergency_stop_output_worst", stats.emergencyStops, stats.emergencyStopOutputMaxUs);
+        printWorstCase("emergency_stop_clear_worst", stats.emergencyStops, stats.emergencyStopClearMaxUs);
+        printf("# emergency stops under load, %u motor commands waited for the full queue\n", stats.queueFullWaits);
+    }
+
+    // One encoder cycle per op, its rising edge on A is one event for the manager's task
+    man.motor(MotorId::M1).encoder();
+    gpio_set_direction(ENC1A, GPIO_MODE_INPUT_OUTPUT);
+    gpio_set_direction(ENC1B, GPIO_MODE_INPUT_OUTPUT);
+    run(
+        "encoder_events", iterations, [&](uint32_t) {
+            for (uint32_t step = 0; step != 4; ++step)
+                quadratureStep(ENC1A, ENC1B, step);
+        },
+        waitForManager);
+
+    // A second for each rate with the default iterations
+    const uint32_t loadDuration_ms = iterations < DEFAULT_ITERATIONS ? iterations : DEFAULT_ITERATIONS;
+    for (uint32_t rate : { 1000, 10000, 50000 })
+        encoderLoad(sampledSpeed ? "sampled" : "edge", rate, loadDuration_ms);
+    gpio_set_direction(ENC1A, GPIO_MODE_INPUT);
+    gpio_set_direction(ENC1B, GPIO_MODE_INPUT);
+
+    run("servo_packet_build", iterations, [](uint32_t i) {
+        auto pkt = lw::Packet::move(0, i % 1000, 100);
+        if (!pkt.valid())
+            abort();
+    });
+
+    auto& bus = man.initSmartServoBus(1);
+    if (bus.pos(0).isNaN()) {
+        printf("# servo_roundtrip skipped, no servo with id 0 on the bus\n");
+    } else {
+        run("servo_roundtrip", iterations / 10, [&](uint32_t) {
+            bus.pos(0);
+        });
+    }
+
+    {
+        ArmBuilder builder;
+        builder.body(60, 30).armOffset(0, 20);
+        builder.bone(0, 110).relStops(-95_deg, 0_deg).absStops(-20_deg, Angle::Pi);
+        builder.bone(1, 150).relStops(0_deg, 170_deg).absStops(-Angle::Pi, 25_deg);
+        auto arm = builder.build();
+
+        static const Arm::CoordType targets[][2] = { { 150, -100 }, { 200, 0 }, { 120, -160 }, { 80, 40 } };
+        run("arm_solve", iterations, [&](uint32_t i) {
+            arm->solve(targets[i & 3][0], targets[i & 3][1]);
+        });
+    }
+
+    printf("# done\n");
+}
+
+#ifdef ARDUINO
+
+void setup() {
+    delay(500);
+    runBenchmarks(DEFAULT_ITERATIONS, BENCHMARK_SAMPLED_SPEED);
+}
+
+void loop() {
+}
+
+#else
+
+// A simulated LX-16A servo with id 0, answers the position reads
+static std::vector<uint8_t> servo(const uint8_t* data, size_t len) {
+    if (len < 6 || data[2] != 0 || lw::Command(data[4]) != lw::Command::SERVO_POS_READ)
+        return {};
+    lw::Packet resp(0, lw::Command::SERVO_POS_READ, 500 & 0xFF, 500 >> 8);
+    return resp._data;
+}
+
+int main(int argc, char** argv) {
+    rbsim::uartAttach(UART_NUM_1, servo);
+    runBenchmarks(argc > 1 ? strtoul(argv[1], nullptr, 0) : DEFAULT_ITERATIONS,
+        argc > 2 ? strcmp(argv[2], "sampled") == 0 : BENCHMARK_SAMPLED_SPEED);
+    fflush(stdout);
+    rbsim::exitProcess(0);
+}
+
+#endif
@@ -0,0 +1,69 @@
+// Hot paths of the motor control: PWM rendering, motor commands, timers and the arm solver.
+
+#include <benchmark/benchmark.h>
+
+#include <mutex>
+
+#include "RBControl_arm.hpp"
+#include "RBControl_manager.hpp"
+#include "RBControl_serialPWM.hpp"
+#include "RBControl_timers.hpp"
+
+using namespace rb;
+
+static Manager& installedManager() {
+    static std::once_flag once;
+    std::call_once(once, []() { Manager::get().install(MAN_DISABLE_MOTOR_FAILSAFE); });
+    return Manager::get();
+}
+
+static void SerialPWM_update(benchmark::State& state) {
+    // Same layout as the Manager's motor PWM, on I2S0 so that it does not collide with it
+    SerialPWM pwm(16, { 1 }, 2, 3, -1, 20000, 0);
+    int value = 0;
+    for (auto _ : state) {
+        pwm[value & 15] = value % SerialPWM::resolution();
+        pwm.update();
+        ++value;
+    }
+}
+BENCHMARK(SerialPWM_update);
+
+static void MotorChangeBuilder_set(benchmark::State& state) {
+    auto& man = installedManager();
+    int8_t power = 0;
+    for (auto _ : state) {
+        man.setMotors().power(MotorId::M1, power).power(MotorId::M2, -power).set();
+        power = (power + 1) % 100;
+    }
+    state.counters["queue_full_waits"] = man.stats().queueFullWaits;
+}
+BENCHMARK(MotorChangeBuilder_set);
+
+static void Timers_scheduleCancel(benchmark::State& state) {
+    auto& timers = Timers::get();
+    for (auto _ : state) {
+        const auto id = timers.schedule(1000, []() { return true; });
+        timers.cancel(id);
+    }
+}
+BENCHMARK(Timers_scheduleCancel);
+
+static std::unique_ptr<Arm> buildArm() {
+    ArmBuilder builder;
+    builder.body(60, 30).armOffset(0, 20);
+    builder.bone(0, 110).relStops(-95_deg, 0_deg).absStops(-20_deg, Angle::Pi);
+    builder.bone(1, 150).relStops(0_deg, 170_deg).absStops(-Angle::Pi, 25_deg);
+    return builder.build();
+}
+
+static void Arm_solve(benchmark::State& state) {
+    auto arm = buildArm();
+    static const Arm::CoordType targets[][2] = { { 150, -100 }, { 200, 0 }, { 120, -160 }, { 80, 40 } };
+    size_t idx = 0;
+    for (auto _ : state) {
+        const auto& t = targets[idx++ & 3];
+        benchmark::DoNotOptimize(arm->solve(t[0], t[1]));
+    }
+}
+BENCHMARK(Arm_solve);
@@ -0,0 +1,57 @@
+// The number formatters, each next to the snprintf path it replaces.
+
+#include <benchmark/benchmark.h>
+
+#include "logger/format.hpp"
+
+template <typename Formatter>
+static void formatInto(const Formatter& f, char* buffer) {
+    char* pos = buffer;
+    f.format(compiled_format::BufferIterator(&pos, buffer + 64));
+    benchmark::DoNotOptimize(pos);
+}
+
+template <typename Formatter>
+static void formatIntoSnprintf(const Formatter& f, char* buffer) {
+    char* pos = buffer;
+    f.formatWithSnprintf(compiled_format::BufferIterator(&pos, buffer + 64));
+    benchmark::DoNotOptimize(pos);
+}
+
+#define NUMBER_BENCHMARK(NAME, EXPR)                               \
+    static void Number_##NAME(benchmark::State& state) {           \
+        char buffer[64];                                           \
+        uint32_t i = 0;                                            \
+        for (auto _ : state) {                                     \
+            formatInto(EXPR, buffer);                              \
+            ++i;                                                   \
+        }                                                          \
+    }                                                              \
+    BENCHMARK(Number_##NAME);                                      \
+    static void Number_##NAME##Snprintf(benchmark::State& state) { \
+        char buffer[64];                                           \
+        uint32_t i = 0;                                            \
+        for (auto _ : state) {                                     \
+            formatIntoSnprintf(EXPR, buffer);                      \
+            ++i;                                                   \
+        }                                                          \
+    }                                                              \
+    BENCHMARK(Number_##NAME##Snprintf)
+
+NUMBER_BENCHMARK(int32, number(int32_t(i * 7919 - 50000)));
+NUMBER_BENCHMARK(int64Width, number(int64_t(i) * 1000003).width(12));
+NUMBER_BENCHMARK(hex, number(uint32_t(i * 2654435761u)).hex().width(8).leadingZeroes());
+NUMBER_BENCHMARK(float, number(float(i) * 0.37f).precision(2));
+NUMBER_BENCHMARK(double, number(double(i) * 1.0001 - 500));
+
+// What FormatString and RB_FMT use for their {} markers
+static void Number_defaultDouble(benchmark::State& state) {
+    char buffer[64];
+    uint32_t i = 0;
+    for (auto _ : state) {
+        char* pos = buffer;
+        DefaultSprintfFormatter<double>(double(i++) * 0.01).format(compiled_format::BufferIterator(&pos, buffer + 64));
+        benchmark::DoNotOptimize(pos);
+    }
+}
+BENCHMARK(Number_defaultDouble);
@@ -0,0 +1,165 @@
+// The cost of log calls, both the ones a sink takes and the ones filtered out.
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <fstream>
+#include <thread>
+
+#include "RBControl_logger.hpp"
+#include "logger/binary_log.hpp"
+
+using BenchLogger = BaseLogger<std::string, std::mutex, DummyClock>;
+
+struct NullSink : public LogSink {
+    void log(Verbosity, const std::string&, const std::string& message, uint64_t) override {
+        benchmark::DoNotOptimize(message.data());
+    }
+};
+
+static BenchLogger& warningLogger() {
+    static BenchLogger* logger = []() {
+        auto* res = new BenchLogger();
+        res->addSink(WARNING, std::unique_ptr<LogSink>(new NullSink()));
+        return res;
+    }();
+    return *logger;
+}
+
+static void Log_enabled(benchmark::State& state) {
+    auto& logger = warningLogger();
+    int value = 0;
+    for (auto _ : state)
+        logger.log(WARNING, "Motor", "power {} enc {}", value++, 42);
+}
+BENCHMARK(Log_enabled);
+
+static void Log_enabledCompiled(benchmark::State& state) {
+    auto& logger = warningLogger();
+    int value = 0;
+    for (auto _ : state)
+        logger.log(WARNING, "Motor", RB_FMT("power {} enc {}"), value++, 42);
+}
+BENCHMARK(Log_enabledCompiled);
+
+static void Log_disabled(benchmark::State& state) {
+    auto& logger = warningLogger();
+    int value = 0;
+    for (auto _ : state)
+        logger.log(DEBUG, "Motor", "power {} enc {}", value++, 42);
+}
+BENCHMARK(Log_disabled);
+
+static void Log_disabledCompiled(benchmark::State& state) {
+    auto& logger = warningLogger();
+    int value = 0;
+    for (auto _ : state)
+        logger.log(DEBUG, "Motor", RB_FMT("power {} enc {}"), value++, 42);
+}
+BENCHMARK(Log_disabledCompiled);
+
+static void Log_disabledCheck(benchmark::State& state) {
+    auto& logger = warningLogger();
+    int value = 0;
+    for (auto _ : state) {
+        if (logger.enabled(DEBUG))
+            logger.log(DEBUG, "Motor", RB_FMT("power {} enc {}"), value, 42);
+        benchmark::DoNotOptimize(++value);
+    }
+}
+BENCHMARK(Log_disabledCheck);
+
+// Counts the messages which made it through the queue
+struct CountingSink : public LogSink {
+    CountingSink()
+        : count(0) {}
+
+    void log(Verbosity, const std::string&, const std::string&, uint64_t) override {
+        count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint32_t> count;
+};
+
+static const size_t ASYNC_CAPACITY = 256;
+
+// The console sink's table formatting, written to /dev/null. The async consumer either
+// polls, or sleeps for idle_ms when the queue is empty like a low-priority task would.
+static BenchLogger* streamLogger(bool async, int idle_ms = 0, CountingSink* counter = nullptr) {
+    static std::ofstream devnull("/dev/null");
+    auto* res = new BenchLogger();
+    res->addSink(ALL, std::unique_ptr<LogSink>(new StreamLogSink(devnull, 80)));
+    if (counter)
+        res->addSink(ALL, std::unique_ptr<LogSink>(counter));
+    if (async) {
+        res->enableAsync(ASYNC_CAPACITY);
+        std::thread([res, idle_ms]() {
+            while (true) {
+                if (res->processQueue() != 0)
+                    continue;
+                if (idle_ms)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(idle_ms));
+                else
+                    std::this_thread::yield();
+            }
+        }).detach();
+    }
+    return res;
+}
+
+static void Log_streamSync(benchmark::State& state) {
+    static BenchLogger* logger = streamLogger(false);
+    int value = 0;
+    for (auto _ : state)
+        logger->log(INFO, "Motor", RB_FMT("power {} enc {}"), value++, 42);
+}
+BENCHMARK(Log_streamSync)->ThreadRange(1, 4)->UseRealTime();
+
+// Steady state: the producers keep at most half of the queue in flight, so nothing is dropped
+// and the time per message is the consumer's, items_per_second are the delivered messages.
+static void Log_streamAsync(benchmark::State& state) {
+    static CountingSink* delivered = new CountingSink();
+    static BenchLogger* logger = streamLogger(true, 0, delivered);
+    static std::atomic<uint32_t> sent(0);
+    const uint32_t dropped = logger->dropped();
+    int value = 0;
+    for (auto _ : state) {
+        sent.fetch_add(1, std::memory_order_relaxed);
+        logger->log(INFO, "Motor", RB_FMT("power {} enc {}"), value++, 42);
+        while (sent.load(std::memory_order_relaxed) - delivered->count.load(std::memory_order_relaxed) > ASYNC_CAPACITY / 2)
+            std::this_thread::yield();
+    }
+    while (sent.load(std::memory_order_relaxed) != delivered->count.load(std::memory_order_relaxed) + logger->dropped())
+        std::this_thread::yield();
+    state.SetItemsProcessed(state.iterations());
+    state.counters["dropped"] = benchmark::Counter(logger->dropped() - dropped, benchmark::Counter::kAvgThreads);
+}
+BENCHMARK(Log_streamAsync)->ThreadRange(1, 4)->UseRealTime();
+
+// The drop path: the producers log as fast as they can and the consumer sleeps 1 ms whenever
+// the queue is empty, most of the messages are dropped. The time is the cost for the caller.
+static void Log_streamAsyncDropping(benchmark::State& state) {
+    static CountingSink* delivered = new CountingSink();
+    static BenchLogger* logger = streamLogger(true, 1, delivered);
+    const uint32_t dropped = logger->dropped();
+    const uint32_t start = delivered->count.load();
+    int value = 0;
+    for (auto _ : state)
+        logger->log(INFO, "Motor", RB_FMT("power {} enc {}"), value++, 42);
+    state.counters["dropped"] = benchmark::Counter(logger->dropped() - dropped, benchmark::Counter::kAvgThreads);
+    state.counters["delivered"] = benchmark::Counter(delivered->count.load() - start, benchmark::Counter::kAvgThreads);
+}
+BENCHMARK(Log_streamAsyncDropping)->ThreadRange(1, 4)->UseRealTime();
+
+// The binary log's cost, to compare with Log_enabledCompiled, which formats the text
+static void BinaryLog_ring(benchmark::State& state) {
+    static BinaryLog* log = []() {
+        auto* res = new BinaryLog();
+        res->addSink(std::unique_ptr<BinaryLogSink>(new RingBinaryLogSink(4096)));
+        return res;
+    }();
+    int value = 0;
+    for (auto _ : state)
+        log->log(RB_FMT("power {} enc {}"), value++, 42);
+}
+BENCHMARK(BinaryLog_ring);
@@ -0,0 +1,65 @@
+// Building the smart servo packets and formatting the logger's messages.
+
+#include <benchmark/benchmark.h>
+
+#include "RBControl_logger.hpp"
+#include "lx16a.hpp"
+
+static void Packet_move(benchmark::State& state) {
+    uint16_t position = 0;
+    for (auto _ : state) {
+        auto pkt = lw::Packet::move(1, position, 100);
+        benchmark::DoNotOptimize(pkt._data.data());
+        position = (position + 7) % 1000;
+    }
+}
+BENCHMARK(Packet_move);
+
+static void Packet_parse(benchmark::State& state) {
+    const auto reference = lw::Packet::move(1, 500, 100);
+    for (auto _ : state) {
+        lw::Packet pkt(reference._data.data(), reference._data.size());
+        benchmark::DoNotOptimize(pkt.valid());
+    }
+}
+BENCHMARK(Packet_parse);
+
+static void Format_4args(benchmark::State& state) {
+    int value = 0;
+    for (auto _ : state) {
+        std::string out = format("motor {} power {} enc {} {}", 1, value, value * 3, "ok");
+        benchmark::DoNotOptimize(out.data());
+        ++value;
+    }
+}
+BENCHMARK(Format_4args);
+
+static void FormatCompiled_4args(benchmark::State& state) {
+    int value = 0;
+    for (auto _ : state) {
+        const auto out = format(RB_FMT("motor {} power {} enc {} {}"), 1, value, value * 3, "ok");
+        benchmark::DoNotOptimize(out.c_str());
+        ++value;
+    }
+}
+BENCHMARK(FormatCompiled_4args);
+
+static void Format_indexed(benchmark::State& state) {
+    int value = 0;
+    for (auto _ : state) {
+        std::string out = format("{1} {0} {1}", value, 3.5);
+        benchmark::DoNotOptimize(out.data());
+        ++value;
+    }
+}
+BENCHMARK(Format_indexed);
+
+static void FormatCompiled_indexed(benchmark::State& state) {
+    int value = 0;
+    for (auto _ : state) {
+        const auto out = format(RB_FMT("{1} {0} {1}"), value, 3.5);
+        benchmark::DoNotOptimize(out.c_str());
+        ++value;
+    }
+}
+BENCHMARK(FormatCompiled_indexed);
@@ -0,0 +1,13 @@
+#include <benchmark/benchmark.h>
+
+#include "rbsim.hpp"
+
+// The library's tasks never return, so the process ends without running the static destructors.
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        rbsim::exitProcess(1);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    rbsim::exitProcess(0);
+}
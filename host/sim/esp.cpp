@@ -0,0 +1,530 @@
+#include <esp_adc_cal.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <nvs_flash.h>
+#include <xtensa/hal.h>
+
+#include <driver/adc.h>
+#include <driver/i2s.h>
+#include <driver/ledc.h>
+#include <driver/periph_ctrl.h>
+
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "rbsim.hpp"
+#include "sim_internal.hpp"
+
+namespace rbsim {
+
+static std::atomic<bool> g_deep_sleep_ends_process(true);
+static std::atomic<uint32_t> g_deep_sleeps(0);
+
+void deepSleepEndsProcess(bool end) {
+    g_deep_sleep_ends_process = end;
+}
+
+uint32_t deepSleepCount() {
+    return g_deep_sleeps.load();
+}
+
+void exitProcess(int code) {
+    fflush(stdout);
+    fflush(stderr);
+    _exit(code);
+}
+
+} // namespace rbsim
+
+// Logging
+namespace {
+std::mutex g_log_mutex;
+std::map<std::string, esp_log_level_t> g_log_levels;
+esp_log_level_t g_log_default = ESP_LOG_WARN;
+} // namespace
+
+extern "C" {
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...) {
+    {
+        std::lock_guard<std::mutex> lock(g_log_mutex);
+        auto itr = g_log_levels.find(tag);
+        if (level > (itr != g_log_levels.end() ? itr->second : g_log_default))
+            return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+void esp_log_level_set(const char* tag, esp_log_level_t level) {
+    std::lock_guard<std::mutex> lock(g_log_mutex);
+    if (strcmp(tag, "*") == 0) {
+        g_log_default = level;
+        g_log_levels.clear();
+    } else {
+        g_log_levels[tag] = level;
+    }
+}
+
+uint32_t esp_log_timestamp(void) {
+    return uint32_t(rbsim::uptimeNs() / 1000000);
+}
+
+} // extern "C"
+
+// esp_timer, all callbacks run from a single dispatcher thread like the ESP_TIMER_TASK method.
+struct rbsim_esp_timer {
+    esp_timer_cb_t callback;
+    void* arg;
+    bool active;
+    uint64_t period_us;
+    int64_t expiry_us;
+};
+
+namespace {
+
+std::mutex g_timer_mutex;
+std::condition_variable g_timer_cond;
+std::map<esp_timer_handle_t, std::shared_ptr<rbsim_esp_timer>> g_esp_timers;
+bool g_timer_thread_started = false;
+std::atomic<uint32_t> g_timer_longest_callback_us(0);
+
+std::atomic<int> g_heap_fail_after(-1);
+std::atomic<int> g_heap_caps_allocated(0);
+
+int64_t threadCpuTimeUs() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+void espTimerThread() {
+    std::unique_lock<std::mutex> lock(g_timer_mutex);
+    while (true) {
+        std::shared_ptr<rbsim_esp_timer> next;
+        for (auto& itr : g_esp_timers) {
+            if (itr.second->active && (!next || itr.second->expiry_us < next->expiry_us))
+                next = itr.second;
+        }
+
+        if (!next) {
+            g_timer_cond.wait(lock);
+            continue;
+        }
+
+        const int64_t remaining = next->expiry_us - esp_timer_get_time();
+        if (remaining > 0) {
+            g_timer_cond.wait_for(lock, std::chrono::microseconds(remaining));
+            continue;
+        }
+
+        if (next->period_us != 0) {
+            next->expiry_us += next->period_us;
+        } else {
+            next->active = false;
+        }
+
+        // The shared_ptr keeps the timer alive if the callback deletes it.
+        lock.unlock();
+        // CPU time, so that the host preempting the thread doesn't count
+        const int64_t start = threadCpuTimeUs();
+        next->callback(next->arg);
+        const uint32_t took = uint32_t(threadCpuTimeUs() - start);
+        if (took > g_timer_longest_callback_us.load())
+            g_timer_longest_callback_us = took;
+        lock.lock();
+    }
+}
+
+esp_err_t espTimerStart(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us) {
+    std::lock_guard<std::mutex> lock(g_timer_mutex);
+    if (g_esp_timers.find(timer) == g_esp_timers.end())
+        return ESP_ERR_INVALID_ARG;
+    if (timer->active)
+        return ESP_ERR_INVALID_STATE;
+    if (!g_timer_thread_started) {
+        std::thread(espTimerThread).detach();
+        g_timer_thread_started = true;
+    }
+    timer->active = true;
+    timer->period_us = period_us;
+    timer->expiry_us = esp_timer_get_time() + timeout_us;
+    g_timer_cond.notify_all();
+    return ESP_OK;
+}
+
+} // namespace
+
+namespace rbsim {
+
+void heapFailAfter(int allocations) {
+    g_heap_fail_after = allocations;
+}
+
+int heapCapsAllocated() {
+    return g_heap_caps_allocated;
+}
+
+uint32_t espTimerLongestCallbackUs(bool reset) {
+    return reset ? g_timer_longest_callback_us.exchange(0) : g_timer_longest_callback_us.load();
+}
+
+} // namespace rbsim
+
+extern "C" {
+
+int64_t esp_timer_get_time(void) {
+    return int64_t(rbsim::uptimeNs() / 1000);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle) {
+    if (!create_args || !create_args->callback || !out_handle)
+        return ESP_ERR_INVALID_ARG;
+
+    auto timer = std::make_shared<rbsim_esp_timer>();
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    timer->active = false;
+    timer->period_us = 0;
+    timer->expiry_us = 0;
+
+    std::lock_guard<std::mutex> lock(g_timer_mutex);
+    g_esp_timers[timer.get()] = timer;
+    *out_handle = timer.get();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return espTimerStart(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    return espTimerStart(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(g_timer_mutex);
+    if (!timer->active)
+        return ESP_ERR_INVALID_STATE;
+    timer->active = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(g_timer_mutex);
+    if (timer->active)
+        return ESP_ERR_INVALID_STATE;
+    g_esp_timers.erase(timer);
+    return ESP_OK;
+}
+
+// System
+void esp_deep_sleep_start(void) {
+    fprintf(stderr, "rbsim: esp_deep_sleep_start\n");
+    ++rbsim::g_deep_sleeps;
+    if (rbsim::g_deep_sleep_ends_process)
+        rbsim::exitProcess(0);
+    while (true)
+        std::this_thread::sleep_for(std::chrono::hours(1));
+}
+
+void esp_restart(void) {
+    fprintf(stderr, "rbsim: esp_restart\n");
+    rbsim::exitProcess(0);
+}
+
+uint32_t esp_get_free_heap_size(void) {
+    return 256 * 1024;
+}
+
+void* heap_caps_malloc(size_t size, uint32_t) {
+    if (g_heap_fail_after == 0)
+        return nullptr;
+    if (g_heap_fail_after > 0)
+        --g_heap_fail_after;
+    void* ptr = malloc(size);
+    if (ptr)
+        ++g_heap_caps_allocated;
+    return ptr;
+}
+
+void* heap_caps_calloc(size_t n, size_t size, uint32_t) {
+    return calloc(n, size);
+}
+
+void heap_caps_free(void* ptr) {
+    if (ptr)
+        --g_heap_caps_allocated;
+    free(ptr);
+}
+
+uint32_t xthal_get_ccount(void) {
+    return uint32_t(rbsim::uptimeNs() * 240 / 1000);
+}
+
+} // extern "C"
+
+// NVS
+namespace {
+
+struct NvsValue {
+    enum Type { I32, STR, BLOB };
+    Type type;
+    int32_t i32;
+    std::string str; // The string or the blob's bytes
+};
+
+std::mutex g_nvs_mutex;
+std::map<std::string, std::map<std::string, NvsValue>> g_nvs;
+std::map<nvs_handle, std::string> g_nvs_handles;
+nvs_handle g_nvs_next_handle = 1;
+
+std::map<std::string, NvsValue>* nvsNamespace(nvs_handle handle) {
+    auto itr = g_nvs_handles.find(handle);
+    return itr != g_nvs_handles.end() ? &g_nvs[itr->second] : nullptr;
+}
+
+} // namespace
+
+extern "C" {
+
+esp_err_t nvs_flash_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    std::lock_guard<std::mutex> lock(g_nvs_mutex);
+    g_nvs.clear();
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char* name, nvs_open_mode, nvs_handle* out_handle) {
+    std::lock_guard<std::mutex> lock(g_nvs_mutex);
+    *out_handle = g_nvs_next_handle++;
+    g_nvs_handles[*out_handle] = name;
+    return ESP_OK;
+}
+
+esp_err_t nvs_open_from_partition(const char*, const char* name, nvs_open_mode open_mode, nvs_handle* out_handle) {
+    return nvs_open(name, open_mode, out_handle);
+}
+
+void nvs_close(nvs_handle handle) {
+    std::lock_guard<std::mutex> lock(g_nvs_mutex);
+    g_nvs_handles.erase(handle);
+}
+
+esp_err_t nvs_commit(nvs_handle handle) {
+    std::lock_guard<std::mutex> lock(g_nvs_mutex);
+    return nvsNamespace(handle) ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+}
+
+esp_err_t nvs_erase_key(nvs_handle handle, const char* key) {
+    std::lock_guard<std::mutex> lock(g_nvs_mutex);
+    auto* ns = nvsNamespace(handle);
+    if (!ns)
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    return ns->erase(key) ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_get_i32(nvs_handle handle, const char* key, int32_t* out_value) {
+    std::lock_guard<std::mutex> lock(g_nvs_mutex);
+    auto* ns = nvsNamespace(handle);
+    if (!ns)
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    auto itr = ns->find(key);
+    if (itr == ns->end())
+        return ESP_ERR_NVS_NOT_FOUND;
+    if (itr->second.type != NvsValue::I32)
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    *out_value = itr->second.i32;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_i32(nvs_handle handle, const char* key, int32_t value) {
+    std::lock_guard<std::mutex> lock(g_nvs_mutex);
+    auto* ns = nvsNamespace(handle);
+    if (!ns)
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    (*ns)[key] = NvsValue { NvsValue::I32, value, std::string() };
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_str(nvs_handle handle, const char* key, char* out_value, size_t* length) {
+    std::lock_guard<std::mutex> lock(g_nvs_mutex);
+    auto* ns = nvsNamespace(handle);
+    if (!ns)
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    auto itr = ns->find(key);
+    if (itr == ns->end())
+        return ESP_ERR_NVS_NOT_FOUND;
+    if (itr->second.type != NvsValue::STR)
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+
+    const size_t needed = itr->second.str.size() + 1;
+    if (out_value) {
+        if (*length < needed)
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        memcpy(out_value, itr->second.str.c_str(), needed);
+    }
+    *length = needed;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_str(nvs_handle handle, const char* key, const char* value) {
+    std::lock_guard<std::mutex> lock(g_nvs_mutex);
+    auto* ns = nvsNamespace(handle);
+    if (!ns)
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    (*ns)[key] = NvsValue { NvsValue::STR, 0, value };
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle handle, const char* key, void* out_value, size_t* length) {
+    std::lock_guard<std::mutex> lock(g_nvs_mutex);
+    auto* ns = nvsNamespace(handle);
+    if (!ns)
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    auto itr = ns->find(key);
+    if (itr == ns->end())
+        return ESP_ERR_NVS_NOT_FOUND;
+    if (itr->second.type != NvsValue::BLOB)
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+
+    const size_t needed = itr->second.str.size();
+    if (out_value) {
+        if (*length < needed)
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        memcpy(out_value, itr->second.str.data(), needed);
+    }
+    *length = needed;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle handle, const char* key, const void* value, size_t length) {
+    std::lock_guard<std::mutex> lock(g_nvs_mutex);
+    auto* ns = nvsNamespace(handle);
+    if (!ns)
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    (*ns)[key] = NvsValue { NvsValue::BLOB, 0, std::string(static_cast<const char*>(value), length) };
+    return ESP_OK;
+}
+
+} // extern "C"
+
+// ADC
+namespace {
+std::mutex g_adc_mutex;
+int g_adc_raw[ADC1_CHANNEL_MAX] = { 3240, 3240, 3240, 3240, 3240, 3240, 3240, 3240 };
+std::atomic<uint32_t> g_adc_conversion_us(0);
+} // namespace
+
+namespace rbsim {
+
+void adcSet(adc1_channel_t channel, int raw) {
+    std::lock_guard<std::mutex> lock(g_adc_mutex);
+    g_adc_raw[channel] = raw;
+}
+
+void adcSetConversionTime(uint32_t us) {
+    g_adc_conversion_us = us;
+}
+
+} // namespace rbsim
+
+extern "C" {
+
+int adc1_get_raw(adc1_channel_t channel) {
+    const int64_t done = esp_timer_get_time() + g_adc_conversion_us.load();
+    while (esp_timer_get_time() < done) {
+    }
+    std::lock_guard<std::mutex> lock(g_adc_mutex);
+    return channel >= 0 && channel < ADC1_CHANNEL_MAX ? g_adc_raw[channel] : -1;
+}
+
+esp_err_t adc1_config_width(adc_bits_width_t) {
+    return ESP_OK;
+}
+
+esp_err_t adc1_config_channel_atten(adc1_channel_t channel, adc_atten_t) {
+    return channel >= 0 && channel < ADC1_CHANNEL_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_adc_cal_value_t esp_adc_cal_characterize(adc_unit_t adc_num, adc_atten_t atten, adc_bits_width_t bit_width,
+    uint32_t default_vref, esp_adc_cal_characteristics_t* chars) {
+    chars->adc_num = adc_num;
+    chars->atten = atten;
+    chars->bit_width = bit_width;
+    chars->vref = default_vref;
+    return ESP_ADC_CAL_VAL_DEFAULT_VREF;
+}
+
+uint32_t esp_adc_cal_raw_to_voltage(uint32_t adc_reading, const esp_adc_cal_characteristics_t* chars) {
+    const uint32_t full_scale = (1 << (9 + chars->bit_width)) - 1;
+    return adc_reading * chars->vref / full_scale;
+}
+
+// LEDC and peripheral clocks have no observable effect in the simulation.
+esp_err_t ledc_channel_config(const ledc_channel_config_t*) {
+    return ESP_OK;
+}
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t*) {
+    return ESP_OK;
+}
+
+esp_err_t ledc_timer_set(ledc_mode_t, ledc_timer_t, uint32_t, uint32_t, ledc_clk_src_t) {
+    return ESP_OK;
+}
+
+esp_err_t ledc_timer_rst(ledc_mode_t, ledc_timer_t) {
+    return ESP_OK;
+}
+
+esp_err_t ledc_timer_pause(ledc_mode_t, ledc_timer_t) {
+    return ESP_OK;
+}
+
+esp_err_t ledc_timer_resume(ledc_mode_t, ledc_timer_t) {
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t, ledc_channel_t, uint32_t) {
+    return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t, ledc_channel_t) {
+    return ESP_OK;
+}
+
+esp_err_t ledc_stop(ledc_mode_t, ledc_channel_t, uint32_t) {
+    return ESP_OK;
+}
+
+void periph_module_enable(periph_module_t) {
+}
+
+void periph_module_disable(periph_module_t) {
+}
+
+esp_err_t i2s_driver_uninstall(i2s_port_t) {
+    return ESP_OK;
+}
+
+} // extern "C"
@@ -0,0 +1,487 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <freertos/timers.h>
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sim_internal.hpp"
+
+struct rbsim_task {
+    std::string name;
+    UBaseType_t priority;
+    uint32_t stack_depth;
+    int core;
+    TaskFunction_t code;
+    void* param;
+
+    std::mutex notify_mutex;
+    std::condition_variable notify_cond;
+    uint32_t notify_value;
+};
+
+struct rbsim_queue {
+    std::mutex mutex;
+    std::condition_variable cond_recv;
+    std::condition_variable cond_send;
+    std::deque<std::vector<uint8_t>> items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+};
+
+struct rbsim_timer {
+    std::string name;
+    TickType_t period;
+    bool auto_reload;
+    void* id;
+    TimerCallbackFunction_t callback;
+    bool active;
+    TickType_t expiry;
+};
+
+namespace {
+
+std::recursive_mutex g_critical;
+std::mutex g_tasks_mutex;
+std::vector<rbsim_task*> g_tasks;
+thread_local rbsim_task* t_current = nullptr;
+thread_local bool t_in_isr = false;
+
+std::chrono::steady_clock::time_point deadlineOf(TickType_t ticks) {
+    return std::chrono::steady_clock::now() + std::chrono::milliseconds(ticks * portTICK_PERIOD_MS);
+}
+
+void taskEntry(rbsim_task* task) {
+    t_current = task;
+    task->code(task->param);
+    // Returning from a task function is a bug in FreeRTOS, mirror it.
+    fprintf(stderr, "rbsim: task %s returned\n", task->name.c_str());
+    abort();
+}
+
+} // namespace
+
+namespace rbsim {
+
+void runIsr(void (*fn)(void*), void* arg) {
+    std::lock_guard<std::recursive_mutex> lock(g_critical);
+    const bool was_in_isr = t_in_isr;
+    t_in_isr = true;
+    fn(arg);
+    t_in_isr = was_in_isr;
+}
+
+uint64_t uptimeNs() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace rbsim
+
+extern "C" {
+
+void vPortEnterCritical(portMUX_TYPE*) {
+    g_critical.lock();
+}
+
+void vPortExitCritical(portMUX_TYPE*) {
+    g_critical.unlock();
+}
+
+BaseType_t xPortGetCoreID(void) {
+    return t_current && t_current->core != tskNO_AFFINITY ? t_current->core : 0;
+}
+
+BaseType_t xPortInIsrContext(void) {
+    return t_in_isr ? pdTRUE : pdFALSE;
+}
+
+void vPortYield(void) {
+    if (!t_in_isr)
+        std::this_thread::yield();
+}
+
+void vPortFree(void* pv) {
+    free(pv);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char* pcName, uint32_t usStackDepth, void* pvParameters,
+    UBaseType_t uxPriority, TaskHandle_t* pvCreatedTask, BaseType_t xCoreID) {
+    auto* task = new rbsim_task();
+    task->name = pcName ? pcName : "";
+    task->priority = uxPriority;
+    task->stack_depth = usStackDepth;
+    task->core = xCoreID;
+    task->code = pvTaskCode;
+    task->param = pvParameters;
+    task->notify_value = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(g_tasks_mutex);
+        g_tasks.push_back(task);
+    }
+
+    if (pvCreatedTask)
+        *pvCreatedTask = task;
+
+    std::thread(taskEntry, task).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pvTaskCode, const char* pcName, uint32_t usStackDepth, void* pvParameters,
+    UBaseType_t uxPriority, TaskHandle_t* pvCreatedTask) {
+    return xTaskCreatePinnedToCore(pvTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pvCreatedTask, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete) {
+    if (xTaskToDelete != nullptr && xTaskToDelete != t_current) {
+        fprintf(stderr, "rbsim: deleting other tasks is not supported\n");
+        abort();
+    }
+
+    // The handle stays valid, FreeRTOS would free it later anyway.
+    {
+        std::lock_guard<std::mutex> lock(g_tasks_mutex);
+        g_tasks.erase(std::remove(g_tasks.begin(), g_tasks.end(), t_current), g_tasks.end());
+    }
+    pthread_exit(nullptr);
+}
+
+void vTaskDelay(TickType_t xTicksToDelay) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(xTicksToDelay * portTICK_PERIOD_MS));
+}
+
+void vTaskDelayUntil(TickType_t* pxPreviousWakeTime, TickType_t xTimeIncrement) {
+    *pxPreviousWakeTime += xTimeIncrement;
+    const TickType_t now = xTaskGetTickCount();
+    const int32_t remaining = int32_t(*pxPreviousWakeTime - now);
+    if (remaining > 0)
+        vTaskDelay(remaining);
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return TickType_t(rbsim::uptimeNs() / 1000000 / portTICK_PERIOD_MS);
+}
+
+TickType_t xTaskGetTickCountFromISR(void) {
+    return xTaskGetTickCount();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return t_current;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t xTask) {
+    xTask = xTask ? xTask : t_current;
+    return xTask ? xTask->priority : 0;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask) {
+    // Host threads have large stacks, report the whole requested depth.
+    xTask = xTask ? xTask : t_current;
+    return xTask ? xTask->stack_depth : 0;
+}
+
+char* pcTaskGetTaskName(TaskHandle_t xTaskToQuery) {
+    static char main_name[] = "main";
+    xTaskToQuery = xTaskToQuery ? xTaskToQuery : t_current;
+    return xTaskToQuery ? &xTaskToQuery->name[0] : main_name;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void) {
+    std::lock_guard<std::mutex> lock(g_tasks_mutex);
+    return g_tasks.size();
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* pxTaskStatusArray, UBaseType_t uxArraySize, uint32_t* pulTotalRunTime) {
+    std::lock_guard<std::mutex> lock(g_tasks_mutex);
+    UBaseType_t count = 0;
+    for (auto* task : g_tasks) {
+        if (count == uxArraySize)
+            break;
+        auto& st = pxTaskStatusArray[count];
+        st.xHandle = task;
+        st.pcTaskName = task->name.c_str();
+        st.xTaskNumber = count;
+        st.uxCurrentPriority = st.uxBasePriority = task->priority;
+        st.ulRunTimeCounter = 0;
+        st.usStackHighWaterMark = task->stack_depth;
+        ++count;
+    }
+    if (pulTotalRunTime)
+        *pulTotalRunTime = uint32_t(rbsim::uptimeNs() / 1000);
+    return count;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait) {
+    auto* task = t_current;
+    if (!task)
+        return 0;
+
+    std::unique_lock<std::mutex> lock(task->notify_mutex);
+    auto pred = [&]() { return task->notify_value != 0; };
+    if (xTicksToWait == portMAX_DELAY) {
+        task->notify_cond.wait(lock, pred);
+    } else {
+        task->notify_cond.wait_until(lock, deadlineOf(xTicksToWait), pred);
+    }
+
+    const uint32_t value = task->notify_value;
+    if (value != 0)
+        task->notify_value = xClearCountOnExit ? 0 : value - 1;
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify) {
+    {
+        std::lock_guard<std::mutex> lock(xTaskToNotify->notify_mutex);
+        ++xTaskToNotify->notify_value;
+    }
+    xTaskToNotify->notify_cond.notify_all();
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t* pxHigherPriorityTaskWoken) {
+    xTaskNotifyGive(xTaskToNotify);
+    if (pxHigherPriorityTaskWoken)
+        *pxHigherPriorityTaskWoken = pdTRUE;
+}
+
+QueueHandle_t xQueueGenericCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize) {
+    auto* q = new rbsim_queue();
+    q->length = uxQueueLength;
+    q->item_size = uxItemSize;
+    return q;
+}
+
+SemaphoreHandle_t rbsim_semaphore_create(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount) {
+    auto* q = xQueueGenericCreate(uxMaxCount, 0);
+    for (UBaseType_t i = 0; i < uxInitialCount; ++i)
+        q->items.emplace_back();
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t xQueue) {
+    delete xQueue;
+}
+
+static bool queuePushLocked(QueueHandle_t q, const void* item, BaseType_t position) {
+    if (position == queueOVERWRITE) {
+        q->items.clear();
+    } else if (q->items.size() >= q->length) {
+        return false;
+    }
+
+    std::vector<uint8_t> data(q->item_size);
+    if (q->item_size != 0 && item)
+        memcpy(data.data(), item, q->item_size);
+
+    if (position == queueSEND_TO_FRONT) {
+        q->items.push_front(std::move(data));
+    } else {
+        q->items.push_back(std::move(data));
+    }
+    return true;
+}
+
+BaseType_t xQueueGenericSend(QueueHandle_t xQueue, const void* pvItemToQueue, TickType_t xTicksToWait, BaseType_t xCopyPosition) {
+    std::unique_lock<std::mutex> lock(xQueue->mutex);
+    auto hasSpace = [&]() { return xCopyPosition == queueOVERWRITE || xQueue->items.size() < xQueue->length; };
+    if (!hasSpace() && xTicksToWait != 0) {
+        if (xTicksToWait == portMAX_DELAY) {
+            xQueue->cond_send.wait(lock, hasSpace);
+        } else {
+            xQueue->cond_send.wait_until(lock, deadlineOf(xTicksToWait), hasSpace);
+        }
+    }
+
+    if (!queuePushLocked(xQueue, pvItemToQueue, xCopyPosition))
+        return errQUEUE_FULL;
+    lock.unlock();
+    xQueue->cond_recv.notify_one();
+    return pdPASS;
+}
+
+BaseType_t xQueueGenericSendFromISR(QueueHandle_t xQueue, const void* pvItemToQueue, BaseType_t* pxHigherPriorityTaskWoken, BaseType_t xCopyPosition) {
+    const BaseType_t res = xQueueGenericSend(xQueue, pvItemToQueue, 0, xCopyPosition);
+    if (pxHigherPriorityTaskWoken && res == pdPASS)
+        *pxHigherPriorityTaskWoken = pdTRUE;
+    return res;
+}
+
+static BaseType_t queueReceive(QueueHandle_t xQueue, void* pvBuffer, TickType_t xTicksToWait, bool remove) {
+    std::unique_lock<std::mutex> lock(xQueue->mutex);
+    auto hasItem = [&]() { return !xQueue->items.empty(); };
+    if (!hasItem() && xTicksToWait != 0) {
+        if (xTicksToWait == portMAX_DELAY) {
+            xQueue->cond_recv.wait(lock, hasItem);
+        } else {
+            xQueue->cond_recv.wait_until(lock, deadlineOf(xTicksToWait), hasItem);
+        }
+    }
+
+    if (!hasItem())
+        return errQUEUE_EMPTY;
+
+    if (xQueue->item_size != 0 && pvBuffer)
+        memcpy(pvBuffer, xQueue->items.front().data(), xQueue->item_size);
+    if (remove) {
+        xQueue->items.pop_front();
+        lock.unlock();
+        xQueue->cond_send.notify_one();
+    }
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void* pvBuffer, TickType_t xTicksToWait) {
+    return queueReceive(xQueue, pvBuffer, xTicksToWait, true);
+}
+
+BaseType_t xQueueReceiveFromISR(QueueHandle_t xQueue, void* pvBuffer, BaseType_t* pxHigherPriorityTaskWoken) {
+    if (pxHigherPriorityTaskWoken)
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    return queueReceive(xQueue, pvBuffer, 0, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t xQueue, void* pvBuffer, TickType_t xTicksToWait) {
+    return queueReceive(xQueue, pvBuffer, xTicksToWait, false);
+}
+
+BaseType_t xQueueReset(QueueHandle_t xQueue) {
+    {
+        std::lock_guard<std::mutex> lock(xQueue->mutex);
+        xQueue->items.clear();
+    }
+    xQueue->cond_send.notify_all();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue) {
+    std::lock_guard<std::mutex> lock(xQueue->mutex);
+    return xQueue->items.size();
+}
+
+UBaseType_t uxQueueMessagesWaitingFromISR(QueueHandle_t xQueue) {
+    return uxQueueMessagesWaiting(xQueue);
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t xQueue) {
+    std::lock_guard<std::mutex> lock(xQueue->mutex);
+    return xQueue->length - xQueue->items.size();
+}
+
+} // extern "C"
+
+// FreeRTOS software timers, run from the "Tmr Svc" task.
+namespace {
+
+std::mutex g_timers_mutex;
+std::condition_variable g_timers_cond;
+std::list<rbsim_timer*> g_timers;
+TaskHandle_t g_timer_task = nullptr;
+
+void timerTask(void*) {
+    std::unique_lock<std::mutex> lock(g_timers_mutex);
+    while (true) {
+        rbsim_timer* next = nullptr;
+        for (auto* t : g_timers) {
+            if (t->active && (!next || int32_t(t->expiry - next->expiry) < 0))
+                next = t;
+        }
+
+        if (!next) {
+            g_timers_cond.wait(lock);
+            continue;
+        }
+
+        const int32_t remaining = int32_t(next->expiry - xTaskGetTickCount());
+        if (remaining > 0) {
+            g_timers_cond.wait_for(lock, std::chrono::milliseconds(remaining * portTICK_PERIOD_MS));
+            continue;
+        }
+
+        if (next->auto_reload) {
+            next->expiry += next->period;
+        } else {
+            next->active = false;
+        }
+
+        lock.unlock();
+        next->callback(next);
+        lock.lock();
+    }
+}
+
+BaseType_t timerCommand(TimerHandle_t timer, bool active, TickType_t period) {
+    std::lock_guard<std::mutex> lock(g_timers_mutex);
+    if (!g_timer_task)
+        xTaskCreate(timerTask, "Tmr Svc", 2048, nullptr, 1, &g_timer_task);
+    if (period != 0)
+        timer->period = period;
+    timer->active = active;
+    timer->expiry = xTaskGetTickCount() + timer->period;
+    g_timers_cond.notify_all();
+    return pdPASS;
+}
+
+} // namespace
+
+extern "C" {
+
+TimerHandle_t xTimerCreate(const char* pcTimerName, TickType_t xTimerPeriodInTicks, UBaseType_t uxAutoReload,
+    void* pvTimerID, TimerCallbackFunction_t pxCallbackFunction) {
+    auto* t = new rbsim_timer();
+    t->name = pcTimerName ? pcTimerName : "";
+    t->period = xTimerPeriodInTicks;
+    t->auto_reload = uxAutoReload;
+    t->id = pvTimerID;
+    t->callback = pxCallbackFunction;
+    t->active = false;
+    t->expiry = 0;
+
+    std::lock_guard<std::mutex> lock(g_timers_mutex);
+    g_timers.push_back(t);
+    return t;
+}
+
+BaseType_t xTimerStart(TimerHandle_t xTimer, TickType_t) {
+    return timerCommand(xTimer, true, 0);
+}
+
+BaseType_t xTimerStop(TimerHandle_t xTimer, TickType_t) {
+    return timerCommand(xTimer, false, 0);
+}
+
+BaseType_t xTimerReset(TimerHandle_t xTimer, TickType_t) {
+    return timerCommand(xTimer, true, 0);
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t xTimer, TickType_t xNewPeriod, TickType_t) {
+    return timerCommand(xTimer, true, xNewPeriod);
+}
+
+BaseType_t xTimerDelete(TimerHandle_t xTimer, TickType_t) {
+    // Freed lazily would need a command queue, the simulation keeps the memory of deleted timers.
+    std::lock_guard<std::mutex> lock(g_timers_mutex);
+    g_timers.remove(xTimer);
+    return pdPASS;
+}
+
+void* pvTimerGetTimerID(TimerHandle_t xTimer) {
+    return xTimer->id;
+}
+
+} // extern "C"
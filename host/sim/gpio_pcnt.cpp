@@ -0,0 +1,495 @@
+#include <driver/gpio.h>
+#include <driver/pcnt.h>
+
+#include <mutex>
+
+#include "rbsim.hpp"
+#include "sim_internal.hpp"
+
+pcnt_dev_t PCNT;
+
+namespace {
+
+struct Pin {
+    int level = 0;
+    bool pullup = false;
+    bool driven = false;
+    gpio_mode_t mode = GPIO_MODE_DISABLE;
+    gpio_int_type_t intr_type = GPIO_INTR_DISABLE;
+    bool intr_enabled = false;
+    gpio_isr_t isr = nullptr;
+    void* isr_arg = nullptr;
+};
+
+struct PcntChannel {
+    int pulse_io = PCNT_PIN_NOT_USED;
+    int ctrl_io = PCNT_PIN_NOT_USED;
+    pcnt_count_mode_t pos_mode = PCNT_COUNT_DIS;
+    pcnt_count_mode_t neg_mode = PCNT_COUNT_DIS;
+    pcnt_ctrl_mode_t hctrl_mode = PCNT_MODE_KEEP;
+    pcnt_ctrl_mode_t lctrl_mode = PCNT_MODE_KEEP;
+};
+
+struct PcntUnit {
+    PcntChannel channels[PCNT_CHANNEL_MAX];
+    int16_t count = 0;
+    int16_t h_lim = 0;
+    int16_t l_lim = 0;
+    int16_t thres0 = 0;
+    int16_t thres1 = 0;
+    uint32_t events = 0;
+    bool paused = false;
+    bool intr_enabled = false;
+};
+
+// Guards the pin and counter state. The interrupt handlers run after it is released,
+// they may call back into the driver functions.
+std::recursive_mutex g_mutex;
+Pin g_pins[GPIO_NUM_MAX];
+PcntUnit g_units[PCNT_UNIT_MAX];
+void (*g_pcnt_isr)(void*) = nullptr;
+void* g_pcnt_isr_arg = nullptr;
+
+bool validPin(int pin) {
+    return pin >= 0 && pin < GPIO_NUM_MAX;
+}
+
+int pinLevel(int pin) {
+    if (!validPin(pin))
+        return 0;
+    const auto& p = g_pins[pin];
+    return p.driven ? p.level : (p.pullup ? 1 : p.level);
+}
+
+int countDelta(pcnt_count_mode_t mode) {
+    switch (mode) {
+    case PCNT_COUNT_INC:
+        return 1;
+    case PCNT_COUNT_DEC:
+        return -1;
+    default:
+        return 0;
+    }
+}
+
+// Returns the status bits of the events caused by the edge.
+uint32_t pcntCount(PcntUnit& unit, int delta) {
+    unit.count += delta;
+    uint32_t status = 0;
+    if (unit.count == unit.h_lim && unit.h_lim != 0) {
+        status |= PCNT_STATUS_H_LIM_M;
+        unit.count = 0;
+    } else if (unit.count == unit.l_lim && unit.l_lim != 0) {
+        status |= PCNT_STATUS_L_LIM_M;
+        unit.count = 0;
+    }
+    if (unit.count == unit.thres0 && (unit.events & PCNT_EVT_THRES_0))
+        status |= PCNT_STATUS_THRES0_M;
+    if (unit.count == unit.thres1 && (unit.events & PCNT_EVT_THRES_1))
+        status |= PCNT_STATUS_THRES1_M;
+    if (unit.count == 0 && (unit.events & PCNT_EVT_ZERO))
+        status |= PCNT_STATUS_ZERO_M;
+    return status & unit.events;
+}
+
+void syncCounterRegister(int unit) {
+    PCNT.cnt_unit[unit].val = uint16_t(g_units[unit].count);
+}
+
+// The raw interrupt bits stay set from the event until the handler takes them, like on
+// the ESP32, so that a reader can see an event the handler hasn't taken yet.
+void pcntIsr(void*) {
+    const uint32_t taken = PCNT.int_raw.val;
+    PCNT.int_st.val = taken;
+    g_pcnt_isr(g_pcnt_isr_arg);
+    PCNT.int_raw.val &= ~taken;
+    PCNT.int_st.val = 0;
+}
+
+} // namespace
+
+namespace rbsim {
+
+void gpioDrive(gpio_num_t pin, int level) {
+    if (!validPin(pin))
+        return;
+
+    level = level ? 1 : 0;
+    gpio_isr_t isr = nullptr;
+    void* isr_arg = nullptr;
+    uint32_t pcnt_int = 0;
+
+    {
+        std::lock_guard<std::recursive_mutex> lock(g_mutex);
+        auto& p = g_pins[pin];
+        const int prev = pinLevel(pin);
+        p.driven = true;
+        p.level = level;
+        if (prev == level)
+            return;
+
+        for (int u = 0; u < PCNT_UNIT_MAX; ++u) {
+            auto& unit = g_units[u];
+            if (unit.paused)
+                continue;
+
+            uint32_t status = 0;
+            for (const auto& ch : unit.channels) {
+                if (ch.pulse_io != pin)
+                    continue;
+                int delta = countDelta(level ? ch.pos_mode : ch.neg_mode);
+                const auto ctrl = pinLevel(ch.ctrl_io) ? ch.hctrl_mode : ch.lctrl_mode;
+                if (ctrl == PCNT_MODE_REVERSE) {
+                    delta = -delta;
+                } else if (ctrl == PCNT_MODE_DISABLE) {
+                    delta = 0;
+                }
+                if (delta != 0)
+                    status |= pcntCount(unit, delta);
+            }
+
+            // The event is visible before the wrapped count is
+            if (status != 0 && unit.intr_enabled) {
+                PCNT.status_unit[u].val = status;
+                PCNT.int_raw.val |= BIT(u);
+                pcnt_int |= BIT(u);
+            }
+            syncCounterRegister(u);
+        }
+
+        const bool edge_matches = (p.intr_type == GPIO_INTR_ANYEDGE)
+            || (p.intr_type == GPIO_INTR_POSEDGE && level)
+            || (p.intr_type == GPIO_INTR_NEGEDGE && !level);
+        if (p.intr_enabled && p.isr && edge_matches) {
+            isr = p.isr;
+            isr_arg = p.isr_arg;
+        }
+    }
+
+    if (pcnt_int != 0 && g_pcnt_isr)
+        runIsr(pcntIsr, nullptr);
+
+    if (isr)
+        runIsr(isr, isr_arg);
+}
+
+int gpioLevel(gpio_num_t pin) {
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    return pinLevel(pin);
+}
+
+void quadratureMove(gpio_num_t a, gpio_num_t b, int steps) {
+    // Gray code sequence of the (A, B) states, A leads B when going forward.
+    static const int seq[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+
+    int pos = 0;
+    {
+        std::lock_guard<std::recursive_mutex> lock(g_mutex);
+        const int la = pinLevel(a);
+        const int lb = pinLevel(b);
+        for (pos = 0; pos < 4; ++pos) {
+            if (seq[pos][0] == la && seq[pos][1] == lb)
+                break;
+        }
+    }
+
+    const int dir = steps >= 0 ? 1 : -1;
+    for (int i = 0; i != steps; i += dir) {
+        const int next = (pos + dir + 4) % 4;
+        if (seq[next][0] != seq[pos][0]) {
+            gpioDrive(a, seq[next][0]);
+        } else {
+            gpioDrive(b, seq[next][1]);
+        }
+        pos = next;
+    }
+}
+
+} // namespace rbsim
+
+extern "C" {
+
+esp_err_t gpio_config(const gpio_config_t* pGPIOConfig) {
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    for (int pin = 0; pin < GPIO_NUM_MAX; ++pin) {
+        if (!(pGPIOConfig->pin_bit_mask & (1ULL << pin)))
+            continue;
+        auto& p = g_pins[pin];
+        p.mode = pGPIOConfig->mode;
+        p.pullup = pGPIOConfig->pull_up_en == GPIO_PULLUP_ENABLE;
+        p.intr_type = pGPIOConfig->intr_type;
+        p.intr_enabled = pGPIOConfig->intr_type != GPIO_INTR_DISABLE;
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level) {
+    if (!validPin(gpio_num))
+        return ESP_ERR_INVALID_ARG;
+    {
+        std::lock_guard<std::recursive_mutex> lock(g_mutex);
+        const auto& p = g_pins[gpio_num];
+        if (!(p.mode & GPIO_MODE_DEF_INPUT) || !(p.mode & GPIO_MODE_DEF_OUTPUT)) {
+            g_pins[gpio_num].level = level ? 1 : 0;
+            return ESP_OK;
+        }
+    }
+    // The output is looped back to the pin's input, like the GPIO matrix does
+    rbsim::gpioDrive(gpio_num, level);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num) {
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    return pinLevel(gpio_num);
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode) {
+    if (!validPin(gpio_num))
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    g_pins[gpio_num].mode = mode;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio_num, gpio_pull_mode_t pull) {
+    if (!validPin(gpio_num))
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    g_pins[gpio_num].pullup = pull == GPIO_PULLUP_ONLY || pull == GPIO_PULLUP_PULLDOWN;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+    if (!validPin(gpio_num))
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    g_pins[gpio_num].intr_type = intr_type;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num) {
+    if (!validPin(gpio_num))
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    g_pins[gpio_num].intr_enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num) {
+    if (!validPin(gpio_num))
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    g_pins[gpio_num].intr_enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int) {
+    return ESP_OK;
+}
+
+void gpio_uninstall_isr_service(void) {
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void* args) {
+    if (!validPin(gpio_num))
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    g_pins[gpio_num].isr = isr_handler;
+    g_pins[gpio_num].isr_arg = args;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num) {
+    return gpio_isr_handler_add(gpio_num, nullptr, nullptr);
+}
+
+void gpio_pad_select_gpio(uint8_t) {
+}
+
+void gpio_matrix_in(uint32_t, uint32_t, bool) {
+}
+
+void gpio_matrix_out(uint32_t, uint32_t, bool, bool) {
+}
+
+esp_err_t pcnt_unit_config(const pcnt_config_t* cfg) {
+    if (cfg->unit >= PCNT_UNIT_MAX || cfg->channel >= PCNT_CHANNEL_MAX)
+        return ESP_ERR_INVALID_ARG;
+
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    auto& unit = g_units[cfg->unit];
+    auto& ch = unit.channels[cfg->channel];
+    ch.pulse_io = cfg->pulse_gpio_num;
+    ch.ctrl_io = cfg->ctrl_gpio_num;
+    ch.pos_mode = cfg->pos_mode;
+    ch.neg_mode = cfg->neg_mode;
+    ch.hctrl_mode = cfg->hctrl_mode;
+    ch.lctrl_mode = cfg->lctrl_mode;
+    unit.h_lim = cfg->counter_h_lim;
+    unit.l_lim = cfg->counter_l_lim;
+    unit.count = 0;
+    syncCounterRegister(cfg->unit);
+    return ESP_OK;
+}
+
+esp_err_t pcnt_get_counter_value(pcnt_unit_t pcnt_unit, int16_t* count) {
+    if (pcnt_unit >= PCNT_UNIT_MAX)
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    *count = g_units[pcnt_unit].count;
+    return ESP_OK;
+}
+
+esp_err_t pcnt_counter_pause(pcnt_unit_t pcnt_unit) {
+    if (pcnt_unit >= PCNT_UNIT_MAX)
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    g_units[pcnt_unit].paused = true;
+    return ESP_OK;
+}
+
+esp_err_t pcnt_counter_resume(pcnt_unit_t pcnt_unit) {
+    if (pcnt_unit >= PCNT_UNIT_MAX)
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    g_units[pcnt_unit].paused = false;
+    return ESP_OK;
+}
+
+esp_err_t pcnt_counter_clear(pcnt_unit_t pcnt_unit) {
+    if (pcnt_unit >= PCNT_UNIT_MAX)
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    g_units[pcnt_unit].count = 0;
+    syncCounterRegister(pcnt_unit);
+    return ESP_OK;
+}
+
+esp_err_t pcnt_intr_enable(pcnt_unit_t pcnt_unit) {
+    if (pcnt_unit >= PCNT_UNIT_MAX)
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    g_units[pcnt_unit].intr_enabled = true;
+    PCNT.int_ena.val |= BIT(pcnt_unit);
+    return ESP_OK;
+}
+
+esp_err_t pcnt_intr_disable(pcnt_unit_t pcnt_unit) {
+    if (pcnt_unit >= PCNT_UNIT_MAX)
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    g_units[pcnt_unit].intr_enabled = false;
+    PCNT.int_ena.val &= ~BIT(pcnt_unit);
+    return ESP_OK;
+}
+
+esp_err_t pcnt_event_enable(pcnt_unit_t unit, pcnt_evt_type_t evt_type) {
+    if (unit >= PCNT_UNIT_MAX)
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    g_units[unit].events |= evt_type;
+    return ESP_OK;
+}
+
+esp_err_t pcnt_event_disable(pcnt_unit_t unit, pcnt_evt_type_t evt_type) {
+    if (unit >= PCNT_UNIT_MAX)
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    g_units[unit].events &= ~uint32_t(evt_type);
+    return ESP_OK;
+}
+
+esp_err_t pcnt_set_event_value(pcnt_unit_t unit, pcnt_evt_type_t evt_type, int16_t value) {
+    if (unit >= PCNT_UNIT_MAX)
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    auto& u = g_units[unit];
+    switch (evt_type) {
+    case PCNT_EVT_THRES_0:
+        u.thres0 = value;
+        break;
+    case PCNT_EVT_THRES_1:
+        u.thres1 = value;
+        break;
+    case PCNT_EVT_H_LIM:
+        u.h_lim = value;
+        break;
+    case PCNT_EVT_L_LIM:
+        u.l_lim = value;
+        break;
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+esp_err_t pcnt_get_event_value(pcnt_unit_t unit, pcnt_evt_type_t evt_type, int16_t* value) {
+    if (unit >= PCNT_UNIT_MAX)
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    const auto& u = g_units[unit];
+    switch (evt_type) {
+    case PCNT_EVT_THRES_0:
+        *value = u.thres0;
+        break;
+    case PCNT_EVT_THRES_1:
+        *value = u.thres1;
+        break;
+    case PCNT_EVT_H_LIM:
+        *value = u.h_lim;
+        break;
+    case PCNT_EVT_L_LIM:
+        *value = u.l_lim;
+        break;
+    default:
+        *value = 0;
+        break;
+    }
+    return ESP_OK;
+}
+
+esp_err_t pcnt_isr_register(void (*fn)(void*), void* arg, int, pcnt_isr_handle_t*) {
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    if (g_pcnt_isr)
+        return ESP_ERR_INVALID_STATE;
+    g_pcnt_isr = fn;
+    g_pcnt_isr_arg = arg;
+    return ESP_OK;
+}
+
+esp_err_t pcnt_set_pin(pcnt_unit_t unit, pcnt_channel_t channel, int pulse_io, int ctrl_io) {
+    if (unit >= PCNT_UNIT_MAX || channel >= PCNT_CHANNEL_MAX)
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    g_units[unit].channels[channel].pulse_io = pulse_io;
+    g_units[unit].channels[channel].ctrl_io = ctrl_io;
+    return ESP_OK;
+}
+
+esp_err_t pcnt_filter_enable(pcnt_unit_t unit) {
+    return unit < PCNT_UNIT_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t pcnt_filter_disable(pcnt_unit_t unit) {
+    return unit < PCNT_UNIT_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t pcnt_set_filter_value(pcnt_unit_t unit, uint16_t) {
+    return unit < PCNT_UNIT_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t pcnt_set_mode(pcnt_unit_t unit, pcnt_channel_t channel, pcnt_count_mode_t pos_mode, pcnt_count_mode_t neg_mode,
+    pcnt_ctrl_mode_t hctrl_mode, pcnt_ctrl_mode_t lctrl_mode) {
+    if (unit >= PCNT_UNIT_MAX || channel >= PCNT_CHANNEL_MAX)
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::recursive_mutex> lock(g_mutex);
+    auto& ch = g_units[unit].channels[channel];
+    ch.pos_mode = pos_mode;
+    ch.neg_mode = neg_mode;
+    ch.hctrl_mode = hctrl_mode;
+    ch.lctrl_mode = lctrl_mode;
+    return ESP_OK;
+}
+
+} // extern "C"
@@ -0,0 +1,205 @@
+#include <driver/i2c.h>
+
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "rbsim.hpp"
+
+struct rbsim_i2c_cmd {
+    enum OpType {
+        START,
+        WRITE,
+        READ,
+        STOP,
+    };
+
+    struct Op {
+        OpType type;
+        std::vector<uint8_t> data;
+        uint8_t* dest;
+    };
+
+    std::vector<Op> ops;
+};
+
+namespace {
+
+std::mutex g_mutex;
+std::map<uint8_t, rbsim::I2cDevice*> g_devices[I2C_NUM_MAX];
+rbsim::I2cStats g_stats[I2C_NUM_MAX];
+
+} // namespace
+
+namespace rbsim {
+
+void i2cAttach(i2c_port_t port, uint8_t address, I2cDevice* device) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (device) {
+        g_devices[port][address] = device;
+    } else {
+        g_devices[port].erase(address);
+    }
+}
+
+I2cStats i2cStats(i2c_port_t port) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    return g_stats[port];
+}
+
+void i2cResetStats(i2c_port_t port) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_stats[port] = I2cStats();
+}
+
+I2cRegisterDevice::I2cRegisterDevice()
+    : m_ptr(0)
+    , m_addressed(false)
+    , m_writes(0) {
+    memset(m_regs, 0, sizeof(m_regs));
+}
+
+uint8_t I2cRegisterDevice::reg(uint8_t addr) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_regs[addr];
+}
+
+void I2cRegisterDevice::setReg(uint8_t addr, uint8_t value) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_regs[addr] = value;
+}
+
+uint32_t I2cRegisterDevice::writes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_writes;
+}
+
+void I2cRegisterDevice::start(bool read) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_addressed = read;
+}
+
+void I2cRegisterDevice::write(uint8_t data) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_addressed) {
+        m_ptr = data;
+        m_addressed = true;
+    } else {
+        m_regs[m_ptr++] = data;
+        ++m_writes;
+    }
+}
+
+uint8_t I2cRegisterDevice::read() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_regs[m_ptr++];
+}
+
+} // namespace rbsim
+
+extern "C" {
+
+esp_err_t i2c_param_config(i2c_port_t i2c_num, const i2c_config_t*) {
+    return i2c_num < I2C_NUM_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t i2c_num, i2c_mode_t, size_t, size_t, int) {
+    return i2c_num < I2C_NUM_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t i2c_driver_delete(i2c_port_t i2c_num) {
+    return i2c_num < I2C_NUM_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create(void) {
+    return new rbsim_i2c_cmd();
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle) {
+    delete cmd_handle;
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd_handle) {
+    cmd_handle->ops.push_back({ rbsim_i2c_cmd::START, {}, nullptr });
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd_handle, uint8_t data, bool) {
+    cmd_handle->ops.push_back({ rbsim_i2c_cmd::WRITE, { data }, nullptr });
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd_handle, const uint8_t* data, size_t data_len, bool) {
+    cmd_handle->ops.push_back({ rbsim_i2c_cmd::WRITE, std::vector<uint8_t>(data, data + data_len), nullptr });
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd_handle, uint8_t* data, i2c_ack_type_t) {
+    return i2c_master_read(cmd_handle, data, 1, I2C_MASTER_NACK);
+}
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd_handle, uint8_t* data, size_t data_len, i2c_ack_type_t) {
+    cmd_handle->ops.push_back({ rbsim_i2c_cmd::READ, std::vector<uint8_t>(data_len), data });
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd_handle) {
+    cmd_handle->ops.push_back({ rbsim_i2c_cmd::STOP, {}, nullptr });
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t i2c_num, i2c_cmd_handle_t cmd_handle, TickType_t) {
+    if (i2c_num >= I2C_NUM_MAX)
+        return ESP_ERR_INVALID_ARG;
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    auto& stats = g_stats[i2c_num];
+    ++stats.transactions;
+    for (const auto& op : cmd_handle->ops) {
+        if (op.type == rbsim_i2c_cmd::START || op.type == rbsim_i2c_cmd::STOP) {
+            ++stats.clocks;
+        } else {
+            stats.bytes += op.data.size();
+            stats.clocks += op.data.size() * 9;
+        }
+    }
+
+    rbsim::I2cDevice* dev = nullptr;
+    bool expect_address = false;
+    for (const auto& op : cmd_handle->ops) {
+        switch (op.type) {
+        case rbsim_i2c_cmd::START:
+            expect_address = true;
+            break;
+        case rbsim_i2c_cmd::WRITE:
+            for (size_t i = 0; i < op.data.size(); ++i) {
+                if (expect_address) {
+                    auto itr = g_devices[i2c_num].find(op.data[i] >> 1);
+                    if (itr == g_devices[i2c_num].end())
+                        return ESP_FAIL;
+                    dev = itr->second;
+                    dev->start(op.data[i] & I2C_MASTER_READ);
+                    expect_address = false;
+                } else if (dev) {
+                    dev->write(op.data[i]);
+                }
+            }
+            break;
+        case rbsim_i2c_cmd::READ:
+            if (!dev)
+                return ESP_FAIL;
+            for (size_t i = 0; i < op.data.size(); ++i)
+                op.dest[i] = dev->read();
+            break;
+        case rbsim_i2c_cmd::STOP:
+            if (dev)
+                dev->stop();
+            dev = nullptr;
+            break;
+        }
+    }
+    return ESP_OK;
+}
+
+} // extern "C"
@@ -0,0 +1,76 @@
+// Replaces src/i2s_parallel.c, which programs the I2S and DMA registers directly.
+// The DMA "sends" the buffer chosen by the last flip, tests read it via rbsim::i2sParallelBuffer.
+
+#include <i2s_parallel.h>
+
+#include <atomic>
+#include <mutex>
+
+#include "rbsim.hpp"
+
+i2s_dev_t I2S0 = { 0 };
+i2s_dev_t I2S1 = { 1 };
+
+namespace {
+
+struct State {
+    bool setup = false;
+    const i2s_parallel_buffer_desc_t* buffers[I2S_PARALLEL_MAX_BUFFERS] = {};
+    int bufcount = 0;
+    std::atomic<int> active { -1 };
+};
+
+std::mutex g_mutex;
+State g_state[2];
+
+} // namespace
+
+namespace rbsim {
+
+int i2sParallelActiveBuffer(int i2s) {
+    return g_state[i2s].active.load();
+}
+
+const i2s_parallel_buffer_desc_t* i2sParallelBuffer(int i2s, int bufid) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    const auto& st = g_state[i2s];
+    return bufid >= 0 && bufid < st.bufcount ? st.buffers[bufid] : nullptr;
+}
+
+} // namespace rbsim
+
+extern "C" {
+
+int i2snum(i2s_dev_t* dev) {
+    return (dev == &I2S0) ? 0 : 1;
+}
+
+void i2s_parallel_setup(i2s_dev_t* dev, const i2s_parallel_config_t* cfg) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    auto& st = g_state[i2snum(dev)];
+    st.setup = true;
+    st.buffers[0] = cfg->bufa;
+    st.buffers[1] = cfg->bufb;
+    st.bufcount = 2;
+    st.active = 0;
+}
+
+int i2s_parallel_add_buffer(i2s_dev_t* dev, i2s_parallel_buffer_desc_t* buf) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    auto& st = g_state[i2snum(dev)];
+    if (!st.setup || st.bufcount >= I2S_PARALLEL_MAX_BUFFERS)
+        return -1;
+    st.buffers[st.bufcount] = buf;
+    return st.bufcount++;
+}
+
+void i2s_parallel_flip_to_buffer(i2s_dev_t* dev, int bufid) {
+    // Called from critical sections and ISRs, so only the atomic is touched.
+    // Buffers are only ever added, a valid id stays valid.
+    auto& st = g_state[i2snum(dev)];
+    if (bufid < 0 || bufid >= I2S_PARALLEL_MAX_BUFFERS || !st.buffers[bufid])
+        return;
+    st.active = bufid;
+}
+
+} // extern "C"
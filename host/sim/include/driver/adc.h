@@ -0,0 +1,52 @@
+#pragma once
+
+#include "esp_err.h"
+
+typedef enum {
+    ADC_UNIT_1 = 1,
+    ADC_UNIT_2 = 2,
+} adc_unit_t;
+
+typedef enum {
+    ADC1_CHANNEL_0 = 0,
+    ADC1_CHANNEL_1,
+    ADC1_CHANNEL_2,
+    ADC1_CHANNEL_3,
+    ADC1_CHANNEL_4,
+    ADC1_CHANNEL_5,
+    ADC1_CHANNEL_6,
+    ADC1_CHANNEL_7,
+    ADC1_CHANNEL_MAX,
+} adc1_channel_t;
+
+typedef enum {
+    ADC_ATTEN_DB_0 = 0,
+    ADC_ATTEN_DB_2_5 = 1,
+    ADC_ATTEN_DB_6 = 2,
+    ADC_ATTEN_DB_11 = 3,
+} adc_atten_t;
+
+typedef enum {
+    ADC_WIDTH_BIT_9 = 0,
+    ADC_WIDTH_BIT_10 = 1,
+    ADC_WIDTH_BIT_11 = 2,
+    ADC_WIDTH_BIT_12 = 3,
+} adc_bits_width_t;
+
+#define ADC_WIDTH_9Bit ADC_WIDTH_BIT_9
+#define ADC_WIDTH_10Bit ADC_WIDTH_BIT_10
+#define ADC_WIDTH_11Bit ADC_WIDTH_BIT_11
+#define ADC_WIDTH_12Bit ADC_WIDTH_BIT_12
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns the value set by rbsim::adcSet.
+int adc1_get_raw(adc1_channel_t channel);
+esp_err_t adc1_config_width(adc_bits_width_t width_bit);
+esp_err_t adc1_config_channel_atten(adc1_channel_t channel, adc_atten_t atten);
+
+#ifdef __cplusplus
+}
+#endif
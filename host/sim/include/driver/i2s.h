@@ -0,0 +1,20 @@
+#pragma once
+
+#include "esp_err.h"
+#include "soc/i2s_struct.h"
+
+typedef enum {
+    I2S_NUM_0 = 0x0,
+    I2S_NUM_1 = 0x1,
+    I2S_NUM_MAX,
+} i2s_port_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t i2s_driver_uninstall(i2s_port_t i2s_num);
+
+#ifdef __cplusplus
+}
+#endif
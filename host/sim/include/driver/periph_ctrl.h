@@ -0,0 +1,24 @@
+#pragma once
+
+typedef enum {
+    PERIPH_LEDC_MODULE = 0,
+    PERIPH_UART0_MODULE,
+    PERIPH_UART1_MODULE,
+    PERIPH_UART2_MODULE,
+    PERIPH_I2C0_MODULE,
+    PERIPH_I2C1_MODULE,
+    PERIPH_I2S0_MODULE,
+    PERIPH_I2S1_MODULE,
+    PERIPH_PCNT_MODULE,
+} periph_module_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void periph_module_enable(periph_module_t periph);
+void periph_module_disable(periph_module_t periph);
+
+#ifdef __cplusplus
+}
+#endif
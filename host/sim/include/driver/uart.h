@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "driver/gpio.h"
+#include "esp_err.h"
+#include "esp_intr_alloc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#define UART_FIFO_LEN (128)
+#define UART_PIN_NO_CHANGE (-1)
+
+typedef enum {
+    UART_NUM_0 = 0x0,
+    UART_NUM_1 = 0x1,
+    UART_NUM_2 = 0x2,
+    UART_NUM_MAX,
+} uart_port_t;
+
+typedef enum {
+    UART_MODE_UART = 0x00,
+    UART_MODE_RS485_HALF_DUPLEX = 0x01,
+    UART_MODE_IRDA = 0x02,
+    UART_MODE_RS485_COLLISION_DETECT = 0x03,
+    UART_MODE_RS485_APP_CTRL = 0x04,
+} uart_mode_t;
+
+typedef enum {
+    UART_DATA_5_BITS = 0x0,
+    UART_DATA_6_BITS = 0x1,
+    UART_DATA_7_BITS = 0x2,
+    UART_DATA_8_BITS = 0x3,
+    UART_DATA_BITS_MAX = 0x4,
+} uart_word_length_t;
+
+typedef enum {
+    UART_STOP_BITS_1 = 0x1,
+    UART_STOP_BITS_1_5 = 0x2,
+    UART_STOP_BITS_2 = 0x3,
+    UART_STOP_BITS_MAX = 0x4,
+} uart_stop_bits_t;
+
+typedef enum {
+    UART_PARITY_DISABLE = 0x0,
+    UART_PARITY_EVEN = 0x2,
+    UART_PARITY_ODD = 0x3,
+} uart_parity_t;
+
+typedef enum {
+    UART_HW_FLOWCTRL_DISABLE = 0x0,
+    UART_HW_FLOWCTRL_RTS = 0x1,
+    UART_HW_FLOWCTRL_CTS = 0x2,
+    UART_HW_FLOWCTRL_CTS_RTS = 0x3,
+    UART_HW_FLOWCTRL_MAX = 0x4,
+} uart_hw_flowcontrol_t;
+
+typedef struct {
+    int baud_rate;
+    uart_word_length_t data_bits;
+    uart_parity_t parity;
+    uart_stop_bits_t stop_bits;
+    uart_hw_flowcontrol_t flow_ctrl;
+    uint8_t rx_flow_ctrl_thresh;
+    bool use_ref_tick;
+} uart_config_t;
+
+typedef struct {
+    uint32_t intr_enable_mask;
+    uint8_t rx_timeout_thresh;
+    uint8_t txfifo_empty_intr_thresh;
+    uint8_t rxfifo_full_thresh;
+} uart_intr_config_t;
+
+typedef intr_handle_t uart_isr_handle_t;
+
+typedef enum {
+    UART_SELECT_READ_NOTIF,
+    UART_SELECT_WRITE_NOTIF,
+    UART_SELECT_ERROR_NOTIF,
+} uart_select_notif_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The standard driver's transmit, see rbsim::uartAttach. Unlike the half-duplex
+// driver, nothing is echoed back.
+int uart_write_bytes(uart_port_t uart_num, const char* src, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "esp_err.h"
+
+#define ESP_INTR_FLAG_LEVEL1 (1 << 1)
+#define ESP_INTR_FLAG_SHARED (1 << 8)
+#define ESP_INTR_FLAG_EDGE (1 << 9)
+#define ESP_INTR_FLAG_IRAM (1 << 10)
+#define ESP_INTR_FLAG_INTRDISABLED (1 << 11)
+#define ESP_INTR_FLAG_DEFAULT 0
+
+typedef struct rbsim_intr_handle* intr_handle_t;
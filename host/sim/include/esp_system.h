@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The simulation ends the process, see rbsim::exitProcess.
+void esp_deep_sleep_start(void) __attribute__((noreturn));
+void esp_restart(void) __attribute__((noreturn));
+uint32_t esp_get_free_heap_size(void);
+
+#ifdef __cplusplus
+}
+#endif
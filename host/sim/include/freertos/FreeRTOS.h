@@ -0,0 +1,68 @@
+#pragma once
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdPASS (pdTRUE)
+#define pdFAIL (pdFALSE)
+#define errQUEUE_EMPTY ((BaseType_t)0)
+#define errQUEUE_FULL ((BaseType_t)0)
+
+#define configTICK_RATE_HZ 1000
+#define configMAX_PRIORITIES 25
+#define configMINIMAL_STACK_SIZE 768
+#define portNUM_PROCESSORS 2
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(xTimeInMs) ((TickType_t)(((TickType_t)(xTimeInMs) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000))
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+typedef struct rbsim_task* TaskHandle_t;
+typedef struct rbsim_queue* QueueHandle_t;
+typedef struct rbsim_timer* TimerHandle_t;
+
+// All critical sections share one recursive lock, which the simulated interrupts take as well.
+typedef struct {
+    uint32_t owner;
+    uint32_t count;
+} portMUX_TYPE;
+
+#define portMUX_FREE_VAL 0xB33FFFFF
+#define portMUX_INITIALIZER_UNLOCKED \
+    { portMUX_FREE_VAL, 0 }
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void vPortEnterCritical(portMUX_TYPE* mux);
+void vPortExitCritical(portMUX_TYPE* mux);
+BaseType_t xPortGetCoreID(void);
+BaseType_t xPortInIsrContext(void);
+void vPortYield(void);
+void vPortFree(void* pv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define portENTER_CRITICAL(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) vPortExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux) vPortExitCritical(mux)
+#define portYIELD() vPortYield()
+#define portYIELD_FROM_ISR() vPortYield()
+#define taskYIELD() vPortYield()
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+#define queueSEND_TO_BACK ((BaseType_t)0)
+#define queueSEND_TO_FRONT ((BaseType_t)1)
+#define queueOVERWRITE ((BaseType_t)2)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+QueueHandle_t xQueueGenericCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize);
+void vQueueDelete(QueueHandle_t xQueue);
+BaseType_t xQueueGenericSend(QueueHandle_t xQueue, const void* pvItemToQueue, TickType_t xTicksToWait, BaseType_t xCopyPosition);
+BaseType_t xQueueGenericSendFromISR(QueueHandle_t xQueue, const void* pvItemToQueue, BaseType_t* pxHigherPriorityTaskWoken, BaseType_t xCopyPosition);
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void* pvBuffer, TickType_t xTicksToWait);
+BaseType_t xQueueReceiveFromISR(QueueHandle_t xQueue, void* pvBuffer, BaseType_t* pxHigherPriorityTaskWoken);
+BaseType_t xQueuePeek(QueueHandle_t xQueue, void* pvBuffer, TickType_t xTicksToWait);
+BaseType_t xQueueReset(QueueHandle_t xQueue);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue);
+UBaseType_t uxQueueMessagesWaitingFromISR(QueueHandle_t xQueue);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t xQueue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define xQueueCreate(uxQueueLength, uxItemSize) xQueueGenericCreate((uxQueueLength), (uxItemSize))
+#define xQueueSend(xQueue, pvItemToQueue, xTicksToWait) xQueueGenericSend((xQueue), (pvItemToQueue), (xTicksToWait), queueSEND_TO_BACK)
+#define xQueueSendToBack(xQueue, pvItemToQueue, xTicksToWait) xQueueGenericSend((xQueue), (pvItemToQueue), (xTicksToWait), queueSEND_TO_BACK)
+#define xQueueSendToFront(xQueue, pvItemToQueue, xTicksToWait) xQueueGenericSend((xQueue), (pvItemToQueue), (xTicksToWait), queueSEND_TO_FRONT)
+#define xQueueOverwrite(xQueue, pvItemToQueue) xQueueGenericSend((xQueue), (pvItemToQueue), 0, queueOVERWRITE)
+#define xQueueSendFromISR(xQueue, pvItemToQueue, pxWoken) xQueueGenericSendFromISR((xQueue), (pvItemToQueue), (pxWoken), queueSEND_TO_BACK)
+#define xQueueSendToBackFromISR(xQueue, pvItemToQueue, pxWoken) xQueueGenericSendFromISR((xQueue), (pvItemToQueue), (pxWoken), queueSEND_TO_BACK)
+#define xQueueSendToFrontFromISR(xQueue, pvItemToQueue, pxWoken) xQueueGenericSendFromISR((xQueue), (pvItemToQueue), (pxWoken), queueSEND_TO_FRONT)
+#define xQueueOverwriteFromISR(xQueue, pvItemToQueue, pxWoken) xQueueGenericSendFromISR((xQueue), (pvItemToQueue), (pxWoken), queueOVERWRITE)
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+// Semaphores are queues of zero-sized items, as in FreeRTOS. The mutexes are not recursive
+// and have no priority inheritance.
+#define xSemaphoreCreateBinary() xQueueGenericCreate(1, 0)
+#define xSemaphoreCreateCounting(uxMaxCount, uxInitialCount) rbsim_semaphore_create((uxMaxCount), (uxInitialCount))
+#define xSemaphoreCreateMutex() rbsim_semaphore_create(1, 1)
+#define vSemaphoreDelete(xSemaphore) vQueueDelete((xSemaphore))
+#define xSemaphoreTake(xSemaphore, xBlockTime) xQueueReceive((xSemaphore), NULL, (xBlockTime))
+#define xSemaphoreGive(xSemaphore) xQueueGenericSend((xSemaphore), NULL, 0, queueSEND_TO_BACK)
+#define xSemaphoreTakeFromISR(xSemaphore, pxWoken) xQueueReceiveFromISR((xSemaphore), NULL, (pxWoken))
+#define xSemaphoreGiveFromISR(xSemaphore, pxWoken) xQueueGenericSendFromISR((xSemaphore), NULL, (pxWoken), queueSEND_TO_BACK)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+SemaphoreHandle_t rbsim_semaphore_create(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <driver/adc.h>
+#include <driver/gpio.h>
+#include <driver/i2c.h>
+#include <driver/uart.h>
+#include <i2s_parallel.h>
+
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * \brief Control of the simulated ESP32 peripherals, for host tests and benchmarks.
+ *
+ * The library is built against the ESP-IDF headers in host/sim/include, which are
+ * implemented on top of POSIX threads. The functions here play the outside world:
+ * they drive the input pins, attach I2C and UART devices and read the outputs.
+ */
+namespace rbsim {
+
+/**
+ * \brief Drive an input pin from the outside.
+ *
+ * Runs the simulated PCNT counters and GPIO interrupts of the edge, from the calling thread.
+ */
+void gpioDrive(gpio_num_t pin, int level);
+
+//! Returns the level of the pin, as driven by gpioDrive or set by gpio_set_level.
+int gpioLevel(gpio_num_t pin);
+
+/**
+ * \brief Move a quadrature encoder connected to pins a and b.
+ * \param steps number of signal edges, A leads B for positive steps
+ */
+void quadratureMove(gpio_num_t a, gpio_num_t b, int steps);
+
+//! Set the raw value returned by adc1_get_raw. The default gives ~8 V on the battery input.
+void adcSet(adc1_channel_t channel, int raw);
+
+//! Make every adc1_get_raw call busy-wait for us microseconds, like a real conversion. 0 by default.
+void adcSetConversionTime(uint32_t us);
+
+/**
+ * \brief The longest time one esp_timer callback ran, in microseconds of CPU time.
+ *
+ * All the ESP_TIMER_TASK callbacks share one task, this is how long the others had to wait.
+ * The host preempting the dispatcher thread doesn't count, so the value is repeatable.
+ * Counts the callbacks since the start or the previous call with reset.
+ */
+uint32_t espTimerLongestCallbackUs(bool reset = false);
+
+//! Make heap_caps_malloc fail after this many more allocations, -1 (the default) never fails.
+void heapFailAfter(int allocations);
+
+//! Returns the number of heap_caps_malloc allocations not freed yet.
+int heapCapsAllocated();
+
+/**
+ * \brief I2C slave, see {@link i2cAttach}.
+ */
+class I2cDevice {
+public:
+    virtual ~I2cDevice() {}
+
+    virtual void start(bool read) {} //!< Called after START and the device's address
+    virtual void write(uint8_t data) = 0;
+    virtual uint8_t read() = 0;
+    virtual void stop() {}
+};
+
+/**
+ * \brief I2C device with 8-bit registers, e.g. the MCP23017 expander in its default mode.
+ *
+ * The first byte written after START selects the register, the following
+ * writes and reads auto-increment it.
+ */
+class I2cRegisterDevice : public I2cDevice {
+public:
+    I2cRegisterDevice();
+
+    uint8_t reg(uint8_t addr) const;
+    void setReg(uint8_t addr, uint8_t value);
+
+    //! Number of data bytes written to the device, to count the bus traffic.
+    uint32_t writes() const;
+
+    void start(bool read) override;
+    void write(uint8_t data) override;
+    uint8_t read() override;
+
+private:
+    mutable std::mutex m_mutex;
+    uint8_t m_regs[256];
+    uint8_t m_ptr;
+    bool m_addressed;
+    uint32_t m_writes;
+};
+
+//! Attach the device to the bus, nullptr detaches it. Commands to missing devices fail with ESP_FAIL.
+void i2cAttach(i2c_port_t port, uint8_t address, I2cDevice* device);
+
+/**
+ * \brief Traffic on an I2C bus, see {@link i2cStats}.
+ */
+struct I2cStats {
+    uint32_t transactions; //!< i2c_master_cmd_begin calls
+    uint32_t bytes; //!< Bytes on the bus, the address bytes included
+    uint32_t clocks; //!< SCL periods: 9 per byte, 1 per start and stop
+
+    //! Time the bus was busy at the given clock speed.
+    uint32_t busTimeUs(uint32_t clockHz = 100000) const {
+        return uint64_t(clocks) * 1000000 / clockHz;
+    }
+};
+
+//! The traffic since the start or the last {@link i2cResetStats}.
+I2cStats i2cStats(i2c_port_t port);
+void i2cResetStats(i2c_port_t port);
+
+/**
+ * \brief Device on a half-duplex UART bus, see {@link uartAttach}.
+ *
+ * Called with every transmitted buffer, returns the response bytes.
+ */
+typedef std::function<std::vector<uint8_t>(const uint8_t* data, size_t len)> UartDevice;
+
+//! The bus receives its own transmission back, followed by the device's response.
+//! The standard driver's uart_write_bytes is passed to the device too, without the echo.
+void uartAttach(uart_port_t port, UartDevice device);
+
+//! Returns the id of the buffer the I2S-parallel DMA is sending, -1 before setup.
+int i2sParallelActiveBuffer(int i2s);
+
+//! Returns the descriptor chain of the buffer, terminated by a null memory pointer.
+const i2s_parallel_buffer_desc_t* i2sParallelBuffer(int i2s, int bufid);
+
+//! By default esp_deep_sleep_start ends the process, otherwise it blocks the calling task forever.
+void deepSleepEndsProcess(bool end);
+
+//! Returns how many times esp_deep_sleep_start was called.
+uint32_t deepSleepCount();
+
+/**
+ * \brief End the process with the exit code.
+ *
+ * The library's tasks never return and the Manager is a static singleton,
+ * so tests call this instead of returning from main.
+ */
+void exitProcess(int code) __attribute__((noreturn));
+
+} // namespace rbsim
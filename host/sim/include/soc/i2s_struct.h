@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The simulated I2S peripherals have no registers, only their identity matters.
+typedef volatile struct i2s_dev_s {
+    uint32_t num;
+} i2s_dev_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern i2s_dev_t I2S0;
+extern i2s_dev_t I2S1;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,4 @@
+#pragma once
+
+#define PIN_FUNC_GPIO 2
+#define PIN_FUNC_SELECT(PIN_NAME, FUNC) ((void)(PIN_NAME), (void)(FUNC))
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+
+// Only the registers accessed by the library, written by the simulated PCNT.
+typedef volatile struct {
+    union {
+        struct {
+            uint32_t cnt_val : 16;
+            uint32_t reserved16 : 16;
+        };
+        uint32_t val;
+    } cnt_unit[8];
+    union {
+        uint32_t val;
+    } int_raw;
+    union {
+        uint32_t val;
+    } int_st;
+    union {
+        uint32_t val;
+    } int_ena;
+    union {
+        uint32_t val;
+    } int_clr;
+    union {
+        uint32_t val;
+    } status_unit[8];
+} pcnt_dev_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern pcnt_dev_t PCNT;
+
+#ifdef __cplusplus
+}
+#endif
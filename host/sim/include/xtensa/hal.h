@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Cycles of a simulated 240 MHz CPU, derived from the host's monotonic clock.
+uint32_t xthal_get_ccount(void);
+
+#ifdef __cplusplus
+}
+#endif
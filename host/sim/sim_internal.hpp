@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace rbsim {
+
+// Runs the simulated interrupt handler with the critical section lock held,
+// so that it is atomic against portENTER_CRITICAL sections like on the ESP32.
+void runIsr(void (*fn)(void*), void* arg);
+
+// Nanoseconds since the start of the process.
+uint64_t uptimeNs();
+
+} // namespace rbsim
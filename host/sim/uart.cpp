@@ -0,0 +1,110 @@
+// Replaces src/half_duplex_uart.cpp. A transmission is echoed back into the
+// receive buffer, followed by the response of the attached device.
+
+#include "half_duplex_uart.h"
+
+#include <deque>
+#include <mutex>
+
+#include "rbsim.hpp"
+
+namespace {
+
+struct Port {
+    bool installed = false;
+    std::deque<uint8_t> rx;
+    rbsim::UartDevice device;
+};
+
+std::mutex g_mutex;
+Port g_ports[UART_NUM_MAX];
+
+} // namespace
+
+namespace rbsim {
+
+void uartAttach(uart_port_t port, UartDevice device) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_ports[port].device = device;
+}
+
+} // namespace rbsim
+
+namespace rb {
+namespace half_duplex {
+
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t*) {
+    return uart_num < UART_NUM_MAX ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int, int, int, QueueHandle_t*, int) {
+    if (uart_num >= UART_NUM_MAX)
+        return ESP_FAIL;
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_ports[uart_num].installed = true;
+    return ESP_OK;
+}
+
+void uart_set_half_duplex_pin(uart_port_t, gpio_num_t) {
+}
+
+int uart_tx_chars(uart_port_t uart_num, const char* buffer, uint32_t len) {
+    if (uart_num >= UART_NUM_MAX || !buffer)
+        return -1;
+
+    std::unique_lock<std::mutex> lock(g_mutex);
+    auto& port = g_ports[uart_num];
+    port.rx.insert(port.rx.end(), buffer, buffer + len);
+
+    // The device may call uartAttach, run it unlocked.
+    auto device = port.device;
+    lock.unlock();
+    if (!device)
+        return len;
+
+    const auto response = device(reinterpret_cast<const uint8_t*>(buffer), len);
+    lock.lock();
+    port.rx.insert(port.rx.end(), response.begin(), response.end());
+    return len;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t uart_num, size_t* size) {
+    if (uart_num >= UART_NUM_MAX)
+        return ESP_FAIL;
+    std::lock_guard<std::mutex> lock(g_mutex);
+    *size = g_ports[uart_num].rx.size();
+    return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t uart_num, uint8_t* buf, uint32_t length, TickType_t) {
+    if (uart_num >= UART_NUM_MAX || !buf)
+        return -1;
+    std::lock_guard<std::mutex> lock(g_mutex);
+    auto& rx = g_ports[uart_num].rx;
+    uint32_t n = 0;
+    while (n < length && !rx.empty()) {
+        buf[n++] = rx.front();
+        rx.pop_front();
+    }
+    return n;
+}
+
+} // namespace half_duplex
+} // namespace rb
+
+extern "C" int uart_write_bytes(uart_port_t uart_num, const char* src, size_t size) {
+    if (uart_num >= UART_NUM_MAX || !src)
+        return -1;
+
+    std::unique_lock<std::mutex> lock(g_mutex);
+    auto device = g_ports[uart_num].device;
+    lock.unlock();
+    if (!device)
+        return size;
+
+    const auto response = device(reinterpret_cast<const uint8_t*>(src), size);
+    lock.lock();
+    auto& rx = g_ports[uart_num].rx;
+    rx.insert(rx.end(), response.begin(), response.end());
+    return size;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+/**
+ * \brief First-order model of a DC motor with an encoder, for closing the control loops on the host.
+ *
+ * The speed follows power * gain with the time constant tau. The load is a constant torque,
+ * expressed as the speed it takes away, e.g. gravity on an arm. Without an integral term,
+ * a regulator holding it leaves a steady-state error.
+ */
+struct DcMotorModel {
+    DcMotorModel(float gain, float tau, float load)
+        : gain(gain)
+        , tau(tau)
+        , load(load)
+        , speed(0.f)
+        , position(0.f) {}
+
+    void step(float power, float dt) {
+        speed += (gain * power - load - speed) * dt / tau;
+        position += speed * dt;
+    }
+
+    float gain; //!< Steady speed per percent of power, edges/s
+    float tau; //!< Time constant, seconds
+    float load; //!< Speed taken away by the load, edges/s
+    float speed; //!< edges/s
+    float position; //!< edges
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "rbsim.hpp"
+
+/**
+ * \brief Decode one SerialPWM channel from the buffer the simulated I2S-parallel DMA is sending.
+ *
+ * The channel's value is the number of samples with its bit set, see SerialPWM::render.
+ * \param channels the SerialPWM's channels per data pin
+ * \param bytes bytes per sample of one channel, ((data pins + test pin) / 8) + 1
+ */
+inline int decodePwm(int i2s, int channel, int channels, int bytes) {
+    const auto* desc = rbsim::i2sParallelBuffer(i2s, rbsim::i2sParallelActiveBuffer(i2s));
+    if (!desc)
+        return -1;
+
+    const int byte = (channel % channels) * bytes + ((channel / channels) >> 3);
+    const uint8_t bit = 1 << ((channel / channels) & 7);
+    int value = 0;
+    for (; desc->memory != nullptr; ++desc) {
+        if (static_cast<const uint8_t*>(desc->memory)[byte] & bit)
+            ++value;
+    }
+    return value;
+}
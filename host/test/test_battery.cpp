@@ -0,0 +1,288 @@
+// Battery voltage: the ADC filter and the load compensation on synthetic voltage traces,
+// then the battery sampling on the simulated ADC, without holding up the timer task for long.
+
+#include <atomic>
+#include <esp_timer.h>
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <vector>
+
+#include "RBControl_adcFilter.hpp"
+#include "RBControl_batteryModel.hpp"
+#include "RBControl_manager.hpp"
+
+#include "unity_host.hpp"
+
+using namespace rb;
+
+// The simulated conversion time of adc1_get_raw
+static const uint32_t CONVERSION_US = 200;
+
+// Noise around level, with the given standard deviation, reproducible
+static std::vector<uint16_t> noisyTrace(uint16_t level, float sigma, size_t length, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0.f, sigma);
+    std::vector<uint16_t> res;
+    for (size_t i = 0; i != length; ++i)
+        res.push_back(uint16_t(lroundf(level + noise(rng))));
+    return res;
+}
+
+static float deviation(const std::vector<uint16_t>& values, uint16_t level) {
+    double sum = 0;
+    for (auto v : values)
+        sum += (double(v) - level) * (double(v) - level);
+    return sqrt(sum / values.size());
+}
+
+static void testFilterSmoothsNoise() {
+    const auto trace = noisyTrace(3000, 30.f, 2000, 1);
+    AdcFilter filter;
+    filter.reset(trace[0]);
+
+    std::vector<uint16_t> out;
+    for (auto s : trace)
+        out.push_back(filter.add(s));
+
+    const float in = deviation(trace, 3000);
+    const float filtered = deviation(out, 3000);
+    TEST_ASSERT_TRUE(in > 25.f);
+    TEST_ASSERT_TRUE(filtered < in / 4);
+}
+
+static void testFilterRejectsSpikes() {
+    // Single-sample spikes, e.g. from the motors switching, don't get through the median
+    auto trace = noisyTrace(3000, 2.f, 500, 2);
+    for (size_t i = 10; i < trace.size(); i += 7)
+        trace[i] = (i & 1) ? 4095 : 0;
+
+    AdcFilter filter;
+    filter.reset(3000);
+    for (auto s : trace) {
+        const int v = filter.add(s);
+        TEST_ASSERT_TRUE(abs(v - 3000) <= 4);
+    }
+}
+
+static void testFilterFollowsStep() {
+    // A load step, e.g. the motors starting: settles within ~5 time constants
+    AdcFilter filter(4);
+    filter.reset(3000);
+    int samples = 0;
+    while (filter.add(2800) > 2802)
+        ++samples;
+    TEST_ASSERT_TRUE(samples >= 16);
+    TEST_ASSERT_TRUE(samples <= 16 * 5);
+    TEST_ASSERT_EQUAL_INT(2800, filter.median());
+
+    // And settles exactly, without a rounding bias
+    for (int i = 0; i != 200; ++i)
+        filter.add(2800);
+    TEST_ASSERT_EQUAL_INT(2800, filter.value());
+}
+
+static void testFilterMedian() {
+    AdcFilter filter;
+    filter.reset(10);
+    filter.add(50);
+    filter.add(1);
+    TEST_ASSERT_EQUAL_INT(10, filter.median());
+    filter.add(40);
+    filter.add(30);
+    filter.add(20); // 50 1 40 30 20
+    TEST_ASSERT_EQUAL_INT(30, filter.median());
+}
+
+static void testStateOfCharge() {
+    TEST_ASSERT_EQUAL_INT(0, BatteryModel::stateOfCharge(3000));
+    TEST_ASSERT_EQUAL_INT(0, BatteryModel::stateOfCharge(3300));
+    TEST_ASSERT_EQUAL_INT(50, BatteryModel::stateOfCharge(3840));
+    TEST_ASSERT_EQUAL_INT(83, BatteryModel::stateOfCharge(4060));
+    TEST_ASSERT_EQUAL_INT(100, BatteryModel::stateOfCharge(4200));
+    TEST_ASSERT_EQUAL_INT(100, BatteryModel::stateOfCharge(4300));
+
+    uint8_t prev = 0;
+    for (uint32_t mv = 3300; mv <= 4200; ++mv) {
+        const uint8_t soc = BatteryModel::stateOfCharge(mv);
+        TEST_ASSERT_TRUE(soc >= prev);
+        prev = soc;
+    }
+}
+
+// A battery with 150mOhm and motors taking 1A each at full power, sampled every 20ms.
+// The motors' current lags behind the commanded duty, like a real motor's would.
+struct DischargeTrace {
+    std::vector<uint32_t> duty;
+    std::vector<uint32_t> openCircuitMv;
+    std::vector<uint16_t> measuredMv;
+};
+
+static DischargeTrace dischargeTrace(uint32_t startMv, uint32_t endMv, size_t length) {
+    std::mt19937 rng(3);
+    std::normal_distribution<float> noise(0.f, 15.f);
+    std::uniform_int_distribution<uint32_t> load(0, 200);
+
+    DischargeTrace res;
+    uint32_t duty = 0;
+    float currentMa = 0;
+    for (size_t i = 0; i != length; ++i) {
+        // Driving around: the load changes every second
+        if (i % 50 == 0)
+            duty = i % 100 == 0 ? load(rng) : 0;
+        currentMa += (duty * 10.f - currentMa) / 3;
+
+        const uint32_t ocv = startMv - (startMv - endMv) * i / length;
+        res.duty.push_back(duty);
+        res.openCircuitMv.push_back(ocv);
+        res.measuredMv.push_back(uint16_t(lroundf(ocv - currentMa * 0.150f + noise(rng))));
+    }
+    return res;
+}
+
+static void testModelCompensatesLoad() {
+    const auto trace = dischargeTrace(8000, 7600, 3000);
+    AdcFilter filter;
+    BatteryModel model;
+    filter.reset(trace.measuredMv[0]);
+    model.reset(trace.duty[0]);
+
+    int worstMeasured = 0;
+    int worstCompensated = 0;
+    int socMeasured[2] = { 100, 0 }; // Min and max
+    int socCompensated[2] = { 100, 0 };
+    for (size_t i = 0; i != trace.duty.size(); ++i) {
+        const int measured = filter.add(trace.measuredMv[i]);
+        const int compensated = measured + model.update(trace.duty[i]);
+        if (i < 100)
+            continue;
+
+        const int ocv = trace.openCircuitMv[i];
+        worstMeasured = std::max(worstMeasured, abs(measured - ocv));
+        worstCompensated = std::max(worstCompensated, abs(compensated - ocv));
+
+        // With the discharge itself taken out, only the swings of the estimate remain
+        const int discharged = trace.openCircuitMv[100] - ocv;
+        const int sm = BatteryModel::stateOfCharge((measured + discharged) / Battery::CELLS);
+        const int sc = BatteryModel::stateOfCharge((compensated + discharged) / Battery::CELLS);
+        socMeasured[0] = std::min(socMeasured[0], sm);
+        socMeasured[1] = std::max(socMeasured[1], sm);
+        socCompensated[0] = std::min(socCompensated[0], sc);
+        socCompensated[1] = std::max(socCompensated[1], sc);
+    }
+
+    printf("  worst error: %d mV measured, %d mV compensated\n", worstMeasured, worstCompensated);
+    printf("  charge swings: %d %% measured, %d %% compensated\n",
+        socMeasured[1] - socMeasured[0], socCompensated[1] - socCompensated[0]);
+    TEST_ASSERT_TRUE(worstMeasured > 200);
+    TEST_ASSERT_TRUE(worstCompensated < 70);
+    TEST_ASSERT_TRUE((socCompensated[1] - socCompensated[0]) * 2 < socMeasured[1] - socMeasured[0]);
+}
+
+static void testNoFalseUndervoltage() {
+    // Just above the shutdown voltage, the load pulls the measured voltage well below it
+    const auto trace = dischargeTrace(Battery::VOLTAGE_MIN + 60, Battery::VOLTAGE_MIN + 50, 1000);
+    AdcFilter filter;
+    BatteryModel model;
+    filter.reset(trace.measuredMv[0]);
+    model.reset(trace.duty[0]);
+
+    int measuredUnder = 0;
+    for (size_t i = 0; i != trace.duty.size(); ++i) {
+        const uint32_t measured = filter.add(trace.measuredMv[i]);
+        const uint32_t compensated = measured + model.update(trace.duty[i]);
+        if (measured <= Battery::VOLTAGE_MIN)
+            ++measuredUnder;
+        TEST_ASSERT_TRUE(compensated > Battery::VOLTAGE_MIN);
+    }
+    TEST_ASSERT_TRUE(measuredUnder > 100);
+}
+
+static void testTimerNotBlocked() {
+    // All the timers share one task, the battery's sampling must not hold it up
+    rbsim::espTimerLongestCallbackUs(true);
+    vTaskDelay(pdMS_TO_TICKS(1100));
+    const uint32_t longest = rbsim::espTimerLongestCallbackUs();
+
+    printf("  longest timer callback: %u us, %u us per conversion\n", longest, CONVERSION_US);
+    TEST_ASSERT_TRUE(longest >= CONVERSION_US);
+    TEST_ASSERT_TRUE(longest < 8 * CONVERSION_US); // 32 conversions before the filter
+}
+
+static void testVoltageFollowsAdc() {
+    auto& bat = Manager::get().battery();
+    const uint32_t start = bat.voltageMv();
+    TEST_ASSERT_TRUE(start > 7000);
+
+    rbsim::adcSet(BATT_ADC_CHANNEL, 3240 * 9 / 10);
+    TEST_ASSERT_EVENTUALLY(bat.voltageMv() < start * 91 / 100, 3000);
+    TEST_ASSERT_TRUE(bat.voltageMv() > start * 89 / 100);
+
+    rbsim::adcSet(BATT_ADC_CHANNEL, 3240);
+    TEST_ASSERT_EVENTUALLY(bat.voltageMv() > start * 99 / 100, 3000);
+}
+
+static void testLoadCompensation() {
+    auto& man = Manager::get();
+    auto& bat = man.battery();
+    TEST_ASSERT_EVENTUALLY(bat.raw() == 3240, 3000);
+    const uint32_t start = bat.openCircuitMv();
+    const uint32_t startPct = bat.pct();
+    TEST_ASSERT_EQUAL_INT(start, bat.voltageMv());
+
+    // Two motors at full power, 2A through the default 150mOhm sag the battery by 300mV
+    const uint32_t sagRaw = 300 * 4095 * Battery::BATT_DIVIDER / 1100;
+    man.setMotors().power(MotorId::M1, 100).power(MotorId::M2, -100).set();
+    rbsim::adcSet(BATT_ADC_CHANNEL, 3240 - sagRaw);
+
+    TEST_ASSERT_EVENTUALLY(bat.voltageMv() < start - 280, 3000);
+    TEST_ASSERT_TRUE(abs(int(bat.openCircuitMv()) - int(start)) < 20);
+    TEST_ASSERT_TRUE(abs(int(bat.pct()) - int(startPct)) <= 1);
+
+    man.setMotors().power(MotorId::M1, 0).power(MotorId::M2, 0).set();
+    rbsim::adcSet(BATT_ADC_CHANNEL, 3240);
+    TEST_ASSERT_EVENTUALLY(bat.raw() == 3240, 3000);
+    TEST_ASSERT_TRUE(abs(int(bat.openCircuitMv()) - int(start)) <= 2);
+}
+
+static void testUndervoltageUnderLoad() {
+    // All the motors commanded, but free-running: the battery doesn't sag, it is empty.
+    // The model would add 1.2 V, the measured voltage must shut the robot down anyway.
+    auto& man = Manager::get();
+    auto& bat = man.battery();
+    rbsim::deepSleepEndsProcess(false);
+
+    auto builder = man.setMotors();
+    for (int m = 0; m != int(MotorId::MAX); ++m)
+        builder.power(MotorId(m), 100);
+    builder.set();
+
+    const uint32_t measuredMv = Battery::VOLTAGE_SHUTDOWN - 100;
+    rbsim::adcSet(BATT_ADC_CHANNEL, measuredMv * 4095 * Battery::BATT_DIVIDER / 1100);
+    TEST_ASSERT_EVENTUALLY(bat.voltageMv() < measuredMv + 20, 3000);
+    TEST_ASSERT_TRUE(bat.openCircuitMv() <= bat.voltageMv() + BatteryModel::MAX_SAG_MV);
+    TEST_ASSERT_TRUE(bat.openCircuitMv() < Battery::VOLTAGE_WARNING);
+
+    // Ten checks in a row under the limit, plus the delay before the power goes off
+    TEST_ASSERT_EVENTUALLY(rbsim::deepSleepCount() == 1, 10000);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(testFilterSmoothsNoise);
+    RUN_TEST(testFilterRejectsSpikes);
+    RUN_TEST(testFilterFollowsStep);
+    RUN_TEST(testFilterMedian);
+    RUN_TEST(testStateOfCharge);
+    RUN_TEST(testModelCompensatesLoad);
+    RUN_TEST(testNoFalseUndervoltage);
+
+    rbsim::adcSetConversionTime(CONVERSION_US);
+    Manager::get().install(MAN_DISABLE_MOTOR_FAILSAFE);
+
+    RUN_TEST(testTimerNotBlocked);
+    RUN_TEST(testVoltageFollowsAdc);
+    RUN_TEST(testLoadCompensation);
+    RUN_TEST(testUndervoltageUnderLoad); // Last, the shutdown stops the timers
+    UNITY_END();
+}
@@ -0,0 +1,169 @@
+// Binary log: the decoded text matches what the text logger would format.
+
+#include <vector>
+
+#include "RBControl_binaryLog.hpp"
+#include "logger/binary_log_decoder.hpp"
+
+#include "unity_host.hpp"
+
+struct VectorSink : public BinaryLogSink {
+    virtual void write(const uint8_t* frame, size_t length) override {
+        data.insert(data.end(), frame, frame + length);
+    }
+
+    std::vector<uint8_t> data;
+};
+
+static std::vector<std::string> decode(const std::vector<uint8_t>& data, BinaryLogDecoder& decoder) {
+    std::vector<std::string> res;
+    decoder.feed(data.data(), data.size(), [&](uint64_t, const std::string& text) {
+        res.push_back(text);
+    });
+    return res;
+}
+
+static std::vector<std::string> decode(const std::vector<uint8_t>& data) {
+    BinaryLogDecoder decoder;
+    return decode(data, decoder);
+}
+
+static void testDecodedText() {
+    auto* sink = new VectorSink();
+    BinaryLog log;
+    log.addSink(std::unique_ptr<BinaryLogSink>(sink));
+
+    const char* name = "left";
+    log.log(RB_FMT("motor {} power {} speed {}"), name, int16_t(-1200), 0.25f);
+    log.log(RB_FMT("{1} before {0}, then {}"), uint8_t(7), int64_t(-9000000000LL), 1.5);
+    log.log(RB_FMT("unused args at the end"), 3, std::string("tail"));
+    log.log(RB_FMT("escaped \\{}"), 1u);
+
+    const auto text = decode(sink->data);
+    TEST_ASSERT_EQUAL_INT(4, text.size());
+    TEST_ASSERT_EQUAL_STRING(format(RB_FMT("motor {} power {} speed {}"), name, int16_t(-1200), 0.25f), text[0]);
+    TEST_ASSERT_EQUAL_STRING(format(RB_FMT("{1} before {0}, then {}"), uint8_t(7), int64_t(-9000000000LL), 1.5), text[1]);
+    TEST_ASSERT_EQUAL_STRING("unused args at the end3tail", text[2]);
+    TEST_ASSERT_EQUAL_STRING("escaped {}1", text[3]);
+}
+
+static void testDefinitionSentOnce() {
+    auto* sink = new VectorSink();
+    BinaryLog log;
+    log.addSink(std::unique_ptr<BinaryLogSink>(sink));
+
+    for (int i = 0; i != 3; ++i)
+        log.log(RB_FMT("value {}"), i);
+    size_t definitions = 0;
+    for (size_t pos = 0; pos < sink->data.size(); pos += 2 + sink->data[pos + 1])
+        definitions += sink->data[pos] == binary_log::FRAME_DEFINITION;
+    TEST_ASSERT_EQUAL_INT(1, definitions);
+
+    // The stream can be split anywhere
+    BinaryLogDecoder decoder;
+    std::vector<std::string> text;
+    for (uint8_t b : sink->data) {
+        decoder.feed(&b, 1, [&](uint64_t, const std::string& t) { text.push_back(t); });
+    }
+    TEST_ASSERT_EQUAL_INT(3, text.size());
+    TEST_ASSERT_EQUAL_STRING("value 2", text[2]);
+}
+
+static void testLongString() {
+    auto* sink = new VectorSink();
+    BinaryLog log;
+    log.addSink(std::unique_ptr<BinaryLogSink>(sink));
+
+    const std::string longer(100, 'x');
+    log.log(RB_FMT("[{}]"), longer);
+    const auto text = decode(sink->data);
+    TEST_ASSERT_EQUAL_INT(1, text.size());
+    TEST_ASSERT_EQUAL_STRING("[" + std::string(binary_log::MAX_STRING, 'x') + "]", text[0]);
+}
+
+static void testRingEviction() {
+    auto* ring = new RingBinaryLogSink(64);
+    BinaryLog log;
+    log.addSink(std::unique_ptr<BinaryLogSink>(ring));
+
+    for (int i = 0; i != 20; ++i)
+        log.log(RB_FMT("sample {}"), i);
+    TEST_ASSERT_TRUE(ring->size() <= 64);
+
+    // The definition was evicted, the table brings it back
+    VectorSink dump;
+    BinaryLog::writeFormatTable(dump);
+    const size_t table = dump.data.size();
+    ring->copyTo(dump);
+    TEST_ASSERT_EQUAL_INT(ring->size(), dump.data.size() - table);
+
+    BinaryLogDecoder decoder;
+    const auto text = decode(dump.data, decoder);
+    TEST_ASSERT_TRUE(text.size() > 0);
+    TEST_ASSERT_EQUAL_STRING("sample 19", text.back());
+    TEST_ASSERT_EQUAL_INT(0, decoder.skipped());
+    TEST_ASSERT_EQUAL_INT(0, decoder.unknown());
+}
+
+static void testUartSink() {
+    std::vector<uint8_t> received;
+    rbsim::uartAttach(UART_NUM_2, [&](const uint8_t* data, size_t len) {
+        received.insert(received.end(), data, data + len);
+        return std::vector<uint8_t>();
+    });
+
+    BinaryLog log;
+    log.addSink(std::unique_ptr<BinaryLogSink>(new rb::UartBinaryLogSink(UART_NUM_2)));
+    log.log(RB_FMT("uart {}"), 42);
+
+    const auto text = decode(received);
+    TEST_ASSERT_EQUAL_INT(1, text.size());
+    TEST_ASSERT_EQUAL_STRING("uart 42", text[0]);
+    rbsim::uartAttach(UART_NUM_2, nullptr);
+}
+
+static void testNvsSink() {
+    auto* nvs = new rb::NvsBinaryLogSink("rblogtest", 2, 64);
+    nvs->clear();
+    BinaryLog log;
+    log.addSink(std::unique_ptr<BinaryLogSink>(nvs));
+
+    for (int i = 0; i != 4; ++i)
+        log.log(RB_FMT("nvs {}"), i);
+    const auto first = decode(nvs->read());
+    TEST_ASSERT_EQUAL_INT(4, first.size());
+    TEST_ASSERT_EQUAL_STRING("nvs 3", first.back());
+
+    // Only the newest two chunks stay in flash, the rest is dropped whole
+    for (int i = 4; i != 40; ++i)
+        log.log(RB_FMT("nvs {}"), i);
+    nvs->flush();
+
+    // A new sink, like after a reset, finds the chunks
+    rb::NvsBinaryLogSink reopened("rblogtest", 2, 64);
+    VectorSink dump;
+    BinaryLog::writeFormatTable(dump);
+    const auto stored = reopened.read();
+    dump.data.insert(dump.data.end(), stored.begin(), stored.end());
+    TEST_ASSERT_TRUE(stored.size() <= 2 * 64);
+
+    BinaryLogDecoder decoder;
+    const auto text = decode(dump.data, decoder);
+    TEST_ASSERT_TRUE(text.size() > 0 && text.size() < 40);
+    TEST_ASSERT_EQUAL_STRING("nvs 39", text.back());
+    TEST_ASSERT_EQUAL_INT(0, decoder.skipped());
+
+    reopened.clear();
+    TEST_ASSERT_EQUAL_INT(0, rb::NvsBinaryLogSink("rblogtest", 2, 64).read().size());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(testDecodedText);
+    RUN_TEST(testDefinitionSentOnce);
+    RUN_TEST(testLongString);
+    RUN_TEST(testRingEviction);
+    RUN_TEST(testUartSink);
+    RUN_TEST(testNvsSink);
+    UNITY_END();
+}
@@ -0,0 +1,213 @@
+// Buttons on the expander: the debouncing on its own, then the whole path from
+// the expander's INTA pin through the buttons task to the callback.
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "RBControl_manager.hpp"
+
+#include "unity_host.hpp"
+
+using namespace rb;
+
+static const gpio_num_t INT_PIN = GPIO_NUM_21;
+static const uint16_t MASK = 0x0007;
+static const uint8_t INTCAPB = 0x11;
+static const uint8_t GPIOA = 0x12;
+static const uint8_t GPIOB = 0x13;
+
+// Like the MCP23017 with INTCON = 0: INTA goes low on a change of the enabled pins,
+// INTCAP keeps the levels of that change until INTCAP or GPIO is read.
+class ExpanderDevice : public rbsim::I2cRegisterDevice {
+public:
+    void start(bool read) override {
+        // Lets the test change the pins several times without the task reading in between
+        std::lock_guard<std::mutex> wait(hold);
+        m_selecting = !read;
+        if (read && m_selected >= INTCAPB - 1 && m_selected <= GPIOB)
+            rbsim::gpioDrive(INT_PIN, 1);
+        I2cRegisterDevice::start(read);
+    }
+
+    void write(uint8_t data) override {
+        if (m_selecting) {
+            m_selected = data;
+            m_selecting = false;
+        }
+        I2cRegisterDevice::write(data);
+    }
+
+    void setButtons(uint8_t portB) {
+        if (portB == reg(GPIOB))
+            return;
+        setReg(GPIOB, portB);
+        if (rbsim::gpioLevel(INT_PIN)) {
+            setReg(INTCAPB, portB);
+            rbsim::gpioDrive(INT_PIN, 0);
+        }
+    }
+
+    std::mutex hold;
+
+private:
+    bool m_selecting = false;
+    uint8_t m_selected = 0;
+};
+
+static ExpanderDevice expander;
+
+struct Change {
+    int pin;
+    bool pressed;
+};
+
+static std::mutex changesMutex;
+static std::vector<Change> changes;
+
+static size_t changeCount() {
+    std::lock_guard<std::mutex> lock(changesMutex);
+    return changes.size();
+}
+
+static void testDebounceBounces() {
+    ButtonDebouncer deb(MASK, MASK, 20);
+    TEST_ASSERT_EQUAL_INT(MASK, deb.state());
+
+    // Pressed at 100 ms, bouncing until 105 ms
+    TEST_ASSERT_EQUAL_INT(0, deb.update(0x6, 100));
+    TEST_ASSERT_EQUAL_INT(0x1, deb.settling());
+    TEST_ASSERT_EQUAL_INT(120, deb.deadline());
+    TEST_ASSERT_EQUAL_INT(0, deb.update(0x7, 102));
+    TEST_ASSERT_EQUAL_INT(0, deb.settling());
+    TEST_ASSERT_EQUAL_INT(0, deb.update(0x6, 105));
+    TEST_ASSERT_EQUAL_INT(125, deb.deadline());
+
+    TEST_ASSERT_EQUAL_INT(0, deb.update(0x6, 124));
+    TEST_ASSERT_EQUAL_INT(0x1, deb.update(0x6, 125));
+    TEST_ASSERT_EQUAL_INT(0x6, deb.state());
+    TEST_ASSERT_EQUAL_INT(0, deb.settling());
+    TEST_ASSERT_EQUAL_INT(0, deb.update(0x6, 200));
+}
+
+static void testDebounceGlitch() {
+    ButtonDebouncer deb(MASK, MASK, 20);
+
+    // Shorter than the debounce time, ignored
+    TEST_ASSERT_EQUAL_INT(0, deb.update(0x5, 10));
+    TEST_ASSERT_EQUAL_INT(0, deb.update(0x7, 25));
+    TEST_ASSERT_EQUAL_INT(0, deb.settling());
+    TEST_ASSERT_EQUAL_INT(0, deb.update(0x7, 100));
+    TEST_ASSERT_EQUAL_INT(MASK, deb.state());
+}
+
+static void testDebounceIndependentBits() {
+    ButtonDebouncer deb(MASK, MASK, 20);
+
+    // The other pins and the bits outside of the mask don't restart the wait
+    TEST_ASSERT_EQUAL_INT(0, deb.update(0xFE, 0));
+    TEST_ASSERT_EQUAL_INT(0, deb.update(0x0A, 10));
+    TEST_ASSERT_EQUAL_INT(20, deb.deadline());
+    TEST_ASSERT_EQUAL_INT(0x1, deb.update(0x0A, 20));
+    TEST_ASSERT_EQUAL_INT(30, deb.deadline());
+    TEST_ASSERT_EQUAL_INT(0x4, deb.update(0x0A, 30));
+    TEST_ASSERT_EQUAL_INT(0x2, deb.state());
+}
+
+static void testDebounceWraps() {
+    ButtonDebouncer deb(MASK, MASK, 20);
+    const uint32_t start = 0xFFFFFFF0;
+    TEST_ASSERT_EQUAL_INT(0, deb.update(0x6, start));
+    TEST_ASSERT_EQUAL_INT(4, deb.deadline());
+    TEST_ASSERT_EQUAL_INT(0, deb.update(0x6, 3));
+    TEST_ASSERT_EQUAL_INT(0x1, deb.update(0x6, 4));
+}
+
+static void testPressRelease() {
+    auto& buttons = Manager::get().buttons();
+    changes.clear();
+    TEST_ASSERT_FALSE(buttons.pressed(SW1));
+
+    for (int bounce = 0; bounce != 4; ++bounce) {
+        expander.setButtons(0xFE);
+        vTaskDelay(1);
+        expander.setButtons(0xFF);
+        vTaskDelay(1);
+    }
+    expander.setButtons(0xFE);
+    TEST_ASSERT_EVENTUALLY(buttons.pressed(SW1), 1000);
+
+    expander.setButtons(0xFF);
+    TEST_ASSERT_EVENTUALLY(!buttons.pressed(SW1), 1000);
+    TEST_ASSERT_EVENTUALLY(changeCount() == 2, 1000);
+
+    std::lock_guard<std::mutex> lock(changesMutex);
+    TEST_ASSERT_EQUAL_INT(SW1, changes[0].pin);
+    TEST_ASSERT_TRUE(changes[0].pressed);
+    TEST_ASSERT_EQUAL_INT(SW1, changes[1].pin);
+    TEST_ASSERT_FALSE(changes[1].pressed);
+}
+
+static void testGlitchIgnored() {
+    auto& buttons = Manager::get().buttons();
+    changes.clear();
+
+    expander.setButtons(0xFB);
+    vTaskDelay(2);
+    expander.setButtons(0xFF);
+    vTaskDelay(100);
+    TEST_ASSERT_EQUAL_INT(0, changeCount());
+    TEST_ASSERT_FALSE(buttons.pressed(SW3));
+}
+
+static void testBounceBackBeforeRead() {
+    auto& buttons = Manager::get().buttons();
+    changes.clear();
+
+    // The task reads the first change, then the pin bounces back and forth before the
+    // next read: INTCAP holds the stable level, though the button stays pressed.
+    expander.setButtons(0xFD);
+    TEST_ASSERT_EVENTUALLY(rbsim::gpioLevel(INT_PIN) == 1, 1000);
+    {
+        std::lock_guard<std::mutex> noReads(expander.hold);
+        expander.setButtons(0xFF);
+        expander.setButtons(0xFD);
+    }
+    TEST_ASSERT_EVENTUALLY(buttons.pressed(SW2), 1000);
+
+    expander.setButtons(0xFF);
+    TEST_ASSERT_EVENTUALLY(!buttons.pressed(SW2), 1000);
+    TEST_ASSERT_EVENTUALLY(changeCount() == 2, 1000);
+}
+
+static void testInterruptReleased() {
+    // Every change was read back, the expander is ready to signal the next one
+    TEST_ASSERT_EVENTUALLY(rbsim::gpioLevel(INT_PIN) == 1, 1000);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(testDebounceBounces);
+    RUN_TEST(testDebounceGlitch);
+    RUN_TEST(testDebounceIndependentBits);
+    RUN_TEST(testDebounceWraps);
+
+    for (int reg = 0; reg != 0x16; ++reg)
+        expander.setReg(reg, reg < 2 ? 0xFF : 0x00);
+    expander.setReg(GPIOA, 0xFF);
+    expander.setReg(GPIOB, 0xFF);
+    rbsim::i2cAttach(I2C_NUM_0, I2C_ADDR_EXPANDER, &expander);
+
+    auto& man = Manager::get();
+    man.install(MAN_DISABLE_MOTOR_FAILSAFE);
+    man.initButtons(INT_PIN).onChange([](int pin, bool pressed) {
+        std::lock_guard<std::mutex> lock(changesMutex);
+        changes.push_back({ pin, pressed });
+    });
+
+    RUN_TEST(testPressRelease);
+    RUN_TEST(testGlitchIgnored);
+    RUN_TEST(testBounceBackBeforeRead);
+    RUN_TEST(testInterruptReleased);
+    UNITY_END();
+}
@@ -0,0 +1,67 @@
+// A braking emergency stop, with the motor failsafe enabled: the brake buffer stays active
+// after the manager's task handles the stop, and after the failsafe period.
+
+#include "RBControl_manager.hpp"
+
+#include "pwm_decode.hpp"
+#include "unity_host.hpp"
+
+using namespace rb;
+
+// Motor M1 drives these SerialPWM channels, the outputs are inverted
+static const int M1_PWM0 = 12;
+static const int M1_PWM1 = 13;
+static const int PWM_MAX = 100;
+
+static const int FAILSAFE_PERIOD_MS = 300; // MOTORS_FAILSAFE_PERIOD_MS
+
+static int decode(int channel) {
+    return decodePwm(1, channel, 16, 1);
+}
+
+static bool braking() {
+    return decode(M1_PWM0) == 0 && decode(M1_PWM1) == 0;
+}
+
+static void testBrakeStaysActive() {
+    auto& man = Manager::get();
+    man.setMotors().power(MotorId::M1, 80).set();
+    TEST_ASSERT_EVENTUALLY(decode(M1_PWM1) == PWM_MAX - 80, 1000);
+
+    man.emergencyStop(true);
+    TEST_ASSERT_TRUE(braking());
+
+    // The manager's task handled the wake-up event
+    vTaskDelay(pdMS_TO_TICKS(50));
+    TEST_ASSERT_EQUAL_INT(0, man.stats().eventQueueWaiting);
+    TEST_ASSERT_TRUE(braking());
+
+    // No motor changes get through while latched, the failsafe must not switch to coasting
+    for (int i = 0; i != 3; ++i) {
+        man.setMotors().power(MotorId::M1, 50).set();
+        vTaskDelay(pdMS_TO_TICKS(FAILSAFE_PERIOD_MS));
+        TEST_ASSERT_TRUE(braking());
+    }
+}
+
+static void testFailsafeAfterClear() {
+    auto& man = Manager::get();
+    man.clearEmergencyStop();
+    TEST_ASSERT_TRUE(braking());
+
+    man.setMotors().power(MotorId::M1, 40).set();
+    TEST_ASSERT_EVENTUALLY(decode(M1_PWM1) == PWM_MAX - 40, 1000);
+
+    // Rearmed by the motor change, coasts once the changes stop coming
+    TEST_ASSERT_EVENTUALLY(decode(M1_PWM0) == PWM_MAX && decode(M1_PWM1) == PWM_MAX, 3 * FAILSAFE_PERIOD_MS);
+}
+
+int main() {
+    UNITY_BEGIN();
+    Manager::get().install();
+    vTaskDelay(pdMS_TO_TICKS(10)); // A motor change at tick 0 wouldn't arm the failsafe
+
+    RUN_TEST(testBrakeStaysActive);
+    RUN_TEST(testFailsafeAfterClear);
+    UNITY_END();
+}
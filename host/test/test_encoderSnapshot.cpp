@@ -0,0 +1,56 @@
+// Encoder snapshots stay coherent while a counter wraps at its limit: the interrupt which
+// accounts for the wrap can be held off by a critical section, like on the ESP32.
+
+#include <atomic>
+#include <thread>
+
+#include "RBControl_manager.hpp"
+
+#include "unity_host.hpp"
+
+using namespace rb;
+
+static void testSnapshotAcrossWrap() {
+    auto& man = Manager::get();
+    auto* enc = man.motor(MotorId::M2).encoder();
+
+    int direction = 1;
+    rbsim::quadratureMove(ENC2A, ENC2B, 4);
+    if (enc->value() < 0)
+        direction = -1;
+
+    // Up to one count before the limit, one edge at a time
+    const int32_t last = direction > 0 ? 32766 : -32767;
+    while (enc->value() != last)
+        rbsim::quadratureMove(ENC2A, ENC2B, direction);
+    const int32_t before = enc->value();
+
+    // Hold off the PCNT interrupt, the counter wraps but the accumulator stays behind
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+    portENTER_CRITICAL(&mux);
+    std::thread mover([&]() {
+        // Blocks in the edge which wraps the counter, until the interrupt can run
+        while (enc->value() == before)
+            rbsim::quadratureMove(ENC2A, ENC2B, direction);
+    });
+    while (!(PCNT.int_raw.val & BIT(PCNT_UNIT_1)))
+        std::this_thread::yield();
+    TEST_ASSERT_TRUE(abs(int16_t(PCNT.cnt_unit[PCNT_UNIT_1].cnt_val)) < 2);
+
+    const auto snapshot = man.readEncoders();
+    portEXIT_CRITICAL(&mux);
+    mover.join();
+
+    TEST_ASSERT_EQUAL_INT(before + direction, snapshot.value(MotorId::M2));
+    TEST_ASSERT_EQUAL_INT(before + direction, enc->value());
+    TEST_ASSERT_EQUAL_INT(before + direction, man.readEncoders().value(MotorId::M2));
+}
+
+int main() {
+    UNITY_BEGIN();
+    // No edge interrupts, the manager's queue would overflow with tens of thousands of edges
+    Manager::get().install(MAN_DISABLE_MOTOR_FAILSAFE | MAN_ENCODER_SAMPLED_SPEED);
+
+    RUN_TEST(testSnapshotAcrossWrap);
+    UNITY_END();
+}
@@ -0,0 +1,91 @@
+// Sampled encoder speed: with MAN_ENCODER_SAMPLED_SPEED the speed comes from the PCNT
+// counter deltas over the last sampler ticks, not from the period of the edge interrupts.
+
+#include <atomic>
+#include <esp_timer.h>
+#include <math.h>
+#include <thread>
+
+#include "RBControl_manager.hpp"
+
+#include "unity_host.hpp"
+
+using namespace rb;
+
+// Turns the encoder at a steady rate until stopped
+class Mover {
+public:
+    Mover(int stepsPerMs)
+        : m_thread([this, stepsPerMs]() {
+            while (!m_stop) {
+                rbsim::quadratureMove(ENC1A, ENC1B, stepsPerMs);
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }) {}
+
+    ~Mover() {
+        m_stop = true;
+        m_thread.join();
+    }
+
+private:
+    std::atomic<bool> m_stop { false };
+    std::thread m_thread;
+};
+
+// Encoder cycles per second, measured the same way the sampler does, over a longer time
+static float measureSpeed(Encoder* enc, int durationMs) {
+    const int64_t startUs = esp_timer_get_time();
+    const int32_t start = enc->value();
+    vTaskDelay(pdMS_TO_TICKS(durationMs));
+    const int32_t delta = enc->value() - start;
+    return float(delta) / enc->incPerRevolution() * 1000000.f / (esp_timer_get_time() - startUs);
+}
+
+static void testStopped() {
+    auto* enc = Manager::get().motor(MotorId::M1).encoder();
+    vTaskDelay(pdMS_TO_TICKS(100));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.f, enc->speed());
+}
+
+static void testSteadySpeed(int stepsPerMs) {
+    auto* enc = Manager::get().motor(MotorId::M1).encoder();
+    Mover mover(stepsPerMs);
+
+    // Let the window fill up
+    vTaskDelay(pdMS_TO_TICKS(200));
+    const float expected = measureSpeed(enc, 500);
+    const float sampled = enc->speed();
+    printf("  %d steps/ms: %.0f sampled, %.0f measured\n", stepsPerMs, sampled, expected);
+    TEST_ASSERT_TRUE(fabsf(expected) > 100.f);
+    TEST_ASSERT_FLOAT_WITHIN(fabsf(expected) * 0.3f, expected, sampled);
+}
+
+static void testForward() {
+    testSteadySpeed(4);
+}
+
+static void testBackward() {
+    testSteadySpeed(-4);
+}
+
+static void testSpeedDecaysToZero() {
+    auto* enc = Manager::get().motor(MotorId::M1).encoder();
+    {
+        Mover mover(4);
+        TEST_ASSERT_EVENTUALLY(fabsf(enc->speed()) > 100.f, 1000);
+    }
+    // The window is 8 ticks of ENCODER_SAMPLE_PERIOD_MS
+    TEST_ASSERT_EVENTUALLY(enc->speed() == 0.f, 1000);
+}
+
+int main() {
+    UNITY_BEGIN();
+    Manager::get().install(MAN_DISABLE_MOTOR_FAILSAFE | MAN_ENCODER_SAMPLED_SPEED);
+
+    RUN_TEST(testStopped);
+    RUN_TEST(testForward);
+    RUN_TEST(testBackward);
+    RUN_TEST(testSpeedDecaysToZero);
+    UNITY_END();
+}
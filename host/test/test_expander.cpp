@@ -0,0 +1,153 @@
+// MCP23017 expander: the cached registers are written without reading them first,
+// batches go out in one I2C transaction.
+
+#include <vector>
+
+#include "Adafruit_MCP23017.h"
+#include "RBControl_pinout.hpp"
+
+#include "unity_host.hpp"
+
+using namespace rb;
+
+static const i2c_port_t PORT = I2C_NUM_1;
+static const uint8_t ADDRESS = 0x20;
+
+static const uint8_t IODIRA = 0x00;
+static const uint8_t GPPUA = 0x0C;
+static const uint8_t GPPUB = 0x0D;
+static const uint8_t OLATA = 0x14;
+static const uint8_t OLATB = 0x15;
+
+// Records the register each write starts at
+class RecordingDevice : public rbsim::I2cRegisterDevice {
+public:
+    void start(bool read) override {
+        m_selecting = !read;
+        I2cRegisterDevice::start(read);
+    }
+
+    void write(uint8_t data) override {
+        if (m_selecting) {
+            selected.push_back(data);
+            m_selecting = false;
+        }
+        I2cRegisterDevice::write(data);
+    }
+
+    std::vector<uint8_t> selected;
+
+private:
+    bool m_selecting = false;
+};
+
+static RecordingDevice device;
+
+static void resetDevice() {
+    for (int reg = 0; reg != 0x16; ++reg)
+        device.setReg(reg, reg < 2 ? 0xFF : 0x00);
+    device.selected.clear();
+}
+
+static rbsim::I2cStats traffic(const std::function<void()>& fn) {
+    rbsim::i2cResetStats(PORT);
+    fn();
+    return rbsim::i2cStats(PORT);
+}
+
+static void testKeepsStateOverReset() {
+    resetDevice();
+    device.setReg(OLATB, 0x80);
+    device.setReg(GPPUB, 0x07);
+    Adafruit_MCP23017 exp(ADDRESS, PORT, GPIO_NUM_21, GPIO_NUM_22);
+    TEST_ASSERT_EQUAL_INT(0xFF, device.reg(IODIRA));
+
+    // The latch and the pull-ups were read, not overwritten
+    exp.digitalWrite(EB0, 1);
+    TEST_ASSERT_EQUAL_INT(0x81, device.reg(OLATB));
+    TEST_ASSERT_EQUAL_INT(0x07, device.reg(GPPUB));
+}
+
+static void testWritesWithoutReading() {
+    resetDevice();
+    Adafruit_MCP23017 exp(ADDRESS, PORT, GPIO_NUM_21, GPIO_NUM_22);
+
+    auto stats = traffic([&]() { exp.digitalWrite(LED_RED, 1); });
+    TEST_ASSERT_EQUAL_INT(1, stats.transactions);
+    TEST_ASSERT_EQUAL_INT(3, stats.bytes); // Address, register, value
+    TEST_ASSERT_EQUAL_INT(1 << (LED_RED - 8), device.reg(OLATB));
+
+    stats = traffic([&]() { exp.digitalWrite(LED_RED, 1); });
+    TEST_ASSERT_EQUAL_INT(0, stats.transactions);
+
+    exp.pinMode(EA3, GPIO_MODE_OUTPUT);
+    exp.pullUp(EA5, 1);
+    exp.digitalWrite(EA3, 1);
+    exp.digitalWrite(LED_RED, 0);
+    TEST_ASSERT_EQUAL_INT(0xF7, device.reg(IODIRA));
+    TEST_ASSERT_EQUAL_INT(0x20, device.reg(GPPUA));
+    TEST_ASSERT_EQUAL_INT(0x08, device.reg(OLATA));
+    TEST_ASSERT_EQUAL_INT(0x00, device.reg(OLATB));
+
+    exp.writeGPIOAB(0x1234);
+    stats = traffic([&]() { exp.digitalWrite(EA2, 1); });
+    TEST_ASSERT_EQUAL_INT(0, stats.transactions);
+}
+
+static void testBatch() {
+    resetDevice();
+    Adafruit_MCP23017 exp(ADDRESS, PORT, GPIO_NUM_21, GPIO_NUM_22);
+    device.selected.clear();
+
+    // Manager::setupExpander
+    const auto setup = traffic([&]() {
+        auto batch = exp.batch();
+        for (int pin = EA0; pin <= EA7; ++pin)
+            batch.pinMode(pin, GPIO_MODE_OUTPUT);
+        batch.pinMode(SW1, GPIO_MODE_INPUT).pullUp(SW1, 1);
+        batch.pinMode(SW2, GPIO_MODE_INPUT).pullUp(SW2, 1);
+        batch.pinMode(SW3, GPIO_MODE_INPUT).pullUp(SW3, 1);
+        batch.digitalWrite(EXPANDER_BOARD_POWER_ON, 1);
+        batch.pinMode(EXPANDER_BOARD_POWER_ON, GPIO_MODE_OUTPUT);
+        batch.apply();
+    });
+    TEST_ASSERT_EQUAL_INT(1, setup.transactions);
+    TEST_ASSERT_EQUAL_INT(0x00, device.reg(IODIRA));
+    TEST_ASSERT_EQUAL_INT(0x7F, device.reg(IODIRA + 1));
+    TEST_ASSERT_EQUAL_INT(0x07, device.reg(GPPUB));
+    TEST_ASSERT_EQUAL_INT(0x80, device.reg(OLATB));
+
+    // The latch is set before the power pin becomes an output
+    TEST_ASSERT_EQUAL_INT(3, device.selected.size());
+    TEST_ASSERT_EQUAL_INT(OLATB, device.selected[0]);
+    TEST_ASSERT_EQUAL_INT(IODIRA, device.selected[2]);
+
+    // All four LEDs
+    const auto leds = traffic([&]() {
+        exp.batch()
+            .digitalWrite(LED_RED, 1)
+            .digitalWrite(LED_YELLOW, 1)
+            .digitalWrite(LED_GREEN, 1)
+            .digitalWrite(LED_BLUE, 1)
+            .apply();
+    });
+    TEST_ASSERT_EQUAL_INT(1, leds.transactions);
+    TEST_ASSERT_EQUAL_INT(3, leds.bytes);
+
+    printf("    setupExpander: %u transactions, %u us of bus time at 100 kHz\n",
+        setup.transactions, setup.busTimeUs());
+    printf("    four LEDs: %u transactions, %u us of bus time at 100 kHz\n",
+        leds.transactions, leds.busTimeUs());
+
+    // Nothing changes, nothing is sent
+    TEST_ASSERT_EQUAL_INT(0, traffic([&]() { exp.batch().digitalWrite(LED_RED, 1).apply(); }).transactions);
+}
+
+int main() {
+    UNITY_BEGIN();
+    rbsim::i2cAttach(PORT, ADDRESS, &device);
+    RUN_TEST(testKeepsStateOverReset);
+    RUN_TEST(testWritesWithoutReading);
+    RUN_TEST(testBatch);
+    UNITY_END();
+}
@@ -0,0 +1,55 @@
+// The compile-time format strings produce the same text as FormatString.
+
+#include "RBControl_logger.hpp"
+
+#include "unity_host.hpp"
+
+static void testSequentialMarkers() {
+    TEST_ASSERT_EQUAL_STRING(format("motor {} power {} enc {} {}", 1, -42, 1234567, "ok"),
+        format(RB_FMT("motor {} power {} enc {} {}"), 1, -42, 1234567, "ok"));
+    TEST_ASSERT_EQUAL_STRING(format("{}{}", std::string("ab"), 2.5),
+        format(RB_FMT("{}{}"), std::string("ab"), 2.5));
+}
+
+static void testIndexedMarkers() {
+    TEST_ASSERT_EQUAL_STRING("b a b", format(RB_FMT("{1} {0} {1}"), "a", "b"));
+    TEST_ASSERT_EQUAL_STRING(format("{1} {0} {1}", 1, 2), format(RB_FMT("{1} {0} {1}"), 1, 2));
+}
+
+static void testEscapes() {
+    TEST_ASSERT_EQUAL_STRING("{} 1 \\", format(RB_FMT("\\{\\} {} \\\\"), 1));
+    TEST_ASSERT_EQUAL_STRING(format("\\{\\} {} \\\\", 1), format(RB_FMT("\\{\\} {} \\\\"), 1));
+
+    // The arguments are not parsed for markers
+    TEST_ASSERT_EQUAL_STRING("a {} b", format(RB_FMT("a {} b"), "{}"));
+}
+
+static void testUnusedArgumentsAppended() {
+    TEST_ASSERT_EQUAL_STRING(format("x {}", 1, 2), format(RB_FMT("x {}"), 1, 2));
+    TEST_ASSERT_EQUAL_STRING("no markers12", format(RB_FMT("no markers"), 1, 2));
+}
+
+static void testFormatters() {
+    TEST_ASSERT_EQUAL_STRING("|  ab|0x1f|", format(RB_FMT("|{}|{}|"), string("ab").width(4), number(31).hex().basePrefix()));
+}
+
+static void testClipped() {
+    char buffer[8];
+    TEST_ASSERT_EQUAL_INT(7, formatTo(buffer, sizeof(buffer), RB_FMT("value {}"), 123456));
+    TEST_ASSERT_EQUAL_STRING("value 1", buffer);
+
+    const FormatBuffer<16> small(RB_FMT("{} {} {} {}"), "aaaa", "bbbb", "cccc", "dddd");
+    TEST_ASSERT_EQUAL_INT(15, small.size());
+    TEST_ASSERT_EQUAL_STRING("aaaa bbbb cccc ", small.c_str());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(testSequentialMarkers);
+    RUN_TEST(testIndexedMarkers);
+    RUN_TEST(testEscapes);
+    RUN_TEST(testUnusedArgumentsAppended);
+    RUN_TEST(testFormatters);
+    RUN_TEST(testClipped);
+    UNITY_END();
+}
@@ -0,0 +1,175 @@
+// Number formatters: the fast paths must print exactly what snprintf prints.
+
+#include <limits>
+#include <random>
+#include <string>
+
+#include "logger/format.hpp"
+
+#include "unity_host.hpp"
+
+static const int ROUNDS = 200000;
+
+static std::mt19937_64 rng(3201);
+
+template <typename T>
+static uint32_t randomModifiers(NumberFortmatter<T>& f, bool integer) {
+    const uint32_t r = rng();
+    if (r & 1)
+        f.alignLeft();
+    if (r & 2)
+        f.forceSign();
+    if (r & 4)
+        f.spaceForSign();
+    if (r & 8)
+        f.basePrefix();
+    if (r & 16)
+        f.leadingZeroes();
+    if (r & 32)
+        f.upperCase();
+    if (r & 64)
+        f.width((r >> 8) % 24);
+    if (r & 128)
+        f.precision((r >> 16) % (integer ? 24 : 12));
+    return r;
+}
+
+template <typename Formatter>
+static std::string fast(const Formatter& f) {
+    std::string res;
+    f.format(std::back_inserter(res));
+    return res;
+}
+
+template <typename Formatter>
+static std::string reference(const Formatter& f) {
+    std::string res;
+    f.formatWithSnprintf(std::back_inserter(res));
+    return res;
+}
+
+template <typename T>
+static std::string defaultFast(T value) {
+    std::string res;
+    DefaultSprintfFormatter<T>(value).format(std::back_inserter(res));
+    return res;
+}
+
+template <typename T>
+static std::string defaultReference(T value) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), FmtStr<T>::fmt_full, value);
+    return buffer;
+}
+
+#define ASSERT_SAME(expected, actual, value)                                                    \
+    do {                                                                                        \
+        const std::string e_ = (expected), a_ = (actual);                                       \
+        if (e_ != a_) {                                                                         \
+            printf("%s:%d: FAIL: value %s printed \"%s\", snprintf \"%s\"\n", __FILE__, __LINE__, \
+                std::to_string(value).c_str(), a_.c_str(), e_.c_str());                         \
+            rbsim::exitProcess(1);                                                              \
+        }                                                                                       \
+    } while (0)
+
+template <typename T>
+static T randomInteger() {
+    // Mostly small numbers, they are the common ones, and all the bit patterns too
+    const uint64_t bits = rng();
+    switch (bits & 3) {
+    case 0:
+        return static_cast<T>(static_cast<int64_t>(bits >> 2) % 1000);
+    case 1:
+        return static_cast<T>(bits >> 2);
+    case 2:
+        return (bits & 4) ? std::numeric_limits<T>::min() : std::numeric_limits<T>::max();
+    default:
+        return static_cast<T>(bits >> (2 + (bits >> 58)));
+    }
+}
+
+template <typename T>
+static void fuzzInteger() {
+    for (int i = 0; i != ROUNDS; ++i) {
+        const T value = randomInteger<T>();
+        auto f = number(value);
+        const uint32_t r = randomModifiers(f, true);
+        if (r & (1 << 24))
+            f.hex();
+        if (r & (1 << 25))
+            f.octal();
+        ASSERT_SAME(reference(f), fast(f), value);
+        ASSERT_SAME(defaultReference(value), defaultFast(value), value);
+    }
+}
+
+static void testIntegers() {
+    fuzzInteger<int16_t>();
+    fuzzInteger<uint16_t>();
+    fuzzInteger<int32_t>();
+    fuzzInteger<uint32_t>();
+    fuzzInteger<int64_t>();
+    fuzzInteger<uint64_t>();
+}
+
+template <typename T>
+static T randomFloat() {
+    const uint64_t bits = rng();
+    switch (bits & 3) {
+    case 0: // Typical sensor values
+        return static_cast<T>(static_cast<int64_t>(bits >> 2) % 2000000) / 1000;
+    case 1: { // Exact ties of the decimal places
+        const int places = (bits >> 2) % 8;
+        return static_cast<T>((static_cast<int64_t>(bits >> 8) % 100000) + 0.5) / (1 << places);
+    }
+    case 2: { // Any magnitude, infinities and NaNs included
+        typedef typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type Bits;
+        const Bits raw = static_cast<Bits>(rng());
+        T value;
+        memcpy(&value, &raw, sizeof(value));
+        return value;
+    }
+    default: // Around the range the fast path covers
+        return static_cast<T>(ldexp(static_cast<double>(bits >> 11) / (uint64_t(1) << 53), (bits >> 2) % 80 - 10))
+            * ((bits & 4) ? -1 : 1);
+    }
+}
+
+template <typename T>
+static void fuzzFloat() {
+    for (int i = 0; i != ROUNDS; ++i) {
+        const T value = randomFloat<T>();
+        auto f = number(value);
+        randomModifiers(f, false);
+        if (rng() & 1)
+            f.decimal();
+        ASSERT_SAME(reference(f), fast(f), value);
+        ASSERT_SAME(defaultReference(value), defaultFast(value), value);
+    }
+}
+
+static void testFloats() {
+    fuzzFloat<float>();
+    fuzzFloat<double>();
+}
+
+static void testKnownValues() {
+    TEST_ASSERT_EQUAL_STRING("-0.000000", defaultFast(-0.0));
+    TEST_ASSERT_EQUAL_STRING("0.125", fast(number(0.125).precision(3)));
+    TEST_ASSERT_EQUAL_STRING("0.12", fast(number(0.125).precision(2))); // Half to even
+    TEST_ASSERT_EQUAL_STRING("2.", fast(number(2.5).precision(0).basePrefix()));
+    TEST_ASSERT_EQUAL_STRING("-0001.50", fast(number(-1.5).precision(2).width(8).leadingZeroes()));
+    TEST_ASSERT_EQUAL_STRING("0x00ff", fast(number(255).hex().basePrefix().width(6).leadingZeroes()));
+    TEST_ASSERT_EQUAL_STRING("0", fast(number(0).octal().basePrefix().precision(0)));
+    TEST_ASSERT_EQUAL_STRING("", fast(number(0).precision(0)));
+    TEST_ASSERT_EQUAL_STRING("+42  ", fast(number(42).forceSign().alignLeft().width(5)));
+    TEST_ASSERT_EQUAL_STRING("ffffffff", fast(number(int16_t(-1)).hex()));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(testKnownValues);
+    RUN_TEST(testIntegers);
+    RUN_TEST(testFloats);
+    UNITY_END();
+}
@@ -0,0 +1,248 @@
+// I2C worker queue: writes never wait for the bus, pending writes to the same registers
+// merge, writes to one device share a transaction and reads see the writes before them.
+
+#include <atomic>
+#include <esp_timer.h>
+#include <thread>
+#include <vector>
+
+#include "Adafruit_MCP23017.h"
+#include "RBControl_i2cQueue.hpp"
+#include "RBControl_pinout.hpp"
+
+#include "unity_host.hpp"
+
+using namespace rb;
+
+static const i2c_port_t PORT = I2C_NUM_1;
+static const uint8_t ADDRESS = 0x20;
+static const uint8_t OTHER_ADDRESS = 0x40;
+
+static const uint8_t IODIRA = 0x00;
+static const uint8_t OLATA = 0x14;
+static const uint8_t OLATB = 0x15;
+
+// Takes its time with every byte, like a real bus would
+class SlowDevice : public rbsim::I2cRegisterDevice {
+public:
+    void start(bool read) override {
+        m_selecting = !read;
+        m_recorded = false;
+        I2cRegisterDevice::start(read);
+    }
+
+    void write(uint8_t data) override {
+        std::this_thread::sleep_for(std::chrono::microseconds(delay_us));
+        if (m_selecting) {
+            m_selected = data;
+            m_selecting = false;
+        } else if (!m_recorded) {
+            written.push_back(m_selected);
+            m_recorded = true;
+        }
+        I2cRegisterDevice::write(data);
+    }
+
+    std::atomic<int> delay_us { 0 };
+    std::vector<uint8_t> written; //!< Registers in the order they were written to
+
+private:
+    bool m_selecting = false;
+    bool m_recorded = false;
+    uint8_t m_selected = 0;
+};
+
+static SlowDevice device;
+static SlowDevice other;
+static I2cQueue queue(PORT);
+
+// Keeps the worker busy in a read callback until release()
+class Gate {
+public:
+    Gate() {
+        queue.read(ADDRESS, 0, 1, [this](esp_err_t, const uint8_t*, size_t) {
+            entered = true;
+            while (!released)
+                vTaskDelay(1);
+        });
+        while (!entered)
+            vTaskDelay(1);
+    }
+
+    void release() { released = true; }
+
+private:
+    std::atomic<bool> entered { false };
+    std::atomic<bool> released { false };
+};
+
+static void testSynchronousBeforeInstall() {
+    const uint8_t value = 0x5A;
+    TEST_ASSERT_EQUAL_INT(ESP_OK, queue.write(ADDRESS, OLATA, &value, 1));
+    TEST_ASSERT_EQUAL_INT(0x5A, device.reg(OLATA)); // Already written
+
+    uint8_t read = 0;
+    TEST_ASSERT_EQUAL_INT(ESP_OK, queue.readSync(ADDRESS, OLATA, &read, 1));
+    TEST_ASSERT_EQUAL_INT(0x5A, read);
+
+    uint8_t tooLong[I2cQueue::MAX_LENGTH + 1] = { 0 };
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, queue.write(ADDRESS, 0, tooLong, sizeof(tooLong)));
+}
+
+static void testWriteDoesNotWait() {
+    device.delay_us = 2000;
+    const uint8_t values[2] = { 0x12, 0x34 };
+
+    const int64_t start = esp_timer_get_time();
+    queue.write(ADDRESS, OLATA, values, 2);
+    const int64_t queued = esp_timer_get_time() - start;
+    queue.flush();
+    const int64_t flushed = esp_timer_get_time() - start;
+    device.delay_us = 0;
+
+    TEST_ASSERT_TRUE(queued < 1000);
+    TEST_ASSERT_TRUE(flushed >= 6000); // Address, register and two values
+    TEST_ASSERT_EQUAL_INT(0x12, device.reg(OLATA));
+    TEST_ASSERT_EQUAL_INT(0x34, device.reg(OLATB));
+}
+
+static void testCoalescing() {
+    Gate gate;
+    const auto before = queue.stats();
+
+    for (uint8_t i = 0; i != 10; ++i) {
+        const uint8_t values[2] = { i, uint8_t(i + 100) };
+        queue.write(ADDRESS, OLATA, values, 2);
+    }
+    const uint8_t other_value = 7;
+    queue.write(OTHER_ADDRESS, 0x01, &other_value, 1);
+    TEST_ASSERT_EQUAL_INT(2, queue.stats().waiting);
+
+    rbsim::i2cResetStats(PORT);
+    gate.release();
+    queue.flush();
+
+    const auto after = queue.stats();
+    TEST_ASSERT_EQUAL_INT(9, after.coalesced - before.coalesced);
+    TEST_ASSERT_EQUAL_INT(2, rbsim::i2cStats(PORT).transactions);
+    TEST_ASSERT_EQUAL_INT(9, device.reg(OLATA));
+    TEST_ASSERT_EQUAL_INT(109, device.reg(OLATB));
+    TEST_ASSERT_EQUAL_INT(7, other.reg(0x01));
+    TEST_ASSERT_TRUE(after.maxWaiting >= 2);
+    TEST_ASSERT_EQUAL_INT(0, after.errors);
+}
+
+static void testCoalescingKeepsOrder() {
+    Gate gate;
+    const auto before = queue.stats();
+    const uint8_t input = 0xFF;
+    const uint8_t latch = 0x5A;
+    const uint8_t output = 0x00;
+
+    // The latches have to be set before the pins become outputs
+    queue.write(ADDRESS, IODIRA, &input, 1);
+    queue.write(ADDRESS, OLATA, &latch, 1);
+    queue.write(ADDRESS, IODIRA, &output, 1);
+    TEST_ASSERT_EQUAL_INT(3, queue.stats().waiting);
+
+    device.written.clear();
+    gate.release();
+    queue.flush();
+    TEST_ASSERT_EQUAL_INT(0, queue.stats().coalesced - before.coalesced);
+    TEST_ASSERT_EQUAL_INT(3, device.written.size());
+    TEST_ASSERT_EQUAL_INT(IODIRA, device.written[0]);
+    TEST_ASSERT_EQUAL_INT(OLATA, device.written[1]);
+    TEST_ASSERT_EQUAL_INT(IODIRA, device.written[2]);
+    TEST_ASSERT_EQUAL_INT(0x5A, device.reg(OLATA));
+    TEST_ASSERT_EQUAL_INT(0x00, device.reg(IODIRA));
+}
+
+static void testReadSeesEarlierWrites() {
+    Gate gate;
+    const uint8_t first = 1;
+    const uint8_t second = 2;
+    std::atomic<int> seen { -1 };
+
+    queue.write(ADDRESS, OLATA, &first, 1);
+    queue.read(ADDRESS, OLATA, 1, [&](esp_err_t err, const uint8_t* data, size_t len) {
+        seen = err == ESP_OK && len == 1 ? data[0] : -2;
+    });
+    // Must not merge over the read
+    queue.write(ADDRESS, OLATA, &second, 1);
+
+    gate.release();
+    queue.flush();
+    TEST_ASSERT_EQUAL_INT(1, seen.load());
+    TEST_ASSERT_EQUAL_INT(2, device.reg(OLATA));
+}
+
+static void testWritesShareTransaction() {
+    Gate gate;
+    const uint8_t a = 0xA0;
+    const uint8_t b = 0xB0;
+    const uint8_t c = 0xC0;
+    queue.write(ADDRESS, 0x00, &a, 1);
+    queue.write(ADDRESS, 0x0C, &b, 1);
+    queue.write(ADDRESS, 0x14, &c, 1);
+
+    rbsim::i2cResetStats(PORT);
+    gate.release();
+    queue.flush();
+    TEST_ASSERT_EQUAL_INT(1, rbsim::i2cStats(PORT).transactions);
+    TEST_ASSERT_EQUAL_INT(0xA0, device.reg(0x00));
+    TEST_ASSERT_EQUAL_INT(0xB0, device.reg(0x0C));
+    TEST_ASSERT_EQUAL_INT(0xC0, device.reg(0x14));
+}
+
+static void testExpanderThroughQueue() {
+    for (int reg = 0; reg != 0x16; ++reg)
+        device.setReg(reg, reg < 2 ? 0xFF : 0x00);
+    Adafruit_MCP23017 exp(ADDRESS, PORT, GPIO_NUM_21, GPIO_NUM_22);
+    exp.setQueue(&queue);
+
+    {
+        Gate gate;
+        exp.batch().pinMode(LED_RED, GPIO_MODE_OUTPUT).pinMode(LED_GREEN, GPIO_MODE_OUTPUT).apply();
+        for (int i = 0; i != 5; ++i) {
+            exp.digitalWrite(LED_RED, i & 1);
+            exp.digitalWrite(LED_GREEN, !(i & 1));
+        }
+
+        rbsim::i2cResetStats(PORT);
+        gate.release();
+        exp.flush();
+    }
+
+    // All the latch writes merged, the direction write shares the transaction
+    TEST_ASSERT_EQUAL_INT(1, rbsim::i2cStats(PORT).transactions);
+    TEST_ASSERT_EQUAL_INT(1 << (LED_GREEN - 8), device.reg(OLATB));
+    TEST_ASSERT_EQUAL_INT(0xFF & ~((1 << (LED_RED - 8)) | (1 << (LED_GREEN - 8))), device.reg(0x01));
+
+    device.setReg(0x12, 0x34);
+    device.setReg(0x13, 0x12);
+    TEST_ASSERT_EQUAL_INT(0x1234, exp.readGPIOAB());
+}
+
+static void testLatencyStats() {
+    const auto stats = queue.stats();
+    TEST_ASSERT_TRUE(stats.latency.count() > 0);
+    TEST_ASSERT_TRUE(stats.latency.max() >= 6000); // The slow write
+    TEST_ASSERT_EQUAL_INT(0, stats.waiting);
+}
+
+int main() {
+    UNITY_BEGIN();
+    rbsim::i2cAttach(PORT, ADDRESS, &device);
+    rbsim::i2cAttach(PORT, OTHER_ADDRESS, &other);
+
+    RUN_TEST(testSynchronousBeforeInstall);
+    queue.install();
+    RUN_TEST(testWriteDoesNotWait);
+    RUN_TEST(testCoalescing);
+    RUN_TEST(testCoalescingKeepsOrder);
+    RUN_TEST(testReadSeesEarlierWrites);
+    RUN_TEST(testWritesShareTransaction);
+    RUN_TEST(testExpanderThroughQueue);
+    RUN_TEST(testLatencyStats);
+    UNITY_END();
+}
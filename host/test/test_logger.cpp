@@ -0,0 +1,265 @@
+// Logger filtering: messages no sink takes are dropped before any formatting.
+
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "RBControl_logger.hpp"
+
+#include "unity_host.hpp"
+
+using TestLogger = BaseLogger<std::string, std::mutex, DummyClock>;
+
+struct CaptureSink : public LogSink {
+    CaptureSink(std::vector<std::string>& out)
+        : messages(out) {}
+
+    void log(Verbosity, const std::string& tag, const std::string& message, uint64_t) override {
+        messages.push_back(tag + ": " + message);
+    }
+
+    std::vector<std::string>& messages;
+};
+
+static int evaluated = 0;
+
+static int countEvaluation() {
+    return ++evaluated;
+}
+
+static void testNoSinks() {
+    TestLogger logger;
+    TEST_ASSERT_FALSE(logger.enabled(PANIC));
+}
+
+static void testThresholds() {
+    std::vector<std::string> messages;
+    TestLogger logger;
+    logger.addSink(WARNING, std::unique_ptr<LogSink>(new CaptureSink(messages)));
+    TEST_ASSERT_TRUE(logger.enabled(ERROR));
+    TEST_ASSERT_TRUE(logger.enabled(WARNING));
+    TEST_ASSERT_FALSE(logger.enabled(INFO));
+
+    logger.log(INFO, "Tag", "dropped {}", 1) << 2;
+    logger.log(DEBUG, "Tag", RB_FMT("dropped {}"), 1);
+    logger.log(WARNING, "Tag", "kept {}", 1) << 2;
+    logger.log(ERROR, "Tag", RB_FMT("kept {}"), 3);
+    TEST_ASSERT_EQUAL_INT(2, messages.size());
+    TEST_ASSERT_EQUAL_STRING("Tag: kept 12", messages[0]);
+    TEST_ASSERT_EQUAL_STRING("Tag: kept 3", messages[1]);
+
+    // The most verbose sink decides
+    logger.addSink(DEBUG, std::unique_ptr<LogSink>(new CaptureSink(messages)));
+    TEST_ASSERT_TRUE(logger.enabled(DEBUG));
+    logger.log(INFO, "Tag", RB_FMT("once"));
+    TEST_ASSERT_EQUAL_INT(3, messages.size());
+}
+
+static void testDiscardedFormatString() {
+    FormatString fmt = FormatString::discarded();
+    fmt << 1 << "text" << number(2).width(5);
+    TEST_ASSERT_EQUAL_STRING("", fmt);
+}
+
+static void testMacroSkipsArguments() {
+    // Above RB_LOG_LEVEL and every sink's threshold, the arguments are not even evaluated
+    RB_LOG(ALL + 1, "Tag", RB_FMT("{}"), countEvaluation());
+    TEST_ASSERT_EQUAL_INT(0, evaluated);
+}
+
+static void testAsyncDelivery() {
+    std::vector<std::string> messages;
+    TestLogger logger;
+    logger.addSink(ALL, std::unique_ptr<LogSink>(new CaptureSink(messages)));
+    logger.enableAsync(8);
+
+    logger.log(INFO, "Motor", "power {}", 10);
+    logger.log(INFO, "Encoder", RB_FMT("value {}"), 20);
+    logger.log(INFO, "Motor", RB_FMT("power {}"), 30);
+    TEST_ASSERT_EQUAL_INT(0, messages.size());
+
+    TEST_ASSERT_EQUAL_INT(3, logger.processQueue());
+    TEST_ASSERT_EQUAL_INT(3, messages.size());
+    TEST_ASSERT_EQUAL_STRING("Motor: power 10", messages[0]);
+    TEST_ASSERT_EQUAL_STRING("Encoder: value 20", messages[1]);
+    TEST_ASSERT_EQUAL_STRING("Motor: power 30", messages[2]);
+    TEST_ASSERT_EQUAL_INT(0, logger.processQueue());
+}
+
+static void testAsyncOverflow() {
+    std::vector<std::string> messages;
+    TestLogger logger;
+    logger.addSink(ALL, std::unique_ptr<LogSink>(new CaptureSink(messages)));
+    logger.enableAsync(4);
+
+    for (int i = 0; i != 10; ++i)
+        logger.log(INFO, "Tag", RB_FMT("{}"), i);
+    TEST_ASSERT_EQUAL_INT(6, logger.dropped());
+
+    // The oldest messages are kept, the drop is reported after them
+    TEST_ASSERT_EQUAL_INT(4, logger.processQueue());
+    TEST_ASSERT_EQUAL_INT(5, messages.size());
+    TEST_ASSERT_EQUAL_STRING("Tag: 3", messages[3]);
+    TEST_ASSERT_EQUAL_STRING("Logger: 6 messages dropped, the queue is full", messages[4]);
+
+    logger.log(INFO, "Tag", RB_FMT("after"));
+    logger.processQueue();
+    TEST_ASSERT_EQUAL_INT(6, messages.size());
+}
+
+static void testAsyncLongMessage() {
+    std::vector<std::string> messages;
+    TestLogger logger;
+    logger.addSink(ALL, std::unique_ptr<LogSink>(new CaptureSink(messages)));
+    logger.enableAsync(4);
+
+    // Takes three records, the same as the synchronous mode would print
+    const std::string line(250, 'x');
+    logger.log(INFO, "Tag", line + "{}", 1);
+    logger.log(INFO, "Tag", RB_FMT("short"));
+    TEST_ASSERT_EQUAL_INT(0, logger.dropped());
+    TEST_ASSERT_EQUAL_INT(2, logger.processQueue());
+    TEST_ASSERT_EQUAL_INT(2, messages.size());
+    TEST_ASSERT_EQUAL_STRING("Tag: " + line + "1", messages[0]);
+    TEST_ASSERT_EQUAL_STRING("Tag: short", messages[1]);
+
+    // Doesn't fit next to a queued message, dropped as a whole
+    logger.log(INFO, "Tag", RB_FMT("first"));
+    logger.log(INFO, "Tag", std::string(4 * LOG_PAYLOAD_SIZE, 'z'));
+    TEST_ASSERT_EQUAL_INT(1, logger.dropped());
+    TEST_ASSERT_EQUAL_INT(1, logger.processQueue());
+    TEST_ASSERT_EQUAL_STRING("Tag: first", messages[2]);
+
+    // Longer than the whole queue, only that much is kept
+    logger.log(INFO, "Tag", std::string(1000, 'y'));
+    TEST_ASSERT_EQUAL_INT(1, logger.processQueue());
+    TEST_ASSERT_EQUAL_STRING("Tag: " + std::string(4 * LOG_PAYLOAD_SIZE, 'y'), messages.back());
+}
+
+static void testAsyncManyProducers() {
+    std::vector<std::string> messages;
+    TestLogger logger;
+    logger.addSink(ALL, std::unique_ptr<LogSink>(new CaptureSink(messages)));
+    logger.enableAsync(64);
+
+    const int THREADS = 4;
+    const int PER_THREAD = 2000;
+    std::atomic<int> running(THREADS);
+    std::vector<std::thread> producers;
+    for (int t = 0; t != THREADS; ++t) {
+        producers.emplace_back([&, t]() {
+            for (int i = 0; i != PER_THREAD; ++i)
+                logger.log(INFO, "T", RB_FMT("{} {}"), t, i);
+            --running;
+        });
+    }
+
+    size_t received = 0;
+    while (running > 0)
+        received += logger.processQueue();
+    for (auto& t : producers)
+        t.join();
+    received += logger.processQueue();
+
+    TEST_ASSERT_EQUAL_INT(THREADS * PER_THREAD, received + logger.dropped());
+}
+
+// The row as the sink formatted it before the columns were cached
+static std::string referenceRow(Verbosity verb, const std::string& tag, const std::string& message,
+    uint64_t timestamp, int width) {
+    static const std::vector<std::string> levels({ "panic", "error", "warning", "info", "debug" });
+    if (verb >= PANIC && verb <= DEBUG) {
+        return format("| {} | {} | {} | {} |\n")
+            << number(timestamp).alignRight().width(10)
+            << string(levels[verb + 3]).alignRight().width(7)
+            << string(tag).alignRight().width(10)
+            << string(message).alignLeft().width(width).clip();
+    }
+    return format("| {} | {} | {} | {} |\n")
+        << number(timestamp).alignRight().width(10)
+        << number(static_cast<int>(verb)).width(7)
+        << string(tag).alignRight().width(10)
+        << string(message).alignLeft().width(width).clip();
+}
+
+static void testStreamSinkRows() {
+    std::ostringstream out;
+    StreamLogSink sink(out, 80);
+    const std::string header = out.str();
+    TEST_ASSERT_TRUE(header.size() > 0);
+
+    const std::string longMessage(60, 'm');
+    struct {
+        Verbosity verb;
+        const char* tag;
+        std::string message;
+        uint64_t timestamp;
+    } rows[] = {
+        { INFO, "Motor", "power 42", 5 },
+        { PANIC, "Motor", "", 12345678901ULL },
+        { DEBUG, "AVeryLongTagName", longMessage, 0 },
+        { static_cast<Verbosity>(7), "Odd", "verbosity", 1 },
+        { WARNING, "", std::string(40, 'x'), 99 },
+    };
+    for (const auto& row : rows) {
+        out.str("");
+        const uint8_t id = TagRegistry<std::string>::global().intern(row.tag, strlen(row.tag));
+        sink.logTagged(row.verb, id, row.tag, row.message, row.timestamp);
+        TEST_ASSERT_EQUAL_STRING(referenceRow(row.verb, row.tag, row.message, row.timestamp, 40), out.str());
+
+        // Cached now, and the overflow path without a cache matches too
+        out.str("");
+        sink.logTagged(row.verb, id, row.tag, row.message, row.timestamp);
+        sink.log(row.verb, row.tag, row.message, row.timestamp);
+        const std::string expected = referenceRow(row.verb, row.tag, row.message, row.timestamp, 40);
+        TEST_ASSERT_EQUAL_STRING(expected + expected, out.str());
+    }
+}
+
+struct IdSink : public LogSink {
+    void log(Verbosity, const std::string&, const std::string&, uint64_t) override {}
+
+    void logTagged(Verbosity, uint8_t tagId, const std::string& tag, const std::string&, uint64_t) override {
+        ids.push_back(tagId);
+        tags.push_back(tag);
+    }
+
+    std::vector<uint8_t> ids;
+    std::vector<std::string> tags;
+};
+
+static void testTagsInterned() {
+    auto* sink = new IdSink();
+    TestLogger first;
+    first.addSink(INFO, std::unique_ptr<LogSink>(sink));
+    TestLogger second;
+    second.addSink(INFO, std::unique_ptr<LogSink>(new IdSink()));
+
+    const std::string dynamic = "Intern";
+    first.log(INFO, "Intern", RB_FMT("a"));
+    first.log(INFO, dynamic, "b");
+    first.log(INFO, "Other", RB_FMT("c"));
+    TEST_ASSERT_EQUAL_INT(3, sink->ids.size());
+    TEST_ASSERT_EQUAL_INT(sink->ids[0], sink->ids[1]);
+    TEST_ASSERT_TRUE(sink->ids[0] != sink->ids[2]);
+    TEST_ASSERT_EQUAL_STRING("Intern", sink->tags[1]);
+    TEST_ASSERT_EQUAL_STRING("Other", sink->tags[2]);
+
+    // The registry is shared, the ids are the same in every logger
+    TEST_ASSERT_EQUAL_INT(sink->ids[2], TagRegistry<std::string>::global().intern("Other", 5));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(testNoSinks);
+    RUN_TEST(testThresholds);
+    RUN_TEST(testDiscardedFormatString);
+    RUN_TEST(testMacroSkipsArguments);
+    RUN_TEST(testAsyncDelivery);
+    RUN_TEST(testAsyncOverflow);
+    RUN_TEST(testAsyncLongMessage);
+    RUN_TEST(testAsyncManyProducers);
+    RUN_TEST(testStreamSinkRows);
+    RUN_TEST(testTagsInterned);
+    UNITY_END();
+}
@@ -0,0 +1,209 @@
+// The Manager with its tasks running on the simulated FreeRTOS: motor power to the
+// PWM outputs, encoders counting simulated quadrature signals, the latching emergency stop.
+
+#include <atomic>
+#include <thread>
+
+#include "RBControl_manager.hpp"
+
+#include "pwm_decode.hpp"
+#include "unity_host.hpp"
+
+using namespace rb;
+
+// Motor M1 drives these SerialPWM channels, the outputs are inverted
+static const int M1_PWM0 = 12;
+static const int M1_PWM1 = 13;
+static const int PWM_MAX = 100;
+
+static rbsim::I2cRegisterDevice expander;
+static int encoderDirection = 1;
+
+static int decode(int channel) {
+    return decodePwm(1, channel, 16, 1);
+}
+
+static void testMotorPower() {
+    auto& man = Manager::get();
+
+    man.setMotors().power(MotorId::M1, 50).set();
+    TEST_ASSERT_EVENTUALLY(decode(M1_PWM1) == PWM_MAX - 50, 1000);
+    TEST_ASSERT_EQUAL_INT(PWM_MAX, decode(M1_PWM0));
+
+    man.setMotors().power(MotorId::M1, -30).set();
+    TEST_ASSERT_EVENTUALLY(decode(M1_PWM0) == PWM_MAX - 30, 1000);
+    TEST_ASSERT_EQUAL_INT(PWM_MAX, decode(M1_PWM1));
+
+    man.setMotors().pwmMaxPercent(MotorId::M1, 50).power(MotorId::M1, 100).set();
+    TEST_ASSERT_EVENTUALLY(decode(M1_PWM1) == PWM_MAX - 50, 1000);
+
+    man.setMotors().pwmMaxPercent(MotorId::M1, 100).power(MotorId::M1, 0).set();
+    TEST_ASSERT_EVENTUALLY(decode(M1_PWM0) == PWM_MAX && decode(M1_PWM1) == PWM_MAX, 1000);
+}
+
+static void testEncoderCounts() {
+    auto* enc = Manager::get().motor(MotorId::M1).encoder();
+    const int32_t start = enc->value();
+
+    // 4 edges make one encoder cycle, 2 increments in the default mode
+    rbsim::quadratureMove(ENC1A, ENC1B, 40);
+    const int32_t moved = enc->value() - start;
+    TEST_ASSERT_EQUAL_INT(20, abs(moved));
+    encoderDirection = moved > 0 ? 1 : -1;
+
+    rbsim::quadratureMove(ENC1A, ENC1B, -40);
+    TEST_ASSERT_EQUAL_INT(start, enc->value());
+
+    const auto snapshot = Manager::get().readEncoders();
+    TEST_ASSERT_EQUAL_INT(start, snapshot.value(MotorId::M1));
+}
+
+static void testDriveToValue() {
+    auto& motor = Manager::get().motor(MotorId::M1);
+    std::atomic<bool> reached(false);
+
+    motor.drive(30, 60, [&](Encoder&) { reached = true; });
+    TEST_ASSERT_EVENTUALLY(decode(M1_PWM1) == PWM_MAX - 60 || decode(M1_PWM0) == PWM_MAX - 60, 1000);
+
+    // Turn the "motor" until the PCNT threshold interrupt stops it
+    for (int i = 0; i != 200 && !reached; ++i) {
+        rbsim::quadratureMove(ENC1A, ENC1B, encoderDirection);
+        vTaskDelay(1);
+    }
+    TEST_ASSERT_EVENTUALLY(reached.load(), 1000);
+    TEST_ASSERT_EVENTUALLY(decode(M1_PWM0) == PWM_MAX && decode(M1_PWM1) == PWM_MAX, 1000);
+}
+
+static void testDriveBackToZero() {
+    // Before the first overflow, the target 0 is where the hardware counter is 0 too
+    auto& motor = Manager::get().motor(MotorId::M1);
+    auto* enc = motor.encoder();
+    std::atomic<bool> reached(false);
+    TEST_ASSERT_TRUE(enc->value() != 0);
+
+    const int back = enc->value() > 0 ? -encoderDirection : encoderDirection;
+    motor.driveToValue(0, 60, [&](Encoder&) { reached = true; });
+    for (int i = 0; i != 200 && !reached; ++i) {
+        rbsim::quadratureMove(ENC1A, ENC1B, back);
+        vTaskDelay(1);
+    }
+    TEST_ASSERT_EVENTUALLY(reached.load(), 1000);
+    TEST_ASSERT_TRUE(abs(enc->value()) <= 2);
+    TEST_ASSERT_EVENTUALLY(decode(M1_PWM0) == PWM_MAX && decode(M1_PWM1) == PWM_MAX, 1000);
+}
+
+static void testEmergencyStop() {
+    auto& man = Manager::get();
+    man.setMotors().power(MotorId::M1, 80).set();
+    TEST_ASSERT_EVENTUALLY(decode(M1_PWM1) == PWM_MAX - 80, 1000);
+
+    // The coast buffer is active right away, without waiting for the manager's task
+    man.emergencyStop();
+    for (int ch = 0; ch != 16; ++ch)
+        TEST_ASSERT_EQUAL_INT(PWM_MAX, decode(ch));
+
+    TEST_ASSERT_TRUE(man.emergencyStopped());
+    man.clearEmergencyStop();
+    man.setMotors().power(MotorId::M1, 40).set();
+    TEST_ASSERT_EVENTUALLY(decode(M1_PWM1) == PWM_MAX - 40, 1000);
+    TEST_ASSERT_TRUE(rbsim::i2sParallelActiveBuffer(1) < 2);
+}
+
+// All the outputs of the coast buffer
+static bool allOff() {
+    for (int ch = 0; ch != 16; ++ch) {
+        if (decode(ch) != PWM_MAX)
+            return false;
+    }
+    return true;
+}
+
+static void testEmergencyStopLatches() {
+    auto& man = Manager::get();
+
+    // Commands queued before the stop, some of them still waiting when it comes
+    for (int i = 0; i != 20; ++i)
+        man.setMotors().power(MotorId::M1, 50 + i).set();
+    man.emergencyStop();
+    TEST_ASSERT_TRUE(allOff());
+
+    // And the control loop's next command after it
+    man.setMotors().power(MotorId::M1, 90).set();
+    for (int i = 0; i != 20; ++i) {
+        vTaskDelay(pdMS_TO_TICKS(5));
+        TEST_ASSERT_TRUE(allOff());
+    }
+    TEST_ASSERT_EQUAL_INT(0, man.stats().eventQueueWaiting);
+    TEST_ASSERT_TRUE(allOff());
+
+    man.clearEmergencyStop();
+    TEST_ASSERT_TRUE(allOff());
+    man.setMotors().power(MotorId::M1, 30).set();
+    TEST_ASSERT_EVENTUALLY(decode(M1_PWM1) == PWM_MAX - 30, 1000);
+    man.setMotors().power(MotorId::M1, 0).set();
+    TEST_ASSERT_EVENTUALLY(decode(M1_PWM0) == PWM_MAX && decode(M1_PWM1) == PWM_MAX, 1000);
+}
+
+static void testEmergencyStopUnderLoad() {
+    auto& man = Manager::get();
+    const uint32_t stopsBefore = man.stats().emergencyStops;
+
+    // The control loop keeps the manager's queue full while the stops come
+    std::atomic<bool> running(true);
+    std::thread load([&]() {
+        for (int i = 0; running.load(); ++i)
+            man.setMotors().power(MotorId::M1, i % 100).set();
+    });
+
+    for (int i = 0; i != 20; ++i) {
+        man.emergencyStop();
+        TEST_ASSERT_TRUE(allOff());
+        vTaskDelay(pdMS_TO_TICKS(5));
+        man.clearEmergencyStop();
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    running.store(false);
+    load.join();
+
+    const auto stats = man.stats();
+    TEST_ASSERT_EQUAL_INT(stopsBefore + 20, stats.emergencyStops);
+    TEST_ASSERT_TRUE(stats.queueFullWaits > 0);
+    TEST_ASSERT_TRUE(stats.emergencyStopOutputMaxUs <= stats.emergencyStopClearMaxUs);
+    TEST_ASSERT_TRUE(stats.emergencyStopClearMaxUs > 0);
+    TEST_ASSERT_TRUE(stats.emergencyStopClearMaxUs < 100000);
+
+    man.setMotors().power(MotorId::M1, 0).set();
+    TEST_ASSERT_EVENTUALLY(decode(M1_PWM0) == PWM_MAX && decode(M1_PWM1) == PWM_MAX, 1000);
+}
+
+static void testExpanderInitialized() {
+    // Port A drives the LEDs, all its pins are outputs, see Manager::setupExpander
+    TEST_ASSERT_EQUAL_INT(0x00, expander.reg(0x00));
+}
+
+static void testStats() {
+    const auto stats = Manager::get().stats();
+    TEST_ASSERT_TRUE(stats.tasks.size() >= 1);
+    TEST_ASSERT_EQUAL_INT(0, stats.droppedIsrEvents);
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    for (int reg = 0; reg != 0x16; ++reg)
+        expander.setReg(reg, reg < 2 ? 0xFF : 0x00); // IODIR resets to inputs
+    rbsim::i2cAttach(I2C_NUM_0, I2C_ADDR_EXPANDER, &expander);
+
+    Manager::get().install(MAN_DISABLE_MOTOR_FAILSAFE);
+
+    RUN_TEST(testMotorPower);
+    RUN_TEST(testEncoderCounts);
+    RUN_TEST(testDriveToValue);
+    RUN_TEST(testDriveBackToZero);
+    RUN_TEST(testEmergencyStop);
+    RUN_TEST(testEmergencyStopLatches);
+    RUN_TEST(testEmergencyStopUnderLoad);
+    RUN_TEST(testExpanderInitialized);
+    RUN_TEST(testStats);
+    UNITY_END();
+}
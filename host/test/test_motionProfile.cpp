@@ -0,0 +1,61 @@
+// Motion profiles: within the limits, monotonic towards the target, ending at rest,
+// and stretched to a longer duration.
+
+#include <math.h>
+
+#include "RBControl_motionProfile.hpp"
+
+#include "unity_host.hpp"
+
+using namespace rb;
+
+static void checkProfile(float distance, const MotionLimits& limits) {
+    MotionProfile profile;
+    profile.plan(distance, limits);
+    TEST_ASSERT_TRUE(profile.duration() > 0.f);
+
+    float pos, vel;
+    profile.sample(0.f, pos, vel);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.f, pos);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.f, vel);
+
+    float prev_pos = 0.f;
+    const int steps = 1000;
+    for (int i = 1; i <= steps; ++i) {
+        profile.sample(profile.duration() * i / steps, pos, vel);
+        TEST_ASSERT_TRUE(fabsf(vel) <= limits.velocity * 1.001f);
+        // Monotonic towards the target
+        TEST_ASSERT_TRUE((pos - prev_pos) * distance >= -0.001f);
+        prev_pos = pos;
+    }
+    TEST_ASSERT_FLOAT_WITHIN(fabsf(distance) * 0.001f + 0.01f, distance, pos);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.f, vel);
+}
+
+static void testMotionProfiles() {
+    checkProfile(1000.f, MotionLimits(200.f, 400.f));
+    checkProfile(-1000.f, MotionLimits(200.f, 400.f));
+    checkProfile(1000.f, MotionLimits(200.f, 400.f, 2000.f));
+    // Too short to reach the velocity or the acceleration limit
+    checkProfile(10.f, MotionLimits(200.f, 400.f));
+    checkProfile(10.f, MotionLimits(200.f, 400.f, 2000.f));
+}
+
+static void testMotionProfileStretch() {
+    MotionProfile profile;
+    profile.plan(1000.f, MotionLimits(200.f, 400.f, 2000.f));
+    const float orig = profile.duration();
+    profile.stretch(orig * 2.f);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, orig * 2.f, profile.duration());
+
+    float pos, vel;
+    profile.sample(profile.duration(), pos, vel);
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 1000.f, pos);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(testMotionProfiles);
+    RUN_TEST(testMotionProfileStretch);
+    UNITY_END();
+}
@@ -0,0 +1,181 @@
+// MotorControl closing its loops over simulated DC motors: the model reads the power from
+// the motors' PWM outputs and turns the encoders, the regulators must hold the speed and
+// the position without a steady-state error against the motors' load.
+
+#include <math.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "RBControl_manager.hpp"
+
+#include "dc_motor.hpp"
+#include "pwm_decode.hpp"
+#include "unity_host.hpp"
+
+using namespace rb;
+
+static const int PWM_MAX = 100;
+
+// A motor's model with its PWM channels and encoder pins
+struct SimMotor {
+    SimMotor(int pwm0, int pwm1, gpio_num_t a, gpio_num_t b)
+        : model(20.f, 0.05f, 150.f)
+        , pwm0(pwm0)
+        , pwm1(pwm1)
+        , a(a)
+        , b(b)
+        , emitted(0) {}
+
+    // The outputs are inverted, see Motor::direct_power
+    float power() const {
+        return float(decodePwm(1, pwm0, 16, 1) - decodePwm(1, pwm1, 16, 1)) * 100.f / PWM_MAX;
+    }
+
+    DcMotorModel model;
+    int pwm0;
+    int pwm1;
+    gpio_num_t a;
+    gpio_num_t b;
+    int32_t emitted;
+};
+
+static SimMotor motors[] = {
+    SimMotor(12, 13, ENC1A, ENC1B),
+    SimMotor(2, 3, ENC2A, ENC2B),
+};
+static std::atomic<bool> simRunning(true);
+static int encoderDirection = 1;
+
+static SimMotor& sim(MotorId id) {
+    return motors[static_cast<int>(id)];
+}
+
+static void simRoutine() {
+    int64_t last = esp_timer_get_time();
+    while (simRunning.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        const int64_t now = esp_timer_get_time();
+        const float dt = float(now - last) / 1000000.f;
+        last = now;
+
+        for (auto& m : motors) {
+            m.model.step(m.power(), dt);
+            const int32_t edges = int32_t(floorf(m.model.position)) - m.emitted;
+            rbsim::quadratureMove(m.a, m.b, edges * encoderDirection);
+            m.emitted += edges;
+        }
+    }
+}
+
+static int32_t value(MotorId id) {
+    return Manager::get().motor(id).encoder()->value();
+}
+
+static MotorControl& control() {
+    return Manager::get().initMotorControl(10);
+}
+
+static void setupRegulators(MotorId id) {
+    // Feedforward from the model's gain, the integral takes care of the load
+    control().speedPid(id, PidParams(0.02f, 0.5f, 0.f, 1.f / sim(id).model.gain));
+    control().positionPid(id, PidParams(8.f, 0.f, 0.f, 0.f, -1500.f, 1500.f));
+}
+
+// The average from the encoder, the regulator's per-period estimate is quantized to whole edges
+static float measureSpeed(MotorId id, uint32_t ms) {
+    const int32_t start = value(id);
+    const int64_t startUs = esp_timer_get_time();
+    vTaskDelay(pdMS_TO_TICKS(ms));
+    return float(value(id) - start) * 1000000.f / float(esp_timer_get_time() - startUs);
+}
+
+static void testSpeed() {
+    setupRegulators(MotorId::M1);
+    control().setSpeed(MotorId::M1, 1000.f);
+
+    // Settled within half a second, then no steady-state error against the load
+    vTaskDelay(pdMS_TO_TICKS(300));
+    TEST_ASSERT_FLOAT_WITHIN(50.f, 1000.f, measureSpeed(MotorId::M1, 200));
+    TEST_ASSERT_FLOAT_WITHIN(20.f, 1000.f, measureSpeed(MotorId::M1, 1000));
+
+    control().setSpeed(MotorId::M1, -500.f);
+    vTaskDelay(pdMS_TO_TICKS(500));
+    TEST_ASSERT_FLOAT_WITHIN(20.f, -500.f, measureSpeed(MotorId::M1, 1000));
+}
+
+static void testSetPosition() {
+    const int32_t target = value(MotorId::M1) + 3000;
+    control().setPosition(MotorId::M1, target);
+
+    TEST_ASSERT_EVENTUALLY(abs(value(MotorId::M1) - target) <= 2, 4000);
+
+    // Held against the load, without a steady-state error
+    for (int i = 0; i != 10; ++i) {
+        vTaskDelay(pdMS_TO_TICKS(50));
+        TEST_ASSERT_TRUE(abs(value(MotorId::M1) - target) <= 2);
+    }
+}
+
+static void testMoveSync() {
+    setupRegulators(MotorId::M2);
+    const int32_t start1 = value(MotorId::M1);
+    const int32_t start2 = value(MotorId::M2);
+    const int32_t target1 = start1 - 2000;
+    const int32_t target2 = start2 + 1000;
+
+    control().moveSync({ { MotorId::M1, target1 }, { MotorId::M2, target2 } }, MotionLimits(1000.f, 2000.f));
+    TEST_ASSERT_TRUE(control().isMoving(MotorId::M1));
+    TEST_ASSERT_TRUE(control().isMoving(MotorId::M2));
+
+    // The shorter move is slowed down, both are halfway at the same time
+    vTaskDelay(pdMS_TO_TICKS(1250));
+    const float done1 = float(value(MotorId::M1) - start1) / (target1 - start1);
+    const float done2 = float(value(MotorId::M2) - start2) / (target2 - start2);
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 0.5f, done1);
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, done1, done2);
+
+    TEST_ASSERT_EVENTUALLY(!control().isMoving(MotorId::M1) && !control().isMoving(MotorId::M2), 3000);
+    TEST_ASSERT_TRUE(abs(value(MotorId::M1) - target1) <= 10);
+    TEST_ASSERT_TRUE(abs(value(MotorId::M2) - target2) <= 10);
+
+    // The speed regulator's integral still carries the motion, it settles on the target after it
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    for (int i = 0; i != 10; ++i) {
+        vTaskDelay(pdMS_TO_TICKS(50));
+        TEST_ASSERT_TRUE(abs(value(MotorId::M1) - target1) <= 2);
+        TEST_ASSERT_TRUE(abs(value(MotorId::M2) - target2) <= 2);
+    }
+}
+
+static void testDisable() {
+    control().disable(MotorId::M1);
+    control().disable(MotorId::M2);
+    TEST_ASSERT_EVENTUALLY(sim(MotorId::M1).power() == 0.f && sim(MotorId::M2).power() == 0.f, 1000);
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    auto& man = Manager::get();
+    man.install(MAN_DISABLE_MOTOR_FAILSAFE | MAN_ENCODER_QUADRATURE_X4);
+
+    // Positive power must turn the encoders forward, find out which way the pins do that
+    auto* enc = man.motor(MotorId::M1).encoder();
+    man.motor(MotorId::M2).encoder();
+    rbsim::quadratureMove(ENC1A, ENC1B, 4);
+    encoderDirection = enc->value() > 0 ? 1 : -1;
+    rbsim::quadratureMove(ENC1A, ENC1B, -4);
+
+    std::thread simThread(simRoutine);
+
+    RUN_TEST(testSpeed);
+    RUN_TEST(testSetPosition);
+    RUN_TEST(testMoveSync);
+    RUN_TEST(testDisable);
+
+    simRunning.store(false);
+    simThread.join();
+    UNITY_END();
+}
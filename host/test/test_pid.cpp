@@ -0,0 +1,99 @@
+// PID regulator: the proportional response, the clamped output with a frozen integral
+// and the derivative computed from the measurement, then closing the speed and position
+// loops over a first-order DC motor model.
+
+#include <math.h>
+
+#include "RBControl_pid.hpp"
+
+#include "dc_motor.hpp"
+#include "unity_host.hpp"
+
+using namespace rb;
+
+static void testPidProportional() {
+    Pid pid(PidParams(2.f));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 20.f, pid.update(10.f, 0.f, 0.01f));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, -10.f, pid.update(0.f, 5.f, 0.01f));
+}
+
+static void testPidClampsAndFreezesIntegral() {
+    Pid pid(PidParams(0.f, 100.f, 0.f, 0.f, -50.f, 50.f));
+    for (int i = 0; i != 100; ++i)
+        pid.update(100.f, 0.f, 0.1f);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 50.f, pid.update(100.f, 0.f, 0.1f));
+    TEST_ASSERT_TRUE(pid.integral() <= 50.f);
+
+    // Once the error flips, the output must respond right away, not after unwinding
+    TEST_ASSERT_TRUE(pid.update(0.f, 100.f, 0.1f) < 50.f);
+}
+
+static void testPidDerivativeOnMeasurement() {
+    Pid pid(PidParams(0.f, 0.f, 1.f));
+    pid.update(0.f, 0.f, 0.1f);
+    // A setpoint step causes no derivative kick
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.f, pid.update(100.f, 0.f, 0.1f));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, -10.f, pid.update(100.f, 1.f, 0.1f));
+}
+
+// Regulated every 10 ms like MotorControl, the model runs in 1 ms steps in between
+static const float PERIOD = 0.01f;
+static const int MODEL_STEPS = 10;
+
+static DcMotorModel motorModel() {
+    return DcMotorModel(20.f, 0.05f, 150.f);
+}
+
+static void runSpeedLoop(Pid& pid, DcMotorModel& motor, float target, int periods) {
+    for (int i = 0; i != periods; ++i) {
+        const float power = pid.update(target, motor.speed, PERIOD);
+        for (int s = 0; s != MODEL_STEPS; ++s)
+            motor.step(power, PERIOD / MODEL_STEPS);
+    }
+}
+
+static void testPidSpeedLoopOnMotorModel() {
+    auto motor = motorModel();
+    Pid pid(PidParams(0.02f, 0.5f, 0.f, 1.f / motor.gain));
+
+    // Within 2 % after half a second, then no steady-state error against the load
+    runSpeedLoop(pid, motor, 1000.f, 50);
+    TEST_ASSERT_FLOAT_WITHIN(20.f, 1000.f, motor.speed);
+    runSpeedLoop(pid, motor, 1000.f, 150);
+    TEST_ASSERT_FLOAT_WITHIN(1.f, 1000.f, motor.speed);
+
+    // The same with only the feedforward leaves the load's share as the error
+    auto open = motorModel();
+    Pid ff(PidParams(0.f, 0.f, 0.f, 1.f / open.gain));
+    runSpeedLoop(ff, open, 1000.f, 200);
+    TEST_ASSERT_FLOAT_WITHIN(1.f, 1000.f - open.load, open.speed);
+}
+
+static void testPidPositionLoopOnMotorModel() {
+    auto motor = motorModel();
+    Pid speedPid(PidParams(0.02f, 0.5f, 0.f, 1.f / motor.gain));
+    Pid positionPid(PidParams(8.f, 0.f, 0.f, 0.f, -1500.f, 1500.f));
+
+    // Cascaded like MotorControl: the position regulator's output is the speed setpoint
+    float maxPosition = 0.f;
+    for (int i = 0; i != 400; ++i) {
+        const float speedTarget = positionPid.update(3000.f, motor.position, PERIOD);
+        const float power = speedPid.update(speedTarget, motor.speed, PERIOD);
+        for (int s = 0; s != MODEL_STEPS; ++s)
+            motor.step(power, PERIOD / MODEL_STEPS);
+        maxPosition = fmaxf(maxPosition, motor.position);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 3000.f, motor.position);
+    TEST_ASSERT_FLOAT_WITHIN(1.f, 0.f, motor.speed);
+    TEST_ASSERT_TRUE(maxPosition < 3000.f * 1.05f);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(testPidProportional);
+    RUN_TEST(testPidClampsAndFreezesIntegral);
+    RUN_TEST(testPidDerivativeOnMeasurement);
+    RUN_TEST(testPidSpeedLoopOnMotorModel);
+    RUN_TEST(testPidPositionLoopOnMotorModel);
+    UNITY_END();
+}
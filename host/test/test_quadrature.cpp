@@ -0,0 +1,41 @@
+// Quadrature decoding model: the counts of the x2 and x4 modes in both directions.
+
+#include "RBControl_quadrature.hpp"
+
+#include "unity_host.hpp"
+
+using namespace rb;
+
+static int quadratureCount(const QuadratureChannel* channels, int count, int steps) {
+    static const bool seq[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+    int pos = 0;
+    int total = 0;
+    const int dir = steps >= 0 ? 1 : -1;
+    for (int i = 0; i != steps; i += dir) {
+        const int next = (pos + dir + 4) % 4;
+        for (int c = 0; c != count; ++c)
+            total += channels[c].step(seq[pos][0], seq[pos][1], seq[next][0], seq[next][1]);
+        pos = next;
+    }
+    return total;
+}
+
+static void testQuadratureModes() {
+    const QuadratureChannel x2[] = { QUADRATURE_CHANNEL_0 };
+    const QuadratureChannel x4[] = { QUADRATURE_CHANNEL_0, QUADRATURE_CHANNEL_1 };
+
+    // 4 edges make one encoder cycle
+    const int fwd2 = quadratureCount(x2, 1, 40);
+    TEST_ASSERT_EQUAL_INT(20, abs(fwd2));
+    TEST_ASSERT_EQUAL_INT(-fwd2, quadratureCount(x2, 1, -40));
+
+    const int fwd4 = quadratureCount(x4, 2, 40);
+    TEST_ASSERT_EQUAL_INT(2 * fwd2, fwd4);
+    TEST_ASSERT_EQUAL_INT(-fwd4, quadratureCount(x4, 2, -40));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(testQuadratureModes);
+    UNITY_END();
+}
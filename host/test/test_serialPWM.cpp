@@ -0,0 +1,90 @@
+#include "RBControl_serialPWM.hpp"
+
+#include "pwm_decode.hpp"
+#include "unity_host.hpp"
+
+using namespace rb;
+
+// 4 channels on each of 2 data pins, sent through I2S0 (the Manager uses I2S1)
+static const int CHANNELS = 4;
+static const int PINS = 2;
+static SerialPWM* pwm;
+
+static int decode(int channel) {
+    return decodePwm(0, channel, CHANNELS, 1);
+}
+
+static void testUpdateRendersValues() {
+    (*pwm)[0] = 30;
+    (*pwm)[5] = 70;
+    (*pwm)[7] = SerialPWM::resolution();
+    pwm->update();
+
+    TEST_ASSERT_EQUAL_INT(30, decode(0));
+    TEST_ASSERT_EQUAL_INT(0, decode(1));
+    TEST_ASSERT_EQUAL_INT(70, decode(5));
+    TEST_ASSERT_EQUAL_INT(SerialPWM::resolution(), decode(7));
+
+    // The buffers are double-buffered, the next update must not see stale values
+    (*pwm)[0] = 10;
+    pwm->update();
+    TEST_ASSERT_EQUAL_INT(10, decode(0));
+    TEST_ASSERT_EQUAL_INT(70, decode(5));
+}
+
+static void testStaticBufferOverride() {
+    const int full = pwm->addStaticBuffer(SerialPWM::resolution());
+    TEST_ASSERT_TRUE(full >= 0);
+
+    pwm->flipTo(full);
+    TEST_ASSERT_TRUE(pwm->isOverridden());
+    for (int ch = 0; ch != CHANNELS * PINS; ++ch)
+        TEST_ASSERT_EQUAL_INT(SerialPWM::resolution(), decode(ch));
+
+    // Updates only rebuild the live buffer while overridden
+    (*pwm)[0] = 50;
+    pwm->update();
+    TEST_ASSERT_EQUAL_INT(full, rbsim::i2sParallelActiveBuffer(0));
+
+    pwm->release();
+    TEST_ASSERT_FALSE(pwm->isOverridden());
+    TEST_ASSERT_EQUAL_INT(50, decode(0));
+}
+
+static void testStaticBufferAllocationFails() {
+    // Fails in the middle of the DMA buffers, nothing may leak or stay taken
+    const int allocated = rbsim::heapCapsAllocated();
+    rbsim::heapFailAfter(10);
+    TEST_ASSERT_EQUAL_INT(-1, pwm->addStaticBuffer(0));
+    rbsim::heapFailAfter(-1);
+    TEST_ASSERT_EQUAL_INT(allocated, rbsim::heapCapsAllocated());
+
+    const int id = pwm->addStaticBuffer(0);
+    TEST_ASSERT_TRUE(id >= 0);
+    pwm->flipTo(id);
+    for (int ch = 0; ch != CHANNELS * PINS; ++ch)
+        TEST_ASSERT_EQUAL_INT(0, decode(ch));
+    pwm->release();
+}
+
+static void testStaticBuffersRunOut() {
+    int id = 0;
+    int added = 0;
+    while ((id = pwm->addStaticBuffer(0)) >= 0)
+        ++added;
+    TEST_ASSERT_TRUE(added < 16);
+
+    // Invalid ids are ignored
+    pwm->flipTo(-1);
+    TEST_ASSERT_FALSE(pwm->isOverridden());
+}
+
+int main() {
+    UNITY_BEGIN();
+    pwm = new SerialPWM(CHANNELS, { 1, 2 }, 3, 4, -1, 20000, 0);
+    RUN_TEST(testUpdateRendersValues);
+    RUN_TEST(testStaticBufferOverride);
+    RUN_TEST(testStaticBufferAllocationFails);
+    RUN_TEST(testStaticBuffersRunOut);
+    UNITY_END();
+}
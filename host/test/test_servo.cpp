@@ -0,0 +1,99 @@
+// SmartServoBus talking to simulated LX-16A servos over the half-duplex UART, and the Arm solver.
+
+#include <mutex>
+
+#include "RBControl_arm.hpp"
+#include "RBControl_manager.hpp"
+
+#include "unity_host.hpp"
+
+using namespace rb;
+
+// LX-16A positions are 0 - 1000 for 0 - 240 degrees
+static std::mutex servosMutex;
+static uint16_t servoPos[2] = { 500, 250 };
+static int movesReceived = 0;
+
+static uint8_t checksum(const uint8_t* data, size_t len) {
+    uint8_t sum = 0;
+    for (size_t i = 2; i < len; ++i)
+        sum += data[i];
+    return ~sum;
+}
+
+static std::vector<uint8_t> lx16a(const uint8_t* data, size_t len) {
+    if (len < 6 || data[0] != 0x55 || data[1] != 0x55 || checksum(data, len - 1) != data[len - 1])
+        return {};
+
+    const uint8_t id = data[2];
+    const auto cmd = lw::Command(data[4]);
+    if (id >= 2)
+        return {};
+
+    std::lock_guard<std::mutex> lock(servosMutex);
+    switch (cmd) {
+    case lw::Command::SERVO_MOVE_TIME_WRITE:
+        servoPos[id] = data[5] | (data[6] << 8);
+        ++movesReceived;
+        return {};
+    case lw::Command::SERVO_POS_READ: {
+        std::vector<uint8_t> resp = { 0x55, 0x55, id, 5, data[4], uint8_t(servoPos[id] & 0xFF), uint8_t(servoPos[id] >> 8) };
+        resp.push_back(checksum(resp.data(), resp.size()));
+        return resp;
+    }
+    default:
+        return {};
+    }
+}
+
+static uint16_t servo(int id) {
+    std::lock_guard<std::mutex> lock(servosMutex);
+    return servoPos[id];
+}
+
+static void testInitialPositions() {
+    auto& bus = Manager::get().servoBus();
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 120.f, bus.posOffline(0).deg());
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 60.f, bus.posOffline(1).deg());
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 60.f, bus.pos(1).deg());
+}
+
+static void testMoveIsRegulated() {
+    auto& bus = Manager::get().servoBus();
+    bus.set(0, Angle::deg(90), 240.f);
+
+    // The regulator moves the servo in steps, not all at once
+    TEST_ASSERT_EVENTUALLY(servo(0) < 500, 1000);
+    TEST_ASSERT_TRUE(servo(0) > 375);
+    TEST_ASSERT_EVENTUALLY(servo(0) == 375, 5000);
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 90.f, bus.posOffline(0).deg());
+}
+
+static void testArmSolve() {
+    ArmBuilder builder;
+    builder.body(0, 0).armOffset(0, 0);
+    builder.bone(0, 100);
+    builder.bone(1, 100);
+    auto arm = builder.build();
+
+    TEST_ASSERT_TRUE(arm->solve(120, -80));
+    const auto& tip = arm->bones().back();
+    TEST_ASSERT_TRUE(abs(tip.x - 120) <= 5 && abs(tip.y + 80) <= 5);
+
+    // Out of reach, the arm stretches towards the target
+    TEST_ASSERT_FALSE(arm->solve(300, 0));
+    TEST_ASSERT_TRUE(arm->bones().back().x > 190);
+}
+
+int main() {
+    UNITY_BEGIN();
+
+    rbsim::uartAttach(UART_NUM_1, lx16a);
+    Manager::get().install(MAN_DISABLE_MOTOR_FAILSAFE);
+    Manager::get().initSmartServoBus(2);
+
+    RUN_TEST(testInitialPositions);
+    RUN_TEST(testMoveIsRegulated);
+    RUN_TEST(testArmSolve);
+    UNITY_END();
+}
@@ -0,0 +1,114 @@
+// Debug statistics: the latency histogram and the trace span collection.
+
+#include "RBControl_latencyHistogram.hpp"
+#include "RBControl_traceStats.hpp"
+
+#include "unity_host.hpp"
+
+using namespace rb;
+
+static void testHistogramBuckets() {
+    TEST_ASSERT_EQUAL_INT(0, LatencyHistogram::bucketOf(0));
+    TEST_ASSERT_EQUAL_INT(1, LatencyHistogram::bucketOf(1));
+    TEST_ASSERT_EQUAL_INT(2, LatencyHistogram::bucketOf(2));
+    TEST_ASSERT_EQUAL_INT(2, LatencyHistogram::bucketOf(3));
+    TEST_ASSERT_EQUAL_INT(11, LatencyHistogram::bucketOf(1024));
+    TEST_ASSERT_EQUAL_INT(LatencyHistogram::BUCKETS - 1, LatencyHistogram::bucketOf(UINT32_MAX));
+}
+
+static void testHistogramPercentile() {
+    LatencyHistogram hist;
+    for (int i = 0; i != 99; ++i)
+        hist.add(10);
+    hist.add(5000);
+
+    TEST_ASSERT_EQUAL_INT(100, hist.count());
+    TEST_ASSERT_EQUAL_INT(5000, hist.max());
+    TEST_ASSERT_EQUAL_INT(16, hist.percentile(50));
+    TEST_ASSERT_EQUAL_INT(16, hist.percentile(99));
+    TEST_ASSERT_EQUAL_INT(5000, hist.percentile(100));
+
+    hist.reset();
+    TEST_ASSERT_EQUAL_INT(0, hist.count());
+    TEST_ASSERT_EQUAL_INT(0, hist.percentile(99));
+}
+
+static void testTraceStats() {
+    TraceStats stats;
+    for (uint32_t i = 1; i <= 100; ++i)
+        stats.add(i);
+    TEST_ASSERT_EQUAL_INT(100, stats.count());
+    TEST_ASSERT_EQUAL_INT(1, stats.min());
+    TEST_ASSERT_EQUAL_INT(100, stats.max());
+    TEST_ASSERT_EQUAL_INT(50, stats.avg());
+    TEST_ASSERT_EQUAL_INT(99, stats.percentile(99));
+}
+
+static TraceRecord rec(int64_t time_us, uint32_t ccount, TracePoint point, uint8_t arg = 0, uint8_t core = 0, uint32_t value = 0) {
+    TraceRecord r;
+    r.time_us = time_us;
+    r.ccount = ccount;
+    r.point = point;
+    r.value = value;
+    r.arg = arg;
+    r.core = core;
+    return r;
+}
+
+static void testCollectMeasuredSpan() {
+    // The second event was queued to the front and handled first, the waits come from the ends
+    const TraceRecord records[] = {
+        rec(0, 0, TRACE_QUEUE_ENQUEUE, 1),
+        rec(10, 2400, TRACE_QUEUE_ENQUEUE, 2),
+        rec(100, 24000, TRACE_QUEUE_DEQUEUE, 2, 0, 90),
+        rec(200, 48000, TRACE_QUEUE_DEQUEUE, 1, 0, 200),
+    };
+    const TraceSpan span = { "queue", TRACE_QUEUE_ENQUEUE, TRACE_QUEUE_DEQUEUE, false, true };
+
+    TraceStats stats;
+    collectSpan(records, 4, span, 240, stats);
+    TEST_ASSERT_EQUAL_INT(2, stats.count());
+    TEST_ASSERT_EQUAL_INT(90000, stats.min());
+    TEST_ASSERT_EQUAL_INT(200000, stats.max());
+}
+
+static void testCollectNewestBegin() {
+    // Only the newest set before an update is paired, older ones were overwritten
+    const TraceRecord records[] = {
+        rec(0, 0, TRACE_MOTORS_SET),
+        rec(10, 2400, TRACE_MOTORS_SET),
+        rec(30, 7200, TRACE_PWM_UPDATE_END),
+        rec(40, 9600, TRACE_PWM_UPDATE_END),
+    };
+    const TraceSpan span = { "set", TRACE_MOTORS_SET, TRACE_PWM_UPDATE_END, false, false };
+
+    TraceStats stats;
+    collectSpan(records, 4, span, 240, stats);
+    TEST_ASSERT_EQUAL_INT(1, stats.count());
+    TEST_ASSERT_EQUAL_INT(20000, stats.max());
+}
+
+static void testCollectCrossCoreSpan() {
+    // The cycle counters of the cores differ, the time is used instead
+    const TraceRecord records[] = {
+        rec(1000, 5000000, TRACE_MOTORS_SET, 0, 0),
+        rec(1050, 10, TRACE_PWM_UPDATE_END, 0, 1),
+    };
+    const TraceSpan span = { "set", TRACE_MOTORS_SET, TRACE_PWM_UPDATE_END, false, false };
+
+    TraceStats stats;
+    collectSpan(records, 2, span, 240, stats);
+    TEST_ASSERT_EQUAL_INT(1, stats.count());
+    TEST_ASSERT_EQUAL_INT(50000, stats.max());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(testHistogramBuckets);
+    RUN_TEST(testHistogramPercentile);
+    RUN_TEST(testTraceStats);
+    RUN_TEST(testCollectMeasuredSpan);
+    RUN_TEST(testCollectNewestBegin);
+    RUN_TEST(testCollectCrossCoreSpan);
+    UNITY_END();
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+// The subset of Unity's macros used by the host tests, so that the tests read like
+// the on-target ones in test/. A failed assertion ends the test with exit code 1.
+
+#include <math.h>
+#include <stdio.h>
+
+#include <string>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "rbsim.hpp"
+
+#define UNITY_BEGIN() printf("%s\n", __FILE__)
+
+#define UNITY_END()                   \
+    do {                              \
+        printf("OK\n");               \
+        rbsim::exitProcess(0);        \
+    } while (0)
+
+#define RUN_TEST(func)                \
+    do {                              \
+        printf("  %s\n", #func);      \
+        fflush(stdout);               \
+        func();                       \
+    } while (0)
+
+#define TEST_FAIL_MESSAGE(msg)                                       \
+    do {                                                             \
+        printf("%s:%d: FAIL: %s\n", __FILE__, __LINE__, msg);        \
+        rbsim::exitProcess(1);                                       \
+    } while (0)
+
+#define TEST_ASSERT_MESSAGE(condition, msg) \
+    do {                                    \
+        if (!(condition))                   \
+            TEST_FAIL_MESSAGE(msg);         \
+    } while (0)
+
+#define TEST_ASSERT(condition) TEST_ASSERT_MESSAGE(condition, #condition)
+#define TEST_ASSERT_TRUE(condition) TEST_ASSERT_MESSAGE(condition, #condition)
+#define TEST_ASSERT_FALSE(condition) TEST_ASSERT_MESSAGE(!(condition), "!(" #condition ")")
+
+#define TEST_ASSERT_EQUAL_INT(expected, actual)                                                           \
+    do {                                                                                                  \
+        const long long e_ = (expected), a_ = (actual);                                                   \
+        if (e_ != a_) {                                                                                   \
+            printf("%s:%d: FAIL: %s expected %lld, was %lld\n", __FILE__, __LINE__, #actual, e_, a_);     \
+            rbsim::exitProcess(1);                                                                        \
+        }                                                                                                 \
+    } while (0)
+
+#define TEST_ASSERT_FLOAT_WITHIN(delta, expected, actual)                                                  \
+    do {                                                                                                   \
+        const double e_ = (expected), a_ = (actual);                                                       \
+        if (!(fabs(e_ - a_) <= (delta))) {                                                                 \
+            printf("%s:%d: FAIL: %s expected %g +- %g, was %g\n", __FILE__, __LINE__, #actual, e_,         \
+                (double)(delta), a_);                                                                      \
+            rbsim::exitProcess(1);                                                                         \
+        }                                                                                                  \
+    } while (0)
+
+#define TEST_ASSERT_EQUAL_STRING(expected, actual)                                                          \
+    do {                                                                                                    \
+        const std::string e_ = (expected), a_ = (actual);                                                   \
+        if (e_ != a_) {                                                                                     \
+            printf("%s:%d: FAIL: %s expected \"%s\", was \"%s\"\n", __FILE__, __LINE__, #actual, e_.c_str(), \
+                a_.c_str());                                                                                \
+            rbsim::exitProcess(1);                                                                          \
+        }                                                                                                   \
+    } while (0)
+
+//! Waits up to timeout_ms for the condition, the library's tasks run in their own threads.
+#define TEST_ASSERT_EVENTUALLY(condition, timeout_ms)                        \
+    do {                                                                     \
+        int waited_ = 0;                                                     \
+        while (!(condition) && waited_ < (timeout_ms)) {                     \
+            vTaskDelay(1);                                                   \
+            waited_ += portTICK_PERIOD_MS;                                   \
+        }                                                                    \
+        TEST_ASSERT_MESSAGE(condition, #condition " (timed out)");           \
+    } while (0)
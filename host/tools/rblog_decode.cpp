@@ -0,0 +1,43 @@
+// Prints the messages of a BinaryLog stream, one per line with its timestamp in seconds:
+//
+//   rblog_decode capture.bin
+//   cat /dev/ttyUSB0 | rblog_decode
+//
+// The stream may start in the middle of a frame. Messages logged before the
+// definition of their format string are counted but not printed.
+
+#include <stdio.h>
+
+#include "logger/binary_log_decoder.hpp"
+
+int main(int argc, char** argv) {
+    FILE* in = stdin;
+    if (argc > 1 && strcmp(argv[1], "-") != 0) {
+        in = fopen(argv[1], "rb");
+        if (!in) {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+
+    BinaryLogDecoder decoder;
+    const auto print = [](uint64_t timestamp_us, const std::string& text) {
+        printf("%llu.%06u %s\n", (unsigned long long)(timestamp_us / 1000000),
+            unsigned(timestamp_us % 1000000), text.c_str());
+    };
+
+    uint8_t buffer[4096];
+    size_t len;
+    while ((len = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        decoder.feed(buffer, len, print);
+        fflush(stdout);
+    }
+
+    if (decoder.unknown() != 0)
+        fprintf(stderr, "%zu messages without a format definition\n", decoder.unknown());
+    if (decoder.skipped() != 0)
+        fprintf(stderr, "%zu bytes skipped\n", decoder.skipped());
+    if (in != stdin)
+        fclose(in);
+    return 0;
+}
@@ -45,6 +45,9 @@
 
 #define MCP23017_INT_ERR 255
 
+// The first register of each cached pair, by CachedReg
+static const uint8_t CACHED_REG_ADDR[] = { MCP23017_OLATA, MCP23017_GPPUA, MCP23017_IODIRA };
+
 static int bitRead(uint32_t x, uint8_t n) {
     return ((x & 1 << n) != 0);
 }
@@ -71,6 +74,12 @@ uint8_t Adafruit_MCP23017::regForPin(uint8_t pin, uint8_t portAaddr, uint8_t por
  * Reads a given register
  */
 uint8_t Adafruit_MCP23017::readRegister(uint8_t addr) {
+    if (m_queue) {
+        uint8_t value = 0;
+        m_queue->readSync(m_i2caddr, addr, &value, 1);
+        return value;
+    }
+
     // read the current GPINTEN
     i2c_cmd_handle_t cmd = i2c_cmd_link_create();
     i2c_master_start(cmd);
@@ -91,10 +100,40 @@ uint8_t Adafruit_MCP23017::readRegister(uint8_t addr) {
     return tmpByte;
 }
 
+/**
+ * Reads a port A register and the port B one after it
+ */
+uint16_t Adafruit_MCP23017::readRegisterPair(uint8_t addrA) {
+    if (m_queue) {
+        uint8_t bytes[2] = { 0, 0 };
+        m_queue->readSync(m_i2caddr, addrA, bytes, 2);
+        return bytes[0] | (bytes[1] << 8);
+    }
+
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (m_i2caddr << 1) | I2C_MASTER_WRITE, 1 /* expect ack */);
+    i2c_master_write_byte(cmd, addrA, 1);
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (m_i2caddr << 1) | I2C_MASTER_READ, 1 /* expect ack */);
+    uint8_t bytes[2] = { 0, 0 };
+    i2c_master_read_byte(cmd, &bytes[0], I2C_MASTER_ACK);
+    i2c_master_read_byte(cmd, &bytes[1], I2C_MASTER_NACK);
+    i2c_master_stop(cmd);
+    i2c_master_cmd_begin(m_port, cmd, 0);
+    i2c_cmd_link_delete(cmd);
+    return bytes[0] | (bytes[1] << 8);
+}
+
 /**
  * Writes a given register
  */
 void Adafruit_MCP23017::writeRegister(uint8_t regAddr, uint8_t regValue) {
+    if (m_queue) {
+        m_queue->write(m_i2caddr, regAddr, &regValue, 1);
+        return;
+    }
+
     // Write the register
     i2c_cmd_handle_t cmd = i2c_cmd_link_create();
     i2c_master_start(cmd);
@@ -107,28 +146,105 @@ void Adafruit_MCP23017::writeRegister(uint8_t regAddr, uint8_t regValue) {
 }
 
 /**
- * Helper to update a single bit of an A/B register.
- * - Reads the current register value
- * - Writes the new register value
+ * Writes a port A register and the port B one after it
  */
-void Adafruit_MCP23017::updateRegisterBit(uint8_t pin, uint8_t pValue, uint8_t portAaddr, uint8_t portBaddr) {
-    uint8_t regValue;
-    uint8_t regAddr = regForPin(pin, portAaddr, portBaddr);
-    uint8_t bit = bitForPin(pin);
+void Adafruit_MCP23017::writeRegisterPair(uint8_t addrA, uint16_t value) {
+    if (m_queue) {
+        const uint8_t bytes[2] = { uint8_t(value & 0xFF), uint8_t(value >> 8) };
+        m_queue->write(m_i2caddr, addrA, bytes, 2);
+        return;
+    }
+
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (m_i2caddr << 1) | I2C_MASTER_WRITE, 1 /* expect ack */);
+    i2c_master_write_byte(cmd, addrA, 1);
+    i2c_master_write_byte(cmd, value & 0xFF, 1);
+    i2c_master_write_byte(cmd, value >> 8, 1);
+    i2c_master_stop(cmd);
+    i2c_master_cmd_begin(m_port, cmd, 0);
+    i2c_cmd_link_delete(cmd);
+}
+
+/**
+ * Helper to update a single bit of a cached A/B register.
+ * - Changes the cached register value
+ * - Writes it only if it differs, without reading it first
+ */
+void Adafruit_MCP23017::updateRegisterBit(uint8_t pin, uint8_t pValue, CachedReg reg) {
+    uint16_t values[CACHE_COUNT] = { 0 };
+    uint16_t masks[CACHE_COUNT] = { 0 };
+    masks[reg] = 1 << pin;
+    values[reg] = pValue ? masks[reg] : 0;
 
     std::lock_guard<std::mutex> l(m_mutex);
+    writeCached(values, masks);
+}
+
+void Adafruit_MCP23017::writeCached(const uint16_t* values, const uint16_t* masks) {
+    // All the changed registers go into one transaction, joined by repeated starts
+    i2c_cmd_handle_t cmd = nullptr;
+    for (int reg = 0; reg != CACHE_COUNT; ++reg) {
+        const uint16_t updated = (m_cache[reg] & ~masks[reg]) | (values[reg] & masks[reg]);
+        const uint16_t changed = updated ^ m_cache[reg];
+        if (changed == 0)
+            continue;
+        m_cache[reg] = updated;
+
+        if (m_queue) {
+            // Always the whole pair, so that it merges with a pending write of the other port
+            writeRegisterPair(CACHED_REG_ADDR[reg], updated);
+            continue;
+        }
+
+        if (!cmd)
+            cmd = i2c_cmd_link_create();
+        i2c_master_start(cmd);
+        i2c_master_write_byte(cmd, (m_i2caddr << 1) | I2C_MASTER_WRITE, 1 /* expect ack */);
+        if (changed & 0xFF) {
+            // The address auto-increments from port A to port B
+            i2c_master_write_byte(cmd, CACHED_REG_ADDR[reg], 1);
+            i2c_master_write_byte(cmd, updated & 0xFF, 1);
+            if (changed >> 8)
+                i2c_master_write_byte(cmd, updated >> 8, 1);
+        } else {
+            i2c_master_write_byte(cmd, CACHED_REG_ADDR[reg] + 1, 1);
+            i2c_master_write_byte(cmd, updated >> 8, 1);
+        }
+    }
+    if (!cmd)
+        return;
+    i2c_master_stop(cmd);
+    i2c_master_cmd_begin(m_port, cmd, 0);
+    i2c_cmd_link_delete(cmd);
+}
 
-    regValue = readRegister(regAddr);
+std::unique_lock<std::mutex> Adafruit_MCP23017::lockBus() {
+    if (m_queue)
+        return std::unique_lock<std::mutex>(m_mutex, std::defer_lock);
+    return std::unique_lock<std::mutex>(m_mutex);
+}
 
-    // set the value for the particular bit
-    regValue = bitWrite(regValue, bit, pValue);
+void Adafruit_MCP23017::setQueue(rb::I2cQueue* queue) {
+    std::lock_guard<std::mutex> l(m_mutex);
+    m_queue = queue;
+}
 
-    writeRegister(regAddr, regValue);
+void Adafruit_MCP23017::flush() {
+    if (m_queue)
+        m_queue->flush();
+}
+
+void Adafruit_MCP23017::reloadCache() {
+    std::lock_guard<std::mutex> l(m_mutex);
+    for (int reg = 0; reg != CACHE_COUNT; ++reg)
+        m_cache[reg] = readRegisterPair(CACHED_REG_ADDR[reg]);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-Adafruit_MCP23017::Adafruit_MCP23017(uint8_t addr, i2c_port_t port, gpio_num_t sda, gpio_num_t scl) {
+Adafruit_MCP23017::Adafruit_MCP23017(uint8_t addr, i2c_port_t port, gpio_num_t sda, gpio_num_t scl)
+    : m_queue(nullptr) {
     m_i2caddr = addr;
     m_port = port;
     m_sda = sda;
@@ -144,8 +260,14 @@ Adafruit_MCP23017::Adafruit_MCP23017(uint8_t addr, i2c_port_t port, gpio_num_t s
     i2c_param_config(m_port, &conf);
     i2c_driver_install(m_port, conf.mode, 0, 0, 0);
 
-    writeRegister(MCP23017_IODIRA, 0xFF);
-    writeRegister(MCP23017_IODIRB, 0xFF);
+    // The expander keeps its state over the ESP32's reset, start with all pins as inputs
+    // but keep the pull-ups and the output latches.
+    m_cache[CACHE_OLAT] = readRegisterPair(MCP23017_OLATA);
+    m_cache[CACHE_GPPU] = readRegisterPair(MCP23017_GPPUA);
+    m_cache[CACHE_IODIR] = 0;
+    const uint16_t values[CACHE_COUNT] = { 0, 0, 0xFFFF };
+    const uint16_t masks[CACHE_COUNT] = { 0, 0, 0xFFFF };
+    writeCached(values, masks);
 }
 
 Adafruit_MCP23017::~Adafruit_MCP23017() {
@@ -155,40 +277,15 @@ Adafruit_MCP23017::~Adafruit_MCP23017() {
  * Sets the pin mode to either INPUT or OUTPUT
  */
 void Adafruit_MCP23017::pinMode(uint8_t p, uint8_t d) {
-    updateRegisterBit(p, (d == GPIO_MODE_INPUT), MCP23017_IODIRA, MCP23017_IODIRB);
+    updateRegisterBit(p, (d == GPIO_MODE_INPUT), CACHE_IODIR);
 }
 
 /**
  * Reads all 16 pins (port A and B) into a single 16 bits variable.
  */
 uint16_t Adafruit_MCP23017::readGPIOAB() {
-    uint16_t ba = 0;
-    uint8_t a;
-
-    std::lock_guard<std::mutex> l(m_mutex);
-
-    // read the current GPIO output latches
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (m_i2caddr << 1) | I2C_MASTER_WRITE, 1 /* expect ack */);
-    i2c_master_write_byte(cmd, MCP23017_GPIOA, 1);
-    i2c_master_stop(cmd);
-    i2c_master_cmd_begin(m_port, cmd, 0);
-    i2c_cmd_link_delete(cmd);
-
-    cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (m_i2caddr << 1) | I2C_MASTER_READ, 1 /* expect ack */);
-    i2c_master_read_byte(cmd, &a, I2C_MASTER_NACK);
-    i2c_master_read_byte(cmd, (uint8_t*)&ba, I2C_MASTER_NACK);
-    i2c_master_stop(cmd);
-    i2c_master_cmd_begin(m_port, cmd, 0);
-    i2c_cmd_link_delete(cmd);
-
-    ba <<= 8;
-    ba |= a;
-
-    return ba;
+    auto l = lockBus();
+    return readRegisterPair(MCP23017_GPIOA);
 }
 
 /**
@@ -196,30 +293,8 @@ uint16_t Adafruit_MCP23017::readGPIOAB() {
  * Parameter b should be 0 for GPIOA, and 1 for GPIOB.
  */
 uint8_t Adafruit_MCP23017::readGPIO(uint8_t b) {
-    std::lock_guard<std::mutex> l(m_mutex);
-
-    // read the current GPIO output latches
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (m_i2caddr << 1) | I2C_MASTER_WRITE, 1 /* expect ack */);
-    if (b == 0) {
-        i2c_master_write_byte(cmd, MCP23017_GPIOA, 1);
-    } else {
-        i2c_master_write_byte(cmd, MCP23017_GPIOB, 1);
-    }
-    i2c_master_stop(cmd);
-    i2c_master_cmd_begin(m_port, cmd, 0);
-    i2c_cmd_link_delete(cmd);
-
-    uint8_t byte;
-    cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (m_i2caddr << 1) | I2C_MASTER_READ, 1 /* expect ack */);
-    i2c_master_read_byte(cmd, &byte, I2C_MASTER_NACK);
-    i2c_master_stop(cmd);
-    i2c_master_cmd_begin(m_port, cmd, 0);
-    i2c_cmd_link_delete(cmd);
-    return byte;
+    auto l = lockBus();
+    return readRegister(b == 0 ? MCP23017_GPIOA : MCP23017_GPIOB);
 }
 
 /**
@@ -227,6 +302,12 @@ uint8_t Adafruit_MCP23017::readGPIO(uint8_t b) {
  */
 void Adafruit_MCP23017::writeGPIOAB(uint16_t ba) {
     std::lock_guard<std::mutex> l(m_mutex);
+    m_cache[CACHE_OLAT] = ba;
+    if (m_queue) {
+        // Writing OLAT sets the outputs like writing GPIO does, and it merges with the other latch writes
+        writeRegisterPair(MCP23017_OLATA, ba);
+        return;
+    }
 
     i2c_cmd_handle_t cmd = i2c_cmd_link_create();
     i2c_master_start(cmd);
@@ -240,29 +321,15 @@ void Adafruit_MCP23017::writeGPIOAB(uint16_t ba) {
 }
 
 void Adafruit_MCP23017::digitalWrite(uint8_t pin, uint8_t d) {
-    uint8_t gpio;
-    uint8_t bit = bitForPin(pin);
-
-    std::lock_guard<std::mutex> l(m_mutex);
-
-    // read the current GPIO output latches
-    uint8_t regAddr = regForPin(pin, MCP23017_OLATA, MCP23017_OLATB);
-    gpio = readRegister(regAddr);
-
-    // set the pin and direction
-    gpio = bitWrite(gpio, bit, d);
-
-    // write the new GPIO
-    regAddr = regForPin(pin, MCP23017_GPIOA, MCP23017_GPIOB);
-    writeRegister(regAddr, gpio);
+    updateRegisterBit(pin, d, CACHE_OLAT);
 }
 
 void Adafruit_MCP23017::pullUp(uint8_t p, uint8_t d) {
-    updateRegisterBit(p, d, MCP23017_GPPUA, MCP23017_GPPUB);
+    updateRegisterBit(p, d, CACHE_GPPU);
 }
 
 uint8_t Adafruit_MCP23017::digitalRead(uint8_t pin) {
-    std::lock_guard<std::mutex> l(m_mutex);
+    auto l = lockBus();
 
     uint8_t bit = bitForPin(pin);
     uint8_t regAddr = regForPin(pin, MCP23017_GPIOA, MCP23017_GPIOB);
@@ -296,6 +363,19 @@ void Adafruit_MCP23017::setupInterrupts(uint8_t mirroring, uint8_t openDrain, ui
     writeRegister(MCP23017_IOCONB, ioconfValue);
 }
 
+void Adafruit_MCP23017::setupInterruptPins(uint16_t mask) {
+    std::lock_guard<std::mutex> l(m_mutex);
+
+    // Compare with the previous value, i.e. interrupt on both edges
+    writeRegisterPair(MCP23017_INTCONA, 0);
+    writeRegisterPair(MCP23017_GPINTENA, mask);
+}
+
+uint16_t Adafruit_MCP23017::readInterruptCapture() {
+    auto l = lockBus();
+    return readRegisterPair(MCP23017_INTCAPA);
+}
+
 uint8_t Adafruit_MCP23017::getLastInterruptPin() {
     uint8_t intf;
 
@@ -326,3 +406,38 @@ uint8_t Adafruit_MCP23017::getLastInterruptPinValue() {
 
     return MCP23017_INT_ERR;
 }
+
+////////////////////////////////////////////////////////////////////////////////
+
+Adafruit_MCP23017::Batch::Batch(Adafruit_MCP23017& expander)
+    : m_expander(expander) {
+    for (int reg = 0; reg != CACHE_COUNT; ++reg) {
+        m_values[reg] = 0;
+        m_masks[reg] = 0;
+    }
+}
+
+static void setBatchBit(uint16_t& value, uint16_t& mask, uint8_t pin, bool set) {
+    mask |= 1 << pin;
+    value = set ? (value | (1 << pin)) : (value & ~(1 << pin));
+}
+
+Adafruit_MCP23017::Batch& Adafruit_MCP23017::Batch::pinMode(uint8_t p, uint8_t d) {
+    setBatchBit(m_values[CACHE_IODIR], m_masks[CACHE_IODIR], p, d == GPIO_MODE_INPUT);
+    return *this;
+}
+
+Adafruit_MCP23017::Batch& Adafruit_MCP23017::Batch::digitalWrite(uint8_t p, uint8_t d) {
+    setBatchBit(m_values[CACHE_OLAT], m_masks[CACHE_OLAT], p, d);
+    return *this;
+}
+
+Adafruit_MCP23017::Batch& Adafruit_MCP23017::Batch::pullUp(uint8_t p, uint8_t d) {
+    setBatchBit(m_values[CACHE_GPPU], m_masks[CACHE_GPPU], p, d);
+    return *this;
+}
+
+void Adafruit_MCP23017::Batch::apply() {
+    std::lock_guard<std::mutex> l(m_expander.m_mutex);
+    m_expander.writeCached(m_values, m_masks);
+}
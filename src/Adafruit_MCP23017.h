@@ -18,11 +18,44 @@
 #include <mutex>
 #include <stdint.h>
 
+#include "RBControl_i2cQueue.hpp"
+
 /**
  * \brief Controls the expander pins
+ *
+ * The direction, pull-up and output latch registers are cached, changing a pin
+ * costs one I2C write and no read, setting a pin to the value it already has costs nothing.
+ * Use {@link batch} to change several pins in one I2C transaction.
+ *
+ * With an {@link rb::I2cQueue} set by {@link setQueue}, the writes return without waiting
+ * for the bus and the reads don't block the writes of other tasks.
  */
 class Adafruit_MCP23017 {
 public:
+    /**
+     * \brief Collects pin changes and writes them in one I2C transaction, see {@link Adafruit_MCP23017::batch}.
+     *
+     * The output latches are written before the directions, a pin switched to output
+     * starts with the value set in the same batch.
+     */
+    class Batch {
+        friend class Adafruit_MCP23017;
+
+    public:
+        Batch& pinMode(uint8_t p, uint8_t d);
+        Batch& digitalWrite(uint8_t p, uint8_t d);
+        Batch& pullUp(uint8_t p, uint8_t d);
+
+        void apply(); //!< Write the changes to the expander
+
+    private:
+        Batch(Adafruit_MCP23017& expander);
+
+        Adafruit_MCP23017& m_expander;
+        uint16_t m_values[3]; //!< By CachedReg, bit per pin, port A in the low byte
+        uint16_t m_masks[3]; //!< Bits of m_values which are set
+    };
+
     Adafruit_MCP23017(uint8_t addr, i2c_port_t port, gpio_num_t sda, gpio_num_t scl);
     ~Adafruit_MCP23017();
 
@@ -31,33 +64,70 @@ public:
     void pullUp(uint8_t p, uint8_t d);
     uint8_t digitalRead(uint8_t p);
 
+    //! Start a batch of pin changes: expander.batch().pinMode(0, GPIO_MODE_OUTPUT).digitalWrite(0, 1).apply();
+    Batch batch() { return Batch(*this); }
+
     void writeGPIOAB(uint16_t);
     uint16_t readGPIOAB();
     uint8_t readGPIO(uint8_t b);
 
+    //! Read the cached registers from the expander again, e.g. after it was reset on its own.
+    void reloadCache();
+
+    /**
+     * \brief Send all the transfers through the queue's worker task from now on.
+     *
+     * Call it before other tasks use the expander. The manager sets its queue in {@link rb::Manager::install}.
+     */
+    void setQueue(rb::I2cQueue* queue);
+    //! Wait until the queued writes reach the expander, returns immediately without a queue.
+    void flush();
+
     void setupInterrupts(uint8_t mirroring, uint8_t open, uint8_t polarity);
+    //! Interrupt on any change of the pins in mask (bit per pin), disable it for the others.
+    void setupInterruptPins(uint16_t mask);
+    //! The pin levels at the last interrupt, reading them clears the interrupt.
+    uint16_t readInterruptCapture();
     uint8_t getLastInterruptPin();
     uint8_t getLastInterruptPinValue();
 
 private:
+    enum CachedReg {
+        CACHE_OLAT = 0,
+        CACHE_GPPU,
+        CACHE_IODIR,
+        CACHE_COUNT,
+    };
+
     uint8_t bitForPin(uint8_t pin);
     uint8_t regForPin(uint8_t pin, uint8_t portAaddr, uint8_t portBaddr);
 
     uint8_t readRegister(uint8_t addr);
+    uint16_t readRegisterPair(uint8_t addrA);
     void writeRegister(uint8_t addr, uint8_t value);
+    void writeRegisterPair(uint8_t addrA, uint16_t value);
+
+    //! Locks m_mutex for a bus access, unless the queue serializes them.
+    std::unique_lock<std::mutex> lockBus();
 
     /**
-   * Utility private method to update a register associated with a pin (whether port A/B)
-   * reads its value, updates the particular bit, and writes its value.
-   */
-    void updateRegisterBit(uint8_t p, uint8_t pValue, uint8_t portAaddr, uint8_t portBaddr);
+     * Set the masked bits of the cached registers, write the ones which changed
+     * to the expander in one transaction. Call with m_mutex locked.
+     */
+    void writeCached(const uint16_t* values, const uint16_t* masks);
+
+    //! Change one bit of a cached register.
+    void updateRegisterBit(uint8_t p, uint8_t pValue, CachedReg reg);
 
     uint8_t m_i2caddr;
     i2c_port_t m_port;
     gpio_num_t m_sda;
     gpio_num_t m_scl;
 
+    rb::I2cQueue* m_queue;
+
     std::mutex m_mutex;
+    uint16_t m_cache[CACHE_COUNT]; //!< Port A in the low byte, port B in the high one
 };
 
 #endif
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace rb {
+
+/**
+ * \brief Filters a stream of raw ADC samples.
+ *
+ * The median of the last WINDOW samples rejects single spikes, e.g. from the motors
+ * switching, an exponential moving average of the medians then smooths the noise.
+ * A new sample moves the average by 1/2^smoothingShift of its difference, so with
+ * samples every T ms its time constant is about 2^smoothingShift * T ms.
+ *
+ * Not thread-safe, it is meant to be fed from a single task.
+ * Doesn't depend on anything ESP32 specific, so it can be tested on the host.
+ */
+class AdcFilter {
+public:
+    static constexpr size_t WINDOW = 5;
+
+    AdcFilter(uint8_t smoothingShift = 4)
+        : m_shift(smoothingShift) {
+        reset(0);
+    }
+
+    //! Forget the history, as if every sample so far was raw.
+    void reset(uint16_t raw) {
+        for (auto& s : m_window)
+            s = raw;
+        m_next = 0;
+        m_average = int32_t(raw) << FRACTION_BITS;
+    }
+
+    //! Add a sample, returns the new value().
+    uint16_t add(uint16_t raw) {
+        m_window[m_next] = raw;
+        m_next = (m_next + 1) % WINDOW;
+
+        const int32_t target = int32_t(median()) << FRACTION_BITS;
+        m_average += (target - m_average) >> m_shift;
+        return value();
+    }
+
+    uint16_t value() const { return uint16_t((m_average + (1 << (FRACTION_BITS - 1))) >> FRACTION_BITS); }
+
+    uint16_t median() const {
+        uint16_t sorted[WINDOW];
+        for (size_t i = 0; i != WINDOW; ++i) {
+            size_t pos = i;
+            for (; pos != 0 && sorted[pos - 1] > m_window[i]; --pos)
+                sorted[pos] = sorted[pos - 1];
+            sorted[pos] = m_window[i];
+        }
+        return sorted[WINDOW / 2];
+    }
+
+private:
+    static constexpr int FRACTION_BITS = 8;
+
+    const uint8_t m_shift;
+    uint16_t m_window[WINDOW];
+    size_t m_next;
+    int32_t m_average; //!< With FRACTION_BITS below the point
+};
+
+} // namespace rb
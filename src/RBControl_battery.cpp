@@ -11,7 +11,10 @@
 namespace rb {
 
 const int DEFAULT_REF_VOLTAGE = 1100;
-const int BATTERY_ADC_SAMPLES = 32;
+// One conversion at a time, so that the timer task is never held up for long
+const uint32_t BATTERY_SAMPLE_PERIOD_MS = 20;
+// The warning and the undervoltage shutdown are checked every 500ms
+const uint8_t BATTERY_SAMPLES_PER_CHECK = 25;
 
 Battery::Battery(rb::Piezo& piezo, rb::Leds& leds, Adafruit_MCP23017& expander)
     : m_piezo(piezo)
@@ -20,7 +23,12 @@ Battery::Battery(rb::Piezo& piezo, rb::Leds& leds, Adafruit_MCP23017& expander)
     m_warningOn = false;
     m_emergencyShutdown = true;
     m_undervoltedCounter = 0;
+    m_samplesToCheck = BATTERY_SAMPLES_PER_CHECK;
     m_coef = 1.0f;
+    m_sagMv = 0;
+    m_motorsDuty = 0;
+    m_resistanceMOhm = BatteryModel::RESISTANCE_MOHM;
+    m_motorCurrentMa = BatteryModel::MOTOR_CURRENT_MA;
 }
 
 Battery::~Battery() {
@@ -45,10 +53,16 @@ void Battery::install(bool disableEmergencyShutdown) {
         ESP_LOGE(TAG, "No ADC calibration. Readings might be incorrect.");
     }
 
-    updateVoltage();
+    const uint16_t initial = adc1_get_raw(BATT_ADC_CHANNEL);
+    m_filter.reset(initial);
+    m_model.reset(m_motorsDuty.load());
+    m_sagMv.store(m_model.sagMv());
+    m_raw.store(initial);
+    m_voltageMv.store(rawToMv(initial));
+    checkVoltage();
 
-    Manager::get().schedule(500, [&]() -> bool {
-        updateVoltage();
+    Manager::get().schedule(BATTERY_SAMPLE_PERIOD_MS, [&]() -> bool {
+        sample();
         return true;
     });
 }
@@ -66,12 +80,22 @@ float Battery::fineTuneCoef() const {
     return m_coef.load();
 }
 
+void Battery::setLoadModel(uint32_t resistanceMOhm, uint32_t motorCurrentMa) {
+    m_resistanceMOhm.store(resistanceMOhm);
+    m_motorCurrentMa.store(motorCurrentMa);
+}
+
+void Battery::setMotorsDuty(uint32_t dutyPercent) {
+    m_motorsDuty.store(dutyPercent);
+}
+
 void Battery::shutdown() {
     ESP_LOGW(TAG, "Shutting down.");
 
     vTaskDelay(pdMS_TO_TICKS(500));
 
     m_expander.digitalWrite(EXPANDER_BOARD_POWER_ON, 0);
+    m_expander.flush();
     // Shut down nearly everything and never wake up - necessary when ESP is
     // powered from USB
     esp_deep_sleep_start();
@@ -85,15 +109,12 @@ uint32_t Battery::voltageMv() const {
     return m_voltageMv.load();
 }
 
+uint32_t Battery::openCircuitMv() const {
+    return m_voltageMv.load() + m_sagMv.load();
+}
+
 uint32_t Battery::pct() const {
-    const auto mv = voltageMv();
-    if (mv <= VOLTAGE_MIN) {
-        return 0;
-    } else if (mv >= VOLTAGE_MAX) {
-        return 100;
-    } else {
-        return (float(mv - VOLTAGE_MIN) / (VOLTAGE_MAX - VOLTAGE_MIN)) * 100.f;
-    }
+    return BatteryModel::stateOfCharge(openCircuitMv() / CELLS);
 }
 
 void Battery::setWarning(bool on) {
@@ -102,21 +123,30 @@ void Battery::setWarning(bool on) {
     m_leds.red(on);
 }
 
-void Battery::updateVoltage() {
-    uint32_t adc_reading = 0;
-    for (int i = 0; i < BATTERY_ADC_SAMPLES; i++) {
-        adc_reading += adc1_get_raw(BATT_ADC_CHANNEL);
+void Battery::sample() {
+    const uint16_t raw = m_filter.add(adc1_get_raw(BATT_ADC_CHANNEL));
+    m_raw.store(raw);
+    m_voltageMv.store(rawToMv(raw));
+
+    m_model.setResistance(m_resistanceMOhm.load());
+    m_model.setMotorCurrent(m_motorCurrentMa.load());
+    m_sagMv.store(m_model.update(m_motorsDuty.load()));
+
+    if (--m_samplesToCheck == 0) {
+        m_samplesToCheck = BATTERY_SAMPLES_PER_CHECK;
+        checkVoltage();
     }
-    adc_reading /= BATTERY_ADC_SAMPLES;
+}
 
-    const uint32_t voltage = rawToMv(adc_reading);
-    m_raw.store(adc_reading);
-    m_voltageMv.store(voltage);
+void Battery::checkVoltage() {
+    const uint32_t adc_reading = m_raw.load();
+    const uint32_t measured = m_voltageMv.load();
+    const uint32_t voltage = openCircuitMv();
 
-    ESP_LOGD(TAG, "Battery is at %u mV (raw %u)", voltage, adc_reading);
+    ESP_LOGD(TAG, "Battery is at %u mV, %u mV under load (raw %u)", voltage, measured, adc_reading);
 
     // Not connected to the battery
-    if (voltage < 3000) {
+    if (measured < 3000) {
         return;
     }
 
@@ -126,8 +156,8 @@ void Battery::updateVoltage() {
         setWarning(false);
     }
 
-    if (voltage <= VOLTAGE_MIN) {
-        ESP_LOGE(TAG, "Battery is at %umV (raw %u)", voltage, adc_reading);
+    if (measured <= VOLTAGE_SHUTDOWN) {
+        ESP_LOGE(TAG, "Battery is at %umV (raw %u)", measured, adc_reading);
         if (++m_undervoltedCounter >= 10) {
             if (m_emergencyShutdown)
                 shutdown();
@@ -4,6 +4,8 @@
 
 #include <esp_adc_cal.h>
 
+#include "RBControl_adcFilter.hpp"
+#include "RBControl_batteryModel.hpp"
 #include "RBControl_leds.hpp"
 #include "RBControl_piezo.hpp"
 
@@ -13,22 +15,36 @@ class Manager;
 
 /**
  * \brief Contains the battery state and can control the robot's power.
+ *
+ * The voltage sags while the motors run. The warning and pct() use the open-circuit voltage,
+ * estimated by compensating the sag, see {@link BatteryModel}. The undervoltage shutdown
+ * doesn't trust the estimate, it uses the measured voltage against VOLTAGE_SHUTDOWN.
  */
 class Battery {
     friend class Manager;
 
 public:
-    static constexpr uint32_t VOLTAGE_MIN = 3300 * 2; //!< Minimal battery voltage, in mV, at which the robot shuts down
+    static constexpr uint32_t VOLTAGE_MIN = 3300 * 2; //!< Minimal battery voltage, in mV, 0 % of pct()
+    static constexpr uint32_t VOLTAGE_SHUTDOWN = VOLTAGE_MIN - BatteryModel::MAX_SAG_MV; //!< Measured voltage, in mV, at which the robot shuts down
     static constexpr uint32_t VOLTAGE_MAX = 4200 * 2; //!< Maximal battery voltage, in mV
     static constexpr uint32_t VOLTAGE_WARNING = 3500 * 2; //!< The voltage at which alert triggers
+    static constexpr uint32_t CELLS = 2; //!< Number of LiPo cells in series
     static constexpr float BATT_DIVIDER = 10.0f / (82.0f + 10.0f); //!< Voltage divider ratio
 
     void setFineTuneCoef(float coef); //!< Tunes battery measurement to compensate e.g. for voltage divider error. Default 1, expected to be 0.5 to 1.5.
     float fineTuneCoef() const;
 
-    uint32_t raw() const; //!< returns the raw value
-    uint32_t pct() const; //!< returns current battery percentage
-    uint32_t voltageMv() const; //!< returns current battery voltage
+    /**
+     * \brief Tune the estimate of the voltage sag under the motors' load, see {@link openCircuitMv}.
+     * \param resistanceMOhm is the internal resistance of the battery and its wiring, in mOhm. Default 150.
+     * \param motorCurrentMa is the current of one motor at full power, in mA. Default 1000.
+     */
+    void setLoadModel(uint32_t resistanceMOhm, uint32_t motorCurrentMa);
+
+    uint32_t raw() const; //!< returns the raw value, filtered
+    uint32_t pct() const; //!< returns the state of charge in %, estimated from openCircuitMv()
+    uint32_t voltageMv() const; //!< returns current battery voltage, as measured
+    uint32_t openCircuitMv() const; //!< returns the voltage without the motors' load, estimated
 
     void shutdown(); //!< shuts the robot down
 private:
@@ -38,14 +54,23 @@ private:
 
     void install(bool disableEmergencyShutdown = false);
 
-    void updateVoltage();
+    void sample(); //!< Take one ADC sample, called every BATTERY_SAMPLE_PERIOD_MS
+    void checkVoltage();
+    void setMotorsDuty(uint32_t dutyPercent); //!< Called by the manager when the motors change
     void setWarning(bool on);
     uint32_t rawToMv(uint32_t rawVal);
 
     esp_adc_cal_characteristics_t m_adcChars;
+    AdcFilter m_filter;
+    BatteryModel m_model;
+    uint8_t m_samplesToCheck;
 
     std::atomic<uint32_t> m_raw;
     std::atomic<uint32_t> m_voltageMv;
+    std::atomic<uint32_t> m_sagMv;
+    std::atomic<uint32_t> m_motorsDuty;
+    std::atomic<uint32_t> m_resistanceMOhm;
+    std::atomic<uint32_t> m_motorCurrentMa;
     std::atomic<float> m_coef;
 
     bool m_warningOn;
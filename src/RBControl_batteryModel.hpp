@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace rb {
+
+/**
+ * \brief Estimates how much the battery voltage sags under the motors' load.
+ *
+ * The load current is estimated from the duty the motors are commanded to, the sag
+ * is that current times the battery's internal resistance (including the wiring). Adding the sag
+ * to the measured voltage gives the open-circuit voltage, which maps to the state of charge
+ * through the LiPo discharge curve, see {@link stateOfCharge}.
+ *
+ * The current goes through the same exponential average as the voltage in {@link AdcFilter},
+ * so that the compensation follows a load step as slowly as the filtered voltage does.
+ *
+ * The commanded duty says nothing about the actual load, e.g. of free-running or stalled motors,
+ * so the sag is capped at MAX_SAG_MV and the estimate must not be trusted for the shutdown.
+ *
+ * Not thread-safe, it is meant to be fed from a single task.
+ * Doesn't depend on anything ESP32 specific, so it can be tested on the host.
+ */
+class BatteryModel {
+public:
+    static constexpr uint32_t RESISTANCE_MOHM = 150; //!< Default internal resistance of the pack and the wiring, in mOhm
+    static constexpr uint32_t MOTOR_CURRENT_MA = 1000; //!< Default current of one motor at full duty, in mA
+    static constexpr uint32_t MAX_SAG_MV = 500; //!< The largest sag the model ever estimates, in mV
+
+    BatteryModel(uint8_t smoothingShift = 4)
+        : m_shift(smoothingShift)
+        , m_resistanceMOhm(RESISTANCE_MOHM)
+        , m_motorCurrentMa(MOTOR_CURRENT_MA) {
+        reset(0);
+    }
+
+    void setResistance(uint32_t mOhm) { m_resistanceMOhm = mOhm; }
+    void setMotorCurrent(uint32_t mA) { m_motorCurrentMa = mA; }
+
+    //! Forget the history, as if the motors always ran at dutyPercent.
+    void reset(uint32_t dutyPercent) {
+        m_current = int32_t(dutyToMa(dutyPercent)) << FRACTION_BITS;
+    }
+
+    /**
+     * \brief Add the duty of one sample, returns the new sagMv().
+     * \param dutyPercent is the sum of all motors' duty, 100 is one motor at full power
+     */
+    uint32_t update(uint32_t dutyPercent) {
+        const int32_t target = int32_t(dutyToMa(dutyPercent)) << FRACTION_BITS;
+        m_current += (target - m_current) >> m_shift;
+        return sagMv();
+    }
+
+    uint32_t currentMa() const { return uint32_t((m_current + (1 << (FRACTION_BITS - 1))) >> FRACTION_BITS); }
+
+    //! How much lower the measured voltage is than the open-circuit one, in mV, at most MAX_SAG_MV.
+    uint32_t sagMv() const {
+        const uint32_t sag = (currentMa() * m_resistanceMOhm + 500) / 1000;
+        return sag < MAX_SAG_MV ? sag : MAX_SAG_MV;
+    }
+
+    /**
+     * \brief Get the state of charge of a LiPo cell from its open-circuit voltage.
+     * \return charge in % <0 - 100>, interpolated between the points of a typical discharge curve
+     */
+    static uint8_t stateOfCharge(uint32_t cellMv) {
+        static const uint16_t curve[][2] = {
+            { 3300, 0 }, { 3610, 5 }, { 3690, 10 }, { 3710, 15 }, { 3730, 20 }, { 3750, 25 },
+            { 3770, 30 }, { 3790, 35 }, { 3800, 40 }, { 3820, 45 }, { 3840, 50 }, { 3850, 55 },
+            { 3870, 60 }, { 3910, 65 }, { 3950, 70 }, { 3980, 75 }, { 4020, 80 }, { 4080, 85 },
+            { 4110, 90 }, { 4150, 95 }, { 4200, 100 },
+        };
+        static const size_t points = sizeof(curve) / sizeof(curve[0]);
+
+        if (cellMv <= curve[0][0])
+            return 0;
+        for (size_t i = 1; i != points; ++i) {
+            if (cellMv < curve[i][0]) {
+                const uint32_t dv = curve[i][0] - curve[i - 1][0];
+                const uint32_t dp = curve[i][1] - curve[i - 1][1];
+                return curve[i - 1][1] + ((cellMv - curve[i - 1][0]) * dp + dv / 2) / dv;
+            }
+        }
+        return 100;
+    }
+
+private:
+    static constexpr int FRACTION_BITS = 8;
+
+    uint32_t dutyToMa(uint32_t dutyPercent) const { return dutyPercent * m_motorCurrentMa / 100; }
+
+    const uint8_t m_shift;
+    uint32_t m_resistanceMOhm;
+    uint32_t m_motorCurrentMa;
+    int32_t m_current; //!< In mA, with FRACTION_BITS below the point
+};
+
+} // namespace rb
@@ -0,0 +1,82 @@
+#include <stdio.h>
+
+#include "RBControl_binaryLog.hpp"
+
+namespace rb {
+
+BinaryLog binaryLog;
+
+UartBinaryLogSink::UartBinaryLogSink(uart_port_t port)
+    : m_port(port) {
+}
+
+void UartBinaryLogSink::write(const uint8_t* frame, size_t length) {
+    uart_write_bytes(m_port, reinterpret_cast<const char*>(frame), length);
+}
+
+NvsBinaryLogSink::NvsBinaryLogSink(const char* name_space, uint8_t chunks, size_t chunkSize)
+    : m_nvs(name_space)
+    , m_chunks(chunks)
+    , m_chunk_size(chunkSize)
+    , m_seq(0) {
+    if (m_nvs.existsInt("seq"))
+        m_seq = m_nvs.getInt("seq");
+    m_chunk.reserve(m_chunk_size);
+}
+
+void NvsBinaryLogSink::chunkKey(uint32_t seq, char* key) const {
+    snprintf(key, 16, "chunk%u", unsigned(seq % m_chunks));
+}
+
+void NvsBinaryLogSink::write(const uint8_t* frame, size_t length) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_chunk.size() + length > m_chunk_size)
+        storeChunk();
+    m_chunk.insert(m_chunk.end(), frame, frame + length);
+}
+
+void NvsBinaryLogSink::flush() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_chunk.empty())
+        storeChunk();
+}
+
+void NvsBinaryLogSink::storeChunk() {
+    char key[16];
+    chunkKey(m_seq, key);
+    m_nvs.writeBlob(key, m_chunk.data(), m_chunk.size());
+    m_nvs.writeInt("seq", ++m_seq);
+    m_nvs.commit();
+    m_chunk.clear();
+}
+
+void NvsBinaryLogSink::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_seq += m_chunks; // All the stored chunks are older than the window now
+    m_nvs.writeInt("seq", m_seq);
+    m_nvs.writeInt("cleared", m_seq);
+    m_nvs.commit();
+    m_chunk.clear();
+}
+
+std::vector<uint8_t> NvsBinaryLogSink::read() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const uint32_t cleared = m_nvs.existsInt("cleared") ? m_nvs.getInt("cleared") : 0;
+    uint32_t first = m_seq > m_chunks ? m_seq - m_chunks : 0;
+    if (first < cleared)
+        first = cleared;
+
+    std::vector<uint8_t> res;
+    char key[16];
+    for (uint32_t seq = first; seq != m_seq; ++seq) {
+        chunkKey(seq, key);
+        if (!m_nvs.existsBlob(key))
+            continue;
+        const auto chunk = m_nvs.getBlob(key);
+        res.insert(res.end(), chunk.begin(), chunk.end());
+    }
+    res.insert(res.end(), m_chunk.begin(), m_chunk.end());
+    return res;
+}
+
+} // namespace rb
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <driver/uart.h>
+
+#include "RBControl_nvs.hpp"
+#include "logger/binary_log.hpp"
+
+namespace rb {
+
+/**
+ * \brief The library's {@link BinaryLog}, for high-rate telemetry like control loop traces.
+ *
+ * Nothing is recorded until a sink is added:
+ * \code
+ * rb::binaryLog.addSink(std::unique_ptr<BinaryLogSink>(new rb::UartBinaryLogSink(UART_NUM_2)));
+ * rb::binaryLog.log(RB_FMT("speed {} {}"), left, right);
+ * \endcode
+ * Decode the stream on a PC with host/tools/rblog_decode.
+ */
+extern BinaryLog binaryLog;
+
+/**
+ * \brief Sends the frames out through a UART.
+ *
+ * Install the UART driver with a TX buffer first, uart_write_bytes waits when it is full.
+ */
+class UartBinaryLogSink : public BinaryLogSink {
+public:
+    UartBinaryLogSink(uart_port_t port);
+
+    virtual void write(const uint8_t* frame, size_t length) override;
+
+private:
+    uart_port_t m_port;
+};
+
+/**
+ * \brief Keeps the frames in NVS flash, so that they survive a reset.
+ *
+ * The frames are collected into a RAM chunk, a full chunk is written to flash as
+ * one blob. The newest `chunks` chunks are kept. Writing takes milliseconds
+ * and wears the flash, record events here, not every control loop iteration.
+ */
+class NvsBinaryLogSink : public BinaryLogSink {
+public:
+    NvsBinaryLogSink(const char* name_space = "rblog", uint8_t chunks = 8, size_t chunkSize = 1024);
+
+    virtual void write(const uint8_t* frame, size_t length) override;
+
+    void flush(); //!< Write the current chunk to flash now
+    void clear(); //!< Forget all the stored chunks
+
+    /**
+     * \brief Read the stored frames, oldest first, including the chunk which was not flushed yet.
+     *
+     * Older chunks may be gone with the format definitions, write
+     * {@link BinaryLog::writeFormatTable} before the frames when sending them out.
+     */
+    std::vector<uint8_t> read();
+
+private:
+    void chunkKey(uint32_t seq, char* key) const;
+    void storeChunk();
+
+    std::mutex m_mutex;
+    Nvs m_nvs;
+    const uint8_t m_chunks;
+    const size_t m_chunk_size;
+    uint32_t m_seq; //!< Sequence number of the chunk being collected
+    std::vector<uint8_t> m_chunk;
+};
+
+} // namespace rb
@@ -0,0 +1,172 @@
+#include <driver/gpio.h>
+#include <esp_timer.h>
+
+#include "RBControl_buttons.hpp"
+#include "RBControl_manager.hpp"
+#include "RBControl_pinout.hpp"
+
+#define ESP_INTR_FLAG_DEFAULT 0
+
+namespace rb {
+
+static const uint16_t BUTTONS_MASK = (1 << SW1) | (1 << SW2) | (1 << SW3);
+
+ButtonDebouncer::ButtonDebouncer(uint16_t mask, uint16_t initialLevels, uint32_t debounce_ms)
+    : m_mask(mask)
+    , m_debounce_ms(debounce_ms)
+    , m_stable(initialLevels & mask)
+    , m_candidate(initialLevels & mask)
+    , m_since {} {
+}
+
+uint16_t ButtonDebouncer::update(uint16_t levels, uint32_t now_ms) {
+    levels &= m_mask;
+
+    const uint16_t moved = levels ^ m_candidate;
+    for (int bit = 0; bit < 16; ++bit) {
+        if (moved & (1 << bit))
+            m_since[bit] = now_ms;
+    }
+    m_candidate = levels;
+
+    uint16_t changed = 0;
+    const uint16_t pending = settling();
+    for (int bit = 0; bit < 16; ++bit) {
+        if ((pending & (1 << bit)) && now_ms - m_since[bit] >= m_debounce_ms)
+            changed |= 1 << bit;
+    }
+    m_stable ^= changed;
+    return changed;
+}
+
+uint32_t ButtonDebouncer::deadline() const {
+    const uint16_t pending = settling();
+    bool found = false;
+    uint32_t first = 0;
+    for (int bit = 0; bit < 16; ++bit) {
+        if (!(pending & (1 << bit)))
+            continue;
+        const uint32_t accept = m_since[bit] + m_debounce_ms;
+        if (!found || int32_t(accept - first) < 0)
+            first = accept;
+        found = true;
+    }
+    return first;
+}
+
+Buttons::Buttons(Manager& man)
+    : m_man(man)
+    , m_task(nullptr)
+    , m_int_pin(GPIO_NUM_MAX)
+    , m_debounce_ms(0)
+    , m_levels(BUTTONS_MASK) {
+}
+
+Buttons::~Buttons() {
+}
+
+void Buttons::install(gpio_num_t intPin, uint32_t debounce_ms) {
+    if (m_task)
+        return;
+
+    m_int_pin = intPin;
+    m_debounce_ms = debounce_ms;
+
+    // Both ports drive INTA, open-drain and active low, so that the pin can be shared
+    auto& expander = m_man.expander();
+    expander.setupInterrupts(1, 1, 0);
+    expander.setupInterruptPins(BUTTONS_MASK);
+    m_levels.store(expander.readGPIOAB() | ~BUTTONS_MASK);
+
+    gpio_config_t io_conf = {};
+    io_conf.intr_type = GPIO_INTR_NEGEDGE;
+    io_conf.pin_bit_mask = (1ULL << intPin);
+    io_conf.mode = GPIO_MODE_INPUT;
+    io_conf.pull_up_en = GPIO_PULLUP_ENABLE;
+    gpio_config(&io_conf);
+
+    xTaskCreate(&Buttons::taskTrampoline, "rbbuttons", 3072, this, 4, &m_task);
+    m_man.monitorTask(m_task);
+
+    gpio_install_isr_service(ESP_INTR_FLAG_DEFAULT);
+    gpio_isr_handler_add(intPin, isr, this);
+
+    // A change between the read above and here left INTA low, with no edge to see
+    xTaskNotifyGive(m_task);
+}
+
+void Buttons::onChange(Callback callback) {
+    std::lock_guard<std::mutex> lock(m_callback_mutex);
+    m_callback = std::move(callback);
+}
+
+bool Buttons::pressed(int pin) const {
+    return !(m_levels.load() & (1 << pin));
+}
+
+void IRAM_ATTR Buttons::isr(void* cookie) {
+    auto& self = *((Buttons*)cookie);
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(self.m_task, &woken);
+    if (woken == pdTRUE) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+void Buttons::taskTrampoline(void* cookie) {
+    ((Buttons*)cookie)->task();
+}
+
+void Buttons::task() {
+    auto& expander = m_man.expander();
+    const auto nowMs = []() { return uint32_t(esp_timer_get_time() / 1000); };
+
+    ButtonDebouncer debouncer(BUTTONS_MASK, m_levels.load(), m_debounce_ms);
+    bool confirm = false; // The pins have to be read after the last interrupt
+    uint32_t confirmAt = 0;
+    while (true) {
+        TickType_t wait = portMAX_DELAY;
+        if (debouncer.settling() || confirm) {
+            uint32_t deadline = confirm ? confirmAt : debouncer.deadline();
+            if (debouncer.settling() && int32_t(debouncer.deadline() - deadline) < 0)
+                deadline = debouncer.deadline();
+            const int32_t left = int32_t(deadline - nowMs());
+            wait = left > 0 ? pdMS_TO_TICKS(left) + 1 : 0;
+        }
+
+        uint16_t levels;
+        if (ulTaskNotifyTake(pdTRUE, wait) != 0) {
+            // The levels the change was detected with, reading them releases INTA.
+            // INTCAP only holds the first change, the pins may have moved on since,
+            // even back to the stable levels, so they are read once more later.
+            levels = expander.readInterruptCapture();
+            confirm = true;
+            confirmAt = nowMs() + m_debounce_ms;
+        } else if (debouncer.settling() || confirm) {
+            // Quiet for the debounce time, the bouncing is over. INTCAP keeps the levels
+            // of the first change until it's read, so read the pins themselves.
+            levels = expander.readGPIOAB();
+            confirm = false;
+        } else {
+            continue;
+        }
+
+        const uint16_t changed = debouncer.update(levels, nowMs());
+        if (changed)
+            publish(changed, debouncer.state());
+    }
+}
+
+void Buttons::publish(uint16_t changed, uint16_t levels) {
+    m_levels.store(levels | ~BUTTONS_MASK);
+
+    std::lock_guard<std::mutex> lock(m_callback_mutex);
+    if (!m_callback)
+        return;
+    for (int pin = 0; pin < 16; ++pin) {
+        if (changed & (1 << pin))
+            m_callback(pin, !(levels & (1 << pin)));
+    }
+}
+
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <atomic>
+#include <driver/gpio.h>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+
+namespace rb {
+
+class Manager;
+
+/**
+ * \brief Debounces up to 16 digital inputs, without any I/O of its own.
+ *
+ * Feed it the levels whenever they may have changed, e.g. on every interrupt.
+ * A new level is accepted once it has stayed the same for the debounce time,
+ * pulses shorter than that are ignored. When {@link settling} is non-zero,
+ * feed it the levels again at {@link deadline}, no further change may come.
+ */
+class ButtonDebouncer {
+public:
+    ButtonDebouncer(uint16_t mask, uint16_t initialLevels, uint32_t debounce_ms);
+
+    /**
+     * \brief Take the levels sampled at now_ms.
+     * \return the bits whose debounced level has changed
+     */
+    uint16_t update(uint16_t levels, uint32_t now_ms);
+
+    uint16_t state() const { return m_stable; } //!< The debounced levels
+    uint16_t settling() const { return m_candidate ^ m_stable; } //!< Bits whose new level is not accepted yet
+    uint32_t deadline() const; //!< The time the first settling bit gets accepted, if it doesn't change again
+
+private:
+    const uint16_t m_mask;
+    const uint32_t m_debounce_ms;
+    uint16_t m_stable;
+    uint16_t m_candidate;
+    uint32_t m_since[16]; //!< When each bit's m_candidate level was first seen
+};
+
+/**
+ * \brief The buttons connected to the expander, SW1 to SW3.
+ *
+ * Initialize it with {@link Manager::initButtons}. The expander signals the changes
+ * on its INTA pin, so the buttons cost nothing while nobody presses them.
+ */
+class Buttons {
+    friend class Manager;
+
+public:
+    /**
+     * \brief Called from the buttons task on every debounced change.
+     * \param pin the expander pin of the button, e.g. rb::SW1
+     * \param pressed the button's new state
+     */
+    typedef std::function<void(int pin, bool pressed)> Callback;
+
+    void onChange(Callback callback); //!< Set the callback, replaces the previous one
+    bool pressed(int pin) const; //!< The debounced state of the button on the expander pin
+
+private:
+    Buttons(Manager& man);
+    Buttons(const Buttons&) = delete;
+    ~Buttons();
+
+    void install(gpio_num_t intPin, uint32_t debounce_ms);
+
+    static void isr(void* cookie);
+    static void taskTrampoline(void* cookie);
+    void task();
+    void publish(uint16_t changed, uint16_t levels);
+
+    Manager& m_man;
+    TaskHandle_t m_task;
+    gpio_num_t m_int_pin;
+    uint32_t m_debounce_ms;
+    std::atomic<uint16_t> m_levels; //!< Debounced levels of the expander pins, low is pressed
+
+    std::mutex m_callback_mutex;
+    Callback m_callback;
+};
+
+};
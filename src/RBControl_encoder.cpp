@@ -2,17 +2,19 @@
 #include <driver/pcnt.h>
 #include <driver/periph_ctrl.h>
 #include <esp_log.h>
+#include <xtensa/hal.h>
 
 #include "RBControl_encoder.hpp"
 #include "RBControl_manager.hpp"
 #include "RBControl_pinout.hpp"
+#include "RBControl_quadrature.hpp"
+#include "RBControl_trace.hpp"
 
 #define TAG "RbEncoder"
 
 #define ENC_COUNT static_cast<int>(MotorId::MAX)
 #define PCNT_H_LIM_VAL 32767
 #define PCNT_L_LIM_VAL (-32768)
-#define INC_PER_REVOLUTION 2 //PCNT increments per 1 engine revolution
 #define ESP_INTR_FLAG_DEFAULT 0
 #define ENC_DEBOUNCE_US 20 //[microseconds]
 #define MAX_ENGINE_PERIOD_US 100000 //engine period limit separating zero result [us]
@@ -50,6 +52,9 @@ const gpio_num_t ENCODER_PINS[ENC_COUNT * 2] = {
     ENC8B,
 };
 
+// Orders the overflow accounting in the PCNT interrupt against Encoder::readAll
+static portMUX_TYPE s_pcnt_mux = portMUX_INITIALIZER_UNLOCKED;
+
 PcntInterruptHandler& PcntInterruptHandler::get(Manager* manager) {
     static PcntInterruptHandler instance(manager);
     return instance;
@@ -66,7 +71,17 @@ void PcntInterruptHandler::enable(int index) {
     pcnt_intr_enable((pcnt_unit_t)index);
 }
 
+// What the counter lost by wrapping at a limit
+static inline int32_t IRAM_ATTR limitValue(uint32_t status) {
+    if (status & PCNT_STATUS_L_LIM_M)
+        return PCNT_L_LIM_VAL;
+    if (status & PCNT_STATUS_H_LIM_M)
+        return PCNT_H_LIM_VAL;
+    return 0;
+}
+
 void IRAM_ATTR PcntInterruptHandler::isrHandler(void* cookie) {
+    RB_TRACE(TRACE_PCNT_ISR, 0);
     auto* man = (Manager*)cookie;
     uint32_t intr_status = PCNT.int_st.val;
     for (int i = 0; i < PCNT_UNIT_MAX; i++) {
@@ -82,8 +97,18 @@ void IRAM_ATTR PcntInterruptHandler::isrHandler(void* cookie) {
                 },
             };
 
+            // Reaching the driveToValue target must not wait behind queued motor/edge events
+            const bool isTarget = ev.data.encoderPcnt.status & (PCNT_STATUS_THRES0_M | PCNT_STATUS_ZERO_M);
+
+            // The counter has already wrapped, the accumulator must follow right away,
+            // not when the manager's task gets to the event.
+            portENTER_CRITICAL_ISR(&s_pcnt_mux);
+            Encoder* enc = man->m_encoders[i].load();
+            if (enc)
+                enc->m_counter.fetch_add(limitValue(ev.data.encoderPcnt.status));
             PCNT.int_clr.val = BIT(i);
-            if (man->queueFromIsr(&ev)) {
+            portEXIT_CRITICAL_ISR(&s_pcnt_mux);
+            if (man->queueFromIsr(&ev, isTarget)) {
                 portYIELD_FROM_ISR();
             }
         }
@@ -105,6 +130,12 @@ Encoder::Encoder(rb::Manager& man, rb::MotorId id)
     m_target_direction = 0;
     m_target_callback = NULL;
     m_target = 0;
+
+    m_sampled = (m_manager.m_install_flags & MAN_ENCODER_SAMPLED_SPEED);
+    m_x4 = (m_manager.m_install_flags & MAN_ENCODER_QUADRATURE_X4);
+    m_samples_idx = 0;
+    m_samples_count = 0;
+    m_sampled_speed = 0.f;
 }
 
 Encoder::~Encoder() {
@@ -116,7 +147,9 @@ void Encoder::install() {
 
     {
         gpio_config_t io_conf;
-        io_conf.intr_type = GPIO_INTR_POSEDGE; //ANYEDGE gives oscillating time differences in engine rotor half turns
+        // ANYEDGE gives oscillating time differences in engine rotor half turns.
+        // The sampled mode reads only the PCNT counters, so the edge ISR is not needed at all.
+        io_conf.intr_type = m_sampled ? GPIO_INTR_DISABLE : GPIO_INTR_POSEDGE;
         io_conf.pin_bit_mask = (1ULL << encA);
         io_conf.mode = GPIO_MODE_INPUT;
         io_conf.pull_up_en = GPIO_PULLUP_ENABLE;
@@ -131,30 +164,52 @@ void Encoder::install() {
         gpio_config(&io_conf);
     }
 
-    gpio_install_isr_service(ESP_INTR_FLAG_DEFAULT);
-    gpio_isr_handler_add(encA, isrGpio, this);
+    if (!m_sampled) {
+        gpio_install_isr_service(ESP_INTR_FLAG_DEFAULT);
+        gpio_isr_handler_add(encA, isrGpio, this);
+    }
 
     pcnt_init(PCNT_UNITS[static_cast<int>(m_id)], encA, encB);
+
+    m_manager.m_encoders[static_cast<int>(m_id)].store(this);
 }
 
-void Encoder::pcnt_init(pcnt_unit_t pcntUnit, gpio_num_t GPIO_A, gpio_num_t GPIO_B) {
+static pcnt_count_mode_t pcntCountMode(int8_t count) {
+    if (count > 0)
+        return PCNT_COUNT_INC;
+    else if (count < 0)
+        return PCNT_COUNT_DEC;
+    return PCNT_COUNT_DIS;
+}
+
+static void pcntChannelInit(pcnt_unit_t pcntUnit, pcnt_channel_t channel, const QuadratureChannel& mode,
+    gpio_num_t GPIO_A, gpio_num_t GPIO_B) {
     pcnt_config_t pcnt_config = {
         // Set PCNT input signal and control GPIOs
-        GPIO_A, //pulse_gpio_num
-        GPIO_B, //ctrl_gpio_num
+        mode.pulseIsA ? GPIO_A : GPIO_B, //pulse_gpio_num
+        mode.pulseIsA ? GPIO_B : GPIO_A, //ctrl_gpio_num
         // What to do when control input is low or high?
-        PCNT_MODE_KEEP, //lctrl_mode  // Keep the primary counter mode if high
-        PCNT_MODE_REVERSE, //hctrl_mode   // Reverse counting direction if low
+        mode.reverseOnLow ? PCNT_MODE_REVERSE : PCNT_MODE_KEEP, //lctrl_mode
+        mode.reverseOnLow ? PCNT_MODE_KEEP : PCNT_MODE_REVERSE, //hctrl_mode
         // What to do on the positive / negative edge of pulse input?
-        PCNT_COUNT_INC, //pos_mode   // Count up on the positive edge
-        PCNT_COUNT_DEC, //neg_mode   // Keep the counter value on the negative edge  --TODO: is this correct? comment says keep, code says decrease
+        pcntCountMode(mode.pos), //pos_mode
+        pcntCountMode(mode.neg), //neg_mode
         // Set the maximum and minimum limit values to watch
         PCNT_H_LIM_VAL, //counter_h_lim
         PCNT_L_LIM_VAL, //counter_l_lim
         pcntUnit, //unit
-        PCNT_CHANNEL_0, //channel
+        channel, //channel
     };
     pcnt_unit_config(&pcnt_config); //Initialize PCNT units
+}
+
+void Encoder::pcnt_init(pcnt_unit_t pcntUnit, gpio_num_t GPIO_A, gpio_num_t GPIO_B) {
+    // Channel 0 counts both edges of A, channel 1 adds both edges of B in the x4 mode.
+    // The limits are unit-wide, the overflow accounting in onPcntIsr does not depend on the mode.
+    pcntChannelInit(pcntUnit, PCNT_CHANNEL_0, QUADRATURE_CHANNEL_0, GPIO_A, GPIO_B);
+    if (m_x4) {
+        pcntChannelInit(pcntUnit, PCNT_CHANNEL_1, QUADRATURE_CHANNEL_1, GPIO_A, GPIO_B);
+    }
 
     /* Configure and enable the input filter */
     pcnt_set_filter_value(pcntUnit, 255);
@@ -163,11 +218,7 @@ void Encoder::pcnt_init(pcnt_unit_t pcntUnit, gpio_num_t GPIO_A, gpio_num_t GPIO
     /* interrupts */
     PcntInterruptHandler::get(&m_manager).enable(pcntUnit);
 
-    /* Set threshold 0 and 1 values and enable events to watch */
-    /*pcnt_set_event_value(pcntUnit, PCNT_EVT_THRES_1, PCNT_THRESH1_VAL);
-    pcnt_event_enable(pcntUnit, PCNT_EVT_THRES_1);
-    pcnt_set_event_value(pcntUnit, PCNT_EVT_THRES_0, PCNT_THRESH0_VAL);
-    pcnt_event_enable(pcntUnit, PCNT_EVT_THRES_0);*/
+    /* Threshold 0 is armed by driveToValue, see armTargetLocked() */
     /* Enable events on zero, maximum and minimum limit values */
     //pcnt_event_enable(pcntUnit, PCNT_EVT_ZERO);
     pcnt_event_enable(pcntUnit, PCNT_EVT_H_LIM);
@@ -182,7 +233,9 @@ void Encoder::pcnt_init(pcnt_unit_t pcntUnit, gpio_num_t GPIO_A, gpio_num_t GPIO
 }
 
 void IRAM_ATTR Encoder::isrGpio(void* cookie) {
+    const uint32_t start = xthal_get_ccount();
     auto& enc = *((Encoder*)cookie);
+    RB_TRACE(TRACE_GPIO_ISR, static_cast<uint8_t>(enc.m_id));
     const Manager::Event ev = {
         .type = Manager::EVENT_ENCODER_EDGE,
         .data = {
@@ -194,14 +247,14 @@ void IRAM_ATTR Encoder::isrGpio(void* cookie) {
         },
     };
 
-    if (enc.m_manager.queueFromIsr(&ev)) {
+    const bool woken = enc.m_manager.queueFromIsr(&ev);
+    enc.m_manager.m_encoder_cycles.fetch_add(xthal_get_ccount() - start);
+    if (woken) {
         portYIELD_FROM_ISR();
     }
 }
 
 void Encoder::onEdgeIsr(int64_t timestamp, uint8_t pinLevel) {
-    std::function<void(Encoder&)> callback;
-
     m_time_mutex.lock();
     if (timestamp > m_counter_time_us_last + ENC_DEBOUNCE_US) {
         m_counter_time_us_diff = timestamp - m_counter_time_us_last;
@@ -211,32 +264,106 @@ void Encoder::onEdgeIsr(int64_t timestamp, uint8_t pinLevel) {
         m_counter_time_us_last = timestamp;
 
         ESP_LOGD(TAG, "Edge %d %d %d", (int)m_id, value(), (int)pinLevel);
+    }
+    m_time_mutex.unlock();
+}
 
-        if (m_target_direction != 0) {
-            const auto val = value();
-            if ((m_target_direction > 0 && val >= m_target) || (m_target_direction < 0 && val <= m_target)) {
-                m_manager.setMotors().power(m_id, 0).set(true);
-                m_target_direction = 0;
-                callback = m_target_callback;
-            }
-        }
+void Encoder::onSampleTick(int64_t timestamp, int32_t val) {
+    m_time_mutex.lock();
+    m_samples[m_samples_idx] = { timestamp, val };
+    m_samples_idx = (m_samples_idx + 1) % SPEED_WINDOW;
+    if (m_samples_count < SPEED_WINDOW)
+        ++m_samples_count;
+
+    // Once the window is full, m_samples_idx points to the oldest sample.
+    const auto& oldest = m_samples[m_samples_count < SPEED_WINDOW ? 0 : m_samples_idx];
+    const auto dt = timestamp - oldest.timestamp;
+    if (dt > 0) {
+        m_sampled_speed.store((float(val - oldest.value) / incPerRevolution()) * 1000000.f / dt);
     }
     m_time_mutex.unlock();
+}
 
-    if (callback)
-        callback(*this);
+bool Encoder::checkTargetLocked(int32_t val, std::function<void(Encoder&)>& callback) {
+    if ((m_target_direction > 0 && val >= m_target) || (m_target_direction < 0 && val <= m_target)) {
+        m_manager.setMotors().power(m_id, 0).set(true);
+        m_target_direction = 0;
+        callback = m_target_callback;
+        pcnt_event_disable(PCNT_UNITS[static_cast<int>(m_id)], PCNT_EVT_THRES_0);
+        pcnt_event_disable(PCNT_UNITS[static_cast<int>(m_id)], PCNT_EVT_ZERO);
+
+        ESP_LOGD(TAG, "Target %d reached at %d, overshoot %d", m_target, val, (val - m_target) * m_target_direction);
+        return true;
+    }
+    return false;
+}
+
+void Encoder::armTargetLocked() {
+    const auto unit = PCNT_UNITS[static_cast<int>(m_id)];
+
+    // The hardware counter only covers the range between the limits, m_counter holds the rest.
+    // If the target is out of that range, it gets armed again after the counter overflows.
+    // A threshold of 0 can't be set, the zero event stands in for it. It also fires when
+    // the counter wraps at a limit, checkTargetLocked() ignores that.
+    const int32_t thres = m_target - m_counter.load();
+    if (thres == 0) {
+        pcnt_event_disable(unit, PCNT_EVT_THRES_0);
+        pcnt_event_enable(unit, PCNT_EVT_ZERO);
+    } else if (thres > PCNT_L_LIM_VAL && thres < PCNT_H_LIM_VAL) {
+        pcnt_set_event_value(unit, PCNT_EVT_THRES_0, thres);
+        pcnt_event_enable(unit, PCNT_EVT_THRES_0);
+        pcnt_event_disable(unit, PCNT_EVT_ZERO);
+    } else {
+        pcnt_event_disable(unit, PCNT_EVT_THRES_0);
+        pcnt_event_disable(unit, PCNT_EVT_ZERO);
+    }
 }
 
 void Encoder::onPcntIsr(uint32_t status) {
+    std::function<void(Encoder&)> callback;
+
+    // The limits are already added to m_counter by the interrupt handler
     m_time_mutex.lock();
-    if (status & PCNT_STATUS_L_LIM_M) {
-        m_counter.fetch_add(PCNT_L_LIM_VAL);
-    } else if (status & PCNT_STATUS_H_LIM_M) {
-        m_counter.fetch_add(PCNT_H_LIM_VAL);
-    } else {
+    if (!(status & (PCNT_STATUS_L_LIM_M | PCNT_STATUS_H_LIM_M | PCNT_STATUS_THRES0_M | PCNT_STATUS_ZERO_M))) {
         ESP_LOGE(TAG, "invalid pcnt state 0x%08x", status);
     }
+
+    if (m_target_direction != 0 && !checkTargetLocked(value(), callback)) {
+        armTargetLocked();
+    }
     m_time_mutex.unlock();
+
+    if (callback) {
+        m_manager.dispatch([this, callback]() { callback(*this); });
+    }
+}
+
+void Encoder::readAll(const Encoder* const encoders[], EncoderSnapshot& snapshot) {
+    int16_t counts[ENC_COUNT];
+    int32_t accumulated[ENC_COUNT];
+
+    // Read the count registers directly, without the driver's checks,
+    // so that all of them are sampled within a few cycles.
+    portENTER_CRITICAL(&s_pcnt_mux);
+    snapshot.timestamp = esp_timer_get_time();
+    for (int i = 0; i < ENC_COUNT; ++i) {
+        counts[i] = (int16_t)PCNT.cnt_unit[PCNT_UNITS[i]].cnt_val;
+    }
+    const uint32_t pending = PCNT.int_raw.val;
+    for (int i = 0; i < ENC_COUNT; ++i) {
+        accumulated[i] = encoders[i] ? encoders[i]->m_counter.load() : 0;
+
+        // A counter which wrapped, but whose interrupt wasn't handled yet. If it wrapped only
+        // after its count was read, the count is still near the limit and needs no correction.
+        if ((pending & BIT(PCNT_UNITS[i])) && abs(counts[i]) < PCNT_H_LIM_VAL / 2) {
+            accumulated[i] += limitValue(PCNT.status_unit[PCNT_UNITS[i]].val);
+        }
+    }
+    portEXIT_CRITICAL(&s_pcnt_mux);
+
+    for (int i = 0; i < ENC_COUNT; ++i) {
+        snapshot.values[i] = encoders[i] ? accumulated[i] + counts[i] : 0;
+    }
 }
 
 int32_t Encoder::value() {
@@ -246,6 +373,9 @@ int32_t Encoder::value() {
 }
 
 float Encoder::speed() {
+    if (m_sampled)
+        return m_sampled_speed.load();
+
     m_time_mutex.lock();
     const auto last = m_counter_time_us_last;
     const auto diff = m_counter_time_us_diff;
@@ -264,7 +394,7 @@ void Encoder::driveToValue(int32_t positionAbsolute, uint8_t power, std::functio
     if (power == 0)
         return;
 
-    ESP_LOGD(TAG, "driveToValue %d %d %d %p", positionAbsolute, this->value(), power, callback);
+    ESP_LOGD(TAG, "driveToValue %d %d %d callback: %d", positionAbsolute, this->value(), power, bool(callback));
 
     const auto current = this->value();
     if (current == positionAbsolute)
@@ -277,6 +407,7 @@ void Encoder::driveToValue(int32_t positionAbsolute, uint8_t power, std::functio
     m_target_callback = callback;
     m_target = positionAbsolute;
     m_target_direction = (positionAbsolute > current ? 1 : -1);
+    armTargetLocked();
     m_manager.motor(m_id).power(static_cast<int8_t>(power) * m_target_direction);
     m_time_mutex.unlock();
 }
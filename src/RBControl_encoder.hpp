@@ -14,9 +14,22 @@ namespace rb {
 class Encoder;
 class Manager;
 
+/**
+ * \brief Values of all encoders, sampled in one pass at the same time.
+ *
+ * See {@link Manager::readEncoders} and {@link Manager::encoderSnapshot}.
+ */
+struct EncoderSnapshot {
+    int64_t timestamp; //!< Time of the sampling, in microseconds (`esp_timer_get_time()`)
+    int32_t values[static_cast<int>(MotorId::MAX)]; //!< Same as {@link Encoder::value}, 0 if the encoder is not initialized
+
+    int32_t value(MotorId id) const { return values[static_cast<int>(id)]; }
+};
+
 class Encoder {
     friend class Manager;
     friend class Motor;
+    friend class PcntInterruptHandler;
 
 public:
     ~Encoder();
@@ -24,6 +37,9 @@ public:
     /**
      * \brief Drive motor to set position (according absolute value).
      *
+     * The target is watched by the PCNT threshold event, so the motor is stopped
+     * as soon as the counter reaches it, without checking every encoder edge.
+     *
      * \param positionAbsolute absolute position on which the motor drive \n
      *        e.g. if the actual motor position (`value()`) is 1000 and the `positionAbsolute` is 100
      *        then the motor will go backward to position 100
@@ -49,8 +65,19 @@ public:
      */
     int32_t value();
 
+    /**
+     * \brief Get number of counted increments per one encoder cycle.
+     * \return 4 if the manager was installed with {@link MAN_ENCODER_QUADRATURE_X4}, otherwise 2.
+     */
+    int32_t incPerRevolution() const { return m_x4 ? 4 : 2; }
+
     /**
      * \brief Get number of edges per one second.
+     *
+     * When the manager is installed with {@link MAN_ENCODER_SAMPLED_SPEED}, the speed
+     * is estimated from the PCNT counter deltas over the last few sampler ticks instead
+     * of the period between two edges.
+     *
      * \return The number of counted edges after one second.
      */
     float speed();
@@ -65,6 +92,12 @@ private:
 
     void onEdgeIsr(int64_t timestamp, uint8_t pinLevel);
     void onPcntIsr(uint32_t status);
+    void onSampleTick(int64_t timestamp, int32_t val);
+
+    static void readAll(const Encoder* const encoders[], EncoderSnapshot& snapshot);
+
+    bool checkTargetLocked(int32_t val, std::function<void(Encoder&)>& callback);
+    void armTargetLocked();
 
     void pcnt_init(pcnt_unit_t pcntUnit, gpio_num_t GPIO_A, gpio_num_t GPIO_B);
 
@@ -79,6 +112,20 @@ private:
     int32_t m_target;
     int8_t m_target_direction;
     std::function<void(Encoder&)> m_target_callback;
+
+    struct speed_sample_t {
+        int64_t timestamp;
+        int32_t value;
+    };
+
+    static constexpr int SPEED_WINDOW = 8;
+
+    bool m_sampled;
+    bool m_x4;
+    speed_sample_t m_samples[SPEED_WINDOW];
+    uint8_t m_samples_idx;
+    uint8_t m_samples_count;
+    std::atomic<float> m_sampled_speed;
 };
 
 /// @private
@@ -0,0 +1,225 @@
+#include <freertos/semphr.h>
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <string.h>
+
+#include "RBControl_i2cQueue.hpp"
+
+#define TAG "RBControlI2cQueue"
+
+// The worker may wait for the bus, it blocks nobody
+#define I2C_TIMEOUT_MS 50
+
+namespace rb {
+
+I2cQueue::I2cQueue(i2c_port_t port)
+    : m_port(port)
+    , m_task(nullptr)
+    , m_stats {} {
+}
+
+I2cQueue::~I2cQueue() {
+}
+
+void I2cQueue::install(UBaseType_t priority) {
+    if (m_task)
+        return;
+    xTaskCreate(&I2cQueue::workerTrampoline, "rbi2c", 3072, this, priority, &m_task);
+}
+
+esp_err_t I2cQueue::write(uint8_t address, uint8_t reg, const uint8_t* data, size_t len) {
+    if (len == 0 || len > MAX_LENGTH)
+        return ESP_ERR_INVALID_SIZE;
+
+    Request req;
+    req.queued_us = esp_timer_get_time();
+    req.address = address;
+    req.reg = reg;
+    req.len = len;
+    req.read = false;
+    memcpy(req.data, data, len);
+    push(std::move(req));
+    return ESP_OK;
+}
+
+esp_err_t I2cQueue::read(uint8_t address, uint8_t reg, size_t len, ReadCallback callback) {
+    if (len == 0 || len > MAX_LENGTH)
+        return ESP_ERR_INVALID_SIZE;
+
+    Request req;
+    req.queued_us = esp_timer_get_time();
+    req.address = address;
+    req.reg = reg;
+    req.len = len;
+    req.read = true;
+    req.callback = std::move(callback);
+    push(std::move(req));
+    return ESP_OK;
+}
+
+esp_err_t I2cQueue::readSync(uint8_t address, uint8_t reg, uint8_t* data, size_t len) {
+    SemaphoreHandle_t done = xSemaphoreCreateBinary();
+    esp_err_t res = ESP_OK;
+    const esp_err_t queued = read(address, reg, len, [&](esp_err_t err, const uint8_t* in, size_t inLen) {
+        res = err;
+        if (err == ESP_OK)
+            memcpy(data, in, inLen);
+        xSemaphoreGive(done);
+    });
+    if (queued == ESP_OK)
+        xSemaphoreTake(done, portMAX_DELAY);
+    vSemaphoreDelete(done);
+    return queued == ESP_OK ? res : queued;
+}
+
+void I2cQueue::flush() {
+    // An empty read is a barrier, it completes once everything before it has
+    SemaphoreHandle_t done = xSemaphoreCreateBinary();
+    Request req;
+    req.queued_us = esp_timer_get_time();
+    req.address = 0;
+    req.reg = 0;
+    req.len = 0;
+    req.read = true;
+    req.callback = [&](esp_err_t, const uint8_t*, size_t) { xSemaphoreGive(done); };
+    push(std::move(req));
+    xSemaphoreTake(done, portMAX_DELAY);
+    vSemaphoreDelete(done);
+}
+
+I2cQueueStats I2cQueue::stats() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    I2cQueueStats res = m_stats;
+    res.waiting = m_pending.size();
+    return res;
+}
+
+void I2cQueue::push(Request&& req) {
+    // Without the worker, or from its callbacks, there is nobody to wait for
+    if (!m_task || xTaskGetCurrentTaskHandle() == m_task) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_stats.requests;
+        }
+        std::deque<Request> now;
+        now.push_back(std::move(req));
+        process(now);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_stats.requests;
+        if (coalesce(req))
+            return;
+        m_pending.push_back(std::move(req));
+        if (m_pending.size() > m_stats.maxWaiting)
+            m_stats.maxWaiting = m_pending.size();
+    }
+    xTaskNotifyGive(m_task);
+}
+
+bool I2cQueue::coalesce(const Request& req) {
+    if (req.read)
+        return false;
+
+    // Only into the newest request to the device: not over a read, it must see the older data,
+    // and not over a write to other registers, the device may depend on their order.
+    for (auto itr = m_pending.rbegin(); itr != m_pending.rend(); ++itr) {
+        if (itr->address != req.address)
+            continue;
+        if (itr->read || itr->reg != req.reg || itr->len != req.len)
+            return false;
+        memcpy(itr->data, req.data, req.len);
+        ++m_stats.coalesced;
+        return true;
+    }
+    return false;
+}
+
+void I2cQueue::workerTrampoline(void* cookie) {
+    ((I2cQueue*)cookie)->worker();
+}
+
+void I2cQueue::worker() {
+    std::deque<Request> requests;
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                requests.swap(m_pending);
+            }
+            if (requests.empty())
+                break;
+            process(requests);
+            requests.clear();
+        }
+    }
+}
+
+void I2cQueue::process(std::deque<Request>& requests) {
+    size_t i = 0;
+    while (i != requests.size()) {
+        const auto& first = requests[i];
+        if (first.read && first.len == 0) {
+            complete(first);
+            first.callback(ESP_OK, nullptr, 0);
+            ++i;
+        } else if (first.read) {
+            uint8_t data[MAX_LENGTH];
+            i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+            i2c_master_start(cmd);
+            i2c_master_write_byte(cmd, (first.address << 1) | I2C_MASTER_WRITE, 1 /* expect ack */);
+            i2c_master_write_byte(cmd, first.reg, 1);
+            i2c_master_start(cmd);
+            i2c_master_write_byte(cmd, (first.address << 1) | I2C_MASTER_READ, 1 /* expect ack */);
+            for (size_t b = 0; b != first.len; ++b)
+                i2c_master_read_byte(cmd, &data[b], b + 1 == first.len ? I2C_MASTER_NACK : I2C_MASTER_ACK);
+            i2c_master_stop(cmd);
+            const esp_err_t err = execute(cmd);
+
+            complete(first);
+            if (first.callback)
+                first.callback(err, data, first.len);
+            ++i;
+        } else {
+            // The following writes to the same device join this transaction
+            size_t end = i;
+            i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+            while (end != requests.size() && !requests[end].read && requests[end].address == first.address) {
+                const auto& req = requests[end++];
+                i2c_master_start(cmd);
+                i2c_master_write_byte(cmd, (req.address << 1) | I2C_MASTER_WRITE, 1 /* expect ack */);
+                i2c_master_write_byte(cmd, req.reg, 1);
+                i2c_master_write(cmd, (uint8_t*)req.data, req.len, 1);
+            }
+            i2c_master_stop(cmd);
+            execute(cmd);
+            for (; i != end; ++i)
+                complete(requests[i]);
+        }
+    }
+}
+
+esp_err_t I2cQueue::execute(i2c_cmd_handle_t cmd) {
+    const esp_err_t err = i2c_master_cmd_begin(m_port, cmd, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+    i2c_cmd_link_delete(cmd);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_stats.transactions;
+    if (err != ESP_OK) {
+        ++m_stats.errors;
+        ESP_LOGD(TAG, "I2C transaction failed: %d", err);
+    }
+    return err;
+}
+
+void I2cQueue::complete(const Request& req) {
+    const int64_t now = esp_timer_get_time();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.latency.add(uint32_t(now - req.queued_us));
+}
+
+};
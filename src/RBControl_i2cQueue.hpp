@@ -0,0 +1,97 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <deque>
+#include <driver/i2c.h>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+
+#include "RBControl_latencyHistogram.hpp"
+
+namespace rb {
+
+/**
+ * \brief Statistics of an {@link I2cQueue}, see {@link I2cQueue::stats}.
+ */
+struct I2cQueueStats {
+    uint32_t waiting; //!< Requests waiting for the worker now
+    uint32_t maxWaiting; //!< The most requests ever waiting at once
+    uint32_t requests; //!< All submitted requests
+    uint32_t coalesced; //!< Writes merged into a pending write of the same registers
+    uint32_t transactions; //!< I2C transactions, consecutive writes to one device share one
+    uint32_t errors; //!< Transactions which failed
+    LatencyHistogram latency; //!< From submitting a request to its completion, in microseconds
+};
+
+/**
+ * \brief Runs the transfers of one I2C port in a worker task, so that the callers never wait for the bus.
+ *
+ * A write returns immediately. A write to the same registers as a write which is still waiting
+ * replaces its data, the waiting write keeps its place in the queue. Writes queued one after
+ * another to the same device are sent in one transaction, joined by repeated starts.
+ * Reads call a callback from the worker task, or block in {@link readSync}.
+ *
+ * All requests to the port must go through the queue once it is installed.
+ */
+class I2cQueue {
+public:
+    static constexpr size_t MAX_LENGTH = 16; //!< The most bytes one request may transfer
+
+    /**
+     * \brief Called from the worker task when a read is finished.
+     * \param err is ESP_OK or the error of i2c_master_cmd_begin, data is valid only on success
+     */
+    typedef std::function<void(esp_err_t err, const uint8_t* data, size_t len)> ReadCallback;
+
+    I2cQueue(i2c_port_t port);
+    I2cQueue(const I2cQueue&) = delete;
+    ~I2cQueue();
+
+    //! Start the worker task, the requests are handled synchronously until then.
+    void install(UBaseType_t priority = 4);
+    bool installed() const { return m_task != nullptr; }
+    TaskHandle_t task() const { return m_task; }
+
+    //! Queue a write of len bytes, starting at register reg of the device.
+    esp_err_t write(uint8_t address, uint8_t reg, const uint8_t* data, size_t len);
+    //! Queue a read of len bytes, starting at register reg of the device.
+    esp_err_t read(uint8_t address, uint8_t reg, size_t len, ReadCallback callback);
+    //! Queue a read and wait for it, after all the requests queued before it.
+    esp_err_t readSync(uint8_t address, uint8_t reg, uint8_t* data, size_t len);
+    //! Wait until all the requests queued so far are finished.
+    void flush();
+
+    I2cQueueStats stats();
+
+private:
+    struct Request {
+        int64_t queued_us;
+        uint8_t address;
+        uint8_t reg;
+        uint8_t len;
+        bool read;
+        uint8_t data[MAX_LENGTH];
+        ReadCallback callback;
+    };
+
+    static void workerTrampoline(void* cookie);
+    void worker();
+
+    void push(Request&& req);
+    bool coalesce(const Request& req); //!< Call with m_mutex locked
+    void process(std::deque<Request>& requests);
+    esp_err_t execute(i2c_cmd_handle_t cmd);
+    void complete(const Request& req); //!< Count the request's latency
+
+    const i2c_port_t m_port;
+    TaskHandle_t m_task;
+
+    std::mutex m_mutex;
+    std::deque<Request> m_pending;
+    I2cQueueStats m_stats;
+};
+
+};
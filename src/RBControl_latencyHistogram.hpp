@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace rb {
+
+/**
+ * \brief Histogram of latencies in microseconds, with power-of-two buckets.
+ *
+ * Bucket 0 counts zero latencies, bucket i counts latencies in <2^(i-1), 2^i),
+ * the last bucket also counts everything longer. Adding a value is O(1) and never allocates.
+ *
+ * Not thread-safe, it is meant for debug statistics written from a single task.
+ * Doesn't depend on anything ESP32 specific, so it can be tested on the host.
+ */
+class LatencyHistogram {
+public:
+    static constexpr int BUCKETS = 20; //!< The last bucket starts at ~262ms
+
+    LatencyHistogram() { reset(); }
+
+    void reset() {
+        for (auto& b : m_buckets)
+            b = 0;
+        m_count = 0;
+        m_max = 0;
+    }
+
+    void add(uint32_t us) {
+        ++m_buckets[bucketOf(us)];
+        ++m_count;
+        if (us > m_max)
+            m_max = us;
+    }
+
+    uint32_t count() const { return m_count; } //!< Number of added values
+    uint32_t max() const { return m_max; } //!< The longest added latency
+    uint32_t bucket(int idx) const { return m_buckets[idx]; } //!< Number of values in the bucket
+
+    //! Returns the exclusive upper bound of the bucket's latencies, the last bucket has none.
+    static uint32_t bucketLimit(int idx) { return idx >= BUCKETS - 1 ? UINT32_MAX : (uint32_t(1) << idx); }
+
+    static int bucketOf(uint32_t us) {
+        int idx = 0;
+        while (us != 0 && idx < BUCKETS - 1) {
+            us >>= 1;
+            ++idx;
+        }
+        return idx;
+    }
+
+    /**
+     * \brief Returns the upper bound of the latency below which `percent` of the values lie.
+     *
+     * The result is the limit of the bucket, clamped to max(), so it is exact up to a factor of 2.
+     */
+    uint32_t percentile(float percent) const {
+        const uint64_t wanted = uint64_t(float(m_count) * percent / 100.f + 0.5f);
+        uint64_t sum = 0;
+        for (int i = 0; i < BUCKETS; ++i) {
+            sum += m_buckets[i];
+            if (sum >= wanted && sum != 0)
+                return bucketLimit(i) < m_max ? bucketLimit(i) : m_max;
+        }
+        return m_max;
+    }
+
+private:
+    uint32_t m_buckets[BUCKETS];
+    uint32_t m_count;
+    uint32_t m_max;
+};
+
+} // namespace rb
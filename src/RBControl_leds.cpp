@@ -5,10 +5,12 @@ namespace rb {
 
 Leds::Leds(Adafruit_MCP23017& expander)
     : m_expander(expander) {
-    m_expander.pinMode(LED_RED, GPIO_MODE_OUTPUT);
-    m_expander.pinMode(LED_YELLOW, GPIO_MODE_OUTPUT);
-    m_expander.pinMode(LED_GREEN, GPIO_MODE_OUTPUT);
-    m_expander.pinMode(LED_BLUE, GPIO_MODE_OUTPUT);
+    m_expander.batch()
+        .pinMode(LED_RED, GPIO_MODE_OUTPUT)
+        .pinMode(LED_YELLOW, GPIO_MODE_OUTPUT)
+        .pinMode(LED_GREEN, GPIO_MODE_OUTPUT)
+        .pinMode(LED_BLUE, GPIO_MODE_OUTPUT)
+        .apply();
 }
 
 Leds::~Leds() {
@@ -1,3 +1,6 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
 #include "RBControl_logger.hpp"
 
 namespace rb {
@@ -8,4 +11,18 @@ __attribute__((constructor)) void loggerInit() {
     logger.addSink(ALL, std::unique_ptr<LogSink>(new StreamLogSink(std::cout, 80)));
 }
 
+static void asyncLoggingRoutine(void*) {
+    while (true) {
+        if (logger.processQueue() == 0)
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+    }
+}
+
+void startAsyncLogging(size_t capacity, unsigned priority) {
+    if (logger.async())
+        return;
+    logger.enableAsync(capacity);
+    xTaskCreate(&asyncLoggingRoutine, "rblog", 4096, nullptr, priority, nullptr);
+}
+
 } // namespace rb
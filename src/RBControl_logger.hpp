@@ -6,39 +6,80 @@
 #include "logger/format.hpp"
 #include "logger/logging.hpp"
 
+// The RB_LOG* macros compile out messages more verbose than this, e.g. build with -DRB_LOG_LEVEL=WARNING.
+// Set it for the whole build, not in a single file.
+#ifndef RB_LOG_LEVEL
+#define RB_LOG_LEVEL ALL
+#endif
+
+/**
+ * \brief Log a message only if some sink takes it, without evaluating the arguments otherwise.
+ *
+ * Messages more verbose than RB_LOG_LEVEL are removed at compile time.
+ * Use it with RB_FMT to format on the stack: RB_LOG(DEBUG, "Motor", RB_FMT("power {}"), power);
+ */
+#define RB_LOG(verbosity, tag, ...)                                                \
+    do {                                                                           \
+        if ((verbosity) <= RB_LOG_LEVEL && rb::logger.enabled(verbosity))          \
+            rb::log(verbosity, tag, __VA_ARGS__);                                  \
+    } while (0)
+
+#define RB_LOG_PANIC(tag, ...) RB_LOG(PANIC, tag, __VA_ARGS__)
+#define RB_LOG_ERROR(tag, ...) RB_LOG(ERROR, tag, __VA_ARGS__)
+#define RB_LOG_WARNING(tag, ...) RB_LOG(WARNING, tag, __VA_ARGS__)
+#define RB_LOG_INFO(tag, ...) RB_LOG(INFO, tag, __VA_ARGS__)
+#define RB_LOG_DEBUG(tag, ...) RB_LOG(DEBUG, tag, __VA_ARGS__)
+
 /**
  * \brief The base namespace. Contains some logging functions, too.
  */
 namespace rb {
 extern Logger logger;
 
+/**
+ * \brief Move the sinks of the rb logger to a low-priority task.
+ *
+ * The log calls then only format the message and put it into a lock-free queue of
+ * capacity messages, they never wait for the console. When the queue is full,
+ * messages are dropped and the count is reported later.
+ *
+ * \param capacity of the queue, in messages of at most LOG_PAYLOAD_SIZE characters
+ * \param priority of the task writing the messages to the sinks
+ */
+void startAsyncLogging(size_t capacity = 32, unsigned priority = 1);
+
 template <typename... Args>
-FormatString log(int verbosity, const std::string& tag, const std::string& message, Args... args) {
+FormatString log(int verbosity, LogTag tag, const std::string& message, Args... args) {
     return rb::logger.log(verbosity, tag, message, std::forward<Args>(args)...);
 }
 
+template <typename Str, typename... Args>
+void log(int verbosity, LogTag tag, CompiledFormat<Str> fmt, Args... args) {
+    rb::logger.log(verbosity, tag, fmt, std::forward<Args>(args)...);
+}
+
 template <typename... Args>
-FormatString logPanic(const std::string& tag, const std::string& message, Args... args) {
+FormatString logPanic(LogTag tag, const std::string& message, Args... args) {
     return rb::logger.logPanic(tag, message, std::forward<Args>(args)...);
 }
 
 template <typename... Args>
-FormatString logError(const std::string& tag, const std::string& message, Args... args) {
+FormatString logError(LogTag tag, const std::string& message, Args... args) {
     return rb::logger.logError(tag, message, std::forward<Args>(args)...);
 }
 
 template <typename... Args>
-FormatString logWarning(const std::string& tag, const std::string& message, Args... args) {
+FormatString logWarning(LogTag tag, const std::string& message, Args... args) {
     return rb::logger.logWarning(tag, message, std::forward<Args>(args)...);
 }
 
 template <typename... Args>
-FormatString logInfo(const std::string& tag, const std::string& message, Args... args) {
+FormatString logInfo(LogTag tag, const std::string& message, Args... args) {
     return rb::logger.logInfo(tag, message, std::forward<Args>(args)...);
 }
 
 template <typename... Args>
-FormatString logDebug(const std::string& tag, const std::string& message, Args... args) {
+FormatString logDebug(LogTag tag, const std::string& message, Args... args) {
     return rb::logger.logDebug(tag, message, std::forward<Args>(args)...);
 }
 
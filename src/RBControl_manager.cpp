@@ -3,36 +3,84 @@
 #include <freertos/task.h>
 
 #include <esp_log.h>
+#include <xtensa/hal.h>
 
 #include "RBControl_battery.hpp"
 #include "RBControl_manager.hpp"
+#include "RBControl_trace.hpp"
 
 #define TAG "RBControlManager"
 
 #define MOTORS_FAILSAFE_PERIOD_MS 300
 #define MOTORS_CHANNELS 16
 
+#ifndef ENCODER_SAMPLE_PERIOD_MS
+#define ENCODER_SAMPLE_PERIOD_MS 10
+#endif
+
+#ifndef RB_CONTROL_TASK_PRIORITY
+#define RB_CONTROL_TASK_PRIORITY 10
+#endif
+
+#ifndef RB_DISPATCH_TASK_PRIORITY
+#define RB_DISPATCH_TASK_PRIORITY 3
+#endif
+
 #ifndef MOTORS_PWM_FREQUENCY
 #define MOTORS_PWM_FREQUENCY 10000
 #endif
 
 namespace rb {
 
+static inline void storeMax(std::atomic<uint32_t>& target, uint32_t value) {
+    uint32_t cur = target.load();
+    while (value > cur && !target.compare_exchange_weak(cur, value)) {
+    }
+}
+
 Manager::Manager()
-    : m_queue(nullptr)
+    : m_tasks_last_total_run_time(0)
+    , m_queue_full_waits(0)
+    , m_isr_events_dropped(0)
+    , m_encoder_cycles(0)
+    , m_queue(nullptr)
+    , m_dispatch_queue(nullptr)
+    , m_install_flags(MAN_NONE)
+    , m_snapshot_timer(Timers::INVALID_ID)
+    , m_snapshot_seq(0)
+    , m_snapshot {}
     , m_motors_pwm { MOTORS_CHANNELS, { SERMOT }, RCKMOT, SCKMOT, -1, MOTORS_PWM_FREQUENCY }
+    , m_pwm_coast_buffer(-1)
+    , m_pwm_brake_buffer(-1)
+    , m_pwm_live_stale(false)
+    , m_estop_pending(false)
+    , m_estop_latched(false)
+    , m_estop_brake(false)
+    , m_estop_time_us(0)
+    , m_estop_count(0)
+    , m_estop_output_max_us(0)
+    , m_estop_clear_max_us(0)
+    , m_motor_control(*this)
+    , m_i2c_queue(I2C_NUM_0)
     , m_expander(I2C_ADDR_EXPANDER, I2C_NUM_0, I2C_MASTER_SDA, I2C_MASTER_SCL)
     , m_piezo()
     , m_leds(m_expander)
+    , m_buttons(*this)
     , m_battery(m_piezo, m_leds, m_expander)
     , m_servos()
     , m_config("rb") {
+    for (auto& enc : m_encoders) {
+        enc.store(nullptr);
+    }
 }
 
 Manager::~Manager() {
     if (m_queue) {
         vQueueDelete(m_queue);
     }
+    if (m_dispatch_queue) {
+        vQueueDelete(m_dispatch_queue);
+    }
 }
 
 void Manager::install(ManagerInstallFlags flags) {
@@ -42,6 +90,7 @@ void Manager::install(ManagerInstallFlags flags) {
     }
 
     m_queue = xQueueCreate(32, sizeof(struct Event));
+    m_install_flags = flags;
 
     std::vector<int> pwm_index({ 12, 13, 2, 3, 8, 9, 14, 15, 4, 5, 10, 11, 1, 2, 6, 7 });
     assert(pwm_index.size() / 2 == static_cast<size_t>(MotorId::MAX));
@@ -50,11 +99,28 @@ void Manager::install(ManagerInstallFlags flags) {
         m_motors.emplace_back(new Motor(*this, MotorId(index / 2), m_motors_pwm[pwm_index[index]], m_motors_pwm[pwm_index[index + 1]]));
     }
 
+    // The motor outputs are inverted, all channels at full value means all motors
+    // coasting (see Motor::direct_power(0)), all at zero means braking (Motor::direct_stop).
+    m_pwm_coast_buffer = m_motors_pwm.addStaticBuffer(SerialPWM::resolution());
+    m_pwm_brake_buffer = m_motors_pwm.addStaticBuffer(0);
+    if (m_pwm_coast_buffer < 0 || m_pwm_brake_buffer < 0) {
+        ESP_LOGE(TAG, "Can't create the coast and brake PWM buffers, emergency stop and failsafe "
+                      "will have to wait for the manager's task.");
+    }
+
     m_motors_last_set = 0;
     if (!(flags & MAN_DISABLE_MOTOR_FAILSAFE)) {
         schedule(MOTORS_FAILSAFE_PERIOD_MS, std::bind(&Manager::motorsFailSafe, this));
     }
 
+    if (flags & MAN_ENCODER_SAMPLED_SPEED) {
+        schedule(ENCODER_SAMPLE_PERIOD_MS, std::bind(&Manager::sampleEncoders, this));
+    }
+
+    // From now on, setting the LEDs and the power pin doesn't wait for the bus
+    m_i2c_queue.install();
+    monitorTask(m_i2c_queue.task());
+    m_expander.setQueue(&m_i2c_queue);
     setupExpander();
 
     if (!(flags & MAN_DISABLE_PIEZO)) {
@@ -64,52 +130,84 @@ void Manager::install(ManagerInstallFlags flags) {
     m_battery.install(flags & MAN_DISABLE_BATTERY_MANAGEMENT);
 
     TaskHandle_t task;
-    xTaskCreate(&Manager::consumerRoutineTrampoline, "rbmanager_loop", 3072, this, 5, &task);
+    if (flags & MAN_DISPATCH_CALLBACKS) {
+        m_dispatch_queue = xQueueCreate(16, sizeof(std::function<void()>*));
+        xTaskCreate(&Manager::dispatchRoutineTrampoline, "rbmanager_cb", 3072, this, RB_DISPATCH_TASK_PRIORITY, &task);
+        monitorTask(task);
+    }
+
+    if (flags & MAN_PIN_CONTROL_TASK) {
+        xTaskCreatePinnedToCore(&Manager::consumerRoutineTrampoline, "rbmanager_loop", 3072, this,
+            RB_CONTROL_TASK_PRIORITY, &task, RB_CONTROL_TASK_CORE);
+    } else {
+        xTaskCreate(&Manager::consumerRoutineTrampoline, "rbmanager_loop", 3072, this, 5, &task);
+    }
     monitorTask(task);
 
 #ifdef RB_DEBUG_MONITOR_TASKS
     schedule(10000, [&]() { return printTasksDebugInfo(); });
 #endif
+#ifdef RB_DEBUG_CONTROL_JITTER
+    schedule(10000, [&]() { return printJitterDebugInfo(); });
+#endif
+#ifdef RB_TRACE_ENABLED
+    schedule(10000, []() {
+        Trace::dump();
+        return true;
+    });
+#endif
 }
 
 void Manager::setupExpander() {
-    m_expander.pinMode(EA0, GPIO_MODE_OUTPUT);
-    m_expander.pinMode(EA1, GPIO_MODE_OUTPUT);
-    m_expander.pinMode(EA2, GPIO_MODE_OUTPUT);
-    m_expander.pinMode(EA3, GPIO_MODE_OUTPUT);
-    m_expander.pinMode(EA4, GPIO_MODE_OUTPUT);
-    m_expander.pinMode(EA5, GPIO_MODE_OUTPUT);
-    m_expander.pinMode(EA6, GPIO_MODE_OUTPUT);
-    m_expander.pinMode(EA7, GPIO_MODE_OUTPUT);
-
-    m_expander.pinMode(SW1, GPIO_MODE_INPUT);
-    m_expander.pullUp(SW1, 1);
-    m_expander.pinMode(SW2, GPIO_MODE_INPUT);
-    m_expander.pullUp(SW2, 1);
-    m_expander.pinMode(SW3, GPIO_MODE_INPUT);
-    m_expander.pullUp(SW3, 1);
-
-    // This pin keeps the board in the ON state.
-    m_expander.digitalWrite(EXPANDER_BOARD_POWER_ON, 1);
-    m_expander.pinMode(EXPANDER_BOARD_POWER_ON, GPIO_MODE_OUTPUT);
+    auto batch = m_expander.batch();
+    for (int pin = EA0; pin <= EA7; ++pin)
+        batch.pinMode(pin, GPIO_MODE_OUTPUT);
+
+    batch.pinMode(SW1, GPIO_MODE_INPUT).pullUp(SW1, 1);
+    batch.pinMode(SW2, GPIO_MODE_INPUT).pullUp(SW2, 1);
+    batch.pinMode(SW3, GPIO_MODE_INPUT).pullUp(SW3, 1);
+
+    // This pin keeps the board in the ON state. The batch sets the latch before the direction.
+    batch.digitalWrite(EXPANDER_BOARD_POWER_ON, 1);
+    batch.pinMode(EXPANDER_BOARD_POWER_ON, GPIO_MODE_OUTPUT);
+    batch.apply();
 }
 
 void Manager::queue(const Event* ev, bool toFront) {
+    RB_TRACE(TRACE_QUEUE_ENQUEUE, ev->type);
+#if defined(RB_DEBUG_CONTROL_JITTER) || defined(RB_TRACE_ENABLED)
+    Event stamped = *ev;
+    stamped.queued_us = esp_timer_get_time();
+    ev = &stamped;
+#endif
     if (!toFront) {
-        while (xQueueSendToBack(m_queue, ev, 0) != pdTRUE)
+        while (xQueueSendToBack(m_queue, ev, 0) != pdTRUE) {
+            m_queue_full_waits.fetch_add(1);
             vTaskDelay(1);
+        }
     } else {
-        while (xQueueSendToFront(m_queue, ev, 0) != pdTRUE)
+        while (xQueueSendToFront(m_queue, ev, 0) != pdTRUE) {
+            m_queue_full_waits.fetch_add(1);
             vTaskDelay(1);
+        }
     }
 }
 
 bool Manager::queueFromIsr(const Event* ev, bool toFront) {
+    RB_TRACE(TRACE_QUEUE_ENQUEUE, ev->type);
+#if defined(RB_DEBUG_CONTROL_JITTER) || defined(RB_TRACE_ENABLED)
+    Event stamped = *ev;
+    stamped.queued_us = esp_timer_get_time();
+    ev = &stamped;
+#endif
     BaseType_t woken = pdFALSE;
+    BaseType_t sent;
     if (!toFront)
-        xQueueSendToBackFromISR(m_queue, ev, &woken);
+        sent = xQueueSendToBackFromISR(m_queue, ev, &woken);
     else
-        xQueueSendToFrontFromISR(m_queue, ev, &woken);
+        sent = xQueueSendToFrontFromISR(m_queue, ev, &woken);
+    if (sent != pdTRUE)
+        m_isr_events_dropped.fetch_add(1);
     return woken == pdTRUE;
 }
 
@@ -121,42 +219,168 @@ void Manager::consumerRoutine() {
     struct Event ev;
     while (true) {
         while (xQueueReceive(m_queue, &ev, portMAX_DELAY) == pdTRUE) {
+#if defined(RB_DEBUG_CONTROL_JITTER) || defined(RB_TRACE_ENABLED)
+            const uint32_t waited_us = uint32_t(esp_timer_get_time() - ev.queued_us);
+            RB_TRACE_VALUE(TRACE_QUEUE_DEQUEUE, ev.type, waited_us);
+#ifdef RB_DEBUG_CONTROL_JITTER
+            m_jitter.add(waited_us);
+#endif
+#else
+            RB_TRACE(TRACE_QUEUE_DEQUEUE, ev.type);
+#endif
             processEvent(&ev);
         }
     }
 }
 
+void Manager::dispatch(std::function<void()>&& callback) {
+    if (!m_dispatch_queue) {
+        callback();
+        return;
+    }
+
+    auto* cb = new std::function<void()>(std::move(callback));
+    if (xQueueSendToBack(m_dispatch_queue, &cb, 0) != pdTRUE) {
+        // Don't block the manager's task, and don't lose the callback either.
+        ESP_LOGW(TAG, "The callback queue is full, calling the callback from the manager task.");
+        (*cb)();
+        delete cb;
+    }
+}
+
+void Manager::dispatchRoutineTrampoline(void* cookie) {
+    ((Manager*)cookie)->dispatchRoutine();
+}
+
+void Manager::dispatchRoutine() {
+    std::function<void()>* cb;
+    while (true) {
+        while (xQueueReceive(m_dispatch_queue, &cb, portMAX_DELAY) == pdTRUE) {
+            (*cb)();
+            delete cb;
+        }
+    }
+}
+
+void IRAM_ATTR Manager::emergencyStop(bool brake) {
+    if (!m_queue)
+        return;
+
+    const uint32_t start_us = esp_timer_get_time();
+
+    // Latch first, so that the manager task can't release the stop buffer in between
+    m_estop_brake.store(brake);
+    m_estop_latched.store(true);
+    m_motors_pwm.flipTo(brake ? m_pwm_brake_buffer : m_pwm_coast_buffer);
+    m_estop_time_us.store(start_us);
+    m_estop_pending.store(true);
+
+    m_estop_count.fetch_add(1);
+    storeMax(m_estop_output_max_us, uint32_t(esp_timer_get_time()) - start_us);
+
+    // Wake up the manager task. If the queue is full, the flag is handled with the next event.
+    Event ev = { .type = EVENT_MOTORS_STOP_ALL, .data = {} };
+    if (xPortInIsrContext()) {
+        if (queueFromIsr(&ev, true)) {
+            portYIELD_FROM_ISR();
+        }
+    } else {
+        RB_TRACE(TRACE_QUEUE_ENQUEUE, ev.type);
+#if defined(RB_DEBUG_CONTROL_JITTER) || defined(RB_TRACE_ENABLED)
+        ev.queued_us = esp_timer_get_time();
+#endif
+        xQueueSendToFront(m_queue, &ev, 0);
+    }
+}
+
+void Manager::clearEmergencyStop() {
+    m_estop_latched.store(false);
+}
+
+void Manager::handleEmergencyStop() {
+    stopAllMotorsDirect(m_estop_brake.load());
+
+    const uint32_t latency_us = uint32_t(esp_timer_get_time()) - m_estop_time_us.load();
+    storeMax(m_estop_clear_max_us, latency_us);
+    ESP_LOGW(TAG, "Emergency stop, motor values cleared %u us after the call.", latency_us);
+}
+
+void Manager::stopAllMotorsDirect(bool brake) {
+    // Only the motor values are changed here, the output is switched to the precomputed
+    // buffer instead of rebuilding the live one. That happens with the next motor change.
+    for (MotorId id = MotorId::M1; id < MotorId::MAX; ++id) {
+        if (brake) {
+            m_motors[static_cast<int>(id)]->direct_stop(0);
+        } else {
+            m_motors[static_cast<int>(id)]->direct_power(0);
+        }
+    }
+    updateMotorsLoad();
+
+    const int buffer = brake ? m_pwm_brake_buffer : m_pwm_coast_buffer;
+    if (buffer < 0) {
+        m_motors_pwm.update();
+        return;
+    }
+    m_motors_pwm.flipTo(buffer);
+    m_pwm_live_stale = true;
+}
+
+void Manager::updateMotorsLoad() {
+    uint32_t duty = 0;
+    for (const auto& m : m_motors)
+        duty += m->dutyPercent();
+    m_battery.setMotorsDuty(duty);
+}
+
 void Manager::processEvent(struct Manager::Event* ev) {
+    if (m_estop_pending.exchange(false)) {
+        handleEmergencyStop();
+    }
+
     switch (ev->type) {
     case EVENT_MOTORS: {
         auto data = (std::vector<EventMotorsData>*)ev->data.motors;
+        if (m_estop_latched.load()) {
+            // Also the changes queued before the stop, they must not restart the motors
+            delete data;
+            break;
+        }
+
         bool changed = false;
         for (const auto& m : *data) {
             if ((m_motors[static_cast<int>(m.id)].get()->*m.setter_func)(m.value)) {
                 changed = true;
             }
         }
-        if (changed) {
+        if (changed || m_pwm_live_stale) {
             m_motors_pwm.update();
+            m_pwm_live_stale = false;
+            updateMotorsLoad();
+        }
+        if (m_motors_pwm.isOverridden()) {
+            m_motors_pwm.release();
+            // A stop from an ISR in the meantime, its buffer must stay. The motor values
+            // are set to 0 with the next event.
+            if (m_estop_latched.load()) {
+                m_motors_pwm.flipTo(m_estop_brake.load() ? m_pwm_brake_buffer : m_pwm_coast_buffer);
+            }
         }
         delete data;
 
         m_motors_last_set = xTaskGetTickCount();
         break;
     }
-    case EVENT_MOTORS_STOP_ALL: {
-        bool changed = false;
-        for (MotorId id = MotorId::M1; id < MotorId::MAX; ++id) {
-            if (m_motors[static_cast<int>(id)]->direct_power(0))
-                changed = true;
-        }
-        if (changed)
-            m_motors_pwm.update();
+    case EVENT_MOTORS_STOP_ALL:
+        // The wake-up of an emergency stop, which was handled above, don't switch it to coasting
+        if (!m_estop_latched.load())
+            stopAllMotorsDirect(false);
         break;
-    }
     case EVENT_ENCODER_EDGE: {
+        const uint32_t start = xthal_get_ccount();
         const auto& e = ev->data.encoderEdge;
         m_motors[static_cast<int>(e.id)]->enc()->onEdgeIsr(e.timestamp, e.pinLevel);
+        m_encoder_cycles.fetch_add(xthal_get_ccount() - start);
         break;
     }
     case EVENT_ENCODER_PCNT: {
@@ -168,10 +392,19 @@ void Manager::processEvent(struct Manager::Event* ev) {
 }
 
 bool Manager::motorsFailSafe() {
+    // The latched emergency stop already holds the outputs, maybe braking.
+    // Rearmed with the first motor change after it is cleared.
+    if (m_estop_latched.load()) {
+        m_motors_last_set = 0;
+        return true;
+    }
+
     if (m_motors_last_set != 0) {
         const auto now = xTaskGetTickCount();
         if (now - m_motors_last_set > pdMS_TO_TICKS(MOTORS_FAILSAFE_PERIOD_MS)) {
             ESP_LOGE(TAG, "Motor failsafe triggered, stopping all motors!");
+            // Stop the outputs right away, the event only updates the motor values.
+            m_motors_pwm.flipTo(m_pwm_coast_buffer);
             const Event ev = { .type = EVENT_MOTORS_STOP_ALL, .data = {} };
             queue(&ev);
             m_motors_last_set = 0;
@@ -180,34 +413,166 @@ bool Manager::motorsFailSafe() {
     return true;
 }
 
+EncoderSnapshot Manager::readEncoders() const {
+    // Encoders are created lazily, but never destroyed.
+    const Encoder* encoders[static_cast<int>(MotorId::MAX)];
+    for (int i = 0; i < static_cast<int>(MotorId::MAX); ++i) {
+        encoders[i] = m_encoders[i].load();
+    }
+
+    EncoderSnapshot snapshot;
+    Encoder::readAll(encoders, snapshot);
+    return snapshot;
+}
+
+void Manager::publishEncoderSnapshots(uint32_t period_ms) {
+    if (m_snapshot_timer == Timers::INVALID_ID || !timers().reset(m_snapshot_timer, period_ms)) {
+        m_snapshot_timer = timers().schedule(period_ms, std::bind(&Manager::publishEncoderSnapshot, this));
+    }
+}
+
+bool Manager::publishEncoderSnapshot() {
+    const auto snapshot = readEncoders();
+
+    // Only the timer task writes, so the seqlock needs no writer lock.
+    m_snapshot_seq.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_snapshot = snapshot;
+    m_snapshot_seq.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+EncoderSnapshot Manager::encoderSnapshot() const {
+    EncoderSnapshot snapshot;
+    uint32_t seq;
+    do {
+        seq = m_snapshot_seq.load(std::memory_order_acquire);
+        snapshot = m_snapshot;
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || seq != m_snapshot_seq.load(std::memory_order_relaxed));
+    return snapshot;
+}
+
+bool Manager::sampleEncoders() {
+    const uint32_t start = xthal_get_ccount();
+    const auto snapshot = readEncoders();
+    for (int i = 0; i < static_cast<int>(MotorId::MAX); ++i) {
+        auto* enc = m_encoders[i].load();
+        if (enc)
+            enc->onSampleTick(snapshot.timestamp, snapshot.values[i]);
+    }
+    m_encoder_cycles.fetch_add(xthal_get_ccount() - start);
+    return true;
+}
+
 rb::SmartServoBus& Manager::initSmartServoBus(uint8_t servo_count, gpio_num_t pin, uart_port_t uart) {
     m_servos.install(servo_count, uart, pin);
     return m_servos;
 }
 
+MotorControl& Manager::initMotorControl(uint32_t period_ms) {
+    m_motor_control.install(period_ms);
+    return m_motor_control;
+}
+
+Buttons& Manager::initButtons(gpio_num_t intPin, uint32_t debounce_ms) {
+    m_buttons.install(intPin, debounce_ms);
+    return m_buttons;
+}
+
 MotorChangeBuilder Manager::setMotors() {
     return MotorChangeBuilder(*this);
 }
 
 void Manager::monitorTask(TaskHandle_t task) {
-#ifdef RB_DEBUG_MONITOR_TASKS
     m_tasks_mutex.lock();
-    m_tasks.push_back(task);
+    m_tasks.push_back({ task, 0 });
     m_tasks_mutex.unlock();
+}
+
+ManagerStats Manager::stats() {
+    ManagerStats res;
+    res.eventQueueWaiting = m_queue ? uxQueueMessagesWaiting(m_queue) : 0;
+    res.servoQueueWaiting = m_servos.m_uart_queue ? uxQueueMessagesWaiting(m_servos.m_uart_queue) : 0;
+    res.queueFullWaits = m_queue_full_waits.load();
+    res.droppedIsrEvents = m_isr_events_dropped.load();
+    res.encoderCycles = m_encoder_cycles.load();
+    res.emergencyStops = m_estop_count.load();
+    res.emergencyStopOutputMaxUs = m_estop_output_max_us.load();
+    res.emergencyStopClearMaxUs = m_estop_clear_max_us.load();
+    res.i2c = m_i2c_queue.stats();
+
+    std::lock_guard<std::mutex> lock(m_tasks_mutex);
+
+#if configGENERATE_RUN_TIME_STATS == 1 && configUSE_TRACE_FACILITY == 1
+    std::vector<TaskStatus_t> status(uxTaskGetNumberOfTasks() + 2);
+    uint32_t total = 0;
+    status.resize(uxTaskGetSystemState(status.data(), status.size(), &total));
+    // The counter runs with the wall clock, so the percentage is of one core.
+    const uint32_t totalDelta = total - m_tasks_last_total_run_time;
+    m_tasks_last_total_run_time = total;
 #endif
+
+    res.tasks.reserve(m_tasks.size());
+    for (auto& task : m_tasks) {
+        TaskStats ts = {
+            .name = pcTaskGetTaskName(task.handle),
+            .handle = task.handle,
+            .priority = uxTaskPriorityGet(task.handle),
+            .stackFree = uxTaskGetStackHighWaterMark(task.handle),
+            .cpuPercent = -1.f,
+        };
+#if configGENERATE_RUN_TIME_STATS == 1 && configUSE_TRACE_FACILITY == 1
+        for (const auto& s : status) {
+            if (s.xHandle != task.handle)
+                continue;
+            if (totalDelta != 0)
+                ts.cpuPercent = float(s.ulRunTimeCounter - task.last_run_time) * 100.f / totalDelta;
+            task.last_run_time = s.ulRunTimeCounter;
+            break;
+        }
+#endif
+        res.tasks.push_back(ts);
+    }
+    return res;
 }
 
 #ifdef RB_DEBUG_MONITOR_TASKS
 bool Manager::printTasksDebugInfo() {
-    std::lock_guard<std::mutex> lock(m_tasks_mutex);
+    const auto st = stats();
 
-    printf("%16s %5s %5s\n", "Name", "prio", "stack");
+    printf("%16s %5s %5s %6s\n", "Name", "prio", "stack", "cpu%");
     printf("==========================================\n");
-    for (auto task : m_tasks) {
-        auto stackMark = uxTaskGetStackHighWaterMark(task);
-        auto prio = uxTaskPriorityGet(task);
-        printf("%16s %5d %5d\n", pcTaskGetTaskName(task), (int)prio, (int)stackMark);
+    for (const auto& task : st.tasks) {
+        printf("%16s %5d %5d %6.1f\n", task.name, (int)task.priority, (int)task.stackFree, task.cpuPercent);
+    }
+    printf("queue: %u waiting, %u full waits, %u dropped ISR events; servo queue: %u waiting\n",
+        st.eventQueueWaiting, st.queueFullWaits, st.droppedIsrEvents, st.servoQueueWaiting);
+    printf("i2c queue: %u waiting (max %u), %u transactions, %u coalesced writes, %u errors, latency p99 %u us\n",
+        st.i2c.waiting, st.i2c.maxWaiting, st.i2c.transactions, st.i2c.coalesced, st.i2c.errors,
+        st.i2c.latency.percentile(99.f));
+    return true;
+}
+#endif
+
+#ifdef RB_DEBUG_CONTROL_JITTER
+bool Manager::printJitterDebugInfo() {
+    printf("Manager event delay: %s, callbacks %s, %u events\n",
+        (m_install_flags & MAN_PIN_CONTROL_TASK) ? "pinned task" : "unpinned task",
+        m_dispatch_queue ? "dispatched" : "inline", m_jitter.count());
+    printf("%10s %8s\n", "< us", "count");
+    printf("====================\n");
+    for (int i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+        if (m_jitter.bucket(i) == 0)
+            continue;
+        if (i == LatencyHistogram::BUCKETS - 1) {
+            printf("%10s %8u\n", "more", m_jitter.bucket(i));
+        } else {
+            printf("%10u %8u\n", LatencyHistogram::bucketLimit(i), m_jitter.bucket(i));
+        }
     }
+    printf("p50 < %u us, p99 < %u us, max %u us\n", m_jitter.percentile(50), m_jitter.percentile(99), m_jitter.max());
+    m_jitter.reset();
     return true;
 }
 #endif
@@ -250,6 +615,7 @@ MotorChangeBuilder& MotorChangeBuilder::stop(MotorId id) {
 }
 
 void MotorChangeBuilder::set(bool toFront) {
+    RB_TRACE(TRACE_MOTORS_SET, 0);
     const Manager::Event ev = {
         .type = Manager::EVENT_MOTORS,
         .data = {
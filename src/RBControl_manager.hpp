@@ -1,7 +1,9 @@
 #pragma once
 
 #include <freertos/FreeRTOS.h>
+#include <atomic>
 #include <freertos/queue.h>
+#include <freertos/task.h>
 #include <functional>
 #include <list>
 #include <memory>
@@ -10,13 +12,18 @@
 
 #include "Adafruit_MCP23017.h"
 #include "RBControl_battery.hpp"
+#include "RBControl_buttons.hpp"
 #include "RBControl_encoder.hpp"
+#include "RBControl_i2cQueue.hpp"
+#include "RBControl_latencyHistogram.hpp"
 #include "RBControl_leds.hpp"
 #include "RBControl_motor.hpp"
+#include "RBControl_motorControl.hpp"
 #include "RBControl_nvs.hpp"
 #include "RBControl_piezo.hpp"
 #include "RBControl_servo.hpp"
 #include "RBControl_timers.hpp"
+#include "RBControl_trace.hpp"
 
 namespace rb {
 
@@ -33,15 +40,61 @@ enum ManagerInstallFlags {
     //!< the pins free for other functions.
     //!< Warning: disabling the piezo is not recommanded because
     //!< it is used to signalize low battery voltage.
+    MAN_ENCODER_SAMPLED_SPEED = (1 << 3), //!< Estimate encoder speed by sampling all PCNT counters
+    //!< from one periodic timer instead of handling an interrupt on every encoder edge.
+    MAN_ENCODER_QUADRATURE_X4 = (1 << 4), //!< Count all edges of both encoder signals, giving
+    //!< 4 increments per encoder cycle instead of 2. See {@link Encoder::incPerRevolution}.
+    MAN_PIN_CONTROL_TASK = (1 << 5), //!< Pin the manager's task, which handles the motors and encoders,
+    //!< to core 1 (WiFi runs on core 0) and raise its priority. {@link MotorControl} is pinned too.
+    //!< The core and priority can be changed by defining RB_CONTROL_TASK_CORE and RB_CONTROL_TASK_PRIORITY.
+    MAN_DISPATCH_CALLBACKS = (1 << 6), //!< Call user callbacks (e.g. of {@link Encoder::driveToValue}) from
+    //!< a separate lower-priority task, so that they can't delay the motor and encoder handling.
 };
 
 inline ManagerInstallFlags operator|(ManagerInstallFlags a, ManagerInstallFlags b) {
     return static_cast<ManagerInstallFlags>(static_cast<int>(a) | static_cast<int>(b));
 }
 
-// Periodically print info about all rbcontrol tasks to the console
+// The core used by the control tasks with MAN_PIN_CONTROL_TASK
+#ifndef RB_CONTROL_TASK_CORE
+#define RB_CONTROL_TASK_CORE 1
+#endif
+
+// Periodically print info about all rbcontrol tasks and queues to the console, see Manager::stats()
 //#define RB_DEBUG_MONITOR_TASKS 1
 
+// Periodically print a histogram of the delay between queueing a manager event and handling it
+//#define RB_DEBUG_CONTROL_JITTER 1
+
+/**
+ * \brief Runtime statistics of one RBControl task, see {@link Manager::stats}.
+ */
+struct TaskStats {
+    const char* name;
+    TaskHandle_t handle;
+    UBaseType_t priority;
+    uint32_t stackFree; //!< Stack high-water mark, the least free stack ever
+    float cpuPercent; //!< CPU time used since the previous stats() call, in % of one core.
+    //!< -1 if FreeRTOS run-time stats are disabled in menuconfig.
+};
+
+/**
+ * \brief Runtime statistics of the manager, see {@link Manager::stats}.
+ */
+struct ManagerStats {
+    std::vector<TaskStats> tasks;
+    uint32_t eventQueueWaiting; //!< Events waiting in the manager's queue
+    uint32_t servoQueueWaiting; //!< Requests waiting for the servo bus UART, 0 if the bus is not initialized
+    uint32_t queueFullWaits; //!< Number of times a motor command had to wait because the manager's queue was full
+    uint32_t droppedIsrEvents; //!< Number of encoder interrupt events lost because the manager's queue was full
+    uint32_t encoderCycles; //!< CPU cycles spent estimating the encoders' speed: in the edge interrupts and their events,
+                            //!< or in the sampling with MAN_ENCODER_SAMPLED_SPEED. Wraps around, compare two readings.
+    uint32_t emergencyStops; //!< Number of {@link Manager::emergencyStop} calls
+    uint32_t emergencyStopOutputMaxUs; //!< The longest an emergency stop took to switch the motor outputs, in microseconds
+    uint32_t emergencyStopClearMaxUs; //!< The longest time from an emergency stop until the manager task cleared the motor values, in microseconds
+    I2cQueueStats i2c; //!< The queue of the expander's I2C bus
+};
+
 /**
  * \brief The main library class for working with the RBControl board.
  *        Call the install() method at the start of your program.
@@ -50,6 +103,7 @@ class Manager {
     friend class MotorChangeBuilder;
     friend class Encoder;
     friend class PcntInterruptHandler;
+    friend class MotorControl;
 
 public:
     Manager(Manager const&) = delete;
@@ -85,6 +139,7 @@ public:
     SmartServoBus& servoBus() { return m_servos; };
 
     Adafruit_MCP23017& expander() { return m_expander; } //!< Get the expander {@link Adafruit_MCP23017}. LEDs and buttons are connected to it.
+    I2cQueue& i2cQueue() { return m_i2c_queue; } //!< Get the {@link I2cQueue} of the expander's bus, use it for other devices on the bus.
     Piezo& piezo() { return m_piezo; } //!< Get the {@link Piezo} controller
     Battery& battery() { return m_battery; } //!< Get the {@link Battery} interface
     Leds& leds() { return m_leds; } //!< Get the {@link Leds} helper
@@ -92,6 +147,66 @@ public:
     Motor& motor(MotorId id) { return *m_motors[static_cast<int>(id)]; }; //!< Get a motor instance
     MotorChangeBuilder setMotors(); //!< Create motor power change builder: {@link MotorChangeBuilder}.
 
+    /**
+     * \brief Stop all motors immediately, bypassing the event queue.
+     *
+     * Can be called from any context, including an ISR. The PWM output is switched
+     * to a precomputed all-off buffer in O(1), so the motors stop at the end of the current
+     * PWM period (100us at 10kHz) at the latest, no matter how busy the manager task is.
+     * The manager task then sets the power of all motors to 0.
+     *
+     * The stop latches: motor changes, including the ones queued before the call, are ignored
+     * until {@link clearEmergencyStop}. The live output is restored by the first motor change after that.
+     *
+     * \param brake brake the motors instead of letting them coast
+     */
+    void emergencyStop(bool brake = false);
+
+    /**
+     * \brief Accept motor changes again after {@link emergencyStop}.
+     *
+     * The motors stay stopped until the next motor change.
+     */
+    void clearEmergencyStop();
+    bool emergencyStopped() const { return m_estop_latched.load(); } //!< Returns true from {@link emergencyStop} until {@link clearEmergencyStop}
+
+    /**
+     * \brief Read all initialized encoders now, in one pass with a single timestamp.
+     */
+    EncoderSnapshot readEncoders() const;
+
+    /**
+     * \brief Start publishing {@link EncoderSnapshot}s periodically. Call again to change the period.
+     * \param period_ms is the period of sampling, in milliseconds.
+     */
+    void publishEncoderSnapshots(uint32_t period_ms);
+
+    /**
+     * \brief Get the last snapshot published by {@link publishEncoderSnapshots}.
+     *
+     * Never blocks, can be called from any task. The timestamp is 0 if nothing was published yet.
+     */
+    EncoderSnapshot encoderSnapshot() const;
+
+    /**
+     * \brief Start the closed-loop motor speed and position control.
+     * \param period_ms is the control period, all regulated motors are updated once per period.
+     * \return Instance of the class {@link MotorControl}.
+     */
+    MotorControl& initMotorControl(uint32_t period_ms = 10);
+    MotorControl& motorControl() { return m_motor_control; } //!< Get the {@link MotorControl}
+
+    /**
+     * \brief Start watching the buttons SW1 to SW3 through the expander's interrupt.
+     *
+     * The expander's INTA pin must be wired to intPin, the board doesn't connect it to the ESP32.
+     * \param intPin is the ESP32 pin INTA is connected to, it gets the internal pull-up.
+     * \param debounce_ms is how long a button must stay in the new state for the change to count.
+     * \return Instance of the class {@link Buttons}.
+     */
+    Buttons& initButtons(gpio_num_t intPin, uint32_t debounce_ms = 20);
+    Buttons& buttons() { return m_buttons; } //!< Get the {@link Buttons}
+
     Nvs& config() { return m_config; }
 
     /**
@@ -108,6 +223,14 @@ public:
 
     inline Timers& timers() { return rb::Timers::get(); }
 
+    /**
+     * \brief Get runtime statistics of the RBControl tasks and queues.
+     *
+     * Cheap enough to be called periodically in production, e.g. to find out whether
+     * the manager's queue saturates. The CPU usage is computed since the previous call.
+     */
+    ManagerStats stats();
+
     // internal api to monitor RBControl tasks
     void monitorTask(TaskHandle_t task);
 
@@ -130,6 +253,9 @@ private:
 
     struct Event {
         EventType type;
+#if defined(RB_DEBUG_CONTROL_JITTER) || defined(RB_TRACE_ENABLED)
+        int64_t queued_us; //!< Stamped by queue(), so that the wait is known even for events queued to the front
+#endif
         union {
             std::vector<EventMotorsData>* motors;
 
@@ -152,26 +278,70 @@ private:
     void consumerRoutine();
     void processEvent(struct Event* ev);
 
+    void dispatch(std::function<void()>&& callback);
+    static void dispatchRoutineTrampoline(void* cookie);
+    void dispatchRoutine();
+
     bool motorsFailSafe();
+    void handleEmergencyStop();
+    void stopAllMotorsDirect(bool brake);
+    void updateMotorsLoad();
+    bool sampleEncoders();
+    bool publishEncoderSnapshot();
 
     void setupExpander();
 
+    struct monitored_task_t {
+        TaskHandle_t handle;
+        uint32_t last_run_time;
+    };
+
 #ifdef RB_DEBUG_MONITOR_TASKS
     bool printTasksDebugInfo();
+#endif
 
-    std::vector<TaskHandle_t> m_tasks;
+    std::vector<monitored_task_t> m_tasks;
     std::mutex m_tasks_mutex;
+    uint32_t m_tasks_last_total_run_time;
+    std::atomic<uint32_t> m_queue_full_waits;
+    std::atomic<uint32_t> m_isr_events_dropped;
+    std::atomic<uint32_t> m_encoder_cycles;
+
+#ifdef RB_DEBUG_CONTROL_JITTER
+    bool printJitterDebugInfo();
+
+    LatencyHistogram m_jitter;
 #endif
 
     QueueHandle_t m_queue;
+    QueueHandle_t m_dispatch_queue; //!< std::function<void()>* to call from the dispatcher task, null if disabled
+    ManagerInstallFlags m_install_flags;
 
     TickType_t m_motors_last_set;
     std::vector<std::unique_ptr<Motor>> m_motors;
-    SerialPWM m_motors_pwm;
+    std::atomic<Encoder*> m_encoders[static_cast<int>(MotorId::MAX)];
 
+    uint16_t m_snapshot_timer;
+    std::atomic<uint32_t> m_snapshot_seq; //!< seqlock, odd while m_snapshot is being written
+    EncoderSnapshot m_snapshot;
+    SerialPWM m_motors_pwm;
+    int m_pwm_coast_buffer;
+    int m_pwm_brake_buffer;
+    bool m_pwm_live_stale; //!< m_motors_pwm's live buffer doesn't match the motors, it must be rebuilt before release()
+    std::atomic<bool> m_estop_pending;
+    std::atomic<bool> m_estop_latched;
+    std::atomic<bool> m_estop_brake;
+    std::atomic<uint32_t> m_estop_time_us;
+    std::atomic<uint32_t> m_estop_count;
+    std::atomic<uint32_t> m_estop_output_max_us;
+    std::atomic<uint32_t> m_estop_clear_max_us;
+    MotorControl m_motor_control;
+
+    I2cQueue m_i2c_queue;
     Adafruit_MCP23017 m_expander;
     rb::Piezo m_piezo;
     rb::Leds m_leds;
+    rb::Buttons m_buttons;
     rb::Battery m_battery;
     rb::SmartServoBus m_servos;
     rb::Nvs m_config;
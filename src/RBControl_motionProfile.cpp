@@ -0,0 +1,118 @@
+#include <math.h>
+
+#include "RBControl_motionProfile.hpp"
+
+namespace rb {
+
+MotionProfile::MotionProfile() {
+    plan(0.f, MotionLimits());
+}
+
+void MotionProfile::plan(float distance, const MotionLimits& limits) {
+    m_sign = distance < 0.f ? -1.f : 1.f;
+    m_distance = fabsf(distance);
+    m_duration = 0.f;
+    m_jerk = 0.f;
+    m_accel_peak = 0.f;
+    m_velocity_peak = 0.f;
+    m_t_jerk = m_t_const_accel = m_t_accel = m_t_cruise = 0.f;
+    m_dist_accel = 0.f;
+
+    const float a = limits.acceleration;
+    const float j = limits.jerk;
+    float v = limits.velocity;
+    if (m_distance == 0.f || v <= 0.f || a <= 0.f || j < 0.f)
+        return;
+
+    // The acceleration phase is symmetric, so its distance is v * t_accel / 2.
+    // Lower the peak velocity if accelerating and decelerating would overshoot the distance.
+    if (j == 0.f) {
+        if (v * v / a > m_distance)
+            v = sqrtf(m_distance * a);
+    } else if (v >= a * a / j && v * (v / a + a / j) > m_distance) {
+        const float aj = a / j;
+        v = (sqrtf(aj * aj + 4.f * m_distance / a) - aj) * a / 2.f;
+        if (v < a * a / j)
+            v = powf(m_distance * sqrtf(j) / 2.f, 2.f / 3.f);
+    }
+    if (j != 0.f && v < a * a / j) {
+        // The acceleration limit is never reached
+        if (2.f * v * sqrtf(v / j) > m_distance)
+            v = powf(m_distance * sqrtf(j) / 2.f, 2.f / 3.f);
+        m_t_jerk = sqrtf(v / j);
+        m_accel_peak = j * m_t_jerk;
+    } else {
+        m_t_jerk = j == 0.f ? 0.f : a / j;
+        m_accel_peak = a;
+        m_t_const_accel = v / a - m_t_jerk;
+    }
+
+    m_jerk = j;
+    m_velocity_peak = v;
+    m_t_accel = 2.f * m_t_jerk + m_t_const_accel;
+    m_dist_accel = v * m_t_accel / 2.f;
+    m_t_cruise = fmaxf(0.f, (m_distance - 2.f * m_dist_accel) / v);
+    m_duration = 2.f * m_t_accel + m_t_cruise;
+}
+
+void MotionProfile::stretch(float duration) {
+    if (m_duration <= 0.f || duration <= m_duration)
+        return;
+
+    const float k = duration / m_duration;
+    m_t_jerk *= k;
+    m_t_const_accel *= k;
+    m_t_accel *= k;
+    m_t_cruise *= k;
+    m_duration = duration;
+
+    m_velocity_peak /= k;
+    m_accel_peak /= k * k;
+    m_jerk /= k * k * k;
+}
+
+void MotionProfile::accelPhase(float t, float& position, float& velocity) const {
+    const float t2 = m_t_jerk + m_t_const_accel;
+    if (t < m_t_jerk) {
+        velocity = m_jerk * t * t / 2.f;
+        position = m_jerk * t * t * t / 6.f;
+    } else if (t < t2) {
+        const float v1 = m_jerk * m_t_jerk * m_t_jerk / 2.f;
+        const float p1 = m_jerk * m_t_jerk * m_t_jerk * m_t_jerk / 6.f;
+        const float dt = t - m_t_jerk;
+        velocity = v1 + m_accel_peak * dt;
+        position = p1 + v1 * dt + m_accel_peak * dt * dt / 2.f;
+    } else {
+        // The last segment mirrors the first one
+        const float rt = m_t_accel - t;
+        velocity = m_velocity_peak - m_jerk * rt * rt / 2.f;
+        position = m_dist_accel - (m_velocity_peak * rt - m_jerk * rt * rt * rt / 6.f);
+    }
+}
+
+void MotionProfile::sample(float t, float& position, float& velocity) const {
+    if (t >= m_duration) {
+        position = m_sign * m_distance;
+        velocity = 0.f;
+        return;
+    } else if (t <= 0.f) {
+        position = 0.f;
+        velocity = 0.f;
+        return;
+    }
+
+    if (t < m_t_accel) {
+        accelPhase(t, position, velocity);
+    } else if (t < m_t_accel + m_t_cruise) {
+        velocity = m_velocity_peak;
+        position = m_dist_accel + m_velocity_peak * (t - m_t_accel);
+    } else {
+        accelPhase(m_duration - t, position, velocity);
+        position = m_distance - position;
+    }
+
+    position *= m_sign;
+    velocity *= m_sign;
+}
+
+} // namespace rb
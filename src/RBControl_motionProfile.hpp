@@ -0,0 +1,78 @@
+#pragma once
+
+namespace rb {
+
+/**
+ * \brief Limits of a {@link MotionProfile}, all in encoder edges and seconds.
+ */
+struct MotionLimits {
+    MotionLimits(float velocity = 0.f, float acceleration = 0.f, float jerk = 0.f)
+        : velocity(velocity)
+        , acceleration(acceleration)
+        , jerk(jerk) {}
+
+    float velocity; //!< Maximal velocity, edges/s
+    float acceleration; //!< Maximal acceleration, edges/s^2
+    float jerk; //!< Maximal jerk, edges/s^3. Use 0 for a trapezoidal profile.
+};
+
+/**
+ * \brief Point-to-point motion profile, trapezoidal or S-curve (jerk limited).
+ *
+ * The motion starts and ends at rest, and is symmetric - deceleration mirrors
+ * the acceleration. If the distance is too short, the profile does not reach
+ * the maximal velocity (or acceleration).
+ *
+ * The profile is planned once and then sampled in O(1), it never allocates.
+ * It doesn't depend on anything ESP32 specific, so it can be tested on the host.
+ */
+class MotionProfile {
+public:
+    MotionProfile();
+
+    /**
+     * \brief Plan a new motion.
+     * \param distance the distance to travel, can be negative
+     * \param limits velocity, acceleration and jerk limits, must be positive (jerk can be 0)
+     */
+    void plan(float distance, const MotionLimits& limits);
+
+    /**
+     * \brief Slow the planned motion down so that it takes `duration` seconds.
+     *
+     * The shape of the profile is kept, velocity, acceleration and jerk
+     * are scaled down. Used to make several motors finish together.
+     * Does nothing if the motion already takes longer.
+     */
+    void stretch(float duration);
+
+    float duration() const { return m_duration; } //!< Total time of the motion, in seconds
+    float distance() const { return m_sign * m_distance; } //!< The planned distance
+
+    /**
+     * \brief Get the setpoint at time t.
+     * \param t seconds from the start of the motion, clamped to <0, duration()>
+     * \param position the distance travelled at time t
+     * \param velocity the velocity at time t
+     */
+    void sample(float t, float& position, float& velocity) const;
+
+private:
+    void accelPhase(float t, float& position, float& velocity) const;
+
+    float m_sign;
+    float m_distance;
+    float m_duration;
+
+    float m_jerk;
+    float m_accel_peak;
+    float m_velocity_peak;
+
+    float m_t_jerk; //!< duration of the jerk segments at the start and the end of acceleration
+    float m_t_const_accel; //!< duration of the constant acceleration segment
+    float m_t_accel; //!< duration of the whole acceleration
+    float m_t_cruise; //!< duration of the constant velocity segment
+    float m_dist_accel; //!< distance travelled during the acceleration
+};
+
+} // namespace rb
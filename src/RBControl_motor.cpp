@@ -1,3 +1,5 @@
+#include <stdlib.h>
+
 #include "RBControl_motor.hpp"
 #include "RBControl_encoder.hpp"
 #include "RBControl_manager.hpp"
@@ -58,12 +60,17 @@ bool Motor::direct_pwmMaxPercent(int8_t percent) {
 }
 
 bool Motor::direct_stop(int8_t) {
+    m_power = 0;
     if (m_pwm0 == INV(PWM_MAX) && m_pwm1 == INV(PWM_MAX))
         return false;
     m_pwm0 = m_pwm1 = INV(PWM_MAX);
     return true;
 }
 
+uint8_t Motor::dutyPercent() const {
+    return abs(int(m_power)) * m_pwm_max_percent / POWER_MAX;
+}
+
 void Motor::stop() {
     m_man.setMotors().stop(m_id).set();
 }
@@ -68,6 +68,7 @@ private:
     bool direct_power(int8_t power);
     bool direct_pwmMaxPercent(int8_t percent);
     bool direct_stop(int8_t);
+    uint8_t dutyPercent() const; //!< The duty of the output, the battery load
 
     Manager& m_man;
 
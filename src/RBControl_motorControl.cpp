@@ -0,0 +1,191 @@
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <math.h>
+
+#include <algorithm>
+
+#include "RBControl_manager.hpp"
+#include "RBControl_motorControl.hpp"
+
+#define TAG "RBControlMotorControl"
+
+namespace rb {
+
+MotorControl::MotorControl(Manager& man)
+    : m_man(man)
+    , m_task(nullptr)
+    , m_period_ms(0) {
+}
+
+MotorControl::~MotorControl() {
+}
+
+void MotorControl::install(uint32_t period_ms) {
+    if (m_task)
+        return;
+
+    if (period_ms < portTICK_PERIOD_MS) {
+        ESP_LOGW(TAG, "Control period %u ms is shorter than one tick, using %u ms.", period_ms, portTICK_PERIOD_MS);
+        period_ms = portTICK_PERIOD_MS;
+    }
+    m_period_ms = period_ms;
+
+    if (m_man.m_install_flags & MAN_PIN_CONTROL_TASK) {
+        xTaskCreatePinnedToCore(&MotorControl::controlRoutineTrampoline, "rbmotor_ctrl", 3072, this, 6, &m_task, RB_CONTROL_TASK_CORE);
+    } else {
+        xTaskCreate(&MotorControl::controlRoutineTrampoline, "rbmotor_ctrl", 3072, this, 6, &m_task);
+    }
+    m_man.monitorTask(m_task);
+}
+
+void MotorControl::setSpeed(MotorId id, float edgesPerSecond) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    setModeLocked(id, MODE_SPEED);
+    m_motors[static_cast<int>(id)].speed_target = edgesPerSecond;
+}
+
+void MotorControl::setPosition(MotorId id, int32_t positionAbsolute) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    setModeLocked(id, MODE_POSITION);
+    m_motors[static_cast<int>(id)].position_target = positionAbsolute;
+}
+
+void MotorControl::move(MotorId id, int32_t positionAbsolute, const MotionLimits& limits) {
+    moveSync({ { id, positionAbsolute } }, limits);
+}
+
+void MotorControl::moveSync(std::initializer_list<std::pair<MotorId, int32_t>> targets, const MotionLimits& limits) {
+    const auto now = esp_timer_get_time();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    float duration = 0.f;
+    for (const auto& t : targets) {
+        planLocked(t.first, t.second, limits, now);
+        duration = std::max(duration, m_motors[static_cast<int>(t.first)].profile.duration());
+    }
+
+    for (const auto& t : targets) {
+        m_motors[static_cast<int>(t.first)].profile.stretch(duration);
+    }
+}
+
+bool MotorControl::isMoving(MotorId id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_motors[static_cast<int>(id)].mode == MODE_PROFILE;
+}
+
+void MotorControl::planLocked(MotorId id, int32_t positionAbsolute, const MotionLimits& limits, int64_t start_us) {
+    setModeLocked(id, MODE_PROFILE);
+
+    auto& m = m_motors[static_cast<int>(id)];
+    m.profile_start_position = m.encoder->value();
+    m.profile_start_us = start_us;
+    m.position_target = positionAbsolute;
+    m.profile.plan(positionAbsolute - m.profile_start_position, limits);
+}
+
+void MotorControl::disable(MotorId id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_motors[static_cast<int>(id)].mode == MODE_DISABLED)
+        return;
+    setModeLocked(id, MODE_DISABLED);
+    m_man.setMotors().power(id, 0).set();
+}
+
+void MotorControl::speedPid(MotorId id, const PidParams& params) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_motors[static_cast<int>(id)].speed_pid.setParams(params);
+}
+
+void MotorControl::positionPid(MotorId id, const PidParams& params) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_motors[static_cast<int>(id)].position_pid.setParams(params);
+}
+
+float MotorControl::speed(MotorId id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_motors[static_cast<int>(id)].speed;
+}
+
+void MotorControl::setModeLocked(MotorId id, Mode mode) {
+    auto& m = m_motors[static_cast<int>(id)];
+    if (m.mode == mode)
+        return;
+
+    if (!m.encoder) {
+        m.encoder = m_man.motor(id).encoder();
+    }
+
+    if (m.mode == MODE_DISABLED) {
+        m.last_position = m.encoder->value();
+        m.speed = 0.f;
+    }
+
+    m.mode = mode;
+    m.speed_pid.reset();
+    m.position_pid.reset();
+}
+
+void MotorControl::controlRoutineTrampoline(void* cookie) {
+    ((MotorControl*)cookie)->controlRoutine();
+}
+
+void MotorControl::controlRoutine() {
+    TickType_t lastWake = xTaskGetTickCount();
+    int64_t lastTime = esp_timer_get_time();
+
+    while (true) {
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(m_period_ms));
+
+        // All encoders are sampled at once, so dt is the same for all motors.
+        const auto snapshot = m_man.readEncoders();
+        const auto now = snapshot.timestamp;
+        const float dt = float(now - lastTime) / 1000000.f;
+        lastTime = now;
+        if (dt <= 0.f)
+            continue;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        MotorChangeBuilder builder(m_man);
+        bool regulated = false;
+        for (MotorId id = MotorId::M1; id < MotorId::MAX; ++id) {
+            auto& m = m_motors[static_cast<int>(id)];
+            if (m.mode == MODE_DISABLED)
+                continue;
+
+            const int32_t position = snapshot.value(id);
+            m.speed = float(position - m.last_position) / dt;
+            m.last_position = position;
+
+            float speedTarget = m.speed_target;
+            if (m.mode == MODE_PROFILE) {
+                const float t = float(now - m.profile_start_us) / 1000000.f;
+                float profilePosition, profileVelocity;
+                m.profile.sample(t, profilePosition, profileVelocity);
+                speedTarget = profileVelocity
+                    + m.position_pid.update(m.profile_start_position + profilePosition, position, dt);
+
+                // Keep holding the final position, without resetting the regulators.
+                if (t >= m.profile.duration()) {
+                    m.mode = MODE_POSITION;
+                }
+            } else if (m.mode == MODE_POSITION) {
+                speedTarget = m.position_pid.update(m.position_target, position, dt);
+            }
+
+            const float power = m.speed_pid.update(speedTarget, m.speed, dt);
+
+            builder.power(id, static_cast<int8_t>(roundf(power)));
+            regulated = true;
+        }
+
+        // All regulated motors are submitted in one change, which means one PWM update.
+        if (regulated) {
+            builder.set();
+        }
+    }
+}
+
+} // namespace rb
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <initializer_list>
+#include <mutex>
+#include <utility>
+
+#include "RBControl_motionProfile.hpp"
+#include "RBControl_pid.hpp"
+#include "RBControl_pinout.hpp"
+
+namespace rb {
+
+class Manager;
+class Encoder;
+
+/**
+ * \brief Closed-loop speed and position control of the motors.
+ *
+ * A single task reads the encoders of all regulated motors each period and submits
+ * their new power values in one motor change, so the PWM is updated once per period.
+ * Speed is in encoder edges per second, position in encoder edges (see {@link Encoder::value}).
+ *
+ * Get the instance by calling {@link Manager::initMotorControl}. The PID gains
+ * are zero by default, set them with {@link speedPid} and {@link positionPid} first.
+ */
+class MotorControl {
+    friend class Manager;
+
+public:
+    /**
+     * \brief Regulate the motor to the requested speed.
+     * \param id of the motor (e.g. rb:MotorId::M1)
+     * \param edgesPerSecond the requested speed
+     */
+    void setSpeed(MotorId id, float edgesPerSecond);
+
+    /**
+     * \brief Regulate the motor to the requested position. The position regulator's output
+     * is the setpoint of the speed regulator, so its output limits are the maximal speed.
+     * \param id of the motor (e.g. rb:MotorId::M1)
+     * \param positionAbsolute the requested encoder value
+     */
+    void setPosition(MotorId id, int32_t positionAbsolute);
+
+    /**
+     * \brief Move the motor to the requested position along a motion profile.
+     *
+     * The position regulator follows the profile's setpoints, the profile's velocity is
+     * added to its output as a feedforward. When the motion finishes, the motor keeps
+     * regulating to positionAbsolute as if {@link setPosition} was called.
+     *
+     * \param id of the motor (e.g. rb:MotorId::M1)
+     * \param positionAbsolute the requested encoder value
+     * \param limits velocity, acceleration and jerk limits. See {@link MotionLimits}.
+     */
+    void move(MotorId id, int32_t positionAbsolute, const MotionLimits& limits);
+
+    /**
+     * \brief Move several motors at once, so that they all start and finish together.
+     *
+     * The longest move uses the full limits, the others are slowed down to take the same time.
+     * Useful e.g. for a differential drive: `moveSync({ { MotorId::M1, 1000 }, { MotorId::M2, -1000 } }, limits)`
+     *
+     * \param targets pairs of motor id and the requested encoder value
+     * \param limits velocity, acceleration and jerk limits. See {@link MotionLimits}.
+     */
+    void moveSync(std::initializer_list<std::pair<MotorId, int32_t>> targets, const MotionLimits& limits);
+
+    /**
+     * \brief Returns true while the motor is following a motion profile.
+     */
+    bool isMoving(MotorId id);
+
+    /**
+     * \brief Stop regulating the motor and set its power to 0.
+     */
+    void disable(MotorId id);
+
+    /**
+     * \brief Set the speed regulator's parameters. Its output is motor power <-100 - 100>.
+     */
+    void speedPid(MotorId id, const PidParams& params);
+
+    /**
+     * \brief Set the position regulator's parameters. Its output is the speed setpoint.
+     */
+    void positionPid(MotorId id, const PidParams& params);
+
+    /**
+     * \brief Get the speed measured by the last control period, in encoder edges per second.
+     */
+    float speed(MotorId id);
+
+    uint32_t periodMs() const { return m_period_ms; } //!< Get the control period
+
+private:
+    enum Mode : uint8_t {
+        MODE_DISABLED,
+        MODE_SPEED,
+        MODE_POSITION,
+        MODE_PROFILE,
+    };
+
+    struct motor_t {
+        motor_t() {
+            mode = MODE_DISABLED;
+            encoder = nullptr;
+            speed_target = 0.f;
+            position_target = 0;
+            last_position = 0;
+            speed = 0.f;
+            profile_start_position = 0;
+            profile_start_us = 0;
+        }
+
+        Mode mode;
+        Encoder* encoder;
+        float speed_target;
+        int32_t position_target;
+        int32_t last_position;
+        float speed;
+        Pid speed_pid;
+        Pid position_pid;
+
+        MotionProfile profile;
+        int32_t profile_start_position;
+        int64_t profile_start_us;
+    };
+
+    MotorControl(Manager& man);
+    MotorControl(const MotorControl&) = delete;
+    ~MotorControl();
+
+    void install(uint32_t period_ms);
+
+    void setModeLocked(MotorId id, Mode mode);
+    void planLocked(MotorId id, int32_t positionAbsolute, const MotionLimits& limits, int64_t start_us);
+
+    static void controlRoutineTrampoline(void* cookie);
+    void controlRoutine();
+
+    Manager& m_man;
+    TaskHandle_t m_task;
+    uint32_t m_period_ms;
+
+    std::mutex m_mutex;
+    motor_t m_motors[static_cast<int>(MotorId::MAX)];
+};
+
+} // namespace rb
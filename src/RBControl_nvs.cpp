@@ -63,6 +63,25 @@ void Nvs::writeString(const char* key, const std::string& value) {
     m_dirty = true;
 }
 
+bool Nvs::existsBlob(const char* key) {
+    size_t len;
+    return nvs_get_blob(m_handle, key, NULL, &len) == ESP_OK;
+}
+
+std::vector<uint8_t> Nvs::getBlob(const char* key) {
+    size_t len;
+    ESP_ERROR_CHECK(nvs_get_blob(m_handle, key, NULL, &len));
+
+    std::vector<uint8_t> res(len);
+    ESP_ERROR_CHECK(nvs_get_blob(m_handle, key, res.data(), &len));
+    return res;
+}
+
+void Nvs::writeBlob(const char* key, const void* data, size_t length) {
+    ESP_ERROR_CHECK(nvs_set_blob(m_handle, key, data, length));
+    m_dirty = true;
+}
+
 void Nvs::commit() {
     nvs_commit(m_handle);
     m_dirty = false;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include <esp_system.h>
 #include <nvs.h>
@@ -22,6 +23,10 @@ public:
     std::string getString(const char* key);
     void writeString(const char* key, const std::string& value);
 
+    bool existsBlob(const char* key);
+    std::vector<uint8_t> getBlob(const char* key);
+    void writeBlob(const char* key, const void* data, size_t length);
+
     void commit();
 
 private:
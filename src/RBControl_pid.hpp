@@ -0,0 +1,98 @@
+#pragma once
+
+namespace rb {
+
+/**
+ * \brief Parameters of the {@link Pid} regulator.
+ */
+struct PidParams {
+    PidParams(float kp = 0.f, float ki = 0.f, float kd = 0.f, float kff = 0.f,
+        float outMin = -100.f, float outMax = 100.f)
+        : kp(kp)
+        , ki(ki)
+        , kd(kd)
+        , kff(kff)
+        , outMin(outMin)
+        , outMax(outMax) {}
+
+    float kp; //!< Proportional gain
+    float ki; //!< Integral gain, applied to error * seconds
+    float kd; //!< Derivative gain, applied to the measured value change per second
+    float kff; //!< Feedforward gain, applied to the setpoint
+    float outMin; //!< Lower output limit
+    float outMax; //!< Upper output limit
+};
+
+/**
+ * \brief PID regulator with setpoint feedforward and anti-windup.
+ *
+ * The derivative is computed from the measured value, so setpoint steps
+ * do not cause output spikes. The integral is frozen while the output
+ * is saturated in the direction of the error.
+ *
+ * Doesn't depend on anything ESP32 specific, so it can be tested on the host.
+ */
+class Pid {
+public:
+    Pid(const PidParams& params = PidParams())
+        : m_params(params) {
+        reset();
+    }
+
+    void setParams(const PidParams& params) { m_params = params; }
+    const PidParams& params() const { return m_params; }
+
+    //! Clear the integral and derivative state, e.g. when the regulator is re-enabled.
+    void reset() {
+        m_integral = 0.f;
+        m_prevMeasured = 0.f;
+        m_first = true;
+    }
+
+    /**
+     * \brief Compute new output.
+     * \param setpoint the requested value
+     * \param measured the current value
+     * \param dt time since the last call, in seconds
+     * \return the regulator output, within <outMin, outMax>
+     */
+    float update(float setpoint, float measured, float dt) {
+        const float error = setpoint - measured;
+
+        float derivative = 0.f;
+        if (!m_first && dt > 0.f) {
+            derivative = -(measured - m_prevMeasured) / dt;
+        }
+        m_prevMeasured = measured;
+        m_first = false;
+
+        const float base = m_params.kff * setpoint + m_params.kp * error + m_params.kd * derivative;
+        const float integral = clamp(m_integral + m_params.ki * error * dt);
+
+        float out = base + integral;
+        if ((out > m_params.outMax && error > 0.f) || (out < m_params.outMin && error < 0.f)) {
+            out = base + m_integral;
+        } else {
+            m_integral = integral;
+        }
+        return clamp(out);
+    }
+
+    float integral() const { return m_integral; }
+
+private:
+    float clamp(float val) const {
+        if (val > m_params.outMax)
+            return m_params.outMax;
+        if (val < m_params.outMin)
+            return m_params.outMin;
+        return val;
+    }
+
+    PidParams m_params;
+    float m_integral;
+    float m_prevMeasured;
+    bool m_first;
+};
+
+} // namespace rb
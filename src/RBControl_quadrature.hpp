@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace rb {
+
+/**
+ * \brief Counting mode of one PCNT channel decoding the encoder's A/B signals.
+ *
+ * The PCNT channel counts edges of its pulse input, the level of its control
+ * input can reverse the counting direction. Both the {@link Encoder} configuration
+ * and the software model used in tests are generated from these values.
+ *
+ * Doesn't depend on anything ESP32 specific, so it can be tested on the host.
+ */
+struct QuadratureChannel {
+    bool pulseIsA; //!< The pulse input is A and control is B, otherwise swapped
+    int8_t pos; //!< Count on the rising edge of the pulse input: +1, -1 or 0
+    int8_t neg; //!< Count on the falling edge of the pulse input: +1, -1 or 0
+    bool reverseOnLow; //!< Reverse the direction while the control input is low, otherwise while it is high
+
+    //! Returns the count change caused by one edge of the pulse input.
+    int8_t count(bool rising, bool ctrlLevel) const {
+        const int8_t val = rising ? pos : neg;
+        return (ctrlLevel == reverseOnLow) ? val : -val;
+    }
+
+    /**
+     * \brief Returns the count change of a transition between two A/B states.
+     *
+     * Only one of the signals can change at a time, as in a real quadrature signal.
+     */
+    int8_t step(bool prevA, bool prevB, bool a, bool b) const {
+        const bool prevPulse = pulseIsA ? prevA : prevB;
+        const bool pulse = pulseIsA ? a : b;
+        if (prevPulse == pulse)
+            return 0;
+        return count(pulse, pulseIsA ? b : a);
+    }
+};
+
+/**
+ * \brief Channel 0, used in both modes. A is the pulse, B the direction.
+ *
+ * Counts on both edges of A, giving 2 counts per encoder cycle.
+ */
+static constexpr QuadratureChannel QUADRATURE_CHANNEL_0 = { true, 1, -1, false };
+
+/**
+ * \brief Channel 1, used only in the x4 mode. B is the pulse, A the direction.
+ *
+ * Counts on both edges of B in the same direction as channel 0,
+ * together they give 4 counts per encoder cycle.
+ */
+static constexpr QuadratureChannel QUADRATURE_CHANNEL_1 = { false, 1, -1, true };
+
+} // namespace rb
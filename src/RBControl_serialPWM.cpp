@@ -5,6 +5,7 @@
 #include <cstring>
 
 #include "RBControl_serialPWM.hpp"
+#include "RBControl_trace.hpp"
 
 namespace rb {
 
@@ -32,7 +33,11 @@ SerialPWM::SerialPWM(const int channels,
     , m_buffer_descriptors { nullptr }
     , m_buffer { nullptr }
     , m_active_buffer(0)
-    , m_pwm(channels * data_pins.size(), 0) {
+    , m_pwm(channels * data_pins.size(), 0)
+    , m_static_descriptors { nullptr }
+    , m_static_buffer { nullptr }
+    , m_override(-1)
+    , m_flip_mux(portMUX_INITIALIZER_UNLOCKED) {
     const int buffer_size = c_channels * c_bytes;
     for (int buffer = 0; buffer != sc_buffers; ++buffer) {
         m_buffer_descriptors[buffer] = static_cast<i2s_parallel_buffer_desc_t*>(heap_caps_malloc((sc_resolution + 1) * sizeof(i2s_parallel_buffer_desc_t), MALLOC_CAP_32BIT)); // +1 for end mark
@@ -94,22 +99,97 @@ SerialPWM::~SerialPWM() {
             m_buffer[buffer][i] = nullptr;
         }
     }
+    for (int buffer = 0; buffer != sc_static_buffers; ++buffer)
+        freeStaticBuffer(buffer);
+}
+
+void SerialPWM::freeStaticBuffer(int slot) {
+    if (!m_static_descriptors[slot])
+        return;
+    heap_caps_free(m_static_descriptors[slot]);
+    m_static_descriptors[slot] = nullptr;
+    for (int i = 0; i != sc_resolution; ++i) {
+        heap_caps_free(m_static_buffer[slot][i]);
+        m_static_buffer[slot][i] = nullptr;
+    }
 }
 
 SerialPWM::value_type& SerialPWM::operator[](size_t index) { return m_pwm[index]; }
 
-void SerialPWM::update() {
-    m_active_buffer ^= 1;
+void SerialPWM::render(uint8_t* const* buffer, const value_type* pwm) {
     for (int sample = 0; sample != sc_resolution; ++sample) {
         for (int channel = 0; channel != m_pwm.size(); ++channel) {
-            uint8_t& value = m_buffer[m_active_buffer][sample][(channel % c_channels) * c_bytes + ((channel / c_channels) >> 3)];
-            if (sample < m_pwm[channel])
+            uint8_t& value = buffer[sample][(channel % c_channels) * c_bytes + ((channel / c_channels) >> 3)];
+            if (sample < pwm[channel])
                 value |= (1 << ((channel / c_channels) & 7));
             else
                 value &= ~(1 << ((channel / c_channels) & 7));
         }
     }
+}
+
+void SerialPWM::update() {
+    RB_TRACE(TRACE_PWM_UPDATE_BEGIN, 0);
+    m_active_buffer ^= 1;
+    render(m_buffer[m_active_buffer], m_pwm.data());
+
+    portENTER_CRITICAL(&m_flip_mux);
+    if (m_override < 0)
+        i2s_parallel_flip_to_buffer(static_cast<i2s_dev_t*>(m_i2s), m_active_buffer);
+    portEXIT_CRITICAL(&m_flip_mux);
+    RB_TRACE(TRACE_PWM_UPDATE_END, 0);
+}
+
+int SerialPWM::addStaticBuffer(value_type value) {
+    int slot = 0;
+    while (slot != sc_static_buffers && m_static_descriptors[slot])
+        ++slot;
+    if (slot == sc_static_buffers)
+        return -1;
+
+    auto* descriptors = static_cast<i2s_parallel_buffer_desc_t*>(heap_caps_malloc((sc_resolution + 1) * sizeof(i2s_parallel_buffer_desc_t), MALLOC_CAP_32BIT)); // +1 for end mark
+    if (!descriptors)
+        return -1;
+    m_static_descriptors[slot] = descriptors;
+
+    const int buffer_size = c_channels * c_bytes;
+    for (int i = 0; i != sc_resolution; ++i) {
+        // Start from the live buffer, which already has the latch and test pin bits set
+        uint8_t* p_buffer = static_cast<uint8_t*>(heap_caps_malloc(buffer_size, MALLOC_CAP_DMA));
+        if (!p_buffer) {
+            freeStaticBuffer(slot);
+            return -1;
+        }
+        memcpy(p_buffer, m_buffer[0][i], buffer_size);
+        descriptors[i].memory = p_buffer;
+        descriptors[i].size = buffer_size;
+        m_static_buffer[slot][i] = p_buffer;
+    }
+    descriptors[sc_resolution].memory = nullptr;
+
+    const std::vector<value_type> pwm(m_pwm.size(), value);
+    render(m_static_buffer[slot], pwm.data());
+
+    const int id = i2s_parallel_add_buffer(static_cast<i2s_dev_t*>(m_i2s), descriptors);
+    if (id < 0)
+        freeStaticBuffer(slot);
+    return id;
+}
+
+void IRAM_ATTR SerialPWM::flipTo(int id) {
+    if (id < 0)
+        return;
+    portENTER_CRITICAL_ISR(&m_flip_mux);
+    m_override = id;
+    i2s_parallel_flip_to_buffer(static_cast<i2s_dev_t*>(m_i2s), id);
+    portEXIT_CRITICAL_ISR(&m_flip_mux);
+}
+
+void SerialPWM::release() {
+    portENTER_CRITICAL(&m_flip_mux);
+    m_override = -1;
     i2s_parallel_flip_to_buffer(static_cast<i2s_dev_t*>(m_i2s), m_active_buffer);
+    portEXIT_CRITICAL(&m_flip_mux);
 }
 
 int SerialPWM::resolution() { return sc_resolution; }
@@ -28,6 +28,27 @@ public:
 
     void update();
 
+    /**
+     * \brief Precompute a static buffer with all channels set to value.
+     * \return id of the buffer for {@link flipTo}, or -1 if there is no space left.
+     */
+    int addStaticBuffer(value_type value);
+
+    /**
+     * \brief Switch the output to a static buffer in O(1). Can be called from an ISR.
+     *
+     * The output takes effect at the end of the current PWM period and stays
+     * on the static buffer until {@link release}. update() only rebuilds the live buffer meanwhile.
+     */
+    void flipTo(int id);
+
+    /**
+     * \brief Switch the output back to the live buffer, without rebuilding it.
+     */
+    void release();
+
+    bool isOverridden() const { return m_override >= 0; } //!< Returns true while a static buffer is active
+
     static int resolution();
 
 private:
@@ -35,7 +56,11 @@ private:
 
     static volatile void* i2snum2struct(const int num);
 
+    void render(uint8_t* const* buffer, const value_type* pwm);
+    void freeStaticBuffer(int slot);
+
     static constexpr int sc_buffers = 2;
+    static constexpr int sc_static_buffers = I2S_PARALLEL_MAX_BUFFERS - sc_buffers;
     static constexpr int sc_resolution = 100;
     const int c_channels;
     const int c_bytes;
@@ -44,6 +69,11 @@ private:
     uint8_t* m_buffer[sc_buffers][sc_resolution];
     int m_active_buffer;
     std::vector<value_type> m_pwm;
+
+    i2s_parallel_buffer_desc_t* m_static_descriptors[sc_static_buffers];
+    uint8_t* m_static_buffer[sc_static_buffers][sc_resolution];
+    volatile int m_override;
+    portMUX_TYPE m_flip_mux;
 };
 
 } // namespace rb
@@ -1,5 +1,6 @@
 #include "RBControl_servo.hpp"
 #include "RBControl_manager.hpp"
+#include "RBControl_trace.hpp"
 #include <algorithm>
 #include <chrono>
 #include <esp_log.h>
@@ -14,7 +15,8 @@
 
 namespace rb {
 
-SmartServoBus::SmartServoBus() {
+SmartServoBus::SmartServoBus()
+    : m_uart_queue(nullptr) {
 }
 
 void SmartServoBus::install(uint8_t servo_count, uart_port_t uart, gpio_num_t pin) {
@@ -269,12 +271,14 @@ void SmartServoBus::uartRoutine() {
             vTaskDelay(min_delay - diff);
         }
 
+        RB_TRACE(TRACE_SERVO_TX, 0);
         half_duplex::uart_tx_chars(m_uart, req.data, req.size);
         tm_last = xTaskGetTickCount();
         req.size = uartReceive((uint8_t*)req.data, sizeof(req.data));
 
         if (req.size != 0 && req.expect_response) {
             resp.size = uartReceive(resp.data, sizeof(resp.data));
+            RB_TRACE(TRACE_SERVO_RX, 0);
         } else {
             resp.size = 0;
         }
@@ -346,7 +350,7 @@ void SmartServoBus::send(const lw::Packet& pkt, QueueHandle_t responseQueue, boo
     req.responseQueue = responseQueue;
 
     if (sizeof(req.data) < pkt._data.size()) {
-        ESP_LOGE(TAG, "packet is too big, %u > %u", pkt._data.size(), sizeof(req.data));
+        ESP_LOGE(TAG, "packet is too big, %u > %u", (unsigned)pkt._data.size(), (unsigned)sizeof(req.data));
         abort();
     }
     memcpy(req.data, pkt._data.data(), pkt._data.size());
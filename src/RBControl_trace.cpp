@@ -0,0 +1,111 @@
+#include "RBControl_trace.hpp"
+
+#ifdef RB_TRACE_ENABLED
+
+#include <esp_attr.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdio.h>
+#include <xtensa/hal.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#ifndef CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ
+#define CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ 240
+#endif
+
+static_assert((RB_TRACE_BUFFER_SIZE & (RB_TRACE_BUFFER_SIZE - 1)) == 0, "RB_TRACE_BUFFER_SIZE must be a power of two");
+
+namespace rb {
+
+struct TraceRing {
+    std::atomic<uint32_t> head;
+    TraceRecord records[RB_TRACE_BUFFER_SIZE];
+};
+
+static TraceRing s_rings[portNUM_PROCESSORS];
+static std::atomic<bool> s_recording(true);
+
+static const TraceSpan s_spans[] = {
+    { "queue wait", TRACE_QUEUE_ENQUEUE, TRACE_QUEUE_DEQUEUE, false, true },
+    { "set -> pwm out", TRACE_MOTORS_SET, TRACE_PWM_UPDATE_END, false, false },
+    { "pwm update", TRACE_PWM_UPDATE_BEGIN, TRACE_PWM_UPDATE_END, false, false },
+    { "servo tx -> rx", TRACE_SERVO_TX, TRACE_SERVO_RX, false, false },
+};
+
+void IRAM_ATTR Trace::record(TracePoint point, uint8_t arg, uint32_t value) {
+    if (!s_recording.load(std::memory_order_relaxed))
+        return;
+
+    const uint8_t core = xPortGetCoreID();
+    auto& ring = s_rings[core];
+    auto& rec = ring.records[ring.head.fetch_add(1, std::memory_order_relaxed) & (RB_TRACE_BUFFER_SIZE - 1)];
+    rec.ccount = xthal_get_ccount();
+    rec.time_us = esp_timer_get_time();
+    rec.point = point;
+    rec.value = value;
+    rec.arg = arg;
+    rec.core = core;
+}
+
+void Trace::dump() {
+    std::vector<TraceRecord> records;
+    records.reserve(RB_TRACE_BUFFER_SIZE * portNUM_PROCESSORS);
+
+    s_recording.store(false);
+    for (auto& ring : s_rings) {
+        const uint32_t head = ring.head.load();
+        const uint32_t count = std::min<uint32_t>(head, RB_TRACE_BUFFER_SIZE);
+        for (uint32_t i = head - count; i != head; ++i) {
+            records.push_back(ring.records[i & (RB_TRACE_BUFFER_SIZE - 1)]);
+        }
+        ring.head.store(0);
+    }
+    s_recording.store(true);
+
+    // Records of each core are already in order, stable sort keeps it for equal timestamps.
+    std::stable_sort(records.begin(), records.end(), [](const TraceRecord& a, const TraceRecord& b) {
+        return a.time_us < b.time_us;
+    });
+
+    uint32_t counts[TRACE_POINT_MAX] = {};
+    for (const auto& rec : records) {
+        if (rec.point < TRACE_POINT_MAX)
+            ++counts[rec.point];
+    }
+
+    printf("%20s %6s %9s %9s %9s %9s\n", "span [us]", "count", "min", "avg", "p99", "max");
+    printf("==================================================================\n");
+    for (const auto& span : s_spans) {
+        TraceStats stats;
+        collectSpan(records.data(), records.size(), span, CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ, stats);
+        if (stats.count() == 0)
+            continue;
+        printf("%20s %6u %9.1f %9.1f %9.1f %9.1f\n", span.name, (unsigned)stats.count(),
+            stats.min() / 1000.f, stats.avg() / 1000.f, stats.percentile(99) / 1000.f, stats.max() / 1000.f);
+    }
+
+    for (int i = 0; i < TRACE_POINT_MAX; ++i) {
+        printf("%s: %u ", tracePointName(TracePoint(i)), counts[i]);
+    }
+    printf("\n");
+}
+
+} // namespace rb
+
+#else
+
+namespace rb {
+
+void Trace::record(TracePoint, uint8_t, uint32_t) {
+}
+
+void Trace::dump() {
+}
+
+} // namespace rb
+
+#endif
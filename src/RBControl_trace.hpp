@@ -0,0 +1,50 @@
+#pragma once
+
+#include "RBControl_traceStats.hpp"
+
+// Record timestamps at named points of the hot paths (see rb::TracePoint) and periodically
+// print min/avg/p99/max durations between them. Costs a few dozen cycles per trace point.
+//#define RB_TRACE_ENABLED 1
+
+#ifndef RB_TRACE_BUFFER_SIZE
+#define RB_TRACE_BUFFER_SIZE 256 // records per core, must be a power of two
+#endif
+
+#ifdef RB_TRACE_ENABLED
+#define RB_TRACE(point, arg) rb::Trace::record(point, arg)
+#define RB_TRACE_VALUE(point, arg, value) rb::Trace::record(point, arg, value)
+#else
+#define RB_TRACE(point, arg) \
+    do {                     \
+    } while (0)
+#define RB_TRACE_VALUE(point, arg, value) \
+    do {                                  \
+    } while (0)
+#endif
+
+namespace rb {
+
+/**
+ * \brief Lock-free per-core ring buffers of {@link TraceRecord}s.
+ *
+ * Use the RB_TRACE macro instead of calling record() directly, so that the trace
+ * points compile to nothing unless RB_TRACE_ENABLED is defined. When the buffer is full,
+ * the oldest records are overwritten.
+ */
+class Trace {
+public:
+    //! Record the trace point on the current core. Can be called from an ISR.
+    static void record(TracePoint point, uint8_t arg = 0, uint32_t value = 0);
+
+    /**
+     * \brief Print the summary of the spans recorded since the last dump and clear the buffers.
+     *
+     * Recording is paused while the buffers are copied.
+     */
+    static void dump();
+
+private:
+    Trace() = delete;
+};
+
+} // namespace rb
@@ -0,0 +1,94 @@
+#include <algorithm>
+
+#include "RBControl_traceStats.hpp"
+
+namespace rb {
+
+const char* tracePointName(TracePoint point) {
+    switch (point) {
+    case TRACE_MOTORS_SET:
+        return "motors_set";
+    case TRACE_QUEUE_ENQUEUE:
+        return "enqueue";
+    case TRACE_QUEUE_DEQUEUE:
+        return "dequeue";
+    case TRACE_PWM_UPDATE_BEGIN:
+        return "pwm_begin";
+    case TRACE_PWM_UPDATE_END:
+        return "pwm_end";
+    case TRACE_SERVO_TX:
+        return "servo_tx";
+    case TRACE_SERVO_RX:
+        return "servo_rx";
+    case TRACE_PCNT_ISR:
+        return "pcnt_isr";
+    case TRACE_GPIO_ISR:
+        return "gpio_isr";
+    default:
+        return "?";
+    }
+}
+
+void TraceStats::add(uint32_t ns) {
+    m_samples.push_back(ns);
+}
+
+uint32_t TraceStats::min() const {
+    return m_samples.empty() ? 0 : *std::min_element(m_samples.begin(), m_samples.end());
+}
+
+uint32_t TraceStats::max() const {
+    return m_samples.empty() ? 0 : *std::max_element(m_samples.begin(), m_samples.end());
+}
+
+uint32_t TraceStats::avg() const {
+    if (m_samples.empty())
+        return 0;
+    uint64_t sum = 0;
+    for (auto s : m_samples)
+        sum += s;
+    return uint32_t(sum / m_samples.size());
+}
+
+uint32_t TraceStats::percentile(float percent) const {
+    if (m_samples.empty())
+        return 0;
+
+    size_t rank = size_t(percent / 100.f * m_samples.size() + 0.999f);
+    rank = std::min(std::max(rank, size_t(1)), m_samples.size());
+
+    auto sorted = m_samples;
+    std::nth_element(sorted.begin(), sorted.begin() + (rank - 1), sorted.end());
+    return sorted[rank - 1];
+}
+
+static uint32_t durationNs(const TraceRecord& begin, const TraceRecord& end, uint32_t cpuMhz) {
+    if (begin.core == end.core && cpuMhz != 0) {
+        return uint32_t(uint64_t(end.ccount - begin.ccount) * 1000 / cpuMhz);
+    }
+    const int64_t us = end.time_us - begin.time_us;
+    return us <= 0 ? 0 : uint32_t(us * 1000);
+}
+
+void collectSpan(const TraceRecord* records, size_t count, const TraceSpan& span, uint32_t cpuMhz, TraceStats& stats) {
+    // Newest unpaired begin record, indexed by arg (or all in slot 0)
+    std::vector<const TraceRecord*> pending(span.matchArg ? 256 : 1, nullptr);
+
+    for (size_t i = 0; i < count; ++i) {
+        const auto& rec = records[i];
+        auto& slot = pending[span.matchArg ? rec.arg : 0];
+
+        if (rec.point == span.end) {
+            if (span.measured) {
+                stats.add(uint32_t(std::min<uint64_t>(uint64_t(rec.value) * 1000, UINT32_MAX)));
+            } else if (slot) {
+                stats.add(durationNs(*slot, rec, cpuMhz));
+                slot = nullptr;
+            }
+        } else if (rec.point == span.begin) {
+            slot = &rec;
+        }
+    }
+}
+
+} // namespace rb
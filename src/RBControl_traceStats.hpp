@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace rb {
+
+//! Named points in the library's hot paths, recorded by {@link RB_TRACE}.
+enum TracePoint : uint8_t {
+    TRACE_MOTORS_SET, //!< MotorChangeBuilder::set was called
+    TRACE_QUEUE_ENQUEUE, //!< A manager event was queued, arg is its type
+    TRACE_QUEUE_DEQUEUE, //!< The manager task received an event, arg is its type, value how long it waited in us
+    TRACE_PWM_UPDATE_BEGIN, //!< SerialPWM::update started rendering
+    TRACE_PWM_UPDATE_END, //!< SerialPWM::update flipped the new buffer to the output
+    TRACE_SERVO_TX, //!< A packet was written to the servo bus UART
+    TRACE_SERVO_RX, //!< The servo bus response was received (or timed out)
+    TRACE_PCNT_ISR, //!< Entry of the PCNT interrupt handler
+    TRACE_GPIO_ISR, //!< Entry of the encoder edge interrupt handler, arg is the motor
+
+    TRACE_POINT_MAX,
+};
+
+//! Returns a short name of the trace point, for printing.
+const char* tracePointName(TracePoint point);
+
+/**
+ * \brief One recorded trace point.
+ *
+ * The cycle counters of the two cores are not synchronized, so durations between records
+ * from the same core are computed from `ccount`, and from `time_us` otherwise.
+ */
+struct TraceRecord {
+    int64_t time_us; //!< esp_timer_get_time() of the record
+    uint32_t ccount; //!< CPU cycle counter of the recording core
+    TracePoint point;
+    uint32_t value; //!< Point specific, e.g. how long a dequeued event waited, in us
+    uint8_t arg; //!< Point specific, used to pair the records of a span
+    uint8_t core;
+};
+
+/**
+ * \brief Duration between two trace points, e.g. from queueing an event to handling it.
+ */
+struct TraceSpan {
+    const char* name;
+    TracePoint begin;
+    TracePoint end;
+    bool matchArg; //!< Only pair records with the same arg
+    bool measured; //!< The end records carry the duration in their value, begins aren't paired (e.g. a queue)
+};
+
+/**
+ * \brief Collects durations and computes min/avg/p99/max summaries.
+ *
+ * Keeps all the samples, it is meant for dumping collected traces, not for the hot path.
+ * Doesn't depend on anything ESP32 specific, so it can be tested on the host.
+ */
+class TraceStats {
+public:
+    void add(uint32_t ns);
+    void clear() { m_samples.clear(); }
+
+    size_t count() const { return m_samples.size(); }
+    uint32_t min() const;
+    uint32_t max() const;
+    uint32_t avg() const;
+
+    //! Returns the sample below which `percent` of the samples lie (nearest-rank), 0 if empty.
+    uint32_t percentile(float percent) const;
+
+private:
+    std::vector<uint32_t> m_samples;
+};
+
+/**
+ * \brief Pair the begin and end records of the span and add their durations to stats.
+ *
+ * Each end is paired with the newest unpaired begin. Spans which can't be paired that way,
+ * like the wait of events queued to the front, have to be measured when recording the end.
+ *
+ * \param records must be sorted by time_us, and by the recording order on each core
+ * \param count number of records
+ * \param cpuMhz CPU frequency, to convert cycle counts to nanoseconds
+ */
+void collectSpan(const TraceRecord* records, size_t count, const TraceSpan& span, uint32_t cpuMhz, TraceStats& stats);
+
+} // namespace rb
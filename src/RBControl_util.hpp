@@ -13,12 +13,12 @@ template <typename T, typename... Args>
 T clamp(T value, T min, T max, const char* tag = "",
     const char* msg = NULL, Args... args) {
     if (value < min) {
-        if (msg != NULL) {
+        if (msg != NULL && rb::logger.enabled(WARNING)) {
             rb::logWarning(tag, msg, std::forward<Args>(args)...);
         }
         return min;
     } else if (value > max) {
-        if (msg != NULL) {
+        if (msg != NULL && rb::logger.enabled(WARNING)) {
             rb::logWarning(tag, msg, std::forward<Args>(args)...);
         }
         return max;
@@ -28,12 +28,14 @@
 #include "soc/io_mux_reg.h"
 #include "rom/lldesc.h"
 #include "esp_heap_caps.h"
+#include "esp_attr.h"
 #include "i2s_parallel.h"
 #include "driver/gpio.h"
 
 typedef struct {
-    volatile lldesc_t *dmadesc_a, *dmadesc_b;
-    int desccount_a, desccount_b;
+    volatile lldesc_t *dmadesc[I2S_PARALLEL_MAX_BUFFERS];
+    int desccount[I2S_PARALLEL_MAX_BUFFERS];
+    int bufcount;
 } i2s_parallel_state_t;
 
 static i2s_parallel_state_t *i2s_state[2]={NULL, NULL};
@@ -195,14 +197,15 @@ void i2s_parallel_setup(i2s_dev_t *dev, const i2s_parallel_config_t *cfg) {
     //Allocate DMA descriptors
     i2s_state[i2snum(dev)]=malloc(sizeof(i2s_parallel_state_t));
     i2s_parallel_state_t *st=i2s_state[i2snum(dev)];
-    st->desccount_a=calc_needed_dma_descs_for(cfg->bufa);
-    st->desccount_b=calc_needed_dma_descs_for(cfg->bufb);
-    st->dmadesc_a=heap_caps_malloc(st->desccount_a*sizeof(lldesc_t), MALLOC_CAP_DMA);
-    st->dmadesc_b=heap_caps_malloc(st->desccount_b*sizeof(lldesc_t), MALLOC_CAP_DMA);
+    st->desccount[0]=calc_needed_dma_descs_for(cfg->bufa);
+    st->desccount[1]=calc_needed_dma_descs_for(cfg->bufb);
+    st->dmadesc[0]=heap_caps_malloc(st->desccount[0]*sizeof(lldesc_t), MALLOC_CAP_DMA);
+    st->dmadesc[1]=heap_caps_malloc(st->desccount[1]*sizeof(lldesc_t), MALLOC_CAP_DMA);
+    st->bufcount=2;
     
     //and fill them
-    fill_dma_desc(st->dmadesc_a, cfg->bufa);
-    fill_dma_desc(st->dmadesc_b, cfg->bufb);
+    fill_dma_desc(st->dmadesc[0], cfg->bufa);
+    fill_dma_desc(st->dmadesc[1], cfg->bufb);
     
     //Reset FIFO/DMA -> needed? Doesn't dma_reset/fifo_reset do this?
     dev->lc_conf.in_rst=1; dev->lc_conf.out_rst=1; dev->lc_conf.ahbm_rst=1; dev->lc_conf.ahbm_fifo_rst=1;
@@ -212,24 +215,36 @@ void i2s_parallel_setup(i2s_dev_t *dev, const i2s_parallel_config_t *cfg) {
     
     //Start dma on front buffer
     dev->lc_conf.val=I2S_OUT_DATA_BURST_EN | I2S_OUTDSCR_BURST_EN;
-    dev->out_link.addr=((uint32_t)(&st->dmadesc_a[0]));
+    dev->out_link.addr=((uint32_t)(&st->dmadesc[0][0]));
     dev->out_link.start=1;
     dev->conf.tx_start=1;
 }
 
 
-//Flip to a buffer: 0 for bufa, 1 for bufb
-void i2s_parallel_flip_to_buffer(i2s_dev_t *dev, int bufid) {
-    int no=i2snum(dev);
-    if (i2s_state[no]==NULL) return;
-    lldesc_t *active_dma_chain;
-    if (bufid==0) {
-        active_dma_chain=(lldesc_t*)&i2s_state[no]->dmadesc_a[0];
-    } else {
-        active_dma_chain=(lldesc_t*)&i2s_state[no]->dmadesc_b[0];
-    }
+//Add another buffer which can be flipped to. Returns its bufid, or -1 on failure.
+int i2s_parallel_add_buffer(i2s_dev_t *dev, i2s_parallel_buffer_desc_t *buf) {
+    i2s_parallel_state_t *st=i2s_state[i2snum(dev)];
+    if (st==NULL || st->bufcount>=I2S_PARALLEL_MAX_BUFFERS) return -1;
+    int id=st->bufcount;
+    st->desccount[id]=calc_needed_dma_descs_for(buf);
+    st->dmadesc[id]=heap_caps_malloc(st->desccount[id]*sizeof(lldesc_t), MALLOC_CAP_DMA);
+    if (st->dmadesc[id]==NULL) return -1;
+    //The new chain loops to itself until it is flipped to
+    fill_dma_desc(st->dmadesc[id], buf);
+    st->bufcount=id+1;
+    return id;
+}
+
+//Flip to a buffer: 0 for bufa, 1 for bufb, or an id from i2s_parallel_add_buffer.
+//Only rewrites the chain ends, so it is O(1) and can be called from an ISR.
+void IRAM_ATTR i2s_parallel_flip_to_buffer(i2s_dev_t *dev, int bufid) {
+    int no=(dev==&I2S0)?0:1;
+    i2s_parallel_state_t *st=i2s_state[no];
+    if (st==NULL || bufid<0 || bufid>=st->bufcount) return;
+    lldesc_t *active_dma_chain=(lldesc_t*)&st->dmadesc[bufid][0];
 
-    i2s_state[no]->dmadesc_a[i2s_state[no]->desccount_a-1].qe.stqe_next=active_dma_chain;
-    i2s_state[no]->dmadesc_b[i2s_state[no]->desccount_b-1].qe.stqe_next=active_dma_chain;
+    for (int i=0; i<st->bufcount; i++) {
+        st->dmadesc[i][st->desccount[i]-1].qe.stqe_next=active_dma_chain;
+    }
 }
 
@@ -4,6 +4,8 @@
 #include "soc/i2s_struct.h"
 #include <stdint.h>
 
+#define I2S_PARALLEL_MAX_BUFFERS 4
+
 typedef enum {
     I2S_PARALLEL_BITS_8 = 8,
     I2S_PARALLEL_BITS_16 = 16,
@@ -35,6 +37,7 @@ extern "C" {
 
 int i2snum(i2s_dev_t* dev);
 void i2s_parallel_setup(i2s_dev_t* dev, const i2s_parallel_config_t* cfg);
+int i2s_parallel_add_buffer(i2s_dev_t* dev, i2s_parallel_buffer_desc_t* buf);
 void i2s_parallel_flip_to_buffer(i2s_dev_t* dev, int bufid);
 
 #ifdef __cplusplus
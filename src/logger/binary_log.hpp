@@ -0,0 +1,304 @@
+#pragma once
+#include "compiled_format.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/time.h>
+#include <vector>
+
+/// @privatesection
+namespace binary_log {
+
+// The stream is a sequence of frames: type, payload length, payload. All numbers are little-endian.
+//   definition: u16 format id, u8 argument count, the argument type codes, the format string
+//   message:    u16 format id, u32 timestamp in us, the arguments
+// The type codes are Python's struct ones, strings are 's': u8 length and the characters.
+enum FrameType : uint8_t {
+    FRAME_DEFINITION = 'D',
+    FRAME_MESSAGE = 'M',
+};
+
+static const size_t MAX_PAYLOAD = 255;
+static const size_t MAX_FRAME = MAX_PAYLOAD + 2;
+static const size_t MAX_STRING = 32; // Longer string arguments are clipped
+
+// The types FormatString can format
+template <typename T>
+struct TypeCode {};
+template <>
+struct TypeCode<int8_t> { static constexpr char value = 'b'; };
+template <>
+struct TypeCode<uint8_t> { static constexpr char value = 'B'; };
+template <>
+struct TypeCode<int16_t> { static constexpr char value = 'h'; };
+template <>
+struct TypeCode<uint16_t> { static constexpr char value = 'H'; };
+template <>
+struct TypeCode<int32_t> { static constexpr char value = 'i'; };
+template <>
+struct TypeCode<uint32_t> { static constexpr char value = 'I'; };
+template <>
+struct TypeCode<int64_t> { static constexpr char value = 'q'; };
+template <>
+struct TypeCode<uint64_t> { static constexpr char value = 'Q'; };
+template <>
+struct TypeCode<float> { static constexpr char value = 'f'; };
+template <>
+struct TypeCode<double> { static constexpr char value = 'd'; };
+template <>
+struct TypeCode<const char*> { static constexpr char value = 's'; };
+template <>
+struct TypeCode<char*> { static constexpr char value = 's'; };
+template <>
+struct TypeCode<std::string> { static constexpr char value = 's'; };
+
+template <typename... Args>
+struct TypeCodes {
+    static constexpr const char value[sizeof...(Args) + 1] = { TypeCode<Args>::value..., '\0' };
+};
+
+template <typename... Args>
+constexpr const char TypeCodes<Args...>::value[sizeof...(Args) + 1];
+
+struct Definition {
+    std::string format;
+    std::string types;
+};
+
+// Shared by all BinaryLogs, the ids are assigned at the first use of each call site
+struct FormatTable {
+    std::mutex mutex;
+    std::vector<Definition> definitions;
+};
+
+inline FormatTable& formatTable() {
+    static FormatTable table;
+    return table;
+}
+
+inline uint16_t defineFormat(const char* format, const char* types) {
+    auto& table = formatTable();
+    std::lock_guard<std::mutex> _(table.mutex);
+    table.definitions.push_back(Definition { format, types });
+    return static_cast<uint16_t>(table.definitions.size() - 1);
+}
+
+// Returns the frame's length
+inline size_t definitionFrame(uint16_t id, const Definition& def, uint8_t* frame) {
+    const size_t types = def.types.size();
+    const size_t format = std::min(def.format.size(), MAX_PAYLOAD - 3 - types);
+    frame[0] = FRAME_DEFINITION;
+    frame[1] = static_cast<uint8_t>(3 + types + format);
+    frame[2] = id & 0xFF;
+    frame[3] = id >> 8;
+    frame[4] = static_cast<uint8_t>(types);
+    memcpy(frame + 5, def.types.data(), types);
+    memcpy(frame + 5 + types, def.format.data(), format);
+    return 5 + types + format;
+}
+
+class Encoder {
+public:
+    Encoder(uint8_t* begin, uint8_t* end)
+        : _pos(begin)
+        , _end(end) {}
+
+    template <typename T>
+    typename std::enable_if<std::is_arithmetic<T>::value>::type put(T value) {
+        // Both the ESP32 and the hosts the decoder runs on are little-endian
+        if (_end - _pos < static_cast<ptrdiff_t>(sizeof(T)))
+            return;
+        memcpy(_pos, &value, sizeof(T));
+        _pos += sizeof(T);
+    }
+
+    void put(const char* s) {
+        putString(s, strlen(s));
+    }
+
+    void put(const std::string& s) {
+        putString(s.data(), s.size());
+    }
+
+    void putAll() {}
+
+    template <typename T, typename... Rest>
+    void putAll(const T& t, const Rest&... rest) {
+        put(t);
+        putAll(rest...);
+    }
+
+    uint8_t* pos() const { return _pos; }
+
+private:
+    void putString(const char* s, size_t len) {
+        len = std::min(len, MAX_STRING);
+        if (_end - _pos < static_cast<ptrdiff_t>(len + 1))
+            return;
+        *(_pos++) = static_cast<uint8_t>(len);
+        memcpy(_pos, s, len);
+        _pos += len;
+    }
+
+    uint8_t* _pos;
+    uint8_t* _end;
+};
+
+} // namespace binary_log
+
+/**
+ * Receives the frames of a BinaryLog, always whole ones.
+ */
+class BinaryLogSink {
+public:
+    virtual ~BinaryLogSink() {}
+    virtual void write(const uint8_t* frame, size_t length) = 0;
+};
+
+/**
+ * Keeps the newest frames in a fixed RAM buffer, the oldest whole frames are dropped.
+ */
+class RingBinaryLogSink : public BinaryLogSink {
+public:
+    RingBinaryLogSink(size_t capacity)
+        : _data(new uint8_t[capacity])
+        , _capacity(capacity)
+        , _head(0)
+        , _used(0) {}
+
+    virtual void write(const uint8_t* frame, size_t length) override {
+        if (length > _capacity)
+            return;
+        std::lock_guard<std::mutex> _(_mutex);
+        while (_capacity - _used < length) {
+            const size_t oldest = 2 + at(_head + 1);
+            _head = (_head + oldest) % _capacity;
+            _used -= oldest;
+        }
+        size_t pos = (_head + _used) % _capacity;
+        for (size_t i = 0; i != length; ++i) {
+            _data[pos] = frame[i];
+            pos = pos + 1 == _capacity ? 0 : pos + 1;
+        }
+        _used += length;
+    }
+
+    // Pass the stored frames, oldest first. Write the format table before them,
+    // the definitions may have been dropped already.
+    void copyTo(BinaryLogSink& out) const {
+        uint8_t frame[binary_log::MAX_FRAME];
+        std::lock_guard<std::mutex> _(_mutex);
+        for (size_t offset = 0; offset < _used;) {
+            const size_t length = 2 + at(_head + offset + 1);
+            for (size_t i = 0; i != length; ++i)
+                frame[i] = at(_head + offset + i);
+            out.write(frame, length);
+            offset += length;
+        }
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> _(_mutex);
+        _head = 0;
+        _used = 0;
+    }
+
+    size_t size() const { return _used; }
+
+private:
+    uint8_t at(size_t pos) const {
+        return _data[pos % _capacity];
+    }
+
+    std::unique_ptr<uint8_t[]> _data;
+    const size_t _capacity;
+    size_t _head;
+    size_t _used;
+    mutable std::mutex _mutex;
+};
+
+/**
+ * Logs the format string's id and the raw arguments instead of the formatted text,
+ * for high-rate data. The text is rebuilt on a PC by BinaryLogDecoder (host/tools/rblog_decode).
+ *
+ * log(RB_FMT("speed {} {}"), left, right) costs a few copies of the arguments.
+ * The format string is sent to the sinks once, before its first message.
+ */
+class BinaryLog {
+public:
+    BinaryLog()
+        : _active(false) {}
+
+    void addSink(std::unique_ptr<BinaryLogSink>&& sink) {
+        std::lock_guard<std::mutex> _(_mutex);
+        _sinks.push_back(std::move(sink));
+        _announced.clear(); // The new sink needs the definitions, too
+        _active = true;
+    }
+
+    template <typename Str, typename... Args>
+    void log(CompiledFormat<Str>, Args... args) {
+        using Fmt = CompiledFormat<Str>;
+        static_assert(Fmt::parsed.argCount <= sizeof...(Args), "The format string refers to a missing argument");
+        static const uint16_t id = binary_log::defineFormat(Str::str(), binary_log::TypeCodes<Args...>::value);
+        if (!_active.load(std::memory_order_relaxed))
+            return;
+
+        uint8_t frame[binary_log::MAX_FRAME];
+        binary_log::Encoder enc(frame + 2, frame + binary_log::MAX_FRAME);
+        enc.put(id);
+        enc.put(now());
+        enc.putAll(args...);
+        frame[0] = binary_log::FRAME_MESSAGE;
+        frame[1] = static_cast<uint8_t>(enc.pos() - frame - 2);
+        write(id, frame, enc.pos() - frame);
+    }
+
+    // Write the definitions of all formats used so far
+    static void writeFormatTable(BinaryLogSink& sink) {
+        auto& table = binary_log::formatTable();
+        uint8_t frame[binary_log::MAX_FRAME];
+        std::lock_guard<std::mutex> _(table.mutex);
+        for (size_t id = 0; id != table.definitions.size(); ++id)
+            sink.write(frame, binary_log::definitionFrame(id, table.definitions[id], frame));
+    }
+
+private:
+    static uint32_t now() {
+        struct timeval t;
+        gettimeofday(&t, NULL);
+        return static_cast<uint32_t>(uint64_t(t.tv_sec) * 1000000 + t.tv_usec);
+    }
+
+    void write(uint16_t id, const uint8_t* frame, size_t length) {
+        std::lock_guard<std::mutex> _(_mutex);
+        if (id >= _announced.size() || !_announced[id]) {
+            announce(id);
+        }
+        for (auto& sink : _sinks)
+            sink->write(frame, length);
+    }
+
+    void announce(uint16_t id) {
+        uint8_t frame[binary_log::MAX_FRAME];
+        size_t length;
+        {
+            auto& table = binary_log::formatTable();
+            std::lock_guard<std::mutex> _(table.mutex);
+            length = binary_log::definitionFrame(id, table.definitions[id], frame);
+        }
+        for (auto& sink : _sinks)
+            sink->write(frame, length);
+        if (id >= _announced.size())
+            _announced.resize(id + 1, false);
+        _announced[id] = true;
+    }
+
+    std::mutex _mutex;
+    std::atomic<bool> _active;
+    std::vector<std::unique_ptr<BinaryLogSink>> _sinks;
+    std::vector<bool> _announced;
+};
@@ -0,0 +1,180 @@
+#pragma once
+#include "binary_log.hpp"
+#include <functional>
+#include <map>
+
+/// @privatesection
+
+/**
+ * Rebuilds the text of a BinaryLog stream, formatted like the text logger would.
+ *
+ * Feed it the stream in any pieces. Frames of unknown type are skipped byte by byte,
+ * so the stream can start in the middle of a frame. Messages whose definition
+ * hasn't been seen yet are counted in unknown().
+ */
+class BinaryLogDecoder {
+public:
+    typedef std::function<void(uint64_t timestamp_us, const std::string& text)> Callback;
+
+    BinaryLogDecoder()
+        : _lastTimestamp(0)
+        , _timestampHigh(0)
+        , _unknown(0)
+        , _skipped(0) {}
+
+    void feed(const uint8_t* data, size_t length, const Callback& callback) {
+        _pending.insert(_pending.end(), data, data + length);
+        size_t pos = 0;
+        while (_pending.size() - pos >= 2) {
+            const uint8_t type = _pending[pos];
+            if (type != binary_log::FRAME_DEFINITION && type != binary_log::FRAME_MESSAGE) {
+                ++pos;
+                ++_skipped;
+                continue;
+            }
+            const size_t payload = _pending[pos + 1];
+            if (_pending.size() - pos < 2 + payload)
+                break;
+            const uint8_t* frame = _pending.data() + pos + 2;
+            if (type == binary_log::FRAME_DEFINITION) {
+                define(frame, payload);
+            } else {
+                decode(frame, payload, callback);
+            }
+            pos += 2 + payload;
+        }
+        _pending.erase(_pending.begin(), _pending.begin() + pos);
+    }
+
+    size_t unknown() const { return _unknown; } //!< Messages without a definition
+    size_t skipped() const { return _skipped; } //!< Bytes which were not a frame
+
+private:
+    struct Reader {
+        const uint8_t* pos;
+        const uint8_t* end;
+
+        template <typename T>
+        bool get(T& value) {
+            if (end - pos < static_cast<ptrdiff_t>(sizeof(T)))
+                return false;
+            memcpy(&value, pos, sizeof(T));
+            pos += sizeof(T);
+            return true;
+        }
+    };
+
+    void define(const uint8_t* payload, size_t length) {
+        Reader r { payload, payload + length };
+        uint16_t id;
+        uint8_t count;
+        if (!r.get(id) || !r.get(count) || r.end - r.pos < count)
+            return;
+        auto& def = _formats[id];
+        def.types.assign(reinterpret_cast<const char*>(r.pos), count);
+        def.format.assign(reinterpret_cast<const char*>(r.pos) + count, r.end - r.pos - count);
+    }
+
+    void decode(const uint8_t* payload, size_t length, const Callback& callback) {
+        Reader r { payload, payload + length };
+        uint16_t id;
+        uint32_t timestamp;
+        if (!r.get(id) || !r.get(timestamp))
+            return;
+        auto itr = _formats.find(id);
+        if (itr == _formats.end()) {
+            ++_unknown;
+            return;
+        }
+
+        std::vector<std::string> args;
+        for (char type : itr->second.types) {
+            args.emplace_back();
+            if (!formatArg(type, r, args.back()))
+                return;
+        }
+        callback(unwrap(timestamp), assemble(itr->second.format, args));
+    }
+
+    template <typename T>
+    static bool formatNumber(Reader& r, std::string& out) {
+        T value;
+        if (!r.get(value))
+            return false;
+        char buffer[64];
+        char* pos = buffer;
+        compiled_format::formatValue(compiled_format::BufferIterator(&pos, buffer + sizeof(buffer)), value);
+        out.assign(buffer, pos);
+        return true;
+    }
+
+    static bool formatArg(char type, Reader& r, std::string& out) {
+        switch (type) {
+        case 'b':
+            return formatNumber<int8_t>(r, out);
+        case 'B':
+            return formatNumber<uint8_t>(r, out);
+        case 'h':
+            return formatNumber<int16_t>(r, out);
+        case 'H':
+            return formatNumber<uint16_t>(r, out);
+        case 'i':
+            return formatNumber<int32_t>(r, out);
+        case 'I':
+            return formatNumber<uint32_t>(r, out);
+        case 'q':
+            return formatNumber<int64_t>(r, out);
+        case 'Q':
+            return formatNumber<uint64_t>(r, out);
+        case 'f':
+            return formatNumber<float>(r, out);
+        case 'd':
+            return formatNumber<double>(r, out);
+        case 's': {
+            uint8_t len;
+            if (!r.get(len) || r.end - r.pos < len)
+                return false;
+            out.assign(reinterpret_cast<const char*>(r.pos), len);
+            r.pos += len;
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
+    // The same rules as formatTo, with the format string parsed at runtime
+    static std::string assemble(const std::string& format, const std::vector<std::string>& args) {
+        const auto parsed = compiled_format::parse<binary_log::MAX_PAYLOAD, binary_log::MAX_PAYLOAD / 2>(format.c_str());
+        const size_t markers = compiled_format::markerCount(format.c_str());
+        std::string res;
+        size_t copied = 0;
+        for (size_t m = 0; m != markers; ++m) {
+            res.append(parsed.text + copied, parsed.markers[m].offset - copied);
+            copied = parsed.markers[m].offset;
+            if (parsed.markers[m].arg < args.size())
+                res += args[parsed.markers[m].arg];
+        }
+        res.append(parsed.text + copied, parsed.textLength - copied);
+        for (size_t a = 0; a < args.size() && a < compiled_format::MAX_ARGS; ++a) {
+            if (!(parsed.usedArgs & (uint32_t(1) << a)))
+                res += args[a];
+        }
+        return res;
+    }
+
+    // The timestamps are 32-bit, they wrap around every 71 minutes
+    uint64_t unwrap(uint32_t timestamp) {
+        if (timestamp < _lastTimestamp)
+            _timestampHigh += uint64_t(1) << 32;
+        _lastTimestamp = timestamp;
+        return _timestampHigh | timestamp;
+    }
+
+    std::vector<uint8_t> _pending;
+    std::map<uint16_t, binary_log::Definition> _formats;
+    uint32_t _lastTimestamp;
+    uint64_t _timestampHigh;
+    size_t _unknown;
+    size_t _skipped;
+};
@@ -0,0 +1,277 @@
+#pragma once
+#include "formatters.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <type_traits>
+
+/// @privatesection
+namespace compiled_format {
+
+static const size_t NOT_FOUND = static_cast<size_t>(-1);
+static const size_t MAX_ARGS = 32;
+
+struct Marker {
+    uint16_t offset; // Position in the unescaped text where the argument goes
+    uint8_t arg;
+};
+
+// The format string with the escapes removed and the markers cut out
+template <size_t TextSize, size_t MarkerCount>
+struct ParsedFormat {
+    char text[TextSize + 1];
+    size_t textLength;
+    Marker markers[MarkerCount + 1];
+    uint32_t usedArgs; // Bit mask of the arguments any marker refers to
+    size_t argCount; // Arguments the markers need, the highest index + 1
+};
+
+constexpr size_t length(const char* s) {
+    size_t n = 0;
+    while (s[n] != '\0')
+        ++n;
+    return n;
+}
+
+constexpr size_t closingBrace(const char* s, size_t open) {
+    for (size_t i = open + 1; s[i] != '\0'; ++i) {
+        if (s[i] == '\\') {
+            if (s[i + 1] == '\0')
+                break;
+            ++i;
+        } else if (s[i] == '}') {
+            return i;
+        }
+    }
+    return NOT_FOUND;
+}
+
+// Like FormatString, ignore invalid characters and pretend it is zero
+constexpr size_t parseIndex(const char* s, size_t pos) {
+    while (s[pos] == ' ')
+        ++pos;
+    size_t idx = 0;
+    for (; s[pos] >= '0' && s[pos] <= '9'; ++pos)
+        idx = idx * 10 + (s[pos] - '0');
+    return idx;
+}
+
+constexpr size_t markerCount(const char* s) {
+    size_t count = 0;
+    for (size_t i = 0; s[i] != '\0'; ++i) {
+        if (s[i] == '\\') {
+            if (s[i + 1] == '\0')
+                break;
+            ++i;
+        } else if (s[i] == '{') {
+            const size_t end = closingBrace(s, i);
+            if (end != NOT_FOUND) {
+                ++count;
+                i = end;
+            }
+        }
+    }
+    return count;
+}
+
+template <size_t TextSize, size_t MarkerCount>
+constexpr ParsedFormat<TextSize, MarkerCount> parse(const char* s) {
+    ParsedFormat<TextSize, MarkerCount> res {};
+    size_t out = 0;
+    size_t marker = 0;
+    size_t sequential = 0;
+    for (size_t i = 0; s[i] != '\0'; ++i) {
+        if (s[i] == '\\') {
+            if (s[i + 1] == '\0')
+                break;
+            res.text[out++] = s[++i];
+            continue;
+        }
+        if (s[i] == '{') {
+            const size_t end = closingBrace(s, i);
+            if (end != NOT_FOUND) {
+                const size_t arg = end == i + 1 ? sequential++ : parseIndex(s, i + 1);
+                res.markers[marker].offset = static_cast<uint16_t>(out);
+                res.markers[marker].arg = static_cast<uint8_t>(arg < MAX_ARGS ? arg : MAX_ARGS);
+                ++marker;
+                if (arg < MAX_ARGS)
+                    res.usedArgs |= uint32_t(1) << arg;
+                if (arg + 1 > res.argCount)
+                    res.argCount = arg + 1;
+                i = end;
+                continue;
+            }
+        }
+        res.text[out++] = s[i];
+    }
+    res.textLength = out;
+    return res;
+}
+
+// Writes into a fixed buffer through a shared position, so that the copies the
+// formatters make of it (std::copy_n, std::fill_n) all advance it. Drops what does not fit.
+class BufferIterator {
+public:
+    typedef std::output_iterator_tag iterator_category;
+    typedef void value_type;
+    typedef void difference_type;
+    typedef void pointer;
+    typedef void reference;
+
+    BufferIterator(char** pos, char* end)
+        : _pos(pos)
+        , _end(end) {}
+
+    BufferIterator& operator=(char c) {
+        if (*_pos != _end)
+            *((*_pos)++) = c;
+        return *this;
+    }
+
+    BufferIterator& operator*() { return *this; }
+    BufferIterator& operator++() { return *this; }
+    BufferIterator operator++(int) { return *this; }
+
+    void write(const char* s, size_t len) {
+        const size_t room = _end - *_pos;
+        if (len > room)
+            len = room;
+        memcpy(*_pos, s, len);
+        *_pos += len;
+    }
+
+private:
+    char** _pos;
+    char* _end;
+};
+
+template <typename T>
+typename std::enable_if<std::is_fundamental<T>::value>::type
+formatValue(BufferIterator it, T& t) {
+    DefaultSprintfFormatter<T>(t).format(it);
+}
+
+inline void formatValue(BufferIterator it, const char* s) {
+    it.write(s, strlen(s));
+}
+
+inline void formatValue(BufferIterator it, const std::string& s) {
+    it.write(s.data(), s.size());
+}
+
+template <typename T>
+typename std::enable_if<std::is_base_of<Formatable, T>::value>::type
+formatValue(BufferIterator it, T& t) {
+    t.format(it);
+}
+
+inline void formatArg(BufferIterator, size_t) {}
+
+template <typename T, typename... Rest>
+void formatArg(BufferIterator it, size_t idx, T& t, Rest&... rest) {
+    if (idx == 0) {
+        formatValue(it, t);
+    } else {
+        formatArg(it, idx - 1, rest...);
+    }
+}
+
+// Not templated on the format string, so that every call site with the same
+// argument types shares one instance
+template <typename... Args>
+size_t formatParsed(char* buffer, size_t capacity, const char* text, size_t textLength,
+    const Marker* markers, size_t markerCount, uint32_t usedArgs, Args&... args) {
+    if (capacity == 0)
+        return 0;
+    char* pos = buffer;
+    BufferIterator it(&pos, buffer + capacity - 1);
+    size_t copied = 0;
+    for (size_t m = 0; m != markerCount; ++m) {
+        it.write(text + copied, markers[m].offset - copied);
+        copied = markers[m].offset;
+        formatArg(it, markers[m].arg, args...);
+    }
+    it.write(text + copied, textLength - copied);
+
+    // Like FormatString, the arguments no marker refers to are appended
+    for (size_t a = 0; a != sizeof...(Args); ++a) {
+        if (!(usedArgs & (uint32_t(1) << a)))
+            formatArg(it, a, args...);
+    }
+    *pos = '\0';
+    return pos - buffer;
+}
+
+} // namespace compiled_format
+
+/**
+ * A format string parsed at compile time, create it with RB_FMT.
+ *
+ * It has the same syntax as FormatString: {} is the next argument, {n} the n-th one,
+ * \ escapes the next character. Unlike in FormatString, {} counts the arguments
+ * on its own, regardless of the {n} markers before it.
+ */
+template <typename Str>
+struct CompiledFormat {
+    static constexpr size_t textSize = compiled_format::length(Str::str());
+    static constexpr size_t markerCount = compiled_format::markerCount(Str::str());
+    static constexpr compiled_format::ParsedFormat<textSize, markerCount> parsed
+        = compiled_format::parse<textSize, markerCount>(Str::str());
+};
+
+template <typename Str>
+constexpr compiled_format::ParsedFormat<CompiledFormat<Str>::textSize, CompiledFormat<Str>::markerCount>
+    CompiledFormat<Str>::parsed;
+
+#define RB_FMT(FMT)                                            \
+    ([] {                                                      \
+        struct Str {                                           \
+            static constexpr const char* str() { return FMT; } \
+        };                                                     \
+        return CompiledFormat<Str>();                          \
+    }())
+
+/**
+ * Format the arguments into buffer in one pass, without any allocation.
+ *
+ * The result is clipped to capacity - 1 characters and always terminated.
+ * \return the length of the result
+ */
+template <typename Str, typename... Args>
+size_t formatTo(char* buffer, size_t capacity, CompiledFormat<Str>, Args... args) {
+    using Fmt = CompiledFormat<Str>;
+    static_assert(sizeof...(Args) <= compiled_format::MAX_ARGS, "Too many format arguments");
+    static_assert(Fmt::parsed.argCount <= sizeof...(Args), "The format string refers to a missing argument");
+    return compiled_format::formatParsed(buffer, capacity, Fmt::parsed.text, Fmt::parsed.textLength,
+        Fmt::parsed.markers, Fmt::markerCount, Fmt::parsed.usedArgs, args...);
+}
+
+static constexpr const size_t FORMAT_BUFFER_SIZE = 128;
+
+/**
+ * A string formatted into a fixed buffer on the stack, see format(CompiledFormat, ...).
+ */
+template <size_t Size = FORMAT_BUFFER_SIZE>
+class FormatBuffer {
+public:
+    template <typename Str, typename... Args>
+    FormatBuffer(CompiledFormat<Str> fmt, Args... args)
+        : _length(formatTo(_data, Size, fmt, args...)) {}
+
+    const char* c_str() const { return _data; }
+    size_t size() const { return _length; }
+
+    operator std::string() const {
+        return std::string(_data, _length);
+    }
+
+private:
+    char _data[Size];
+    size_t _length;
+};
+
+template <size_t Size = FORMAT_BUFFER_SIZE, typename Str, typename... Args>
+inline FormatBuffer<Size> format(CompiledFormat<Str> fmt, Args... args) {
+    return FormatBuffer<Size>(fmt, args...);
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include "compiled_format.hpp"
 #include "formatters.hpp"
 #include <algorithm>
 #include <functional>
@@ -14,16 +15,26 @@ private:
     String _data;
     SizeType _idx;
     std::function<void(const String&)> _del;
+    bool _discard;
 
 public:
     template <typename F>
     FormatObject(const String& fmt, F f)
         : _data(fmt)
         , _idx(0)
-        , _del(f) {}
+        , _del(f)
+        , _discard(false) {}
     FormatObject(const String& fmt)
         : _data(fmt)
-        , _idx(0) {}
+        , _idx(0)
+        , _discard(false) {}
+
+    // A formatter which ignores its arguments, for messages nobody is going to read
+    static FormatObject discarded() {
+        FormatObject res { String() };
+        res._discard = true;
+        return res;
+    }
     ~FormatObject() {
         if (_del)
             _del(*this);
@@ -35,7 +46,8 @@ public:
     FormatObject(FormatObject&& other)
         : _data(std::move(other._data))
         , _idx(other._idx)
-        , _del(std::move(other._del)) {}
+        , _del(std::move(other._del))
+        , _discard(other._discard) {}
     FormatObject& operator=(FormatObject&& other) {
         swap(other);
         return *this;
@@ -122,6 +134,8 @@ private:
 
     template <typename F>
     FormatObject& place(F replaceCallback) {
+        if (_discard)
+            return *this;
         String result;
         SizeType copyFrom = 0;
         bool hit = false;
@@ -172,6 +186,7 @@ private:
         swap(_data, other._data);
         swap(_idx, other._idx);
         swap(_del, other._del);
+        swap(_discard, other._discard);
     }
 };
 
@@ -6,6 +6,8 @@
 #include <cstdio>
 #include <cstring>
 
+#include "number_format.hpp"
+
 /// @privatesection
 struct Formatable {};
 
@@ -54,6 +56,18 @@ struct FmtStr<T, typename std::enable_if<std::is_pointer<T>::value>::type> {
     FMT_CONST("p");
 };
 
+// The printf conversion character of T's default format
+template <class T>
+constexpr char conversion() {
+    return number_format::lastChar(FmtStr<T>::fmt);
+}
+
+// How many bits of T printf looks at, types smaller than int are promoted to it
+template <class T>
+constexpr int promotedBits() {
+    return sizeof(T) >= sizeof(int) ? sizeof(T) * 8 : (FmtStr<T>::fmt[0] == 'h' ? sizeof(T) * 8 : sizeof(int) * 8);
+}
+
 template <class T>
 class DefaultSprintfFormatter : public Formatable {
     T _val;
@@ -66,6 +80,12 @@ public:
     void format(It it) {
         constexpr const int SIZE = 64;
         char buffer[SIZE];
+        const number_format::Spec spec = { false, false, false, false, false, -1, -1, conversion<T>() };
+        const int length = number_format::format(buffer, _val, spec, promotedBits<T>());
+        if (length >= 0) {
+            std::copy_n(buffer, length, it);
+            return;
+        }
         snprintf(buffer, SIZE, FmtStr<T>::fmt_full, _val);
         for (char* c = buffer; *c != '\0'; c++)
             *(it++) = *c;
@@ -88,6 +108,25 @@ struct SprintfFormatter : public Formatable {
 
     template <class It>
     void format(It it) const {
+        char conv = _replacement != '\0' ? _replacement : conversion<T>();
+        if (_upperCase)
+            conv = toupper(conv);
+        const number_format::Spec spec = { _alignLeft, _forceSign, _reserveSpaceForSign, _showPrefix,
+            _leadingZeroes, _width, _precision, conv };
+
+        constexpr const int SIZE = 64;
+        char buffer[SIZE];
+        const int length = number_format::format(buffer, _val, spec, promotedBits<T>());
+        if (length < 0) {
+            formatWithSnprintf(it);
+        } else {
+            std::copy_n(buffer, length, it);
+        }
+    }
+
+    // The reference the fast path in format() matches
+    template <class It>
+    void formatWithSnprintf(It it) const {
         char fmt[64];
         char* pos = fmt;
         *(pos++) = '%';
@@ -0,0 +1,175 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+/// @privatesection
+static constexpr const size_t LOG_PAYLOAD_SIZE = 96;
+
+// One log message (or a part of a longer one), formatted by the producer, waiting for the sinks
+struct LogRecord {
+    uint64_t timestamp;
+    int8_t verbosity;
+    uint8_t tag; // Id from TagRegistry
+    uint8_t length;
+    bool more; // The message continues in the next record
+    char payload[LOG_PAYLOAD_SIZE];
+};
+
+/**
+ * Bounded lock-free queue of log records, any number of producers, one consumer.
+ *
+ * Producers never block, a message which doesn't fit is dropped and counted.
+ * A message longer than LOG_PAYLOAD_SIZE takes several consecutive records,
+ * at most the whole queue, anything beyond that is clipped.
+ * The capacity is rounded up to a power of two and allocated once.
+ */
+class LogQueue {
+public:
+    LogQueue(size_t capacity)
+        : _mask(roundUp(capacity) - 1)
+        , _slots(new Slot[_mask + 1])
+        , _enqueue(0)
+        , _dequeue(0)
+        , _dropped(0) {
+        for (uint32_t i = 0; i <= _mask; ++i)
+            _slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    bool push(uint64_t timestamp, int verbosity, uint8_t tag, const char* message, size_t length) {
+        uint32_t parts = length == 0 ? 1 : (length + LOG_PAYLOAD_SIZE - 1) / LOG_PAYLOAD_SIZE;
+        if (parts > _mask + 1) {
+            parts = _mask + 1;
+            length = parts * LOG_PAYLOAD_SIZE;
+        }
+
+        // The slots are freed in order, so when the last one is free, all of them are
+        uint32_t pos = _enqueue.load(std::memory_order_relaxed);
+        for (;;) {
+            const uint32_t last = pos + parts - 1;
+            const uint32_t seq = _slots[last & _mask].seq.load(std::memory_order_acquire);
+            const int32_t diff = int32_t(seq - last);
+            if (diff == 0) {
+                if (_enqueue.compare_exchange_weak(pos, pos + parts, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                pos = _enqueue.load(std::memory_order_relaxed);
+            }
+        }
+
+        for (uint32_t i = 0; i != parts; ++i) {
+            auto& slot = _slots[(pos + i) & _mask];
+            auto& rec = slot.record;
+            const size_t chunk = length < LOG_PAYLOAD_SIZE ? length : LOG_PAYLOAD_SIZE;
+            rec.timestamp = timestamp;
+            rec.verbosity = static_cast<int8_t>(verbosity);
+            rec.tag = tag;
+            rec.length = static_cast<uint8_t>(chunk);
+            rec.more = i + 1 != parts;
+            memcpy(rec.payload, message, chunk);
+            message += chunk;
+            length -= chunk;
+            slot.seq.store(pos + i + 1, std::memory_order_release);
+        }
+        return true;
+    }
+
+    // Only one task may pop. A record with `more` set is followed by the rest of the message,
+    // which may not be published yet.
+    bool pop(LogRecord& out) {
+        auto& slot = _slots[_dequeue & _mask];
+        if (slot.seq.load(std::memory_order_acquire) != _dequeue + 1)
+            return false;
+        out = slot.record;
+        slot.seq.store(_dequeue + _mask + 1, std::memory_order_release);
+        ++_dequeue;
+        return true;
+    }
+
+    uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+    size_t capacity() const { return _mask + 1; }
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> seq; // == position when free, position + 1 when filled
+        LogRecord record;
+    };
+
+    static uint32_t roundUp(size_t capacity) {
+        uint32_t res = 2;
+        while (res < capacity)
+            res <<= 1;
+        return res;
+    }
+
+    const uint32_t _mask;
+    std::unique_ptr<Slot[]> _slots;
+    std::atomic<uint32_t> _enqueue;
+    uint32_t _dequeue;
+    std::atomic<uint32_t> _dropped;
+};
+
+/**
+ * Maps log tags to small ids, so that the records carry a byte instead of a string
+ * and the sinks can cache the tag's rendering.
+ *
+ * Looking up a known tag takes no lock, only adding a new one does. The names
+ * are never moved, name() references stay valid.
+ */
+template <class String>
+class TagRegistry {
+public:
+    static constexpr const uint8_t MAX_TAGS = 64;
+    static constexpr const uint8_t OVERFLOW_ID = 255; // Every tag after the table is full
+
+    TagRegistry()
+        : _count(0) {}
+
+    // Shared by all loggers and sinks, so that a tag has the same id everywhere
+    static TagRegistry& global() {
+        static TagRegistry registry;
+        return registry;
+    }
+
+    uint8_t intern(const char* tag, size_t length) {
+        const uint8_t found = find(tag, length, _count.load(std::memory_order_acquire));
+        if (found != OVERFLOW_ID)
+            return found;
+
+        std::lock_guard<std::mutex> _(_mutex);
+        const uint8_t count = _count.load(std::memory_order_relaxed);
+        const uint8_t again = find(tag, length, count);
+        if (again != OVERFLOW_ID || count == MAX_TAGS)
+            return again;
+        _tags[count] = String(tag, length);
+        _count.store(count + 1, std::memory_order_release);
+        return count;
+    }
+
+    uint8_t intern(const String& tag) {
+        return intern(tag.data(), tag.size());
+    }
+
+    const String& name(uint8_t id) const {
+        static const String unknown("?");
+        return id < _count.load(std::memory_order_acquire) ? _tags[id] : unknown;
+    }
+
+private:
+    uint8_t find(const char* tag, size_t length, uint8_t count) const {
+        for (uint8_t i = 0; i != count; ++i) {
+            if (_tags[i].size() == length && memcmp(_tags[i].data(), tag, length) == 0)
+                return i;
+        }
+        return OVERFLOW_ID;
+    }
+
+    String _tags[MAX_TAGS];
+    std::atomic<uint8_t> _count;
+    std::mutex _mutex;
+};
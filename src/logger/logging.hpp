@@ -1,5 +1,7 @@
 #pragma once
 #include "format.hpp"
+#include "log_queue.hpp"
+#include <atomic>
 #include <iostream>
 #include <memory>
 #include <mutex>
@@ -22,59 +24,209 @@ enum Verbosity {
 template <class String>
 class BaseLogSink {
 public:
+    virtual ~BaseLogSink() {}
+
     virtual void log(Verbosity verb, const String& tag, const String& message, uint64_t timestamp) = 0;
+
+    // The logger calls this one. tagId is the tag's id in TagRegistry<String>::global(), the same
+    // tag always has the same id, so a sink can cache what it renders from it. Tags which
+    // didn't fit into the registry come with TagRegistry<String>::OVERFLOW_ID.
+    virtual void logTagged(Verbosity verb, uint8_t tagId, const String& tag, const String& message,
+        uint64_t timestamp) {
+        log(verb, tag, message, timestamp);
+    }
+};
+
+// A log tag passed around without copying it, usually a string literal
+class LogTag {
+public:
+    LogTag(const char* tag)
+        : _data(tag)
+        , _size(strlen(tag)) {}
+    LogTag(const std::string& tag)
+        : _data(tag.data())
+        , _size(tag.size()) {}
+    LogTag(const char* tag, size_t size)
+        : _data(tag)
+        , _size(size) {}
+
+    const char* data() const { return _data; }
+    size_t size() const { return _size; }
+
+private:
+    const char* _data;
+    size_t _size;
 };
 
 template <class String, class Mutex, class Clock>
 class BaseLogger {
 public:
+    BaseLogger()
+        : _maxThreshold(NOTHING)
+        , _queue(nullptr)
+        , _reportedDropped(0) {}
+
+    ~BaseLogger() {
+        delete _queue.load();
+    }
+
     void addSink(Verbosity threshold, std::unique_ptr<BaseLogSink<String>>&& sink) {
+        std::lock_guard<Mutex> _(_mutex);
         _sinks.emplace_back(threshold, std::move(sink));
+        if (threshold > _maxThreshold.load())
+            _maxThreshold.store(threshold);
+    }
+
+    // Whether any sink takes messages of this verbosity. Check it before doing
+    // expensive work only to log the result.
+    bool enabled(int verbosity) const {
+        return verbosity <= _maxThreshold.load(std::memory_order_relaxed);
     }
 
     template <typename... Args>
-    FormatString log(int verbosity, String tag, String message, Args... args) {
-        auto logAction = [this, verbosity, tag](const FormatString& fmt) {
-            String message = fmt;
-            uint64_t timestamp = _clock.get();
-            std::lock_guard<Mutex> _(_mutex);
-            for (auto& item : _sinks) {
-                if (item.first < verbosity)
-                    continue;
-                item.second->log(static_cast<Verbosity>(verbosity), tag,
-                    message, timestamp);
-            }
+    FormatString log(int verbosity, LogTag tag, const String& message, Args... args) {
+        if (!enabled(verbosity))
+            return FormatString::discarded();
+        const uint8_t tagId = tags().intern(tag.data(), tag.size());
+        if (tagId == TagRegistry<String>::OVERFLOW_ID) {
+            const String tagCopy(tag.data(), tag.size());
+            auto logAction = [this, verbosity, tagCopy](const FormatString& fmt) {
+                const String message = fmt;
+                if (!enqueue(verbosity, TagRegistry<String>::OVERFLOW_ID, message.data(), message.size()))
+                    deliver(verbosity, TagRegistry<String>::OVERFLOW_ID, tagCopy, message, _clock.get());
+            };
+            return std::move(FormatString(message, logAction).fillWith(args...));
+        }
+        // Small enough for std::function to keep it without an allocation
+        auto logAction = [this, verbosity, tagId](const FormatString& fmt) {
+            const String message = fmt;
+            if (!enqueue(verbosity, tagId, message.data(), message.size()))
+                deliver(verbosity, tagId, tags().name(tagId), message, _clock.get());
         };
         return std::move(FormatString(message, logAction).fillWith(args...));
     }
 
+    // Formats the message on the stack, see RB_FMT
+    template <typename Str, typename... Args>
+    void log(int verbosity, LogTag tag, CompiledFormat<Str> fmt, Args... args) {
+        if (!enabled(verbosity))
+            return;
+        const FormatBuffer<> message(fmt, args...);
+        const uint8_t tagId = tags().intern(tag.data(), tag.size());
+        if (enqueue(verbosity, tagId, message.c_str(), message.size()))
+            return;
+        if (tagId != TagRegistry<String>::OVERFLOW_ID) {
+            deliver(verbosity, tagId, tags().name(tagId), message, _clock.get());
+        } else {
+            deliver(verbosity, tagId, String(tag.data(), tag.size()), message, _clock.get());
+        }
+    }
+
+    /**
+     * Switch to the asynchronous mode: log() only puts the formatted message into a queue,
+     * the sinks are called from processQueue(). A full queue drops the message, log()
+     * never waits for the sinks. Messages longer than LOG_PAYLOAD_SIZE take several records
+     * of the queue.
+     */
+    void enableAsync(size_t capacity) {
+        std::lock_guard<Mutex> _(_mutex);
+        if (!_queue.load())
+            _queue.store(new LogQueue(capacity));
+    }
+
+    bool async() const { return _queue.load() != nullptr; }
+
+    /**
+     * Pass the queued messages to the sinks, in the asynchronous mode.
+     * Only one task may call it.
+     * \return the number of messages processed
+     */
+    size_t processQueue() {
+        auto* queue = _queue.load();
+        if (!queue)
+            return 0;
+        size_t count = 0;
+        LogRecord rec;
+        while (queue->pop(rec)) {
+            // A long message is kept across calls until its last part is published
+            _partial += String(rec.payload, rec.length);
+            if (rec.more)
+                continue;
+            deliver(rec.verbosity, rec.tag, tags().name(rec.tag), _partial, rec.timestamp);
+            _partial = String();
+            ++count;
+        }
+
+        const uint32_t dropped = queue->dropped();
+        if (dropped != _reportedDropped) {
+            const FormatBuffer<> message(RB_FMT("{} messages dropped, the queue is full"), dropped - _reportedDropped);
+            _reportedDropped = dropped;
+            static const uint8_t tagId = tags().intern("Logger", 6);
+            deliver(WARNING, tagId, tags().name(tagId), String(message.c_str(), message.size()), _clock.get());
+        }
+        return count;
+    }
+
+    // Number of messages dropped because the asynchronous queue was full
+    uint32_t dropped() const {
+        auto* queue = _queue.load();
+        return queue ? queue->dropped() : 0;
+    }
+
     template <typename... Args>
-    FormatString logPanic(String tag, String message, Args... args) {
+    FormatString logPanic(LogTag tag, const String& message, Args... args) {
         return log(PANIC, tag, message, args...);
     }
 
     template <typename... Args>
-    FormatString logError(String tag, String message, Args... args) {
+    FormatString logError(LogTag tag, const String& message, Args... args) {
         return log(ERROR, tag, message, args...);
     }
 
     template <typename... Args>
-    FormatString logWarning(String tag, String message, Args... args) {
+    FormatString logWarning(LogTag tag, const String& message, Args... args) {
         return log(WARNING, tag, message, args...);
     }
 
     template <typename... Args>
-    FormatString logInfo(String tag, String message, Args... args) {
+    FormatString logInfo(LogTag tag, const String& message, Args... args) {
         return log(INFO, tag, message, args...);
     }
     template <typename... Args>
-    FormatString logDebug(String tag, String message, Args... args) {
+    FormatString logDebug(LogTag tag, const String& message, Args... args) {
         return log(DEBUG, tag, message, args...);
     }
 
 private:
+    static TagRegistry<String>& tags() {
+        return TagRegistry<String>::global();
+    }
+
+    // Returns false in the synchronous mode, the caller delivers the message itself
+    bool enqueue(int verbosity, uint8_t tagId, const char* message, size_t length) {
+        auto* queue = _queue.load();
+        if (!queue)
+            return false;
+        queue->push(_clock.get(), verbosity, tagId, message, length);
+        return true;
+    }
+
+    void deliver(int verbosity, uint8_t tagId, const String& tag, const String& message, uint64_t timestamp) {
+        std::lock_guard<Mutex> _(_mutex);
+        for (auto& item : _sinks) {
+            if (item.first < verbosity)
+                continue;
+            item.second->logTagged(static_cast<Verbosity>(verbosity), tagId, tag,
+                message, timestamp);
+        }
+    }
+
     Mutex _mutex;
     Clock _clock;
+    std::atomic<int> _maxThreshold; // The highest threshold of the sinks
+    std::atomic<LogQueue*> _queue; // Set in the asynchronous mode
+    uint32_t _reportedDropped;
+    String _partial; // Parts of a long queued message received so far
     std::vector<std::pair<int, std::unique_ptr<BaseLogSink<String>>>> _sinks;
 };
 
@@ -92,36 +244,76 @@ public:
             << string("Tag").width(TAG_WIDTH).center()
             << string("Message ").width(_width).center();
         _stream << header;
+
+        static const char* const levels[] = { "panic", "error", "warning", "info", "debug" };
+        for (int i = 0; i != LEVEL_COUNT; ++i)
+            _levelColumns[i] = column(string(levels[i]).alignRight().width(LEVEL_WIDTH));
     }
 
     virtual void log(Verbosity verb, const String& tag, const String& message,
         uint64_t timestamp) override {
-        static std::vector<String> levels(
-            { "panic", "error", "warning", "info", "debug" });
+        logTagged(verb, TagRegistry<String>::OVERFLOW_ID, tag, message, timestamp);
+    }
+
+    // Builds the row in a reused buffer, the level and tag columns are padded once
+    virtual void logTagged(Verbosity verb, uint8_t tagId, const String& tag, const String& message,
+        uint64_t timestamp) override {
+        _row.clear();
+        _row += "| ";
+        appendFormatted(number(timestamp).alignRight().width(TIME_WIDTH));
+        _row += " | ";
         if (verb >= PANIC && verb <= DEBUG) {
-            String row = format("| {} | {} | {} | {} |\n")
-                << number(timestamp).alignRight().width(TIME_WIDTH)
-                << string(levels[verb + 3]).alignRight().width(LEVEL_WIDTH)
-                << string(tag).alignRight().width(TAG_WIDTH)
-                << string(message).alignLeft().width(_width).clip();
-            _stream << row;
+            _row += _levelColumns[verb - PANIC];
+        } else {
+            appendFormatted(number(static_cast<int>(verb)).width(LEVEL_WIDTH));
+        }
+        _row += " | ";
+        if (tagId < TagRegistry<String>::MAX_TAGS) {
+            if (_tagColumns.size() <= tagId)
+                _tagColumns.resize(tagId + 1);
+            if (_tagColumns[tagId].empty())
+                _tagColumns[tagId] = column(string(tag).alignRight().width(TAG_WIDTH));
+            _row += _tagColumns[tagId];
         } else {
-            String row = format("| {} | {} | {} | {} |\n")
-                << number(timestamp).alignRight().width(TIME_WIDTH)
-                << number(static_cast<int>(verb)).width(LEVEL_WIDTH)
-                << string(tag).alignRight().width(TAG_WIDTH)
-                << string(message).alignLeft().width(_width).clip();
-            _stream << row;
+            _row += column(string(tag).alignRight().width(TAG_WIDTH));
         }
+        _row += " | ";
+        if (message.size() >= static_cast<size_t>(_width)) {
+            _row.append(message.data(), _width);
+        } else {
+            _row += message;
+            _row.append(_width - message.size(), ' ');
+        }
+        _row += " |\n";
+        _stream.write(_row.data(), _row.size());
     }
 
 private:
-    std::ostream& _stream;
-    int _width;
+    template <typename Formatter>
+    static String column(const Formatter& formatter) {
+        String res;
+        formatter.format(std::back_inserter(res));
+        return res;
+    }
+
+    template <typename Formatter>
+    void appendFormatted(const Formatter& formatter) {
+        char buffer[32];
+        char* pos = buffer;
+        formatter.format(compiled_format::BufferIterator(&pos, buffer + sizeof(buffer)));
+        _row.append(buffer, pos - buffer);
+    }
 
     static constexpr const int TIME_WIDTH = 10;
     static constexpr const int LEVEL_WIDTH = 7;
     static constexpr const int TAG_WIDTH = 10;
+    static constexpr const int LEVEL_COUNT = DEBUG - PANIC + 1;
+
+    std::ostream& _stream;
+    int _width;
+    String _row;
+    String _levelColumns[LEVEL_COUNT];
+    std::vector<String> _tagColumns; // By the tag's id, empty until the tag is first logged
 };
 
 struct DummyClock {
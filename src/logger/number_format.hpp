@@ -0,0 +1,284 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/// @privatesection
+namespace number_format {
+
+// Output longer than this is clipped by the snprintf-based formatters, leave it to them
+static const int MAX_LENGTH = 63;
+
+// The printf modifiers, conversion is the final character: d u x X o f F
+struct Spec {
+    bool alignLeft;
+    bool forceSign;
+    bool spaceForSign;
+    bool showPrefix;
+    bool leadingZeroes;
+    int width;
+    int precision;
+    char conversion;
+};
+
+constexpr char lastChar(const char* s) {
+    return s[1] == '\0' ? s[0] : lastChar(s + 1);
+}
+
+static const char DIGIT_PAIRS[] = "00010203040506070809"
+                                  "10111213141516171819"
+                                  "20212223242526272829"
+                                  "30313233343536373839"
+                                  "40414243444546474849"
+                                  "50515253545556575859"
+                                  "60616263646566676869"
+                                  "70717273747576777879"
+                                  "80818283848586878889"
+                                  "90919293949596979899";
+
+// Writes the digits backwards from end, returns the first one
+template <typename U>
+char* decimalDigits(char* end, U value) {
+    while (value >= 100) {
+        const unsigned pair = static_cast<unsigned>(value % 100) * 2;
+        value /= 100;
+        *(--end) = DIGIT_PAIRS[pair + 1];
+        *(--end) = DIGIT_PAIRS[pair];
+    }
+    if (value >= 10) {
+        const unsigned pair = static_cast<unsigned>(value) * 2;
+        *(--end) = DIGIT_PAIRS[pair + 1];
+        *(--end) = DIGIT_PAIRS[pair];
+    } else {
+        *(--end) = '0' + static_cast<char>(value);
+    }
+    return end;
+}
+
+template <typename U>
+char* digits(char* end, U value, char conversion) {
+    switch (conversion) {
+    case 'x':
+    case 'X': {
+        const char* hex = conversion == 'x' ? "0123456789abcdef" : "0123456789ABCDEF";
+        do {
+            *(--end) = hex[value & 0xF];
+            value >>= 4;
+        } while (value != 0);
+        return end;
+    }
+    case 'o':
+        do {
+            *(--end) = '0' + static_cast<char>(value & 7);
+            value >>= 3;
+        } while (value != 0);
+        return end;
+    default:
+        return decimalDigits(end, value);
+    }
+}
+
+// Lays out sign, prefix, zeroes and the digits into out like printf does, -1 when it's too long
+inline int pad(char* out, const Spec& spec, char sign, const char* prefix, int prefixLength,
+    int zeroes, const char* body, int bodyLength) {
+    const int content = (sign ? 1 : 0) + prefixLength + zeroes + bodyLength;
+    int fill = spec.width > content ? spec.width - content : 0;
+    if (content + fill > MAX_LENGTH)
+        return -1;
+
+    char* pos = out;
+    if (fill != 0 && !spec.alignLeft && !spec.leadingZeroes) {
+        memset(pos, ' ', fill);
+        pos += fill;
+        fill = 0;
+    }
+    if (sign)
+        *(pos++) = sign;
+    memcpy(pos, prefix, prefixLength);
+    pos += prefixLength;
+    if (!spec.alignLeft) {
+        zeroes += fill; // Only leadingZeroes may be left at this point
+        fill = 0;
+    }
+    memset(pos, '0', zeroes);
+    pos += zeroes;
+    memcpy(pos, body, bodyLength);
+    pos += bodyLength;
+    memset(pos, ' ', fill);
+    pos += fill;
+    return pos - out;
+}
+
+/**
+ * Format an integer like snprintf would, into out of at least MAX_LENGTH + 1 characters.
+ *
+ * promotedBits is the width of the value as printf receives it, it matters for negative
+ * values in hex and octal. Returns the length, or -1 when the spec needs snprintf.
+ */
+template <typename T>
+int formatInteger(char* out, T value, const Spec& spec, int promotedBits) {
+    typedef typename std::conditional<sizeof(T) <= 4, uint32_t, uint64_t>::type U;
+    const bool isSigned = spec.conversion == 'd';
+    if (!isSigned && spec.conversion != 'u' && spec.conversion != 'x' && spec.conversion != 'X'
+        && spec.conversion != 'o')
+        return -1;
+
+    U magnitude = static_cast<U>(value);
+    char sign = '\0';
+    if (isSigned) {
+        if (value < 0) {
+            magnitude = U(0) - magnitude;
+            sign = '-';
+        } else if (spec.forceSign) {
+            sign = '+';
+        } else if (spec.spaceForSign) {
+            sign = ' ';
+        }
+    } else if (promotedBits < static_cast<int>(sizeof(U) * 8)) {
+        magnitude &= (U(1) << promotedBits) - 1;
+    }
+
+    char buffer[32];
+    char* end = buffer + sizeof(buffer);
+    char* first = end;
+    if (magnitude != 0 || spec.precision != 0)
+        first = digits(end, magnitude, spec.conversion);
+    int length = end - first;
+
+    int zeroes = spec.precision > length ? spec.precision - length : 0;
+    if (spec.conversion == 'o' && spec.showPrefix && zeroes == 0 && (length == 0 || *first != '0'))
+        zeroes = 1;
+
+    const char* prefix = "";
+    int prefixLength = 0;
+    if (spec.showPrefix && magnitude != 0 && (spec.conversion == 'x' || spec.conversion == 'X')) {
+        prefix = spec.conversion == 'x' ? "0x" : "0X";
+        prefixLength = 2;
+    }
+
+    Spec layout = spec;
+    layout.leadingZeroes = spec.leadingZeroes && !spec.alignLeft && spec.precision < 0;
+    return pad(out, layout, sign, prefix, prefixLength, zeroes, first, length);
+}
+
+static const uint32_t POWERS_OF_TEN[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000,
+    100000000, 1000000000 };
+
+/**
+ * Format a double in the fixed notation like snprintf would, rounding the exact binary
+ * value half to even. Returns the length, or -1 when the spec or the value needs snprintf:
+ * other notations, precision over 9, values of 2^64 and more, infinity and NaN.
+ */
+inline int formatFixed(char* out, double value, const Spec& spec) {
+    const int precision = spec.precision < 0 ? 6 : spec.precision;
+    if ((spec.conversion != 'f' && spec.conversion != 'F') || precision > 9 || !std::isfinite(value))
+        return -1;
+
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const bool negative = bits >> 63;
+    const int exponentBits = static_cast<int>((bits >> 52) & 0x7FF);
+    uint64_t mantissa = bits & ((uint64_t(1) << 52) - 1);
+    int exponent = -1074;
+    if (exponentBits != 0) {
+        mantissa |= uint64_t(1) << 52;
+        exponent = exponentBits - 1075;
+    }
+
+    // value * 10^precision = mantissa * scale * 2^exponent, rounded to an integer
+    const uint32_t scale = POWERS_OF_TEN[precision];
+    uint64_t integer; // Of the digits before the point
+    uint64_t fraction = 0;
+    if (mantissa == 0) {
+        integer = 0;
+    } else if (exponent >= 0) {
+        if (exponent > 10)
+            return -1;
+        integer = mantissa << exponent;
+    } else {
+        // The product is at most 83 bits, kept in hi:lo
+        const uint64_t low = (mantissa & 0xFFFFFFFF) * scale;
+        const uint64_t high = (mantissa >> 32) * scale;
+        uint64_t lo = low + (high << 32);
+        uint64_t hi = (high >> 32) + (lo < low ? 1 : 0);
+
+        const int shift = -exponent;
+        uint64_t scaled;
+        if (shift >= 84) {
+            scaled = 0; // Below one half, rounds to zero
+        } else {
+            // quotient = hi:lo >> shift, remainder compared with half of 2^shift
+            uint64_t remHi, remLo, halfHi, halfLo;
+            if (shift >= 64) {
+                scaled = shift == 64 ? hi : hi >> (shift - 64);
+                remHi = shift == 64 ? 0 : hi & ((uint64_t(1) << (shift - 64)) - 1);
+                remLo = lo;
+                halfHi = shift == 64 ? 0 : uint64_t(1) << (shift - 65);
+                halfLo = shift == 64 ? uint64_t(1) << 63 : 0;
+            } else {
+                if ((hi >> shift) != 0)
+                    return -1;
+                scaled = (lo >> shift) | (hi << (64 - shift));
+                remHi = 0;
+                remLo = lo & ((uint64_t(1) << shift) - 1);
+                halfHi = 0;
+                halfLo = uint64_t(1) << (shift - 1);
+            }
+            const bool above = remHi > halfHi || (remHi == halfHi && remLo > halfLo);
+            const bool tie = remHi == halfHi && remLo == halfLo;
+            if (above || (tie && (scaled & 1)))
+                ++scaled;
+        }
+        integer = scaled / scale;
+        fraction = scaled % scale;
+    }
+
+    char buffer[32];
+    char* end = buffer + sizeof(buffer);
+    char* first = end;
+    if (precision != 0) {
+        first = decimalDigits(end, fraction);
+        while (end - first < precision)
+            *(--first) = '0';
+    }
+    if (precision != 0 || spec.showPrefix)
+        *(--first) = '.';
+    first = decimalDigits(first, integer);
+
+    char sign = '\0';
+    if (negative) {
+        sign = '-';
+    } else if (spec.forceSign) {
+        sign = '+';
+    } else if (spec.spaceForSign) {
+        sign = ' ';
+    }
+    Spec layout = spec;
+    layout.leadingZeroes = spec.leadingZeroes && !spec.alignLeft;
+    return pad(out, layout, sign, "", 0, 0, first, end - first);
+}
+
+// The fast paths for the types formatters.hpp handles, -1 leaves the rest to snprintf
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value && (sizeof(T) > 1), int>::type
+format(char* out, T value, const Spec& spec, int promotedBits) {
+    return formatInteger(out, value, spec, promotedBits);
+}
+
+template <typename T>
+typename std::enable_if<std::is_same<T, float>::value || std::is_same<T, double>::value, int>::type
+format(char* out, T value, const Spec& spec, int) {
+    return formatFixed(out, value, spec);
+}
+
+// Characters (%c), long double and pointers
+template <typename T>
+typename std::enable_if<!(std::is_integral<T>::value && (sizeof(T) > 1))
+        && !std::is_same<T, float>::value && !std::is_same<T, double>::value,
+    int>::type
+format(char*, T, const Spec&, int) {
+    return -1;
+}
+
+} // namespace number_format